@@ -5,6 +5,12 @@
 #include <GL/glx.h>
 
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #define WINDOW_WIDTH    640
 #define WINDOW_HEIGHT   480
@@ -16,6 +22,179 @@ extern void Shutdown();
 
 typedef GLXContext (*glXCreateContextAttribsARBProc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
 
+// Frame pacing: 0 = sync to vblank, otherwise a fixed rate in frames per second
+#define FRAME_RATE          0
+#define FRAME_STATS_PERIOD  5.0
+
+typedef void (*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+typedef int  (*glXSwapIntervalMESAProc)(unsigned int);
+typedef int  (*glXGetVideoSyncSGIProc)(unsigned int*);
+typedef int  (*glXWaitVideoSyncSGIProc)(int, int, unsigned int*);
+
+enum { PACE_FIXED, PACE_SWAP_CONTROL, PACE_VIDEO_SYNC };
+
+typedef struct {
+    int       mode;
+    long long interval;
+    long long deadline;
+    glXGetVideoSyncSGIProc  getVideoSync;
+    glXWaitVideoSyncSGIProc waitVideoSync;
+
+    // statistics for the current reporting period
+    long long periodStart;
+    long long cpuStart;
+    long long lastFrame;
+    double    lastDelta;
+    double    sumDelta;
+    double    sumJitter;
+    double    maxDelta;
+    int       frames;
+} FramePacer;
+
+static long long NowNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool HasGLXExtension(Display* display, int screenId, const char* name)
+{
+    const char* extensions = glXQueryExtensionsString(display, screenId);
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static void FramePacerInit(FramePacer* pacer, Display* display, int screenId, GLXDrawable drawable, int rate)
+{
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->mode = PACE_FIXED;
+    pacer->interval = 1000000000LL / (rate > 0 ? rate : 60);
+
+    if (rate <= 0) {
+        if (HasGLXExtension(display, screenId, "GLX_EXT_swap_control")) {
+            glXSwapIntervalEXTProc glXSwapIntervalEXT = (glXSwapIntervalEXTProc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+            if (glXSwapIntervalEXT) {
+                glXSwapIntervalEXT(display, drawable, 1);
+                pacer->mode = PACE_SWAP_CONTROL;
+            }
+        }
+        if (pacer->mode == PACE_FIXED && HasGLXExtension(display, screenId, "GLX_MESA_swap_control")) {
+            glXSwapIntervalMESAProc glXSwapIntervalMESA = (glXSwapIntervalMESAProc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+            if (glXSwapIntervalMESA && glXSwapIntervalMESA(1) == 0) {
+                pacer->mode = PACE_SWAP_CONTROL;
+            }
+        }
+        if (pacer->mode == PACE_FIXED && HasGLXExtension(display, screenId, "GLX_SGI_video_sync")) {
+            pacer->getVideoSync = (glXGetVideoSyncSGIProc)glXGetProcAddressARB((const GLubyte *)"glXGetVideoSyncSGI");
+            pacer->waitVideoSync = (glXWaitVideoSyncSGIProc)glXGetProcAddressARB((const GLubyte *)"glXWaitVideoSyncSGI");
+            if (pacer->getVideoSync && pacer->waitVideoSync) {
+                pacer->mode = PACE_VIDEO_SYNC;
+            }
+        }
+    }
+
+    pacer->deadline = pacer->periodStart = pacer->lastFrame = NowNs(CLOCK_MONOTONIC);
+    pacer->cpuStart = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+
+    if (pacer->mode == PACE_SWAP_CONTROL) {
+        printf("Frame pacing: vsync (swap control)\n");
+    } else if (pacer->mode == PACE_VIDEO_SYNC) {
+        printf("Frame pacing: vsync (SGI video sync)\n");
+    } else {
+        printf("Frame pacing: fixed %.2f fps\n", 1e9 / pacer->interval);
+    }
+}
+
+// Sleeps on the X connection until the next frame is due. Returns false when
+// woken early by X events, so the caller can dispatch them and wait again.
+static bool FramePacerWait(FramePacer* pacer, Display* display)
+{
+    if (pacer->mode == PACE_SWAP_CONTROL) {
+        // glXSwapBuffers throttles to the display refresh
+        return true;
+    }
+    if (pacer->mode == PACE_VIDEO_SYNC) {
+        // A divisor of 1 returns at once (every count is a multiple of 1);
+        // wait for the counter to change parity instead
+        unsigned int count;
+        pacer->getVideoSync(&count);
+        pacer->waitVideoSync(2, (count + 1) % 2, &count);
+        return true;
+    }
+
+    long long remaining = pacer->deadline - NowNs(CLOCK_MONOTONIC);
+    if (remaining >= 1000000) {
+        struct pollfd pfd;
+        pfd.fd = ConnectionNumber(display);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)(remaining / 1000000)) > 0) {
+            return false;
+        }
+    }
+
+    // poll() only has millisecond resolution, finish the last fraction on the clock
+    struct timespec ts;
+    ts.tv_sec = (time_t)(pacer->deadline / 1000000000LL);
+    ts.tv_nsec = (long)(pacer->deadline % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+    return true;
+}
+
+// Call once per presented frame.
+static void FramePacerTick(FramePacer* pacer)
+{
+    long long now = NowNs(CLOCK_MONOTONIC);
+    double delta = (now - pacer->lastFrame) / 1e6;
+    double jitter = delta - pacer->lastDelta;
+
+    if (pacer->frames > 0) {
+        pacer->sumJitter += jitter < 0.0 ? -jitter : jitter;
+    }
+    pacer->sumDelta += delta;
+    if (delta > pacer->maxDelta) {
+        pacer->maxDelta = delta;
+    }
+    pacer->lastDelta = delta;
+    pacer->lastFrame = now;
+    pacer->frames++;
+
+    // Advance on an absolute schedule so sleep overshoot never accumulates into
+    // drift; after a stall longer than a frame, resync instead of bursting.
+    pacer->deadline += pacer->interval;
+    if (now - pacer->deadline > pacer->interval) {
+        pacer->deadline = now + pacer->interval;
+    }
+
+    double elapsed = (now - pacer->periodStart) / 1e9;
+    if (elapsed >= FRAME_STATS_PERIOD) {
+        long long cpu = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+        printf("%.1f fps, frame %.2f ms (max %.2f ms), jitter %.3f ms, cpu %.1f%%\n",
+            pacer->frames / elapsed,
+            pacer->sumDelta / pacer->frames,
+            pacer->maxDelta,
+            pacer->frames > 1 ? pacer->sumJitter / (pacer->frames - 1) : 0.0,
+            100.0 * (cpu - pacer->cpuStart) / (now - pacer->periodStart));
+        fflush(stdout);
+
+        pacer->periodStart = now;
+        pacer->cpuStart = cpu;
+        pacer->sumDelta = 0.0;
+        pacer->sumJitter = 0.0;
+        pacer->maxDelta = 0.0;
+        pacer->frames = 0;
+    }
+}
+
 int main(int argc, char** argv) {
     Display* display;
     Window window;
@@ -109,8 +288,12 @@ int main(int argc, char** argv) {
     XClearWindow(display, window);
     XMapRaised(display, window);
 
-    while (true) {
-        if (XPending(display) > 0) {
+    FramePacer pacer;
+    FramePacerInit(&pacer, display, screenId, window, argc > 1 ? atoi(argv[1]) : FRAME_RATE);
+
+    bool running = true;
+    while (running) {
+        while (XPending(display) > 0) {
             XNextEvent(display, &ev);
             if (ev.type == Expose) {
                 XWindowAttributes attribs;
@@ -118,19 +301,23 @@ int main(int argc, char** argv) {
             }
             if (ev.type == ClientMessage) {
                 if (ev.xclient.data.l[0] == atomWmDeleteWindow) {
-                    break;
+                    running = false;
                 }
             }
             else if (ev.type == DestroyNotify) { 
-                break;
+                running = false;
             }
         }
 
+        if (!running || !FramePacerWait(&pacer, display)) {
+            continue;
+        }
+
         Render();
 
         glXSwapBuffers(display, window);
 
-        usleep((unsigned int)(1/60));
+        FramePacerTick(&pacer);
     }
 
     glXDestroyContext(display, context);
@@ -1 +1 @@
-clang++ -o hello  hello.cpp -lX11 -lGL
+clang++ -o hello  hello.cpp -lX11 -lGL -lpthread
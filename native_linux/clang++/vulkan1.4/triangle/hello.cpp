@@ -9,13 +9,169 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdint>
+#include <cmath>
 #include <optional>
 #include <set>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <map>
+#include <array>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+const int MAX_FRAMES_IN_FLIGHT = 4;
+
+const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+const double STATS_PERIOD = 5.0;
+
+const VkDeviceSize DEVICE_ARENA_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize STAGING_RING_SIZE = 8 * 1024 * 1024;
+
+// Bottom level builds are batched so their scratch memory stays below this
+const VkDeviceSize SCRATCH_BUDGET = 32 * 1024 * 1024;
+
+// Acceleration structures must start at multiples of 256 bytes in their buffer
+const VkDeviceSize ACCELERATION_STRUCTURE_ALIGNMENT = 256;
+
+// Shadow modes: the triangles float this high above the ground plane
+const float SHADOW_CASTER_HEIGHT = 0.15f;
+
+enum ShadowMode {
+    SHADOWS_NONE,
+    SHADOWS_PLANAR,
+    SHADOWS_RAY_QUERY
+};
+
+struct AppOptions {
+    uint32_t drawCount = 1;
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    bool legacyPath = false;
+    uint32_t framesInFlight = 2;
+    std::optional<VkPresentModeKHR> presentMode;
+    bool pipelineStatistics = false;
+    std::string profileFile;
+    std::string shaderDir;
+    uint32_t instanceCount = 0;
+    bool cpuInstanceUpdate = false;
+    bool gpuCulling = false;
+    ShadowMode shadows = SHADOWS_NONE;
+};
+
+AppOptions options;
+
+void parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--draws" && i + 1 < argc) {
+            options.drawCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            options.threadCount = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--legacy") {
+            options.legacyPath = true;
+        }
+        else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            options.framesInFlight = std::min(std::max(1, atoi(argv[++i])), MAX_FRAMES_IN_FLIGHT);
+        }
+        else if (arg == "--present-mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "immediate") {
+                options.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            else if (mode == "mailbox") {
+                options.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            else if (mode == "fifo") {
+                options.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            }
+            else if (mode == "fifo_relaxed") {
+                options.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
+            else {
+                throw std::runtime_error("unknown present mode: " + mode);
+            }
+        }
+        else if (arg == "--pipeline-stats") {
+            options.pipelineStatistics = true;
+        }
+        else if (arg == "--gpu-profile" && i + 1 < argc) {
+            options.profileFile = argv[++i];
+        }
+        else if (arg == "--shader-dir" && i + 1 < argc) {
+            options.shaderDir = argv[++i];
+        }
+        else if (arg == "--instances" && i + 1 < argc) {
+            options.instanceCount = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--instance-update" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "cpu") {
+                options.cpuInstanceUpdate = true;
+            }
+            else if (mode == "compute") {
+                options.cpuInstanceUpdate = false;
+            }
+            else {
+                throw std::runtime_error("unknown instance update mode: " + mode);
+            }
+        }
+        else if (arg == "--gpu-cull") {
+            options.gpuCulling = true;
+        }
+        else if (arg == "--shadows" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "none") {
+                options.shadows = SHADOWS_NONE;
+            }
+            else if (mode == "planar") {
+                options.shadows = SHADOWS_PLANAR;
+            }
+            else if (mode == "ray-query") {
+                options.shadows = SHADOWS_RAY_QUERY;
+            }
+            else {
+                throw std::runtime_error("unknown shadow mode: " + mode);
+            }
+        }
+        else {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    // Stress mode is one instanced draw
+    if (options.instanceCount > 0) {
+        options.drawCount = 1;
+    }
+    if (options.gpuCulling && (options.instanceCount == 0 || options.cpuInstanceUpdate)) {
+        throw std::runtime_error("--gpu-cull needs --instances with compute instance update");
+    }
+    if (options.shadows != SHADOWS_NONE) {
+        if (options.instanceCount > 0) {
+            throw std::runtime_error("--shadows works with --draws, not --instances");
+        }
+        // Every shadow has to be drawn before every triangle, which secondary
+        // command buffers recorded side by side cannot guarantee
+        options.threadCount = 0;
+    }
+}
 
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
@@ -48,231 +204,1283 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
     }
 }
 
-struct QueueFamilyIndices {
-    std::optional<uint32_t> graphicsFamily;
-    std::optional<uint32_t> presentFamily;
-
-    bool isComplete() {
-        return graphicsFamily.has_value() && presentFamily.has_value();
-    }
-};
+#ifdef EMBED_SHADERS
+// Generated by glslangValidator --vn, see build.sh
+#include "hello_vert.h"
+#include "hello_frag.h"
+#include "instance_comp.h"
+#include "cull_comp.h"
+#include "shadow_vert.h"
+#include "ground_vert.h"
+#include "ground_frag.h"
+#define EMBEDDED_SHADER(name) name, sizeof(name)
+#else
+#define EMBEDDED_SHADER(name) nullptr, 0
+#endif
 
-struct SwapChainSupportDetails {
-    VkSurfaceCapabilitiesKHR capabilities;
-    std::vector<VkSurfaceFormatKHR> formats;
-    std::vector<VkPresentModeKHR> presentModes;
-};
+const uint32_t SPIRV_MAGIC = 0x07230203;
 
-class HelloTriangleApplication {
+// SPIR-V code, either compiled into the executable or mapped read-only from a
+// file; the driver reads the words in place, so nothing is copied.
+class ShaderBinary {
 public:
-    void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
-        cleanup();
+    ShaderBinary(const uint32_t* code, size_t size) : words(code), byteSize(size) {
+        validate("embedded shader");
     }
 
-private:
-    GLFWwindow* window;
+    explicit ShaderBinary(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open file: " + path);
+        }
 
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("failed to read file: " + path);
+        }
 
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VkDevice device;
+        // The mapping stays valid after the descriptor is closed
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("failed to map file: " + path);
+        }
 
-    VkQueue graphicsQueue;
-    VkQueue presentQueue;
+        mapping = data;
+        words = static_cast<const uint32_t*>(data);
+        byteSize = (size_t)st.st_size;
+        validate(path);
+    }
 
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
-    VkFormat swapChainImageFormat;
-    VkExtent2D swapChainExtent;
-    std::vector<VkImageView> swapChainImageViews;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+    ShaderBinary(ShaderBinary&& other) noexcept : words(other.words), byteSize(other.byteSize), mapping(other.mapping) {
+        other.mapping = nullptr;
+    }
 
-    VkRenderPass renderPass;
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    ShaderBinary(const ShaderBinary&) = delete;
+    ShaderBinary& operator=(const ShaderBinary&) = delete;
 
-    VkCommandPool commandPool;
-    std::vector<VkCommandBuffer> commandBuffers;
+    ~ShaderBinary() {
+        if (mapping) {
+            munmap(mapping, byteSize);
+        }
+    }
 
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> imagesInFlight;
-    size_t currentFrame = 0;
+    const uint32_t* code() const {
+        return words;
+    }
 
-    bool framebufferResized = false;
+    size_t size() const {
+        return byteSize;
+    }
 
-    void initWindow() {
-        glfwInit();
+private:
+    const uint32_t* words = nullptr;
+    size_t byteSize = 0;
+    void* mapping = nullptr;
+
+    // vkCreateShaderModule requires pCode to be 4-byte aligned and codeSize a
+    // multiple of 4; reject anything that is not SPIR-V before the driver sees it.
+    void validate(const std::string& name) {
+        if (reinterpret_cast<uintptr_t>(words) % alignof(uint32_t) != 0 || byteSize % sizeof(uint32_t) != 0) {
+            release();
+            throw std::runtime_error(name + " is not 4-byte aligned SPIR-V!");
+        }
+        // The SPIR-V header is 5 words
+        if (byteSize < 5 * sizeof(uint32_t) || words[0] != SPIRV_MAGIC) {
+            release();
+            throw std::runtime_error(name + " is not a SPIR-V module!");
+        }
+    }
 
-        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    void release() {
+        if (mapping) {
+            munmap(mapping, byteSize);
+            mapping = nullptr;
+        }
+    }
+};
 
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Hello, Vulkan Triangle!", nullptr, nullptr);
-        glfwSetWindowUserPointer(window, this);
-        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+// Shader files are looked up next to the executable rather than in the
+// working directory, unless --shader-dir says otherwise.
+std::string shaderDirectory() {
+    if (!options.shaderDir.empty()) {
+        return options.shaderDir;
     }
 
-    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
-        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
-        app->framebufferResized = true;
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return ".";
     }
+    path[length] = '\0';
 
-    void initVulkan() {
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFramebuffers();
-        createCommandPool();
-        createCommandBuffers();
-        createSyncObjects();
+    char* slash = strrchr(path, '/');
+    if (!slash) {
+        return ".";
     }
+    *slash = '\0';
+    return path;
+}
 
-    void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
-            drawFrame();
+// Runs the same job on every worker thread and waits for all of them, which is
+// all that parallel command buffer recording needs.
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threadCount) {
+        for (uint32_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
         }
-
-        vkDeviceWaitIdle(device);
     }
 
-    void cleanupSwapChain() {
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        startCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
         }
+    }
 
-        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    uint32_t size() const {
+        return static_cast<uint32_t>(workers.size());
+    }
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
+    void run(const std::function<void(uint32_t)>& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        currentJob = &job;
+        pending = static_cast<uint32_t>(workers.size());
+        generation++;
+        startCondition.notify_all();
+        doneCondition.wait(lock, [this] { return pending == 0; });
+        currentJob = nullptr;
+    }
 
-        for (auto imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
-        }
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(uint32_t)>* currentJob = nullptr;
+    uint64_t generation = 0;
+    uint32_t pending = 0;
+    bool stop = false;
+
+    void workerLoop(uint32_t index) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(uint32_t)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [&] { return stop || generation != seen; });
+                if (stop) {
+                    return;
+                }
+                seen = generation;
+                job = currentJob;
+            }
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+            (*job)(index);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    doneCondition.notify_one();
+                }
+            }
+        }
     }
+};
 
-    void cleanup() {
-        cleanupSwapChain();
+// Brackets named regions of a command buffer with timestamp queries. Every
+// frame in flight owns its own query pools, and a frame's results are read
+// back when its slot comes around again, i.e. after the fence or timeline wait
+// that already guarantees they are available, so reading never stalls.
+const uint32_t PROFILER_MAX_SCOPES = 16;
+
+const VkQueryPipelineStatisticFlags PROFILER_PIPELINE_STATISTICS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+const char* const PROFILER_STATISTIC_NAMES[] = {
+    "vertices", "primitives", "vertex invocations", "clipped primitives", "fragment invocations"
+};
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
-        }
+const uint32_t PROFILER_STATISTIC_COUNT = sizeof(PROFILER_STATISTIC_NAMES) / sizeof(PROFILER_STATISTIC_NAMES[0]);
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
+class GpuProfiler {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamily, uint32_t frameCount, bool pipelineStatistics, const std::string& csvFile) {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
 
-        vkDestroyDevice(device, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-        if (enableValidationLayers) {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+        if (validBits == 0) {
+            std::cout << "GPU profiler: the graphics queue does not support timestamps" << std::endl;
+            return;
         }
+        timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
 
-        glfwDestroyWindow(window);
+        device = logicalDevice;
+        frames.resize(frameCount);
 
-        glfwTerminate();
-    }
+        for (auto& frame : frames) {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = PROFILER_MAX_SCOPES * 2;
 
-    void recreateSwapChain() {
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0) {
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
-        }
+            if (vkCreateQueryPool(device, &poolInfo, nullptr, &frame.timestamps) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
 
-        vkDeviceWaitIdle(device);
+            if (pipelineStatistics) {
+                poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+                poolInfo.queryCount = 1;
+                poolInfo.pipelineStatistics = PROFILER_PIPELINE_STATISTICS;
 
-        cleanupSwapChain();
+                if (vkCreateQueryPool(device, &poolInfo, nullptr, &frame.statistics) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create pipeline statistics query pool!");
+                }
+            }
+        }
 
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFramebuffers();
-        createCommandBuffers();
+        if (!csvFile.empty()) {
+            csv.open(csvFile, std::ios::trunc);
+            if (!csv.is_open()) {
+                throw std::runtime_error("failed to open file: " + csvFile);
+            }
+            csv << "time_s,region,min_ms,avg_ms,p99_ms,samples" << std::endl;
+        }
+        start = std::chrono::steady_clock::now();
 
-        imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+        std::cout << "GPU profiler: " << frameCount << " query pools, " << validBits << " valid timestamp bits, "
+            << timestampPeriod << " ns per tick" << (pipelineStatistics ? ", pipeline statistics" : "") << std::endl;
     }
 
-    void createInstance() {
-        if (enableValidationLayers && !checkValidationLayerSupport()) {
-            throw std::runtime_error("validation layers requested, but not available!");
+    void destroy() {
+        for (auto& frame : frames) {
+            vkDestroyQueryPool(device, frame.timestamps, nullptr);
+            vkDestroyQueryPool(device, frame.statistics, nullptr);
         }
+        frames.clear();
+    }
 
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Hello Triangle";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "No Engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
-
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
+    // Collects what the frame slot measured last time round and resets its
+    // queries; call right after vkBeginCommandBuffer, outside any render pass.
+    void beginFrame(VkCommandBuffer commandBuffer, size_t frameIndex) {
+        if (frames.empty()) {
+            return;
+        }
 
-        auto extensions = getRequiredExtensions();
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        createInfo.ppEnabledExtensionNames = extensions.data();
+        current = &frames[frameIndex];
+        collect(*current);
 
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+        vkCmdResetQueryPool(commandBuffer, current->timestamps, 0, PROFILER_MAX_SCOPES * 2);
+        if (current->statistics != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, current->statistics, 0, 1);
+        }
+        current->scopes.clear();
+        current->statisticsWritten = false;
+    }
 
-            populateDebugMessengerCreateInfo(debugCreateInfo);
-            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+    uint32_t begin(VkCommandBuffer commandBuffer, const char* name) {
+        if (!current || current->scopes.size() == PROFILER_MAX_SCOPES) {
+            return UINT32_MAX;
         }
-        else {
-            createInfo.enabledLayerCount = 0;
-            createInfo.pNext = nullptr;
+
+        uint32_t scope = static_cast<uint32_t>(current->scopes.size());
+        current->scopes.push_back(findRegion(name));
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current->timestamps, scope * 2);
+        return scope;
+    }
+
+    void end(VkCommandBuffer commandBuffer, uint32_t scope) {
+        if (scope == UINT32_MAX) {
+            return;
         }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current->timestamps, scope * 2 + 1);
+    }
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create instance!");
+    void beginStatistics(VkCommandBuffer commandBuffer) {
+        if (current && current->statistics != VK_NULL_HANDLE && !current->statisticsWritten) {
+            vkCmdBeginQuery(commandBuffer, current->statistics, 0, 0);
         }
     }
 
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
-        createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
+    void endStatistics(VkCommandBuffer commandBuffer) {
+        if (current && current->statistics != VK_NULL_HANDLE && !current->statisticsWritten) {
+            vkCmdEndQuery(commandBuffer, current->statistics, 0);
+            current->statisticsWritten = true;
+        }
     }
 
-    void setupDebugMessenger() {
-        if (!enableValidationLayers) return;
+    // Prints min/avg/p99 per region since the previous report and appends
+    // them to the CSV file, if one was requested.
+    void report() {
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
 
-        VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populateDebugMessengerCreateInfo(createInfo);
+        for (auto& region : regions) {
+            if (region.samples.empty()) {
+                continue;
+            }
 
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
-            throw std::runtime_error("failed to set up debug messenger!");
+            std::sort(region.samples.begin(), region.samples.end());
+            double sum = 0.0;
+            for (double sample : region.samples) {
+                sum += sample;
+            }
+            size_t count = region.samples.size();
+            double minimum = region.samples.front();
+            double average = sum / count;
+            double p99 = region.samples[std::min(count - 1, (size_t)std::ceil(count * 0.99) - 1)];
+
+            std::cout << "  GPU " << region.name << ": min " << minimum << " ms, avg " << average
+                << " ms, p99 " << p99 << " ms (" << count << " samples)" << std::endl;
+            if (csv.is_open()) {
+                csv << time.count() << "," << region.name << "," << minimum << "," << average << "," << p99 << "," << count << std::endl;
+            }
+            region.samples.clear();
         }
-    }
 
-    void createSurface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create window surface!");
+        if (missedSamples > 0) {
+            std::cout << "  GPU profiler: " << missedSamples << " samples were not ready" << std::endl;
+            missedSamples = 0;
+        }
+
+        if (statisticsFrames > 0) {
+            std::cout << "  pipeline statistics per frame:";
+            for (uint32_t i = 0; i < PROFILER_STATISTIC_COUNT; i++) {
+                std::cout << (i == 0 ? " " : ", ") << statisticsSums[i] / statisticsFrames << " " << PROFILER_STATISTIC_NAMES[i];
+                statisticsSums[i] = 0;
+            }
+            std::cout << std::endl;
+            statisticsFrames = 0;
+        }
+    }
+
+private:
+    struct FrameQueries {
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        VkQueryPool statistics = VK_NULL_HANDLE;
+        std::vector<uint32_t> scopes;  // region of every begin/end query pair written
+        bool statisticsWritten = false;
+    };
+
+    struct Region {
+        std::string name;
+        std::vector<double> samples;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::vector<FrameQueries> frames;
+    FrameQueries* current = nullptr;
+    std::vector<Region> regions;
+    uint64_t timestampMask = 0;
+    float timestampPeriod = 1.0f;
+    uint32_t missedSamples = 0;
+    uint64_t statisticsSums[PROFILER_STATISTIC_COUNT] = {};
+    uint32_t statisticsFrames = 0;
+    std::ofstream csv;
+    std::chrono::steady_clock::time_point start;
+
+    uint32_t findRegion(const char* name) {
+        for (size_t i = 0; i < regions.size(); i++) {
+            if (regions[i].name == name) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        regions.push_back({ name, {} });
+        return static_cast<uint32_t>(regions.size() - 1);
+    }
+
+    void collect(const FrameQueries& frame) {
+        // No VK_QUERY_RESULT_WAIT_BIT: a query that is unexpectedly not ready is
+        // counted and dropped instead of blocking the CPU.
+        if (!frame.scopes.empty()) {
+            uint32_t queryCount = static_cast<uint32_t>(frame.scopes.size()) * 2;
+            std::vector<uint64_t> results(queryCount * 2);
+            VkResult result = vkGetQueryPoolResults(device, frame.timestamps, 0, queryCount, results.size() * sizeof(uint64_t), results.data(),
+                2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            if (result == VK_SUCCESS || result == VK_NOT_READY) {
+                for (size_t i = 0; i < frame.scopes.size(); i++) {
+                    const uint64_t* pair = &results[i * 4];
+                    if (pair[1] == 0 || pair[3] == 0) {
+                        missedSamples++;
+                        continue;
+                    }
+                    uint64_t ticks = (pair[2] - pair[0]) & timestampMask;
+                    regions[frame.scopes[i]].samples.push_back(ticks * timestampPeriod / 1e6);
+                }
+            }
+        }
+
+        if (frame.statisticsWritten) {
+            uint64_t results[PROFILER_STATISTIC_COUNT + 1];
+            VkResult result = vkGetQueryPoolResults(device, frame.statistics, 0, 1, sizeof(results), results,
+                sizeof(results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            if ((result == VK_SUCCESS || result == VK_NOT_READY) && results[PROFILER_STATISTIC_COUNT] != 0) {
+                for (uint32_t i = 0; i < PROFILER_STATISTIC_COUNT; i++) {
+                    statisticsSums[i] += results[i];
+                }
+                statisticsFrames++;
+            }
+        }
+    }
+};
+
+struct PushConstants {
+    float offset[2];
+    float scale;
+};
+
+// Push constants of shadow.vert and ground.frag: the draw transform of
+// PushConstants plus the light
+struct ShadowConstants {
+    float offset[2];
+    float scale;
+    float height;
+    float light[4];  // direction towards the light, w unused
+};
+
+struct Vertex {
+    float pos[2];
+    float color[3];
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Vertex, color);
+
+        return attributeDescriptions;
+    }
+};
+
+// Per-instance transform, read at instance rate from vertex binding 1
+struct alignas(16) InstanceData {
+    float offset[2];
+    float scale;
+    float angle;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        return bindingDescription;
+    }
+
+    static VkVertexInputAttributeDescription getAttributeDescription() {
+        VkVertexInputAttributeDescription attributeDescription{};
+        attributeDescription.binding = 1;
+        attributeDescription.location = 2;
+        attributeDescription.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescription.offset = 0;
+
+        return attributeDescription;
+    }
+};
+
+// Push constants of instance.comp
+struct InstanceParams {
+    uint32_t count;
+    uint32_t columns;
+    float cell;
+    float scale;
+    float time;
+};
+
+// Push constants of cull.comp; the camera is the same transform the vertex
+// shader applies through PushConstants
+struct CullParams {
+    float offset[2];
+    float scale;
+    uint32_t count;
+    uint32_t indexCount;
+};
+
+const uint32_t INSTANCE_WORKGROUP_SIZE = 64;
+
+// Descriptor set and pipeline of a compute shader whose bindings are all
+// storage buffers
+struct ComputePass {
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+// CPU version of instance.comp for instances [first, last). With SSE2 four
+// instances are built at once, transposed into place and written with
+// non-temporal stores, since the destination is mapped memory that is never
+// read back on the CPU.
+void updateInstancesCpu(InstanceData* out, uint32_t first, uint32_t last, const InstanceParams& params) {
+    uint32_t column = first % params.columns;
+    uint32_t row = first / params.columns;
+
+#ifdef __SSE2__
+    const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128i laneIndex = _mm_set_epi32(3, 2, 1, 0);
+    const __m128 cell = _mm_set1_ps(params.cell);
+    const __m128 time = _mm_set1_ps(params.time);
+#endif
+
+    for (uint32_t i = first; i < last;) {
+#ifdef __SSE2__
+        // Four instances at once while they stay within one row
+        if (i + 4 <= last && column + 4 <= params.columns) {
+            __m128 x = _mm_sub_ps(_mm_mul_ps(cell, _mm_add_ps(_mm_set1_ps(column + 0.5f), lane)), _mm_set1_ps(1.0f));
+            __m128 y = _mm_set1_ps(-1.0f + params.cell * (row + 0.5f));
+            __m128 scale = _mm_set1_ps(params.scale);
+            __m128i index = _mm_add_epi32(_mm_set1_epi32((int)i), laneIndex);
+            __m128 speed = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(index, _mm_set1_epi32(7))), _mm_set1_ps(0.25f)));
+            __m128 angle = _mm_add_ps(_mm_mul_ps(time, speed), _mm_mul_ps(_mm_cvtepi32_ps(index), _mm_set1_ps(0.618f)));
+
+            // x, y, scale, angle rows become one instance per register
+            _MM_TRANSPOSE4_PS(x, y, scale, angle);
+            _mm_stream_ps(&out[i + 0].offset[0], x);
+            _mm_stream_ps(&out[i + 1].offset[0], y);
+            _mm_stream_ps(&out[i + 2].offset[0], scale);
+            _mm_stream_ps(&out[i + 3].offset[0], angle);
+
+            i += 4;
+            column += 4;
+            if (column == params.columns) {
+                column = 0;
+                row++;
+            }
+            continue;
+        }
+#endif
+
+        out[i].offset[0] = -1.0f + params.cell * (column + 0.5f);
+        out[i].offset[1] = -1.0f + params.cell * (row + 0.5f);
+        out[i].scale = params.scale;
+        out[i].angle = params.time * (1.0f + (i & 7) * 0.25f) + (float)i * 0.618f;
+
+        i++;
+        if (++column == params.columns) {
+            column = 0;
+            row++;
+        }
+    }
+
+#ifdef __SSE2__
+    _mm_sfence();
+#endif
+}
+
+const std::vector<Vertex> vertices = {
+    {{ 0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{ 0.5f,  0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{-0.5f,  0.5f}, {0.0f, 0.0f, 1.0f}}
+};
+
+const std::vector<uint16_t> indices = {
+    0, 1, 2
+};
+
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+// One vkAllocateMemory carved into many buffers, so the number of resources
+// is not bounded by maxMemoryAllocationCount. Free ranges are kept sorted by
+// offset and merged with their neighbours, so buffers can be released in any
+// order.
+class DeviceMemoryArena {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize size, uint32_t memoryTypeBits, VkMemoryPropertyFlags properties,
+        VkMemoryAllocateFlags allocateFlags) {
+        device = logicalDevice;
+        typeIndex = findMemoryType(physicalDevice, memoryTypeBits, properties);
+
+        // Buffers whose device address is taken need memory allocated for it
+        VkMemoryAllocateFlagsInfo flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        flagsInfo.flags = allocateFlags;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = allocateFlags ? &flagsInfo : nullptr;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = typeIndex;
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory arena!");
+        }
+
+        capacity = size;
+        freeRanges[0] = size;
+    }
+
+    void destroy() {
+        vkFreeMemory(device, memory, nullptr);
+        memory = VK_NULL_HANDLE;
+        freeRanges.clear();
+    }
+
+    VkDeviceSize allocate(VkDeviceSize size, VkDeviceSize alignment) {
+        // First fit; the padding in front of an aligned block stays free
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            VkDeviceSize rangeStart = it->first;
+            VkDeviceSize rangeEnd = it->first + it->second;
+            VkDeviceSize offset = (rangeStart + alignment - 1) / alignment * alignment;
+            if (offset + size > rangeEnd) {
+                continue;
+            }
+
+            freeRanges.erase(it);
+            if (offset > rangeStart) {
+                freeRanges[rangeStart] = offset - rangeStart;
+            }
+            if (offset + size < rangeEnd) {
+                freeRanges[offset + size] = rangeEnd - (offset + size);
+            }
+            used += size;
+            allocations++;
+            return offset;
+        }
+
+        throw std::runtime_error("device memory arena is full!");
+    }
+
+    void free(VkDeviceSize offset, VkDeviceSize size) {
+        auto range = freeRanges.emplace(offset, size).first;
+
+        auto next = std::next(range);
+        if (next != freeRanges.end() && range->first + range->second == next->first) {
+            range->second += next->second;
+            freeRanges.erase(next);
+        }
+        if (range != freeRanges.begin()) {
+            auto previous = std::prev(range);
+            if (previous->first + previous->second == range->first) {
+                previous->second += range->second;
+                freeRanges.erase(range);
+            }
+        }
+        used -= size;
+        allocations--;
+    }
+
+    VkDeviceMemory deviceMemory() const {
+        return memory;
+    }
+
+    uint32_t memoryTypeIndex() const {
+        return typeIndex;
+    }
+
+    VkDeviceSize size() const {
+        return capacity;
+    }
+
+    VkDeviceSize usedBytes() const {
+        return used;
+    }
+
+    uint32_t allocationCount() const {
+        return allocations;
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint32_t typeIndex = 0;
+    VkDeviceSize capacity = 0;
+    VkDeviceSize used = 0;
+    uint32_t allocations = 0;
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;  // offset -> size
+};
+
+struct ArenaBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
+
+// A persistently mapped host visible buffer used as a ring: uploads are
+// memcpy'd in and queued, and flush() records them with one vkCmdCopyBuffer
+// per destination buffer followed by a single barrier. Positions grow
+// monotonically; space is handed back with retire() once the command buffer
+// that consumed it has finished.
+class StagingRing {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, VkDeviceSize size) {
+        device = logicalDevice;
+        capacity = size;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create staging buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate staging buffer memory!");
+        }
+
+        vkBindBufferMemory(device, buffer, memory, 0);
+
+        void* data;
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map staging buffer!");
+        }
+        mapped = static_cast<char*>(data);
+    }
+
+    void destroy() {
+        vkUnmapMemory(device, memory);
+        vkDestroyBuffer(device, buffer, nullptr);
+        vkFreeMemory(device, memory, nullptr);
+    }
+
+    // Returns false when the ring has no room until older batches retire
+    bool upload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+        uint64_t start = (head + 15) & ~15ull;
+        VkDeviceSize offset = start % capacity;
+        if (offset + size > capacity) {
+            // Never split a copy across the end of the ring
+            start += capacity - offset;
+            offset = 0;
+        }
+        if (size > capacity || start + size - tail > capacity) {
+            return false;
+        }
+
+        memcpy(mapped + offset, data, size);
+
+        VkBufferCopy region{};
+        region.srcOffset = offset;
+        region.dstOffset = dstOffset;
+        region.size = size;
+        pending.push_back({ dst, region });
+
+        head = start + size;
+        uploadedBytes += size;
+        return true;
+    }
+
+    // Records the queued copies; returns the ring position to retire() once
+    // commandBuffer has completed.
+    uint64_t flush(VkCommandBuffer commandBuffer) {
+        if (pending.empty()) {
+            return head;
+        }
+
+        std::stable_sort(pending.begin(), pending.end(), [](const PendingCopy& a, const PendingCopy& b) { return a.dst < b.dst; });
+
+        std::vector<VkBufferCopy> regions;
+        for (size_t i = 0; i < pending.size(); i++) {
+            regions.push_back(pending[i].region);
+            if (i + 1 == pending.size() || pending[i + 1].dst != pending[i].dst) {
+                vkCmdCopyBuffer(commandBuffer, buffer, pending[i].dst, static_cast<uint32_t>(regions.size()), regions.data());
+                regions.clear();
+                copyCommands++;
+            }
+        }
+        pending.clear();
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+        return head;
+    }
+
+    void retire(uint64_t position) {
+        tail = std::max(tail, position);
+    }
+
+    VkDeviceSize size() const {
+        return capacity;
+    }
+
+    uint64_t totalUploadedBytes() const {
+        return uploadedBytes;
+    }
+
+    uint32_t totalCopyCommands() const {
+        return copyCommands;
+    }
+
+private:
+    struct PendingCopy {
+        VkBuffer dst;
+        VkBufferCopy region;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    char* mapped = nullptr;
+    VkDeviceSize capacity = 0;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    std::vector<PendingCopy> pending;
+    uint64_t uploadedBytes = 0;
+    uint32_t copyCommands = 0;
+};
+
+struct QueueFamilyIndices {
+    std::optional<uint32_t> graphicsFamily;
+    std::optional<uint32_t> presentFamily;
+
+    bool isComplete() {
+        return graphicsFamily.has_value() && presentFamily.has_value();
+    }
+};
+
+struct SwapChainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+};
+
+class HelloTriangleApplication {
+public:
+    void run() {
+        initWindow();
+        initVulkan();
+        mainLoop();
+        cleanup();
+    }
+
+private:
+    GLFWwindow* window;
+
+    VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger;
+    VkSurfaceKHR surface;
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device;
+
+    VkQueue graphicsQueue;
+    VkQueue presentQueue;
+
+    VkSwapchainKHR swapChain;
+    std::vector<VkImage> swapChainImages;
+    VkFormat swapChainImageFormat;
+    VkExtent2D swapChainExtent;
+    std::vector<VkImageView> swapChainImageViews;
+    std::vector<VkFramebuffer> swapChainFramebuffers;
+
+    // Vulkan 1.3 path: dynamic rendering, synchronization2 and a timeline
+    // semaphore instead of render pass/framebuffer objects and fences.
+    bool dynamicRendering = false;
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline graphicsPipeline;
+
+    // One transient pool per frame in flight, reset as a whole once the frame's
+    // fence has signaled, plus one per worker thread because pools are not
+    // thread safe.
+    std::vector<VkCommandPool> commandPools;
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<std::vector<VkCommandPool>> workerCommandPools;
+    std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;
+    std::unique_ptr<ThreadPool> recordThreads;
+
+    // Vertex and index buffers live in one device local allocation and are
+    // filled through the staging ring.
+    DeviceMemoryArena deviceArena;
+    StagingRing stagingRing;
+    std::vector<uint64_t> stagingBatches;
+    ArenaBuffer vertexBuffer;
+    ArenaBuffer indexBuffer;
+
+    // Instance transforms: a single identity instance normally; in stress
+    // mode either written by instance.comp into instanceBuffer, or by the
+    // thread pool into one host visible slice per frame in flight.
+    ArenaBuffer instanceBuffer;
+    bool computeInstanceUpdate = false;
+    VkBuffer hostInstanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory hostInstanceBufferMemory = VK_NULL_HANDLE;
+    InstanceData* hostInstances = nullptr;
+    ComputePass instancePass;
+    std::chrono::steady_clock::time_point instanceStart;
+    double instanceUpdateTime = 0.0;
+
+    // GPU driven stress mode: cull.comp turns the visible instances into
+    // indirect draw commands and a draw count, so recording costs the same
+    // for any instance count. The count of every frame slot is copied back
+    // to report how many objects survived.
+    bool indirectCount = false;
+    ComputePass cullPass;
+    ArenaBuffer drawCommandBuffer;
+    ArenaBuffer drawCountBuffer;
+    VkBuffer visibleCountBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory visibleCountBufferMemory = VK_NULL_HANDLE;
+    uint32_t* visibleCounts = nullptr;
+    uint64_t visibleObjects = 0;
+    PushConstants camera = { { 0.0f, 0.0f }, 1.0f };
+
+    // Shadow modes: the triangles float above a ground plane and a moving
+    // directional light throws their shadows on it. Planar shadows rasterize
+    // every triangle a second time, flattened onto the ground; ray query
+    // shadows trace one ray per ground pixel in the fragment shader against
+    // a bottom level acceleration structure per draw and a top level one
+    // over all of them.
+    VkPipelineLayout shadowPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline shadowPipeline = VK_NULL_HANDLE;
+    std::chrono::steady_clock::time_point shadowStart;
+
+    bool rayQuery = false;
+    VkDescriptorSetLayout groundDescriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool groundDescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet groundDescriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout groundPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline groundPipeline = VK_NULL_HANDLE;
+    DeviceMemoryArena accelerationArena;
+    ArenaBuffer bottomLevelBuffer;
+    ArenaBuffer topLevelBuffer;
+    std::vector<VkAccelerationStructureKHR> bottomLevels;
+    VkAccelerationStructureKHR topLevel = VK_NULL_HANDLE;
+
+    PFN_vkCreateAccelerationStructureKHR vkCreateAccelerationStructure = nullptr;
+    PFN_vkDestroyAccelerationStructureKHR vkDestroyAccelerationStructure = nullptr;
+    PFN_vkGetAccelerationStructureBuildSizesKHR vkGetAccelerationStructureBuildSizes = nullptr;
+    PFN_vkGetAccelerationStructureDeviceAddressKHR vkGetAccelerationStructureDeviceAddress = nullptr;
+    PFN_vkCmdBuildAccelerationStructuresKHR vkCmdBuildAccelerationStructures = nullptr;
+    PFN_vkCmdWriteAccelerationStructuresPropertiesKHR vkCmdWriteAccelerationStructuresProperties = nullptr;
+    PFN_vkCmdCopyAccelerationStructureKHR vkCmdCopyAccelerationStructure = nullptr;
+
+    GpuProfiler gpuProfiler;
+    bool pipelineStatistics = false;
+
+    std::vector<double> recordTimes;
+    double primaryRecordTime = 0.0;
+    uint32_t statsFrames = 0;
+    std::chrono::steady_clock::time_point statsStart;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+    std::vector<VkFence> imagesInFlight;
+    VkSemaphore frameTimeline = VK_NULL_HANDLE;
+    uint64_t frameTimelineValue = 0;
+    std::vector<uint64_t> framesInFlightValues;
+    std::vector<uint64_t> imagesInFlightValues;
+
+    // VK_KHR_present_id + VK_KHR_present_wait: every present is tagged with an
+    // id, and waiting for it tells when the image actually reached the screen.
+    bool presentWait = false;
+    PFN_vkWaitForPresentKHR vkWaitForPresent = nullptr;
+    uint64_t presentId = 0;
+    std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>> pendingPresents;
+    double lastPresentLatency = 0.0;
+    double presentLatencySum = 0.0;
+    double presentLatencyMax = 0.0;
+    uint32_t presentLatencyCount = 0;
+    size_t currentFrame = 0;
+
+    bool framebufferResized = false;
+
+    void initWindow() {
+        glfwInit();
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        window = glfwCreateWindow(WIDTH, HEIGHT, "Hello, Vulkan Triangle!", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->framebufferResized = true;
+    }
+
+    void initVulkan() {
+        auto start = std::chrono::steady_clock::now();
+
+        createInstance();
+        setupDebugMessenger();
+        createSurface();
+        pickPhysicalDevice();
+        createLogicalDevice();
+        createPipelineCache();
+        createShadowLayouts();
+        createSwapChain();
+        createImageViews();
+        if (!dynamicRendering) {
+            createRenderPass();
+        }
+        createGraphicsPipeline();
+        if (!dynamicRendering) {
+            createFramebuffers();
+        }
+        createCommandPool();
+        createBufferMemory();
+        createMeshBuffers();
+        createAccelerationStructures();
+        createInstanceUpdate();
+        createCommandBuffers();
+        createSyncObjects();
+        createGpuProfiler();
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "initVulkan: " << elapsed.count() << " ms" << std::endl;
+    }
+
+    void mainLoop() {
+        while (!glfwWindowShouldClose(window)) {
+            glfwPollEvents();
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(device);
+    }
+
+    void cleanupSwapChain() {
+        for (auto framebuffer : swapChainFramebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+
+        for (auto imageView : swapChainImageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
+    }
+
+    void cleanup() {
+        cleanupSwapChain();
+
+        vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        vkDestroyPipeline(device, shadowPipeline, nullptr);
+        vkDestroyPipeline(device, groundPipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, shadowPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, groundPipelineLayout, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+
+        vkDestroyDescriptorPool(device, groundDescriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, groundDescriptorSetLayout, nullptr);
+
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+        }
+        for (auto fence : inFlightFences) {
+            vkDestroyFence(device, fence, nullptr);
+        }
+        vkDestroySemaphore(device, frameTimeline, nullptr);
+
+        gpuProfiler.destroy();
+
+        destroyComputePass(cullPass);
+        destroyComputePass(instancePass);
+        destroyMappedBuffer(visibleCountBuffer, visibleCountBufferMemory);
+        destroyMappedBuffer(hostInstanceBuffer, hostInstanceBufferMemory);
+
+        destroyAccelerationStructures();
+
+        destroyDeviceBuffer(drawCountBuffer);
+        destroyDeviceBuffer(drawCommandBuffer);
+        destroyDeviceBuffer(instanceBuffer);
+        destroyDeviceBuffer(indexBuffer);
+        destroyDeviceBuffer(vertexBuffer);
+        stagingRing.destroy();
+        deviceArena.destroy();
+
+        recordThreads.reset();
+
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            vkDestroyCommandPool(device, commandPools[i], nullptr);
+            for (auto pool : workerCommandPools[i]) {
+                vkDestroyCommandPool(device, pool, nullptr);
+            }
+        }
+
+        vkDestroyDevice(device, nullptr);
+
+        if (enableValidationLayers) {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        vkDestroyInstance(instance, nullptr);
+
+        glfwDestroyWindow(window);
+
+        glfwTerminate();
+    }
+
+    void recreateSwapChain() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwGetFramebufferSize(window, &width, &height);
+            glfwWaitEvents();
+        }
+
+        vkDeviceWaitIdle(device);
+
+        auto start = std::chrono::steady_clock::now();
+
+        VkFormat oldFormat = swapChainImageFormat;
+
+        // Present ids belong to the old swapchain
+        pendingPresents.clear();
+
+        cleanupSwapChain();
+
+        createSwapChain();
+        createImageViews();
+
+        // Viewport and scissor are dynamic state, so the render pass and the
+        // pipeline only depend on the surface format, which rarely changes.
+        if (swapChainImageFormat != oldFormat) {
+            vkDestroyPipeline(device, graphicsPipeline, nullptr);
+            vkDestroyPipeline(device, shadowPipeline, nullptr);
+            vkDestroyPipeline(device, groundPipeline, nullptr);
+            vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+            vkDestroyRenderPass(device, renderPass, nullptr);
+
+            if (!dynamicRendering) {
+                createRenderPass();
+            }
+            createGraphicsPipeline();
+        }
+
+        if (!dynamicRendering) {
+            createFramebuffers();
+        }
+
+        imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+        imagesInFlightValues.resize(swapChainImages.size(), 0);
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "recreateSwapChain: " << swapChainExtent.width << "x" << swapChainExtent.height << " in " << elapsed.count() << " ms" << std::endl;
+    }
+
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Hello Triangle";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_3;
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        auto extensions = getRequiredExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+            createInfo.pNext = nullptr;
+        }
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+        createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+            throw std::runtime_error("failed to set up debug messenger!");
+        }
+    }
+
+    void createSurface() {
+        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create window surface!");
         }
     }
 
@@ -280,220 +1488,1681 @@ private:
         uint32_t deviceCount = 0;
         vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
 
-        if (deviceCount == 0) {
-            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        if (deviceCount == 0) {
+            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        }
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        for (const auto& device : devices) {
+            if (isDeviceSuitable(device)) {
+                physicalDevice = device;
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE) {
+            throw std::runtime_error("failed to find a suitable GPU!");
+        }
+
+        dynamicRendering = !options.legacyPath && supportsDynamicRendering(physicalDevice);
+
+        indirectCount = options.gpuCulling && supportsIndirectCount(physicalDevice);
+        if (options.gpuCulling && !indirectCount) {
+            throw std::runtime_error("GPU culling needs drawIndirectCount, multiDrawIndirect and drawIndirectFirstInstance!");
+        }
+
+        rayQuery = options.shadows == SHADOWS_RAY_QUERY && supportsRayQuery(physicalDevice);
+        if (options.shadows == SHADOWS_RAY_QUERY && !rayQuery) {
+            throw std::runtime_error("ray query shadows need VK_KHR_acceleration_structure, VK_KHR_ray_query and bufferDeviceAddress!");
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        std::cout << properties.deviceName << ": " << (dynamicRendering ? "dynamic rendering + synchronization2 + timeline semaphore" : "render pass + fences") << std::endl;
+    }
+
+    bool supportsDynamicRendering(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_3) {
+            return false;
+        }
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceVulkan13Features features13{};
+        features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        features13.pNext = &features12;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features13;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return features13.dynamicRendering && features13.synchronization2 && features12.timelineSemaphore;
+    }
+
+    bool supportsIndirectCount(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return features12.drawIndirectCount && features.features.multiDrawIndirect && features.features.drawIndirectFirstInstance;
+    }
+
+    bool supportsRayQuery(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> requiredExtensions = { VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, VK_KHR_RAY_QUERY_EXTENSION_NAME,
+            VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME };
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+        if (!requiredExtensions.empty()) {
+            return false;
+        }
+
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{};
+        rayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
+        accelerationStructureFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+        accelerationStructureFeatures.pNext = &rayQueryFeatures;
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.pNext = &accelerationStructureFeatures;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return accelerationStructureFeatures.accelerationStructure && rayQueryFeatures.rayQuery && features12.bufferDeviceAddress;
+    }
+
+    void createLogicalDevice() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+        float queuePriority = 1.0f;
+        for (uint32_t queueFamily : uniqueQueueFamilies) {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        pipelineStatistics = options.pipelineStatistics && supportedFeatures.pipelineStatisticsQuery;
+        deviceFeatures.pipelineStatisticsQuery = pipelineStatistics ? VK_TRUE : VK_FALSE;
+        if (options.pipelineStatistics && !pipelineStatistics) {
+            std::cout << "pipeline statistics queries are not supported" << std::endl;
+        }
+        // The statistics query stays active across vkCmdExecuteCommands, which
+        // needs inheritedQueries when the draws are recorded into secondaries
+        if (pipelineStatistics && options.threadCount > 0) {
+            if (supportedFeatures.inheritedQueries) {
+                deviceFeatures.inheritedQueries = VK_TRUE;
+            }
+            else {
+                std::cout << "inherited queries are not supported, pipeline statistics need --threads 0" << std::endl;
+                pipelineStatistics = false;
+                deviceFeatures.pipelineStatisticsQuery = VK_FALSE;
+            }
+        }
+        deviceFeatures.multiDrawIndirect = indirectCount ? VK_TRUE : VK_FALSE;
+        deviceFeatures.drawIndirectFirstInstance = indirectCount ? VK_TRUE : VK_FALSE;
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.timelineSemaphore = VK_TRUE;
+        features12.drawIndirectCount = indirectCount ? VK_TRUE : VK_FALSE;
+        features12.bufferDeviceAddress = rayQuery ? VK_TRUE : VK_FALSE;
+
+        VkPhysicalDeviceVulkan13Features features13{};
+        features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        features13.pNext = &features12;
+        features13.dynamicRendering = VK_TRUE;
+        features13.synchronization2 = VK_TRUE;
+
+        // The 1.2 features are also needed by the render pass path when culling
+        // or tracing rays
+        void* featureChain = dynamicRendering ? (void*)&features13 : (indirectCount || rayQuery) ? (void*)&features12 : nullptr;
+
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
+        accelerationStructureFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+        accelerationStructureFeatures.pNext = featureChain;
+        accelerationStructureFeatures.accelerationStructure = VK_TRUE;
+
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{};
+        rayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+        rayQueryFeatures.pNext = &accelerationStructureFeatures;
+        rayQueryFeatures.rayQuery = VK_TRUE;
+        if (rayQuery) {
+            featureChain = &rayQueryFeatures;
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        presentIdFeatures.pNext = featureChain;
+        presentIdFeatures.presentId = VK_TRUE;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.pNext = &presentIdFeatures;
+        presentWaitFeatures.presentWait = VK_TRUE;
+
+        std::vector<const char*> enabledExtensions = deviceExtensions;
+        presentWait = supportsPresentWait(physicalDevice);
+        if (presentWait) {
+            enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        }
+        if (rayQuery) {
+            enabledExtensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+        }
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        if (presentWait) {
+            createInfo.pNext = &presentWaitFeatures;
+        }
+        else {
+            createInfo.pNext = featureChain;
+        }
+
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+
+        createInfo.pEnabledFeatures = &deviceFeatures;
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
+
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+        if (presentWait) {
+            vkWaitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+            presentWait = vkWaitForPresent != nullptr;
+        }
+
+        if (rayQuery) {
+            vkCreateAccelerationStructure = (PFN_vkCreateAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkCreateAccelerationStructureKHR");
+            vkDestroyAccelerationStructure = (PFN_vkDestroyAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkDestroyAccelerationStructureKHR");
+            vkGetAccelerationStructureBuildSizes = (PFN_vkGetAccelerationStructureBuildSizesKHR)vkGetDeviceProcAddr(device, "vkGetAccelerationStructureBuildSizesKHR");
+            vkGetAccelerationStructureDeviceAddress = (PFN_vkGetAccelerationStructureDeviceAddressKHR)vkGetDeviceProcAddr(device, "vkGetAccelerationStructureDeviceAddressKHR");
+            vkCmdBuildAccelerationStructures = (PFN_vkCmdBuildAccelerationStructuresKHR)vkGetDeviceProcAddr(device, "vkCmdBuildAccelerationStructuresKHR");
+            vkCmdWriteAccelerationStructuresProperties = (PFN_vkCmdWriteAccelerationStructuresPropertiesKHR)vkGetDeviceProcAddr(device, "vkCmdWriteAccelerationStructuresPropertiesKHR");
+            vkCmdCopyAccelerationStructure = (PFN_vkCmdCopyAccelerationStructureKHR)vkGetDeviceProcAddr(device, "vkCmdCopyAccelerationStructureKHR");
+        }
+    }
+
+    bool supportsPresentWait(VkPhysicalDevice device) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> requiredExtensions = { VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME };
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+        if (!requiredExtensions.empty()) {
+            return false;
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.pNext = &presentIdFeatures;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &presentWaitFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+    }
+
+    void createPipelineCache() {
+        std::vector<char> cacheData;
+        std::ifstream file(PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            cacheData.resize((size_t)file.tellg());
+            file.seekg(0);
+            file.read(cacheData.data(), cacheData.size());
+        }
+
+        if (!cacheData.empty() && !isPipelineCacheCompatible(cacheData)) {
+            std::cout << "pipeline cache: " << PIPELINE_CACHE_FILE << " was created by another driver or device, ignoring it" << std::endl;
+            cacheData.clear();
+        }
+
+        VkPipelineCacheCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        createInfo.initialDataSize = cacheData.size();
+        createInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+        if (vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+
+        std::cout << "pipeline cache: " << (cacheData.empty() ? "cold" : "warm") << " start (" << cacheData.size() << " bytes)" << std::endl;
+    }
+
+    bool isPipelineCacheCompatible(const std::vector<char>& cacheData) {
+        // The driver is allowed to reject or even crash on foreign data, so check
+        // the VkPipelineCacheHeaderVersionOne prefix ourselves first.
+        if (cacheData.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+            return false;
+        }
+
+        VkPipelineCacheHeaderVersionOne header;
+        memcpy(&header, cacheData.data(), sizeof(header));
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        return header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID &&
+            memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    void savePipelineCache() {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+            return;
+        }
+
+        std::vector<char> cacheData(dataSize);
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        // Write to a temporary file and rename it, so an interrupted run never
+        // leaves a truncated cache behind.
+        std::string tempFile = std::string(PIPELINE_CACHE_FILE) + ".tmp";
+        std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+        if (!file.write(cacheData.data(), dataSize)) {
+            return;
+        }
+        file.close();
+        std::rename(tempFile.c_str(), PIPELINE_CACHE_FILE);
+    }
+
+    void createSwapChain() {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+        if (indices.graphicsFamily != indices.presentFamily) {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        }
+        else {
+            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = presentMode;
+
+        std::cout << "present mode: " << presentModeName(presentMode) << ", " << options.framesInFlight << " frames in flight" << std::endl;
+        createInfo.clipped = VK_TRUE;
+
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create swap chain!");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+
+        swapChainImageFormat = surfaceFormat.format;
+        swapChainExtent = extent;
+    }
+
+    void createImageViews() {
+        swapChainImageViews.resize(swapChainImages.size());
+
+        for (size_t i = 0; i < swapChainImages.size(); i++) {
+            VkImageViewCreateInfo createInfo{};
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            createInfo.image = swapChainImages[i];
+            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            createInfo.format = swapChainImageFormat;
+            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            createInfo.subresourceRange.baseMipLevel = 0;
+            createInfo.subresourceRange.levelCount = 1;
+            createInfo.subresourceRange.baseArrayLayer = 0;
+            createInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create image views!");
+            }
+        }
+    }
+
+    void createRenderPass() {
+        VkAttachmentDescription colorAttachment{};
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentReference colorAttachmentRef{};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.srcAccessMask = 0;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &colorAttachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
+
+    void createShadowLayouts() {
+        if (options.shadows == SHADOWS_NONE) {
+            return;
+        }
+        shadowStart = std::chrono::steady_clock::now();
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(ShadowConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (options.shadows == SHADOWS_PLANAR) {
+            if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &shadowPipelineLayout) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create pipeline layout!");
+            }
+            return;
+        }
+
+        // ground.frag reads the light and traces against the top level
+        // acceleration structure
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &groundDescriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &groundDescriptorSetLayout;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &groundPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+    }
+
+    void createGraphicsPipeline() {
+        auto start = std::chrono::steady_clock::now();
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        pipelineLayoutInfo.setLayoutCount = 0;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        graphicsPipeline = createPipeline(loadShader("hello_vert.spv", EMBEDDED_SHADER(hello_vert_spv)),
+            loadShader("hello_frag.spv", EMBEDDED_SHADER(hello_frag_spv)), pipelineLayout, true, VK_CULL_MODE_BACK_BIT);
+
+        // Flattened triangles keep their winding; the ground triangle is not
+        // worth getting the winding right for
+        if (options.shadows == SHADOWS_PLANAR) {
+            shadowPipeline = createPipeline(loadShader("shadow_vert.spv", EMBEDDED_SHADER(shadow_vert_spv)),
+                loadShader("hello_frag.spv", EMBEDDED_SHADER(hello_frag_spv)), shadowPipelineLayout, true, VK_CULL_MODE_BACK_BIT);
+        }
+        else if (options.shadows == SHADOWS_RAY_QUERY) {
+            groundPipeline = createPipeline(loadShader("ground_vert.spv", EMBEDDED_SHADER(ground_vert_spv)),
+                loadShader("ground_frag.spv", EMBEDDED_SHADER(ground_frag_spv)), groundPipelineLayout, false, VK_CULL_MODE_NONE);
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "createGraphicsPipeline: " << elapsed.count() << " ms" << std::endl;
+    }
+
+    // Everything but the shaders, the layout, the vertex input and the cull
+    // mode is shared by all pipelines of the sample
+    VkPipeline createPipeline(const ShaderBinary& vertShaderCode, const ShaderBinary& fragShaderCode, VkPipelineLayout layout, bool vertexInput,
+        VkCullModeFlags cullMode) {
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        VkVertexInputBindingDescription bindingDescriptions[] = { Vertex::getBindingDescription(), InstanceData::getBindingDescription() };
+        auto vertexAttributes = Vertex::getAttributeDescriptions();
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+        attributeDescriptions.push_back(InstanceData::getAttributeDescription());
+
+        if (vertexInput) {
+            vertexInputInfo.vertexBindingDescriptionCount = 2;
+            vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+            vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
+            vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        }
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        std::vector<VkDynamicState> dynamicStates = {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = cullMode;
+        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+        colorBlending.blendConstants[0] = 0.0f;
+        colorBlending.blendConstants[1] = 0.0f;
+        colorBlending.blendConstants[2] = 0.0f;
+        colorBlending.blendConstants[3] = 0.0f;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = layout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+        if (dynamicRendering) {
+            pipelineInfo.pNext = &renderingInfo;
+            pipelineInfo.renderPass = VK_NULL_HANDLE;
+        }
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+
+        return pipeline;
+    }
+
+    void createFramebuffers() {
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            VkImageView attachments[] = {
+                swapChainImageViews[i]
+            };
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = attachments;
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create framebuffer!");
+            }
+        }
+    }
+
+    void createCommandPool() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        commandPools.resize(options.framesInFlight);
+        workerCommandPools.resize(options.framesInFlight);
+
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPools[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create command pool!");
+            }
+
+            workerCommandPools[i].resize(options.threadCount);
+            for (auto& pool : workerCommandPools[i]) {
+                if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create command pool!");
+                }
+            }
+        }
+
+        if (options.threadCount > 0) {
+            recordThreads = std::make_unique<ThreadPool>(options.threadCount);
+        }
+        recordTimes.assign(options.threadCount, 0.0);
+        statsStart = std::chrono::steady_clock::now();
+    }
+
+    void createCommandBuffers() {
+        commandBuffers.resize(options.framesInFlight);
+        secondaryCommandBuffers.resize(options.framesInFlight);
+
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPools[i];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+
+            // Command buffers stay allocated; vkResetCommandPool recycles their memory every frame
+            secondaryCommandBuffers[i].resize(options.threadCount);
+            for (uint32_t t = 0; t < options.threadCount; t++) {
+                allocInfo.commandPool = workerCommandPools[i][t];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+                if (vkAllocateCommandBuffers(device, &allocInfo, &secondaryCommandBuffers[i][t]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate command buffers!");
+                }
+            }
+        }
+    }
+
+    void createBufferMemory() {
+        // Buffers with the same usage report the same memoryTypeBits, so a
+        // probe buffer tells which memory types the arena may come from.
+        VkBufferCreateInfo probeInfo{};
+        probeInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        probeInfo.size = 1;
+        probeInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | meshBufferUsage();
+        probeInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer probe;
+        if (vkCreateBuffer(device, &probeInfo, nullptr, &probe) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, probe, &memRequirements);
+        vkDestroyBuffer(device, probe, nullptr);
+
+        // Room for the stress mode instance and draw command buffers on top of the meshes
+        VkDeviceSize arenaSize = DEVICE_ARENA_SIZE + (VkDeviceSize)options.instanceCount * sizeof(InstanceData);
+        if (options.gpuCulling) {
+            arenaSize += (VkDeviceSize)options.instanceCount * sizeof(VkDrawIndexedIndirectCommand);
+        }
+        deviceArena.init(physicalDevice, device, arenaSize, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            rayQuery ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0);
+        stagingRing.init(physicalDevice, device, STAGING_RING_SIZE);
+        stagingBatches.assign(options.framesInFlight, 0);
+    }
+
+    // The acceleration structure builds read the mesh through its device address
+    VkBufferUsageFlags meshBufferUsage() {
+        return rayQuery ? VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0;
+    }
+
+    VkDeviceAddress bufferAddress(VkBuffer buffer) {
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = buffer;
+        return vkGetBufferDeviceAddress(device, &addressInfo);
+    }
+
+    ArenaBuffer createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage) {
+        return createDeviceBuffer(deviceArena, size, usage);
+    }
+
+    ArenaBuffer createDeviceBuffer(DeviceMemoryArena& arena, VkDeviceSize size, VkBufferUsageFlags usage) {
+        ArenaBuffer result;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &result.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, result.buffer, &memRequirements);
+        if (!(memRequirements.memoryTypeBits & (1u << arena.memoryTypeIndex()))) {
+            throw std::runtime_error("buffer cannot live in the device memory arena!");
+        }
+
+        result.size = memRequirements.size;
+        result.offset = arena.allocate(memRequirements.size, memRequirements.alignment);
+        vkBindBufferMemory(device, result.buffer, arena.deviceMemory(), result.offset);
+
+        return result;
+    }
+
+    void destroyDeviceBuffer(ArenaBuffer& buffer) {
+        destroyDeviceBuffer(deviceArena, buffer);
+    }
+
+    void destroyDeviceBuffer(DeviceMemoryArena& arena, ArenaBuffer& buffer) {
+        if (buffer.buffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+        arena.free(buffer.offset, buffer.size);
+        buffer = ArenaBuffer();
+    }
+
+    void createMeshBuffers() {
+        VkDeviceSize vertexBufferSize = sizeof(vertices[0]) * vertices.size();
+        VkDeviceSize indexBufferSize = sizeof(indices[0]) * indices.size();
+
+        vertexBuffer = createDeviceBuffer(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | meshBufferUsage());
+        indexBuffer = createDeviceBuffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | meshBufferUsage());
+
+        // Without stress mode every draw uses one identity instance
+        InstanceData identity = { { 0.0f, 0.0f }, 1.0f, 0.0f };
+        uint32_t instanceCount = options.instanceCount > 0 && !options.cpuInstanceUpdate ? options.instanceCount : 1;
+        instanceBuffer = createDeviceBuffer(sizeof(InstanceData) * instanceCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        if (!stagingRing.upload(vertexBuffer.buffer, 0, vertices.data(), vertexBufferSize) ||
+            !stagingRing.upload(indexBuffer.buffer, 0, indices.data(), indexBufferSize) ||
+            !stagingRing.upload(instanceBuffer.buffer, 0, &identity, sizeof(identity))) {
+            throw std::runtime_error("mesh does not fit into the staging ring!");
+        }
+
+        // All initial uploads go out in one command buffer
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        uint64_t batch = stagingRing.flush(commandBuffer);
+        endSingleTimeCommands(commandBuffer);
+        stagingRing.retire(batch);
+
+        std::cout << "device memory arena: " << deviceArena.usedBytes() << " of " << deviceArena.size() / (1024 * 1024) << " MB used by "
+            << deviceArena.allocationCount() << " buffers, staging ring " << stagingRing.size() / (1024 * 1024) << " MB, "
+            << stagingRing.totalUploadedBytes() << " bytes uploaded with " << stagingRing.totalCopyCommands() << " copies" << std::endl;
+    }
+
+    VkDeviceAddress accelerationStructureAddress(VkAccelerationStructureKHR accelerationStructure) {
+        VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+        addressInfo.accelerationStructure = accelerationStructure;
+        return vkGetAccelerationStructureDeviceAddress(device, &addressInfo);
+    }
+
+    VkAccelerationStructureKHR createAccelerationStructure(VkAccelerationStructureTypeKHR type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+        VkAccelerationStructureCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+        createInfo.buffer = buffer;
+        createInfo.offset = offset;
+        createInfo.size = size;
+        createInfo.type = type;
+
+        VkAccelerationStructureKHR accelerationStructure;
+        if (vkCreateAccelerationStructure(device, &createInfo, nullptr, &accelerationStructure) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create acceleration structure!");
+        }
+        return accelerationStructure;
+    }
+
+    void accelerationStructureBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+        VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // Every draw of the grid gets its own bottom level acceleration structure,
+    // with the draw's transform baked in, and the top level one holds an
+    // instance of each. The bottom level builds share one scratch buffer of at
+    // most SCRATCH_BUDGET bytes, so they go in batches with a barrier in
+    // between, and are compacted once all of them are built. Nothing moves, so
+    // this all happens once at startup.
+    void createAccelerationStructures() {
+        if (!rayQuery) {
+            return;
+        }
+        const uint32_t drawCount = options.drawCount;
+        const uint32_t primitiveCount = static_cast<uint32_t>(indices.size() / 3);
+
+        VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
+        accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &accelerationStructureProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+        VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+
+        // The build inputs live in one host visible buffer: the draw transforms
+        // followed by the top level instances, which must be 16-byte aligned
+        VkDeviceSize instancesOffset = (sizeof(VkTransformMatrixKHR) * drawCount + 15) & ~15ull;
+        VkDeviceSize inputSize = instancesOffset + sizeof(VkAccelerationStructureInstanceKHR) * drawCount;
+
+        VkBuffer inputBuffer;
+        VkDeviceMemory inputMemory;
+        char* input = static_cast<char*>(createMappedBuffer(inputSize,
+            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, 0, inputBuffer, inputMemory));
+        VkDeviceAddress inputAddress = bufferAddress(inputBuffer);
+        VkTransformMatrixKHR* transforms = reinterpret_cast<VkTransformMatrixKHR*>(input);
+        VkAccelerationStructureInstanceKHR* instances = reinterpret_cast<VkAccelerationStructureInstanceKHR*>(input + instancesOffset);
+
+        // Same placement as recordDraws, lifted to the height of the casters
+        uint32_t columns = gridColumns();
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            PushConstants transform = drawTransform(draw, columns);
+            transforms[draw] = {};
+            transforms[draw].matrix[0][0] = transform.scale;
+            transforms[draw].matrix[0][3] = transform.offset[0];
+            transforms[draw].matrix[1][1] = transform.scale;
+            transforms[draw].matrix[1][3] = transform.offset[1];
+            transforms[draw].matrix[2][2] = 1.0f;
+            transforms[draw].matrix[2][3] = SHADOW_CASTER_HEIGHT;
+        }
+
+        std::vector<VkAccelerationStructureGeometryKHR> geometries(drawCount);
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            VkAccelerationStructureGeometryKHR& geometry = geometries[draw];
+            geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+            geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+            geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+
+            // z of the 2D vertices reads as 0
+            VkAccelerationStructureGeometryTrianglesDataKHR& triangles = geometry.geometry.triangles;
+            triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+            triangles.vertexFormat = VK_FORMAT_R32G32_SFLOAT;
+            triangles.vertexData.deviceAddress = bufferAddress(vertexBuffer.buffer);
+            triangles.vertexStride = sizeof(Vertex);
+            triangles.maxVertex = static_cast<uint32_t>(vertices.size() - 1);
+            triangles.indexType = VK_INDEX_TYPE_UINT16;
+            triangles.indexData.deviceAddress = bufferAddress(indexBuffer.buffer);
+            triangles.transformData.deviceAddress = inputAddress + draw * sizeof(VkTransformMatrixKHR);
         }
 
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+        VkAccelerationStructureBuildGeometryInfoKHR bottomLevelInfo{};
+        bottomLevelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        bottomLevelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        bottomLevelInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+        bottomLevelInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        bottomLevelInfo.geometryCount = 1;
+        bottomLevelInfo.pGeometries = &geometries[0];
+
+        // All draws share the mesh, so one size query covers every build
+        VkAccelerationStructureBuildSizesInfoKHR bottomLevelSizes{};
+        bottomLevelSizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        vkGetAccelerationStructureBuildSizes(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &bottomLevelInfo, &primitiveCount, &bottomLevelSizes);
+
+        VkAccelerationStructureGeometryKHR instanceGeometry{};
+        instanceGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+        instanceGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+        instanceGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+        instanceGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+        instanceGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
+        instanceGeometry.geometry.instances.data.deviceAddress = inputAddress + instancesOffset;
+
+        VkAccelerationStructureBuildGeometryInfoKHR topLevelInfo{};
+        topLevelInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        topLevelInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+        topLevelInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+        topLevelInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        topLevelInfo.geometryCount = 1;
+        topLevelInfo.pGeometries = &instanceGeometry;
+
+        VkAccelerationStructureBuildSizesInfoKHR topLevelSizes{};
+        topLevelSizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        vkGetAccelerationStructureBuildSizes(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &topLevelInfo, &drawCount, &topLevelSizes);
+
+        // As many bottom level builds per batch as their scratch fits into the budget
+        VkDeviceSize bottomLevelStride = (bottomLevelSizes.accelerationStructureSize + ACCELERATION_STRUCTURE_ALIGNMENT - 1) /
+            ACCELERATION_STRUCTURE_ALIGNMENT * ACCELERATION_STRUCTURE_ALIGNMENT;
+        VkDeviceSize scratchStride = (bottomLevelSizes.buildScratchSize + scratchAlignment - 1) / scratchAlignment * scratchAlignment;
+        uint32_t batchSize = static_cast<uint32_t>(std::min<VkDeviceSize>(drawCount, std::max<VkDeviceSize>(1, SCRATCH_BUDGET / scratchStride)));
+        uint32_t batchCount = (drawCount + batchSize - 1) / batchSize;
+        VkDeviceSize scratchSize = std::max(scratchStride * batchSize, topLevelSizes.buildScratchSize) + scratchAlignment;
+
+        // Acceleration structures and scratch get an arena of their own, with
+        // room for the uncompacted and compacted copies at the same time
+        VkBufferCreateInfo probeInfo{};
+        probeInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        probeInfo.size = 1;
+        probeInfo.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        probeInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer probe;
+        if (vkCreateBuffer(device, &probeInfo, nullptr, &probe) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, probe, &memRequirements);
+        vkDestroyBuffer(device, probe, nullptr);
+
+        VkDeviceSize bottomLevelBytes = bottomLevelStride * drawCount;
+        VkDeviceSize arenaSize = 2 * bottomLevelBytes + topLevelSizes.accelerationStructureSize + scratchSize + 4 * 65536;
+        accelerationArena.init(physicalDevice, device, arenaSize, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+
+        ArenaBuffer buildBuffer = createDeviceBuffer(accelerationArena, bottomLevelBytes, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        ArenaBuffer scratchBuffer = createDeviceBuffer(accelerationArena, scratchSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        VkDeviceAddress scratchAddress = (bufferAddress(scratchBuffer.buffer) + scratchAlignment - 1) / scratchAlignment * scratchAlignment;
+
+        std::vector<VkAccelerationStructureKHR> uncompacted(drawCount);
+        std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(drawCount, bottomLevelInfo);
+        VkAccelerationStructureBuildRangeInfoKHR range{};
+        range.primitiveCount = primitiveCount;
+        std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ranges(drawCount, &range);
+
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            uncompacted[draw] = createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, buildBuffer.buffer,
+                draw * bottomLevelStride, bottomLevelSizes.accelerationStructureSize);
+            buildInfos[draw].pGeometries = &geometries[draw];
+            buildInfos[draw].dstAccelerationStructure = uncompacted[draw];
+            buildInfos[draw].scratchData.deviceAddress = scratchAddress + (draw % batchSize) * scratchStride;
+        }
 
-        for (const auto& device : devices) {
-            if (isDeviceSuitable(device)) {
-                physicalDevice = device;
-                break;
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+        queryPoolInfo.queryCount = drawCount;
+
+        VkQueryPool compactedSizes;
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &compactedSizes) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create query pool!");
+        }
+
+        // Build: the mesh upload is the only thing the first batch waits for,
+        // every later batch waits for the one before, whose scratch it reuses
+        auto start = std::chrono::steady_clock::now();
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdResetQueryPool(commandBuffer, compactedSizes, 0, drawCount);
+        accelerationStructureBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_SHADER_READ_BIT);
+
+        for (uint32_t first = 0; first < drawCount; first += batchSize) {
+            uint32_t count = std::min(batchSize, drawCount - first);
+            vkCmdBuildAccelerationStructures(commandBuffer, count, &buildInfos[first], &ranges[first]);
+
+            accelerationStructureBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+            vkCmdWriteAccelerationStructuresProperties(commandBuffer, count, &uncompacted[first],
+                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, compactedSizes, first);
+        }
+        endSingleTimeCommands(commandBuffer);
+        std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - start;
+
+        // Compact: the sizes only exist once the builds have run, so this is a
+        // second submission
+        start = std::chrono::steady_clock::now();
+        std::vector<VkDeviceSize> sizes(drawCount);
+        if (vkGetQueryPoolResults(device, compactedSizes, 0, drawCount, sizes.size() * sizeof(VkDeviceSize), sizes.data(), sizeof(VkDeviceSize),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+            throw std::runtime_error("failed to read compacted acceleration structure sizes!");
+        }
+        vkDestroyQueryPool(device, compactedSizes, nullptr);
+
+        std::vector<VkDeviceSize> offsets(drawCount);
+        VkDeviceSize compactedBytes = 0;
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            offsets[draw] = compactedBytes;
+            compactedBytes += (sizes[draw] + ACCELERATION_STRUCTURE_ALIGNMENT - 1) / ACCELERATION_STRUCTURE_ALIGNMENT * ACCELERATION_STRUCTURE_ALIGNMENT;
+        }
+
+        bottomLevelBuffer = createDeviceBuffer(accelerationArena, compactedBytes, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        bottomLevels.resize(drawCount);
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            bottomLevels[draw] = createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, bottomLevelBuffer.buffer,
+                offsets[draw], sizes[draw]);
+        }
+
+        commandBuffer = beginSingleTimeCommands();
+        accelerationStructureBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            VkCopyAccelerationStructureInfoKHR copyInfo{};
+            copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+            copyInfo.src = uncompacted[draw];
+            copyInfo.dst = bottomLevels[draw];
+            copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+            vkCmdCopyAccelerationStructure(commandBuffer, &copyInfo);
+        }
+        endSingleTimeCommands(commandBuffer);
+
+        for (VkAccelerationStructureKHR accelerationStructure : uncompacted) {
+            vkDestroyAccelerationStructure(device, accelerationStructure, nullptr);
+        }
+        destroyDeviceBuffer(accelerationArena, buildBuffer);
+        std::chrono::duration<double, std::milli> compactTime = std::chrono::steady_clock::now() - start;
+
+        // Top level: one instance per draw, the transform is already in the
+        // bottom level structure
+        start = std::chrono::steady_clock::now();
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            VkAccelerationStructureInstanceKHR& instance = instances[draw];
+            instance = {};
+            instance.transform.matrix[0][0] = 1.0f;
+            instance.transform.matrix[1][1] = 1.0f;
+            instance.transform.matrix[2][2] = 1.0f;
+            instance.instanceCustomIndex = draw;
+            instance.mask = 0xFF;
+            instance.instanceShaderBindingTableRecordOffset = 0;
+            instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+            instance.accelerationStructureReference = accelerationStructureAddress(bottomLevels[draw]);
+        }
+
+        topLevelBuffer = createDeviceBuffer(accelerationArena, topLevelSizes.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+        topLevel = createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, topLevelBuffer.buffer, 0, topLevelSizes.accelerationStructureSize);
+        topLevelInfo.dstAccelerationStructure = topLevel;
+        topLevelInfo.scratchData.deviceAddress = scratchAddress;
+
+        VkAccelerationStructureBuildRangeInfoKHR topLevelRange{};
+        topLevelRange.primitiveCount = drawCount;
+        const VkAccelerationStructureBuildRangeInfoKHR* topLevelRanges = &topLevelRange;
+
+        commandBuffer = beginSingleTimeCommands();
+        accelerationStructureBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+        vkCmdBuildAccelerationStructures(commandBuffer, 1, &topLevelInfo, &topLevelRanges);
+        accelerationStructureBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+        endSingleTimeCommands(commandBuffer);
+        std::chrono::duration<double, std::milli> topLevelTime = std::chrono::steady_clock::now() - start;
+
+        destroyDeviceBuffer(accelerationArena, scratchBuffer);
+        destroyMappedBuffer(inputBuffer, inputMemory);
+
+        std::cout << "bottom level acceleration structures: " << drawCount << " built in " << batchCount << " batches of " << batchSize << " ("
+            << scratchStride * batchSize / 1024 << " KB scratch) in " << buildTime.count() << " ms, compacted from " << bottomLevelBytes / 1024
+            << " to " << compactedBytes / 1024 << " KB in " << compactTime.count() << " ms" << std::endl;
+        std::cout << "top level acceleration structure: " << drawCount << " instances, " << topLevelSizes.accelerationStructureSize / 1024
+            << " KB, built in " << topLevelTime.count() << " ms" << std::endl;
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        poolSize.descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &groundDescriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = groundDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &groundDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &groundDescriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        VkWriteDescriptorSetAccelerationStructureKHR accelerationStructureInfo{};
+        accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+        accelerationStructureInfo.accelerationStructureCount = 1;
+        accelerationStructureInfo.pAccelerationStructures = &topLevel;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.pNext = &accelerationStructureInfo;
+        descriptorWrite.dstSet = groundDescriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    void destroyAccelerationStructures() {
+        if (!rayQuery) {
+            return;
+        }
+        vkDestroyAccelerationStructure(device, topLevel, nullptr);
+        for (VkAccelerationStructureKHR bottomLevel : bottomLevels) {
+            vkDestroyAccelerationStructure(device, bottomLevel, nullptr);
+        }
+        bottomLevels.clear();
+        destroyDeviceBuffer(accelerationArena, topLevelBuffer);
+        destroyDeviceBuffer(accelerationArena, bottomLevelBuffer);
+        accelerationArena.destroy();
+    }
+
+    void createInstanceUpdate() {
+        if (options.instanceCount == 0) {
+            return;
+        }
+        instanceStart = std::chrono::steady_clock::now();
+
+        if (!options.cpuInstanceUpdate) {
+            QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+            uint32_t queueFamilyCount = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+            std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            uint32_t groupCount = (options.instanceCount + INSTANCE_WORKGROUP_SIZE - 1) / INSTANCE_WORKGROUP_SIZE;
+
+            if (!(queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+                std::cout << "the graphics queue cannot run compute shaders, updating instances on the CPU" << std::endl;
+            }
+            else if (groupCount > properties.limits.maxComputeWorkGroupCount[0]) {
+                throw std::runtime_error("too many instances for one dispatch!");
+            }
+            else {
+                computeInstanceUpdate = true;
+                instancePass = createComputePass(loadShader("instance_comp.spv", EMBEDDED_SHADER(instance_comp_spv)),
+                    { instanceBuffer.buffer }, sizeof(InstanceParams));
             }
         }
 
-        if (physicalDevice == VK_NULL_HANDLE) {
-            throw std::runtime_error("failed to find a suitable GPU!");
+        if (!computeInstanceUpdate) {
+            if (options.gpuCulling) {
+                throw std::runtime_error("GPU culling needs a graphics queue with compute support!");
+            }
+
+            // Prefer memory that is both device local and mappable (resizable
+            // BAR or unified memory), so the GPU does not fetch instances over PCIe.
+            void* data = createMappedBuffer((VkDeviceSize)options.instanceCount * sizeof(InstanceData) * options.framesInFlight,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hostInstanceBuffer, hostInstanceBufferMemory);
+            hostInstances = static_cast<InstanceData*>(data);
+        }
+
+        if (options.gpuCulling) {
+            createCulling();
         }
+
+        std::cout << "stress mode: " << options.instanceCount << " instances updated by "
+            << (computeInstanceUpdate ? "a compute shader" : "the CPU")
+            << (options.gpuCulling ? ", culled and drawn with vkCmdDrawIndexedIndirectCount" : "") << std::endl;
     }
 
-    void createLogicalDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    void createCulling() {
+        drawCommandBuffer = createDeviceBuffer(sizeof(VkDrawIndexedIndirectCommand) * options.instanceCount,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        drawCountBuffer = createDeviceBuffer(sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+        void* data = createMappedBuffer(sizeof(uint32_t) * options.framesInFlight, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, visibleCountBuffer, visibleCountBufferMemory);
+        visibleCounts = static_cast<uint32_t*>(data);
+        memset(visibleCounts, 0, sizeof(uint32_t) * options.framesInFlight);
 
-        float queuePriority = 1.0f;
-        for (uint32_t queueFamily : uniqueQueueFamilies) {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
+        cullPass = createComputePass(loadShader("cull_comp.spv", EMBEDDED_SHADER(cull_comp_spv)),
+            { instanceBuffer.buffer, drawCommandBuffer.buffer, drawCountBuffer.buffer }, sizeof(CullParams));
+    }
+
+    ComputePass createComputePass(const ShaderBinary& shaderCode, const std::vector<VkBuffer>& storageBuffers, uint32_t pushConstantSize) {
+        ComputePass pass;
+        uint32_t bufferCount = static_cast<uint32_t>(storageBuffers.size());
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings(bufferCount);
+        for (uint32_t i = 0; i < bufferCount; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = bufferCount;
+        layoutInfo.pBindings = bindings.data();
 
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &pass.descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
 
-        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = bufferCount;
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pass.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pass.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &pass.descriptorSetLayout;
 
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+        if (vkAllocateDescriptorSets(device, &allocInfo, &pass.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
         }
-        else {
-            createInfo.enabledLayerCount = 0;
+
+        std::vector<VkDescriptorBufferInfo> bufferInfos(bufferCount);
+        std::vector<VkWriteDescriptorSet> descriptorWrites(bufferCount);
+        for (uint32_t i = 0; i < bufferCount; i++) {
+            bufferInfos[i].buffer = storageBuffers[i];
+            bufferInfos[i].offset = 0;
+            bufferInfos[i].range = VK_WHOLE_SIZE;
+
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = pass.descriptorSet;
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
         }
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create logical device!");
+        vkUpdateDescriptorSets(device, bufferCount, descriptorWrites.data(), 0, nullptr);
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &pass.descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pass.pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
         }
 
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        VkShaderModule compShaderModule = createShaderModule(shaderCode);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = compShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pass.pipelineLayout;
+
+        if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pass.pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+
+        vkDestroyShaderModule(device, compShaderModule, nullptr);
+
+        return pass;
     }
 
-    void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+    void destroyComputePass(ComputePass& pass) {
+        vkDestroyPipeline(device, pass.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pass.pipelineLayout, nullptr);
+        vkDestroyDescriptorPool(device, pass.descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, pass.descriptorSetLayout, nullptr);
+        pass = ComputePass();
+    }
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+    // Persistently mapped host coherent buffer, in memory that also has the
+    // preferred properties when the device offers it
+    void* createMappedBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags preferred, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
 
-        uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        VkMemoryAllocateFlagsInfo flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+
+        VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? &flagsInfo : nullptr;
+        allocInfo.allocationSize = memRequirements.size;
+        try {
+            allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, required | preferred);
+        }
+        catch (const std::runtime_error&) {
+            allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, required);
         }
 
-        VkSwapchainCreateInfoKHR createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate buffer memory!");
+        }
 
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1;
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        vkBindBufferMemory(device, buffer, bufferMemory, 0);
 
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+        void* data;
+        if (vkMapMemory(device, bufferMemory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map buffer memory!");
+        }
+        return data;
+    }
 
-        if (indices.graphicsFamily != indices.presentFamily) {
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+    void destroyMappedBuffer(VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+        if (buffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkUnmapMemory(device, bufferMemory);
+        vkDestroyBuffer(device, buffer, nullptr);
+        vkFreeMemory(device, bufferMemory, nullptr);
+        buffer = VK_NULL_HANDLE;
+        bufferMemory = VK_NULL_HANDLE;
+    }
+
+    InstanceParams instanceParams() {
+        InstanceParams params;
+        params.count = options.instanceCount;
+        params.columns = static_cast<uint32_t>(std::ceil(std::sqrt((double)options.instanceCount)));
+        params.cell = 2.0f / params.columns;
+
+        std::chrono::duration<float> time = std::chrono::steady_clock::now() - instanceStart;
+        params.time = time.count();
+        params.scale = params.cell * 0.9f * (0.75f + 0.25f * std::sin(params.time));
+
+        return params;
+    }
+
+    void updateInstances() {
+        if (options.instanceCount == 0 || computeInstanceUpdate) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        // This frame slot's previous use has finished, so its slice is free
+        InstanceParams params = instanceParams();
+        InstanceData* out = hostInstances + (size_t)currentFrame * options.instanceCount;
+
+        if (recordThreads) {
+            recordThreads->run([&](uint32_t thread) {
+                uint32_t first = (uint32_t)((uint64_t)options.instanceCount * thread / options.threadCount);
+                uint32_t last = (uint32_t)((uint64_t)options.instanceCount * (thread + 1) / options.threadCount);
+                updateInstancesCpu(out, first, last, params);
+            });
         }
         else {
-            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            updateInstancesCpu(out, 0, options.instanceCount, params);
         }
 
-        createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        instanceUpdateTime += elapsed.count();
+    }
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create swap chain!");
+    void dispatchInstanceUpdate(VkCommandBuffer commandBuffer) {
+        InstanceParams params = instanceParams();
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, instancePass.pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, instancePass.pipelineLayout, 0, 1, &instancePass.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, instancePass.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+        vkCmdDispatch(commandBuffer, (options.instanceCount + INSTANCE_WORKGROUP_SIZE - 1) / INSTANCE_WORKGROUP_SIZE, 1, 1);
+    }
+
+    void recordInstanceUpdate(VkCommandBuffer commandBuffer) {
+        if (!computeInstanceUpdate) {
+            return;
+        }
+        if (options.gpuCulling) {
+            recordCulling(commandBuffer);
+            return;
         }
 
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+        uint32_t scope = gpuProfiler.begin(commandBuffer, "instance update");
 
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
+        // The previous frame may still be reading the instances (write after read)
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 0, nullptr);
+
+        dispatchInstanceUpdate(commandBuffer);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = instanceBuffer.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+            0, nullptr, 1, &barrier, 0, nullptr);
+
+        gpuProfiler.end(commandBuffer, scope);
     }
 
-    void createImageViews() {
-        swapChainImageViews.resize(swapChainImages.size());
+    // Slowly zooming and panning view over the instance grid, so culling has
+    // a changing share of the objects to reject
+    PushConstants cullCamera() {
+        std::chrono::duration<float> time = std::chrono::steady_clock::now() - instanceStart;
+        float t = time.count();
 
-        for (size_t i = 0; i < swapChainImages.size(); i++) {
-            VkImageViewCreateInfo createInfo{};
-            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            createInfo.image = swapChainImages[i];
-            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            createInfo.format = swapChainImageFormat;
-            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            createInfo.subresourceRange.baseMipLevel = 0;
-            createInfo.subresourceRange.levelCount = 1;
-            createInfo.subresourceRange.baseArrayLayer = 0;
-            createInfo.subresourceRange.layerCount = 1;
+        PushConstants view;
+        view.scale = 3.0f + 1.5f * std::sin(t * 0.25f);
+        view.offset[0] = -0.6f * std::cos(t * 0.2f) * view.scale;
+        view.offset[1] = -0.6f * std::sin(t * 0.3f) * view.scale;
 
-            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create image views!");
-            }
-        }
+        return view;
     }
 
-    void createRenderPass() {
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    void recordCulling(VkCommandBuffer commandBuffer) {
+        uint32_t scope = gpuProfiler.begin(commandBuffer, "instance update + cull");
 
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        // The previous frame may still be reading the instances, draw
+        // commands and draw count (write after read)
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 0, nullptr);
 
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
+        vkCmdFillBuffer(commandBuffer, drawCountBuffer.buffer, 0, sizeof(uint32_t), 0);
+        dispatchInstanceUpdate(commandBuffer);
 
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = 1;
-        renderPassInfo.pAttachments = &colorAttachment;
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create render pass!");
+        camera = cullCamera();
+
+        CullParams params;
+        params.offset[0] = camera.offset[0];
+        params.offset[1] = camera.offset[1];
+        params.scale = camera.scale;
+        params.count = options.instanceCount;
+        params.indexCount = static_cast<uint32_t>(indices.size());
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPass.pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPass.pipelineLayout, 0, 1, &cullPass.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPass.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+        vkCmdDispatch(commandBuffer, (options.instanceCount + INSTANCE_WORKGROUP_SIZE - 1) / INSTANCE_WORKGROUP_SIZE, 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+        gpuProfiler.end(commandBuffer, scope);
+    }
+
+    // After the draws: keep this frame's draw count for the statistics
+    void recordVisibleCountReadback(VkCommandBuffer commandBuffer) {
+        if (!options.gpuCulling) {
+            return;
         }
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = 0;
+        copyRegion.dstOffset = sizeof(uint32_t) * currentFrame;
+        copyRegion.size = sizeof(uint32_t);
+        vkCmdCopyBuffer(commandBuffer, drawCountBuffer.buffer, visibleCountBuffer, 1, &copyRegion);
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
     }
 
-    void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("hello_vert.spv");
-        auto fragShaderCode = readFile("hello_frag.spv");
+    VkCommandBuffer beginSingleTimeCommands() {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPools[0];
+        allocInfo.commandBufferCount = 1;
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        return commandBuffer;
+    }
+
+    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+        vkQueueWaitIdle(graphicsQueue);
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
+        vkFreeCommandBuffers(device, commandPools[0], 1, &commandBuffer);
+    }
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+    void createGpuProfiler() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        gpuProfiler.init(physicalDevice, device, indices.graphicsFamily.value(), options.framesInFlight, pipelineStatistics, options.profileFile);
+    }
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
+    // Lay the triangles out on a square grid covering the viewport
+    uint32_t gridColumns() {
+        return static_cast<uint32_t>(std::ceil(std::sqrt((double)options.drawCount)));
+    }
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+    PushConstants drawTransform(uint32_t draw, uint32_t columns) {
+        float cell = 2.0f / columns;
+
+        PushConstants constants;
+        constants.offset[0] = -1.0f + cell * (draw % columns + 0.5f);
+        constants.offset[1] = -1.0f + cell * (draw / columns + 0.5f);
+        constants.scale = std::min(1.0f, cell * 0.9f);
+        return constants;
+    }
 
+    void setViewport(VkCommandBuffer commandBuffer) {
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -501,166 +3170,379 @@ private:
         viewport.height = (float)swapChainExtent.height;
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
         VkRect2D scissor{};
         scissor.offset = { 0, 0 };
         scissor.extent = swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
 
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewport;
-        viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
+    // Shadows go on the ground before the triangles are drawn over it. The
+    // light circles the scene so that the shadows keep moving.
+    void recordShadows(VkCommandBuffer commandBuffer) {
+        if (options.shadows == SHADOWS_NONE) {
+            return;
+        }
+        uint32_t scope = gpuProfiler.begin(commandBuffer, "shadows");
+
+        std::chrono::duration<float> time = std::chrono::steady_clock::now() - shadowStart;
+        float angle = time.count() * 0.5f;
+        float light[3] = { 0.6f * std::cos(angle), 0.6f * std::sin(angle), 1.0f };
+        float length = std::sqrt(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+
+        ShadowConstants constants{};
+        constants.height = SHADOW_CASTER_HEIGHT;
+        constants.light[0] = light[0] / length;
+        constants.light[1] = light[1] / length;
+        constants.light[2] = light[2] / length;
+
+        setViewport(commandBuffer);
+
+        if (options.shadows == SHADOWS_RAY_QUERY) {
+            // One ray per ground pixel towards the light
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, groundPipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, groundPipelineLayout, 0, 1, &groundDescriptorSet, 0, nullptr);
+            vkCmdPushConstants(commandBuffer, groundPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                sizeof(constants), &constants);
+            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        }
+        else {
+            // Every triangle once more, flattened onto the ground
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
+
+            VkBuffer vertexBuffers[] = { vertexBuffer.buffer, instanceBuffer.buffer };
+            VkDeviceSize offsets[] = { 0, 0 };
+            vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+            uint32_t columns = gridColumns();
+            for (uint32_t draw = 0; draw < options.drawCount; draw++) {
+                PushConstants transform = drawTransform(draw, columns);
+                constants.offset[0] = transform.offset[0];
+                constants.offset[1] = transform.offset[1];
+                constants.scale = transform.scale;
+
+                vkCmdPushConstants(commandBuffer, shadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+                vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+            }
+        }
 
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
+        gpuProfiler.end(commandBuffer, scope);
+    }
 
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
+        VkBuffer vertexBuffers[] = { vertexBuffer.buffer, instanceBuffer.buffer };
+        VkDeviceSize offsets[] = { 0, 0 };
+        if (hostInstanceBuffer != VK_NULL_HANDLE) {
+            vertexBuffers[1] = hostInstanceBuffer;
+            offsets[1] = (VkDeviceSize)currentFrame * options.instanceCount * sizeof(InstanceData);
+        }
+        vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
 
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f;
-        colorBlending.blendConstants[1] = 0.0f;
-        colorBlending.blendConstants[2] = 0.0f;
-        colorBlending.blendConstants[3] = 0.0f;
+        setViewport(commandBuffer);
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        if (options.instanceCount > 0) {
+            // The instances carry their own grid position
+            if (drawCount == 0) {
+                return;
+            }
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(camera), &camera);
+            if (options.gpuCulling) {
+                // One command per visible instance, firstInstance selects it
+                vkCmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffer.buffer, 0, drawCountBuffer.buffer, 0,
+                    options.instanceCount, sizeof(VkDrawIndexedIndirectCommand));
+            }
+            else {
+                vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), options.instanceCount, 0, 0, 0);
+            }
+            return;
+        }
 
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
+        uint32_t columns = gridColumns();
+        for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; draw++) {
+            PushConstants constants = drawTransform(draw, columns);
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
         }
+    }
 
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    void recordCommandBuffer(uint32_t imageIndex) {
+        auto start = std::chrono::steady_clock::now();
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
+        VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
         }
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    }
+        gpuProfiler.beginFrame(commandBuffer, currentFrame);
 
-    void createFramebuffers() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
+        // Uploads queued since the last frame are copied before any draw
+        stagingBatches[currentFrame] = stagingRing.flush(commandBuffer);
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            VkImageView attachments[] = {
-                swapChainImageViews[i]
-            };
+        recordInstanceUpdate(commandBuffer);
+        uint32_t frameScope = gpuProfiler.begin(commandBuffer, "frame");
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = 1;
-            framebufferInfo.pAttachments = attachments;
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
+        if (dynamicRendering) {
+            recordDynamicRendering(commandBuffer, imageIndex);
+        }
+        else {
+            recordRenderPass(commandBuffer, imageIndex);
+        }
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
+        gpuProfiler.end(commandBuffer, frameScope);
+
+        recordVisibleCountReadback(commandBuffer);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
         }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        primaryRecordTime += elapsed.count();
     }
 
-    void createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    // The shadows need a ground to fall on
+    VkClearValue backgroundColor() {
+        if (options.shadows != SHADOWS_NONE) {
+            return { {{0.55f, 0.55f, 0.5f, 1.0f}} };
+        }
+        return { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+    }
 
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    void recordRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = swapChainExtent;
+
+        VkClearValue clearColor = backgroundColor();
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        // Queries stay outside the render pass: with secondary command buffer
+        // contents the primary may only execute commands inside it.
+        uint32_t scope = gpuProfiler.begin(commandBuffer, "render pass");
+        gpuProfiler.beginStatistics(commandBuffer);
+
+        if (!recordThreads) {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            recordShadows(commandBuffer);
+            recordDraws(commandBuffer, 0, options.drawCount);
+        }
+        else {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            recordSecondaryCommandBuffers(imageIndex);
+            vkCmdExecuteCommands(commandBuffer, options.threadCount, secondaryCommandBuffers[currentFrame].data());
+        }
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create command pool!");
+        vkCmdEndRenderPass(commandBuffer);
+
+        gpuProfiler.endStatistics(commandBuffer);
+        gpuProfiler.end(commandBuffer, scope);
+    }
+
+    void transitionSwapChainImage(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess) {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = srcStage;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstStageMask = dstStage;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[imageIndex];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = 1;
+        dependencyInfo.pImageMemoryBarriers = &barrier;
+
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+
+    void recordDynamicRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        // Only the color attachment output stage waits for the acquire semaphore,
+        // so the layout transition is scoped to exactly that stage.
+        transitionSwapChainImage(commandBuffer, imageIndex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+
+        VkRenderingAttachmentInfo colorAttachment{};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        colorAttachment.imageView = swapChainImageViews[imageIndex];
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.clearValue = backgroundColor();
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea.offset = { 0, 0 };
+        renderingInfo.renderArea.extent = swapChainExtent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+
+        uint32_t scope = gpuProfiler.begin(commandBuffer, "render pass");
+        gpuProfiler.beginStatistics(commandBuffer);
+
+        if (!recordThreads) {
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+            recordShadows(commandBuffer);
+            recordDraws(commandBuffer, 0, options.drawCount);
+        }
+        else {
+            renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+            recordSecondaryCommandBuffers(imageIndex);
+            vkCmdExecuteCommands(commandBuffer, options.threadCount, secondaryCommandBuffers[currentFrame].data());
         }
+
+        vkCmdEndRendering(commandBuffer);
+
+        gpuProfiler.endStatistics(commandBuffer);
+        gpuProfiler.end(commandBuffer, scope);
+
+        transitionSwapChainImage(commandBuffer, imageIndex, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
     }
 
-    void createCommandBuffers() {
-        commandBuffers.resize(swapChainFramebuffers.size());
+    void recordSecondaryCommandBuffers(uint32_t imageIndex) {
+        std::vector<VkResult> results(options.threadCount, VK_SUCCESS);
 
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+        recordThreads->run([&](uint32_t thread) {
+            auto start = std::chrono::steady_clock::now();
 
-        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate command buffers!");
-        }
+            // Split the draws evenly; every thread records one secondary buffer,
+            // even an empty one, so vkCmdExecuteCommands always gets the full set.
+            uint32_t first = options.drawCount * thread / options.threadCount;
+            uint32_t last = options.drawCount * (thread + 1) / options.threadCount;
+
+            VkCommandBuffer commandBuffer = secondaryCommandBuffers[currentFrame][thread];
+
+            VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{};
+            inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+            inheritanceRenderingInfo.colorAttachmentCount = 1;
+            inheritanceRenderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+            inheritanceRenderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+            VkCommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            if (dynamicRendering) {
+                inheritanceInfo.pNext = &inheritanceRenderingInfo;
+            }
+            else {
+                inheritanceInfo.renderPass = renderPass;
+                inheritanceInfo.subpass = 0;
+                inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            }
+            if (pipelineStatistics) {
+                inheritanceInfo.pipelineStatistics = PROFILER_PIPELINE_STATISTICS;
+            }
 
-        for (size_t i = 0; i < commandBuffers.size(); i++) {
             VkCommandBufferBeginInfo beginInfo{};
             beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-            if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-                throw std::runtime_error("failed to begin recording command buffer!");
+            results[thread] = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            if (results[thread] != VK_SUCCESS) {
+                return;
             }
 
-            VkRenderPassBeginInfo renderPassInfo{};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = renderPass;
-            renderPassInfo.framebuffer = swapChainFramebuffers[i];
-            renderPassInfo.renderArea.offset = { 0, 0 };
-            renderPassInfo.renderArea.extent = swapChainExtent;
+            recordDraws(commandBuffer, first, last - first);
 
-            VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-            renderPassInfo.clearValueCount = 1;
-            renderPassInfo.pClearValues = &clearColor;
+            results[thread] = vkEndCommandBuffer(commandBuffer);
 
-            vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            recordTimes[thread] += elapsed.count();
+        });
 
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        for (VkResult result : results) {
+            if (result != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+        }
+    }
+
+    void reportRecordTimes() {
+        statsFrames++;
 
-            vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - statsStart;
+        if (elapsed.count() < STATS_PERIOD) {
+            return;
+        }
 
-            vkCmdEndRenderPass(commandBuffers[i]);
+        std::cout << statsFrames / elapsed.count() << " fps, " << options.drawCount << " draws, record "
+            << primaryRecordTime / statsFrames << " ms/frame";
+        for (uint32_t t = 0; t < options.threadCount; t++) {
+            std::cout << (t == 0 ? " [" : ", ") << recordTimes[t] / statsFrames;
+            recordTimes[t] = 0.0;
+        }
+        std::cout << (options.threadCount > 0 ? "] ms per thread" : "") << std::endl;
 
-            if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to record command buffer!");
-            }
+        if (presentLatencyCount > 0) {
+            std::cout << "  " << options.framesInFlight << " frames in flight, CPU to present latency avg "
+                << presentLatencySum / presentLatencyCount << " ms, max " << presentLatencyMax << " ms" << std::endl;
         }
+        presentLatencySum = 0.0;
+        presentLatencyMax = 0.0;
+        presentLatencyCount = 0;
+
+        if (options.instanceCount > 0) {
+            std::cout << "  " << options.instanceCount << " instances, " << options.instanceCount * (statsFrames / elapsed.count()) / 1e6
+                << " M instances/s, CPU instance update " << instanceUpdateTime / statsFrames << " ms/frame" << std::endl;
+            instanceUpdateTime = 0.0;
+        }
+        if (options.gpuCulling) {
+            std::cout << "  GPU culling: " << visibleObjects / statsFrames << " of " << options.instanceCount
+                << " instances visible per frame" << std::endl;
+            visibleObjects = 0;
+        }
+        if (options.shadows == SHADOWS_RAY_QUERY) {
+            // The ground covers the viewport, so every pixel traces one ray;
+            // the GPU time of the "shadows" region below is what they cost
+            double rays = (double)swapChainExtent.width * swapChainExtent.height;
+            std::cout << "  ray query shadows: " << rays << " rays/frame, " << rays * (statsFrames / elapsed.count()) / 1e6 << " M rays/s, "
+                << options.drawCount << " bottom level acceleration structures" << std::endl;
+        }
+        else if (options.shadows == SHADOWS_PLANAR) {
+            std::cout << "  planar shadows: " << options.drawCount << " extra draws/frame" << std::endl;
+        }
+
+        gpuProfiler.report();
+
+        primaryRecordTime = 0.0;
+        statsFrames = 0;
+        statsStart = std::chrono::steady_clock::now();
     }
 
     void createSyncObjects() {
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+        imageAvailableSemaphores.resize(options.framesInFlight);
+        renderFinishedSemaphores.resize(options.framesInFlight);
         imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+        framesInFlightValues.resize(options.framesInFlight, 0);
+        imagesInFlightValues.resize(swapChainImages.size(), 0);
 
         VkSemaphoreCreateInfo semaphoreInfo{};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -669,17 +3551,58 @@ private:
         fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        for (size_t i = 0; i < options.framesInFlight; i++) {
             if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+
+        if (dynamicRendering) {
+            // One timeline semaphore replaces the per-frame fences: frame N signals
+            // value N, and waiting for a frame slot means waiting for its last value.
+            VkSemaphoreTypeCreateInfo timelineInfo{};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            timelineInfo.initialValue = 0;
+
+            VkSemaphoreCreateInfo timelineSemaphoreInfo{};
+            timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            timelineSemaphoreInfo.pNext = &timelineInfo;
+
+            if (vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &frameTimeline) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create timeline semaphore!");
+            }
+            return;
+        }
+
+        inFlightFences.resize(options.framesInFlight);
+        for (size_t i = 0; i < options.framesInFlight; i++) {
+            if (vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create synchronization objects for a frame!");
             }
         }
     }
 
+    void waitForTimeline(uint64_t value) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &frameTimeline;
+        waitInfo.pValues = &value;
+
+        vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+    }
+
     void drawFrame() {
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        auto frameStart = std::chrono::steady_clock::now();
+
+        if (dynamicRendering) {
+            waitForTimeline(framesInFlightValues[currentFrame]);
+        }
+        else {
+            vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        }
 
         uint32_t imageIndex;
         VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -692,32 +3615,41 @@ private:
             throw std::runtime_error("failed to acquire swap chain image!");
         }
 
-        if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-            vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+        if (dynamicRendering) {
+            waitForTimeline(imagesInFlightValues[imageIndex]);
+        }
+        else {
+            if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+                vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+            }
+            imagesInFlight[imageIndex] = inFlightFences[currentFrame];
         }
-        imagesInFlight[imageIndex] = inFlightFences[currentFrame];
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
 
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+        // The wait above guarantees the GPU is done with this frame's buffers
+        // and with the staging ring space its copies read from
+        stagingRing.retire(stagingBatches[currentFrame]);
+        vkResetCommandPool(device, commandPools[currentFrame], 0);
+        for (auto pool : workerCommandPools[currentFrame]) {
+            vkResetCommandPool(device, pool, 0);
+        }
 
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
+        // Draw count of this slot's previous frame, finished by now
+        if (options.gpuCulling) {
+            visibleObjects += visibleCounts[currentFrame];
+        }
 
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        updateInstances();
+        recordCommandBuffer(imageIndex);
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to submit draw command buffer!");
+        if (dynamicRendering) {
+            submitSynchronization2();
+            imagesInFlightValues[imageIndex] = frameTimelineValue;
         }
+        else {
+            submitLegacy();
+        }
+
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -731,8 +3663,22 @@ private:
 
         presentInfo.pImageIndices = &imageIndex;
 
+        VkPresentIdKHR presentIdInfo{};
+        presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        presentIdInfo.swapchainCount = 1;
+        presentIdInfo.pPresentIds = &presentId;
+        if (presentWait) {
+            presentId++;
+            presentInfo.pNext = &presentIdInfo;
+        }
+
         result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
+        if (presentWait && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+            pendingPresents.emplace_back(presentId, frameStart);
+            collectPresentLatency();
+        }
+
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
             framebufferResized = false;
             recreateSwapChain();
@@ -741,14 +3687,107 @@ private:
             throw std::runtime_error("failed to present swap chain image!");
         }
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        reportRecordTimes();
+
+        currentFrame = (currentFrame + 1) % options.framesInFlight;
+    }
+
+    void collectPresentLatency() {
+        // Presents complete in order. Poll the finished ones without blocking, but
+        // never let more than framesInFlight presents queue up: blocking on the
+        // oldest one both bounds the latency and measures it exactly.
+        while (!pendingPresents.empty()) {
+            bool block = pendingPresents.size() > options.framesInFlight;
+            VkResult result = vkWaitForPresent(device, swapChain, pendingPresents.front().first, block ? 1000000000ull : 0);
+            if (result == VK_TIMEOUT) {
+                break;
+            }
+            if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+                std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - pendingPresents.front().second;
+                lastPresentLatency = latency.count();
+                presentLatencySum += lastPresentLatency;
+                presentLatencyMax = std::max(presentLatencyMax, lastPresentLatency);
+                presentLatencyCount++;
+            }
+            pendingPresents.pop_front();
+        }
+    }
+
+    void submitLegacy() {
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
+        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+    }
+
+    void submitSynchronization2() {
+        VkSemaphoreSubmitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        waitInfo.semaphore = imageAvailableSemaphores[currentFrame];
+        waitInfo.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = commandBuffers[currentFrame];
+
+        frameTimelineValue++;
+
+        VkSemaphoreSubmitInfo signalInfos[2] = {};
+        signalInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signalInfos[0].semaphore = renderFinishedSemaphores[currentFrame];
+        signalInfos[0].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        signalInfos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signalInfos[1].semaphore = frameTimeline;
+        signalInfos[1].value = frameTimelineValue;
+        signalInfos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.waitSemaphoreInfoCount = 1;
+        submitInfo.pWaitSemaphoreInfos = &waitInfo;
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+        submitInfo.signalSemaphoreInfoCount = 2;
+        submitInfo.pSignalSemaphoreInfos = signalInfos;
+
+        if (vkQueueSubmit2(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+
+        framesInFlightValues[currentFrame] = frameTimelineValue;
+    }
+
+    ShaderBinary loadShader(const char* fileName, const uint32_t* embedded, size_t embeddedSize) {
+        // Embedded code wins unless a shader directory was given explicitly,
+        // so a default start does no file I/O for shaders at all.
+        if (embedded && options.shaderDir.empty()) {
+            return ShaderBinary(embedded, embeddedSize);
+        }
+        return ShaderBinary(shaderDirectory() + "/" + fileName);
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
+    VkShaderModule createShaderModule(const ShaderBinary& code) {
         VkShaderModuleCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
         createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        createInfo.pCode = code.code();
 
         VkShaderModule shaderModule;
         if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -768,7 +3807,25 @@ private:
         return availableFormats[0];
     }
 
+    static const char* presentModeName(VkPresentModeKHR presentMode) {
+        switch (presentMode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo_relaxed";
+        default: return "other";
+        }
+    }
+
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
+        if (options.presentMode) {
+            if (std::find(availablePresentModes.begin(), availablePresentModes.end(), *options.presentMode) != availablePresentModes.end()) {
+                return *options.presentMode;
+            }
+            std::cout << "requested present mode is not supported, falling back to FIFO" << std::endl;
+            return VK_PRESENT_MODE_FIFO_KHR;
+        }
+
         for (const auto& availablePresentMode : availablePresentModes) {
             if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
                 return availablePresentMode;
@@ -923,24 +3980,6 @@ private:
         return true;
     }
 
-    static std::vector<char> readFile(const std::string& filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to open file: " + filename);
-        }
-
-        size_t fileSize = (size_t)file.tellg();
-        std::vector<char> buffer(fileSize);
-
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-
-        file.close();
-
-        return buffer;
-    }
-
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
         std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
 
@@ -948,10 +3987,11 @@ private:
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
     HelloTriangleApplication app;
 
     try {
+        parseOptions(argc, argv);
         app.run();
     }
     catch (const std::exception& e) {
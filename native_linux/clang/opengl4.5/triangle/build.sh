@@ -1 +1 @@
-clang -o hello hello.c -lX11 -lGL
+clang -o hello hello.c -lX11 -lGL -lpthread
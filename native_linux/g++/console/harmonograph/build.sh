@@ -0,0 +1 @@
+g++ -O2 -march=native -ffp-contract=off -pthread -o hello hello.cpp
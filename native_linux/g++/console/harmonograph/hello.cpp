@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// CPU version of the DirectX 12 compute harmonograph
+// (native_win/cpp/directx12/compute/hello.hlsl): the same four damped
+// pendulums and hsv2rgb colors, written as structure-of-arrays streams by
+// SIMD kernels on every core. The widest instruction set compiled in and
+// supported by the CPU is used (build with -march=native or a
+// -march=x86-64-v3/v4 target to get AVX2/AVX-512); everything else falls back
+// to scalar code with the same approximations.
+
+#define DEFAULT_POINTS      500000      // VERTEX_COUNT of the DirectX 12 sample
+#define DEFAULT_FRAMES      100
+#define CHUNK_POINTS        4096        // unit of work handed to a thread
+#define STREAM_ALIGNMENT    64
+
+static const float PI = 3.14159265f;
+
+// Error bounds of the approximations below, measured against double
+// precision sin/cos/exp by --accuracy: absolute error of sin/cos for
+// |x| <= 8192 (the Cody-Waite reduction loses accuracy beyond that), and
+// relative error of exp on [-87, 0].
+static const float SINCOS_MAX_ERROR = 1.5e-7f;
+static const float SINCOS_MAX_ARGUMENT = 8192.0f;
+static const float EXP_MAX_REL_ERROR = 1.5e-7f;
+
+/* ---------------------------------------------------------------- */
+/* Parameters and output streams                                    */
+/* ---------------------------------------------------------------- */
+
+struct Pendulum {
+    float A, f, p, d;
+};
+
+struct Harmonograph {
+    Pendulum pendulum[4];
+};
+
+// One array per component; w and alpha are always 1 and not stored
+struct PointStreams {
+    uint32_t count;
+    float*   x;
+    float*   y;
+    float*   z;
+    float*   r;
+    float*   g;
+    float*   b;
+    float*   block;
+};
+
+static bool AllocStreams(PointStreams* streams, uint32_t count)
+{
+    // Every stream starts on a cache line, so full vectors never straddle one
+    size_t padded = ((size_t)count + 15) & ~(size_t)15;
+    size_t bytes = padded * 6 * sizeof(float);
+    streams->block = (float*)aligned_alloc(STREAM_ALIGNMENT, bytes);
+    if (!streams->block) {
+        return false;
+    }
+    memset(streams->block, 0, bytes);
+    streams->count = count;
+    streams->x = streams->block;
+    streams->y = streams->x + padded;
+    streams->z = streams->y + padded;
+    streams->r = streams->z + padded;
+    streams->g = streams->r + padded;
+    streams->b = streams->g + padded;
+    return true;
+}
+
+static void FreeStreams(PointStreams* streams)
+{
+    free(streams->block);
+    streams->block = NULL;
+}
+
+// Same random walk of the frequencies and phase as the DirectX 12 sample
+static void Animate(Harmonograph* h, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> step(0.0f, 1.0f / 40.0f);
+    for (int i = 0; i < 4; i++) {
+        h->pendulum[i].f = fmodf(h->pendulum[i].f + step(rng), 10.0f);
+    }
+    h->pendulum[0].p += 2.0f * PI * 0.5f / 360.0f;
+}
+
+/* ---------------------------------------------------------------- */
+/* Reference: the HLSL compute shader line by line, using libm      */
+/* ---------------------------------------------------------------- */
+
+static void Hsv2Rgb(float h, float s, float v, float rgb[3])
+{
+    float c = v * s;
+    float hp = h / 60.0f;
+    float x = c * (1.0f - fabsf(fmodf(hp, 2.0f) - 1.0f));
+
+    if (hp < 1.0f)      { rgb[0] = c;    rgb[1] = x;    rgb[2] = 0.0f; }
+    else if (hp < 2.0f) { rgb[0] = x;    rgb[1] = c;    rgb[2] = 0.0f; }
+    else if (hp < 3.0f) { rgb[0] = 0.0f; rgb[1] = c;    rgb[2] = x;    }
+    else if (hp < 4.0f) { rgb[0] = 0.0f; rgb[1] = x;    rgb[2] = c;    }
+    else if (hp < 5.0f) { rgb[0] = x;    rgb[1] = 0.0f; rgb[2] = c;    }
+    else                { rgb[0] = c;    rgb[1] = 0.0f; rgb[2] = x;    }
+
+    float m = v - c;
+    rgb[0] += m;
+    rgb[1] += m;
+    rgb[2] += m;
+}
+
+static void GenerateReference(const Harmonograph* h, PointStreams* out)
+{
+    const Pendulum* p = h->pendulum;
+    for (uint32_t idx = 0; idx < out->count; idx++) {
+        float t = (float)idx * 0.001f;
+
+        float a1 = p[0].f * t + PI * p[0].p, e1 = expf(-p[0].d * t);
+        float a2 = p[1].f * t + PI * p[1].p, e2 = expf(-p[1].d * t);
+        float a3 = p[2].f * t + PI * p[2].p, e3 = expf(-p[2].d * t);
+        float a4 = p[3].f * t + PI * p[3].p, e4 = expf(-p[3].d * t);
+
+        out->x[idx] = p[0].A * sinf(a1) * e1 + p[1].A * sinf(a2) * e2;
+        out->y[idx] = p[2].A * sinf(a3) * e3 + p[3].A * sinf(a4) * e4;
+        out->z[idx] = p[0].A * cosf(a1) * e1 + p[1].A * cosf(a2) * e2;
+
+        float hue = fmodf((t / 20.0f) * 360.0f, 360.0f);
+        float rgb[3];
+        Hsv2Rgb(hue, 1.0f, 1.0f, rgb);
+        out->r[idx] = rgb[0];
+        out->g[idx] = rgb[1];
+        out->b[idx] = rgb[2];
+    }
+}
+
+/* ---------------------------------------------------------------- */
+/* SIMD back ends                                                   */
+/*                                                                  */
+/* Each one wraps a vector of floats (F), of 32-bit integers (I)    */
+/* and a lane mask (M) in the handful of operations the kernel      */
+/* needs; the kernel itself is written once, as a template.         */
+/* ---------------------------------------------------------------- */
+
+struct ScalarOps {
+    typedef float   F;
+    typedef int32_t I;
+    typedef bool    M;
+    enum { WIDTH = 1 };
+
+    static F set(float v)                 { return v; }
+    static I seti(int32_t v)              { return v; }
+    static I indices(uint32_t first)      { return (int32_t)first; }
+    static void store(float* p, F v)      { *p = v; }
+    static F add(F a, F b)                { return a + b; }
+    static F sub(F a, F b)                { return a - b; }
+    static F mul(F a, F b)                { return a * b; }
+    static F div(F a, F b)                { return a / b; }
+    static F madd(F a, F b, F c)          { return a * b + c; }
+    static F min(F a, F b)                { return a < b ? a : b; }
+    static F max(F a, F b)                { return a > b ? a : b; }
+    static F abs(F a)                     { return fabsf(a); }
+    static F floor(F a)                   { return floorf(a); }
+    static I trunc(F a)                   { return (int32_t)a; }
+    static F tofloat(I a)                 { return (float)a; }
+    static I addi(I a, I b)               { return a + b; }
+    static I subi(I a, I b)               { return a - b; }
+    static I andi(I a, I b)               { return a & b; }
+    static I andnoti(I a, I b)            { return ~a & b; }
+    static I shl29(I a)                   { return (int32_t)((uint32_t)a << 29); }
+    static I shl23(I a)                   { return (int32_t)((uint32_t)a << 23); }
+    static M iszero(I a)                  { return a == 0; }
+    static F select(M m, F a, F b)        { return m ? a : b; }
+    static I bits(F a)                    { I i; memcpy(&i, &a, 4); return i; }
+    static F frombits(I a)                { F f; memcpy(&f, &a, 4); return f; }
+    static F xorbits(F a, I b)            { return frombits(bits(a) ^ b); }
+};
+
+#ifdef __SSE2__
+struct SseOps {
+    typedef __m128  F;
+    typedef __m128i I;
+    typedef __m128  M;
+    enum { WIDTH = 4 };
+
+    static F set(float v)                 { return _mm_set1_ps(v); }
+    static I seti(int32_t v)              { return _mm_set1_epi32(v); }
+    static I indices(uint32_t first)      { return _mm_add_epi32(_mm_set1_epi32((int32_t)first), _mm_setr_epi32(0, 1, 2, 3)); }
+    static void store(float* p, F v)      { _mm_store_ps(p, v); }
+    static F add(F a, F b)                { return _mm_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F min(F a, F b)                { return _mm_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm_max_ps(a, b); }
+    static F abs(F a)                     { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static F floor(F a) {
+        // SSE2 has no roundps: truncate, then step down where that rounded up
+        F t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    }
+    static I trunc(F a)                   { return _mm_cvttps_epi32(a); }
+    static F tofloat(I a)                 { return _mm_cvtepi32_ps(a); }
+    static I addi(I a, I b)               { return _mm_add_epi32(a, b); }
+    static I subi(I a, I b)               { return _mm_sub_epi32(a, b); }
+    static I andi(I a, I b)               { return _mm_and_si128(a, b); }
+    static I andnoti(I a, I b)            { return _mm_andnot_si128(a, b); }
+    static I shl29(I a)                   { return _mm_slli_epi32(a, 29); }
+    static I shl23(I a)                   { return _mm_slli_epi32(a, 23); }
+    static M iszero(I a)                  { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, _mm_setzero_si128())); }
+    static F select(M m, F a, F b)        { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static I bits(F a)                    { return _mm_castps_si128(a); }
+    static F frombits(I a)                { return _mm_castsi128_ps(a); }
+    static F xorbits(F a, I b)            { return _mm_xor_ps(a, _mm_castsi128_ps(b)); }
+};
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+struct Avx2Ops {
+    typedef __m256  F;
+    typedef __m256i I;
+    typedef __m256  M;
+    enum { WIDTH = 8 };
+
+    static F set(float v)                 { return _mm256_set1_ps(v); }
+    static I seti(int32_t v)              { return _mm256_set1_epi32(v); }
+    static I indices(uint32_t first)      { return _mm256_add_epi32(_mm256_set1_epi32((int32_t)first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+    static void store(float* p, F v)      { _mm256_store_ps(p, v); }
+    static F add(F a, F b)                { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm256_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm256_fmadd_ps(a, b, c); }
+    static F min(F a, F b)                { return _mm256_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm256_max_ps(a, b); }
+    static F abs(F a)                     { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F floor(F a)                   { return _mm256_floor_ps(a); }
+    static I trunc(F a)                   { return _mm256_cvttps_epi32(a); }
+    static F tofloat(I a)                 { return _mm256_cvtepi32_ps(a); }
+    static I addi(I a, I b)               { return _mm256_add_epi32(a, b); }
+    static I subi(I a, I b)               { return _mm256_sub_epi32(a, b); }
+    static I andi(I a, I b)               { return _mm256_and_si256(a, b); }
+    static I andnoti(I a, I b)            { return _mm256_andnot_si256(a, b); }
+    static I shl29(I a)                   { return _mm256_slli_epi32(a, 29); }
+    static I shl23(I a)                   { return _mm256_slli_epi32(a, 23); }
+    static M iszero(I a)                  { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_setzero_si256())); }
+    static F select(M m, F a, F b)        { return _mm256_blendv_ps(b, a, m); }
+    static I bits(F a)                    { return _mm256_castps_si256(a); }
+    static F frombits(I a)                { return _mm256_castsi256_ps(a); }
+    static F xorbits(F a, I b)            { return _mm256_xor_ps(a, _mm256_castsi256_ps(b)); }
+};
+#endif
+
+#ifdef __AVX512F__
+struct Avx512Ops {
+    typedef __m512    F;
+    typedef __m512i   I;
+    typedef __mmask16 M;
+    enum { WIDTH = 16 };
+
+    static F set(float v)                 { return _mm512_set1_ps(v); }
+    static I seti(int32_t v)              { return _mm512_set1_epi32(v); }
+    static I indices(uint32_t first) {
+        return _mm512_add_epi32(_mm512_set1_epi32((int32_t)first),
+            _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    }
+    static void store(float* p, F v)      { _mm512_store_ps(p, v); }
+    static F add(F a, F b)                { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm512_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm512_fmadd_ps(a, b, c); }
+    static F min(F a, F b)                { return _mm512_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm512_max_ps(a, b); }
+    static F abs(F a)                     { return _mm512_abs_ps(a); }
+    static F floor(F a)                   { return _mm512_floor_ps(a); }
+    static I trunc(F a)                   { return _mm512_cvttps_epi32(a); }
+    static F tofloat(I a)                 { return _mm512_cvtepi32_ps(a); }
+    static I addi(I a, I b)               { return _mm512_add_epi32(a, b); }
+    static I subi(I a, I b)               { return _mm512_sub_epi32(a, b); }
+    static I andi(I a, I b)               { return _mm512_and_si512(a, b); }
+    static I andnoti(I a, I b)            { return _mm512_andnot_si512(a, b); }
+    static I shl29(I a)                   { return _mm512_slli_epi32(a, 29); }
+    static I shl23(I a)                   { return _mm512_slli_epi32(a, 23); }
+    static M iszero(I a)                  { return _mm512_cmpeq_epi32_mask(a, _mm512_setzero_si512()); }
+    static F select(M m, F a, F b)        { return _mm512_mask_blend_ps(m, b, a); }
+    static I bits(F a)                    { return _mm512_castps_si512(a); }
+    static F frombits(I a)                { return _mm512_castsi512_ps(a); }
+    static F xorbits(F a, I b)            { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), b)); }
+};
+#endif
+
+/* ---------------------------------------------------------------- */
+/* Vector math                                                      */
+/* ---------------------------------------------------------------- */
+
+// sin and cos of the same argument (Cephes sinf/cosf): reduce to
+// |x| <= pi/4 with a three-part Cody-Waite split of pi/4, then one minimax
+// polynomial each for sin and cos; the octant picks which one and the sign.
+template <class V>
+static inline void SinCos(typename V::F x, typename V::F* s, typename V::F* c)
+{
+    typedef typename V::F F;
+    typedef typename V::I I;
+
+    I signSin = V::andi(V::bits(x), V::seti((int32_t)0x80000000));
+    x = V::abs(x);
+
+    // j = nearest even octant
+    I j = V::trunc(V::mul(x, V::set(1.27323954473516f)));
+    j = V::andi(V::addi(j, V::seti(1)), V::seti(~1));
+    F y = V::tofloat(j);
+
+    I swapSin = V::shl29(V::andi(j, V::seti(4)));
+    typename V::M polySin = V::iszero(V::andi(j, V::seti(2)));
+    I signCos = V::shl29(V::andnoti(V::subi(j, V::seti(2)), V::seti(4)));
+    signSin = V::andi(V::bits(V::xorbits(V::frombits(signSin), swapSin)), V::seti((int32_t)0x80000000));
+
+    x = V::madd(y, V::set(-0.78515625f), x);
+    x = V::madd(y, V::set(-2.4187564849853515625e-4f), x);
+    x = V::madd(y, V::set(-3.77489497744594108e-8f), x);
+
+    F z = V::mul(x, x);
+
+    F cosPoly = V::madd(V::set(2.443315711809948e-5f), z, V::set(-1.388731625493765e-3f));
+    cosPoly = V::madd(cosPoly, z, V::set(4.166664568298827e-2f));
+    cosPoly = V::mul(V::mul(cosPoly, z), z);
+    cosPoly = V::madd(z, V::set(-0.5f), cosPoly);
+    cosPoly = V::add(cosPoly, V::set(1.0f));
+
+    F sinPoly = V::madd(V::set(-1.9515295891e-4f), z, V::set(8.3321608736e-3f));
+    sinPoly = V::madd(sinPoly, z, V::set(-1.6666654611e-1f));
+    sinPoly = V::madd(V::mul(sinPoly, z), x, x);
+
+    *s = V::xorbits(V::select(polySin, sinPoly, cosPoly), signSin);
+    *c = V::xorbits(V::select(polySin, cosPoly, sinPoly), signCos);
+}
+
+// exp (Cephes expf): x = n ln2 + r with |r| <= ln2/2, a degree 6
+// polynomial for e^r, and 2^n assembled in the exponent bits. Inputs below
+// -87.3 are clamped, returning ~1e-38 instead of a denormal.
+template <class V>
+static inline typename V::F Exp(typename V::F x)
+{
+    typedef typename V::F F;
+
+    x = V::min(V::max(x, V::set(-87.3365447504f)), V::set(88.3762626647949f));
+
+    F n = V::floor(V::madd(x, V::set(1.44269504088896341f), V::set(0.5f)));
+    x = V::madd(n, V::set(-0.693359375f), x);
+    x = V::madd(n, V::set(2.12194440e-4f), x);
+
+    F z = V::mul(x, x);
+    F y = V::madd(V::set(1.9875691500e-4f), x, V::set(1.3981999507e-3f));
+    y = V::madd(y, x, V::set(8.3334519073e-3f));
+    y = V::madd(y, x, V::set(4.1665795894e-2f));
+    y = V::madd(y, x, V::set(1.6666665459e-1f));
+    y = V::madd(y, x, V::set(5.0000001201e-1f));
+    y = V::madd(y, z, x);
+    y = V::add(y, V::set(1.0f));
+
+    F scale = V::frombits(V::shl23(V::addi(V::trunc(n), V::seti(127))));
+    return V::mul(y, scale);
+}
+
+/* ---------------------------------------------------------------- */
+/* Kernel                                                           */
+/* ---------------------------------------------------------------- */
+
+// The arguments are formed with a separate multiply and add (and the build
+// uses -ffp-contract=off), so every back end and the reference see
+// bit-identical inputs to sin/cos/exp and only differ by the approximations.
+template <class V>
+static inline void GeneratePoints(const Harmonograph* h, PointStreams* out, uint32_t idx)
+{
+    typedef typename V::F F;
+
+    F t = V::mul(V::tofloat(V::indices(idx)), V::set(0.001f));
+
+    F s[4], c[4], e[4];
+    for (int i = 0; i < 4; i++) {
+        const Pendulum& p = h->pendulum[i];
+        F arg = V::add(V::mul(V::set(p.f), t), V::set(PI * p.p));
+        SinCos<V>(arg, &s[i], &c[i]);
+        e[i] = Exp<V>(V::mul(V::set(-p.d), t));
+    }
+
+    const Pendulum* p = h->pendulum;
+    F x = V::add(V::mul(V::mul(V::set(p[0].A), s[0]), e[0]), V::mul(V::mul(V::set(p[1].A), s[1]), e[1]));
+    F y = V::add(V::mul(V::mul(V::set(p[2].A), s[2]), e[2]), V::mul(V::mul(V::set(p[3].A), s[3]), e[3]));
+    F z = V::add(V::mul(V::mul(V::set(p[0].A), c[0]), e[0]), V::mul(V::mul(V::set(p[1].A), c[1]), e[1]));
+
+    // hsv2rgb with s = v = 1 without branches: each channel is a clamped
+    // triangle of the hue sector hp in [0, 6)
+    F v = V::mul(V::div(t, V::set(20.0f)), V::set(360.0f));
+    F hue = V::sub(v, V::mul(V::floor(V::div(v, V::set(360.0f))), V::set(360.0f)));
+    F hp = V::div(hue, V::set(60.0f));
+    F zero = V::set(0.0f), one = V::set(1.0f), two = V::set(2.0f);
+    F r = V::min(V::max(V::sub(V::abs(V::sub(hp, V::set(3.0f))), one), zero), one);
+    F g = V::min(V::max(V::sub(two, V::abs(V::sub(hp, two))), zero), one);
+    F b = V::min(V::max(V::sub(two, V::abs(V::sub(hp, V::set(4.0f)))), zero), one);
+
+    V::store(out->x + idx, x);
+    V::store(out->y + idx, y);
+    V::store(out->z + idx, z);
+    V::store(out->r + idx, r);
+    V::store(out->g + idx, g);
+    V::store(out->b + idx, b);
+}
+
+// Points [first, last): full vectors, then the tail one point at a time
+template <class V>
+static void GenerateRange(const Harmonograph* h, PointStreams* out, uint32_t first, uint32_t last)
+{
+    uint32_t idx = first;
+    for (; idx + V::WIDTH <= last; idx += V::WIDTH) {
+        GeneratePoints<V>(h, out, idx);
+    }
+    for (; idx < last; idx++) {
+        GeneratePoints<ScalarOps>(h, out, idx);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+/* Instruction set selection                                        */
+/* ---------------------------------------------------------------- */
+
+typedef void (*GenerateFunc)(const Harmonograph*, PointStreams*, uint32_t, uint32_t);
+
+struct Backend {
+    const char*  name;
+    int          width;
+    GenerateFunc generate;
+    bool         compiled;
+    bool         supported;
+};
+
+static std::vector<Backend> Backends()
+{
+    std::vector<Backend> backends;
+    backends.push_back({ "scalar", 1, GenerateRange<ScalarOps>, true, true });
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+#define CPU_SUPPORTS(feature) __builtin_cpu_supports(feature)
+#else
+#define CPU_SUPPORTS(feature) false
+#endif
+
+#ifdef __SSE2__
+    backends.push_back({ "sse2", 4, GenerateRange<SseOps>, true, (bool)CPU_SUPPORTS("sse2") });
+#else
+    backends.push_back({ "sse2", 4, NULL, false, false });
+#endif
+#if defined(__AVX2__) && defined(__FMA__)
+    backends.push_back({ "avx2", 8, GenerateRange<Avx2Ops>, true, CPU_SUPPORTS("avx2") && CPU_SUPPORTS("fma") });
+#else
+    backends.push_back({ "avx2", 8, NULL, false, false });
+#endif
+#ifdef __AVX512F__
+    backends.push_back({ "avx512", 16, GenerateRange<Avx512Ops>, true, (bool)CPU_SUPPORTS("avx512f") });
+#else
+    backends.push_back({ "avx512", 16, NULL, false, false });
+#endif
+
+    return backends;
+}
+
+/* ---------------------------------------------------------------- */
+/* Threads                                                          */
+/* ---------------------------------------------------------------- */
+
+// Runs the same job on every worker thread and waits for all of them
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threadCount) {
+        for (uint32_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        startCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void run(const std::function<void(uint32_t)>& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        currentJob = &job;
+        pending = static_cast<uint32_t>(workers.size());
+        generation++;
+        startCondition.notify_all();
+        doneCondition.wait(lock, [this] { return pending == 0; });
+        currentJob = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(uint32_t)>* currentJob = nullptr;
+    uint64_t generation = 0;
+    uint32_t pending = 0;
+    bool stop = false;
+
+    void workerLoop(uint32_t index) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(uint32_t)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [&] { return stop || generation != seen; });
+                if (stop) {
+                    return;
+                }
+                seen = generation;
+                job = currentJob;
+            }
+
+            (*job)(index);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    doneCondition.notify_one();
+                }
+            }
+        }
+    }
+};
+
+// Threads pull CHUNK_POINTS-sized chunks from a shared counter, so a thread
+// that gets descheduled does not hold up the others. Chunks are multiples of
+// every vector width, so only the last one has a scalar tail.
+static void Generate(const Backend& backend, const Harmonograph* h, PointStreams* out, ThreadPool* pool)
+{
+    uint32_t chunkCount = (out->count + CHUNK_POINTS - 1) / CHUNK_POINTS;
+    if (!pool) {
+        backend.generate(h, out, 0, out->count);
+        return;
+    }
+
+    std::atomic<uint32_t> next(0);
+    pool->run([&](uint32_t) {
+        uint32_t chunk;
+        while ((chunk = next.fetch_add(1, std::memory_order_relaxed)) < chunkCount) {
+            uint32_t first = chunk * CHUNK_POINTS;
+            uint32_t last = std::min(out->count, first + CHUNK_POINTS);
+            backend.generate(h, out, first, last);
+        }
+    });
+}
+
+/* ---------------------------------------------------------------- */
+/* Validation and benchmark                                         */
+/* ---------------------------------------------------------------- */
+
+static double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Largest argument passed to sin/cos for this point count and the current
+// parameters; past SINCOS_MAX_ARGUMENT the stated bound no longer holds.
+static float MaxArgument(const Harmonograph* h, uint32_t count)
+{
+    float tMax = (float)count * 0.001f;
+    float maxArg = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        const Pendulum& p = h->pendulum[i];
+        maxArg = std::max(maxArg, fabsf(p.f) * tMax + fabsf(PI * p.p));
+    }
+    return maxArg;
+}
+
+// Compare a back end against the libm reference. A position can be off by
+// its amplitudes times the sin/cos and exp errors plus a few roundings; the
+// branch-free hsv2rgb only differs by rounding.
+static bool Validate(const Backend& backend, const Harmonograph* h, const PointStreams* ref, PointStreams* out, ThreadPool* pool)
+{
+    Generate(backend, h, out, pool);
+
+    const Pendulum* p = h->pendulum;
+    float ampX = p[0].A + p[1].A;
+    float ampY = p[2].A + p[3].A;
+    float tolX = ampX * (SINCOS_MAX_ERROR + EXP_MAX_REL_ERROR + 4 * FLT_EPSILON);
+    float tolY = ampY * (SINCOS_MAX_ERROR + EXP_MAX_REL_ERROR + 4 * FLT_EPSILON);
+    float tolColor = 1e-5f;
+
+    float errPos = 0.0f, errColor = 0.0f;
+    bool ok = true;
+    for (uint32_t i = 0; i < ref->count; i++) {
+        float ex = fabsf(out->x[i] - ref->x[i]);
+        float ey = fabsf(out->y[i] - ref->y[i]);
+        float ez = fabsf(out->z[i] - ref->z[i]);
+        float ec = std::max(fabsf(out->r[i] - ref->r[i]), std::max(fabsf(out->g[i] - ref->g[i]), fabsf(out->b[i] - ref->b[i])));
+        if (!(ex <= tolX && ey <= tolY && ez <= tolX && ec <= tolColor)) {
+            if (ok) {
+                printf("  %s: point %u differs: (%g, %g, %g) vs (%g, %g, %g)\n", backend.name, i,
+                    out->x[i], out->y[i], out->z[i], ref->x[i], ref->y[i], ref->z[i]);
+            }
+            ok = false;
+        }
+        errPos = std::max(errPos, std::max(ex, std::max(ey, ez)));
+        errColor = std::max(errColor, ec);
+    }
+
+    printf("  %-7s max error: position %.3g (bound %.3g), color %.3g (bound %.3g)  %s\n", backend.name,
+        errPos, std::max(tolX, tolY), errColor, tolColor, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Dense sweep of the approximations against double precision, which is where
+// SINCOS_MAX_ERROR and EXP_MAX_REL_ERROR come from
+static void MeasureAccuracy()
+{
+    double errSin = 0.0, errExp = 0.0;
+    for (float x = -SINCOS_MAX_ARGUMENT; x <= SINCOS_MAX_ARGUMENT; x += 0.000731f * (1.0f + fabsf(x))) {
+        float s, c;
+        SinCos<ScalarOps>(x, &s, &c);
+        errSin = std::max(errSin, std::max(fabs(s - sin((double)x)), fabs(c - cos((double)x))));
+    }
+    for (float x = -87.0f; x <= 0.0f; x += 0.0001f) {
+        double e = exp((double)x);
+        errExp = std::max(errExp, fabs(Exp<ScalarOps>(x) - e) / e);
+    }
+    printf("sin/cos max abs error %.3g for |x| <= %g (bound %.3g)\n", errSin, SINCOS_MAX_ARGUMENT, SINCOS_MAX_ERROR);
+    printf("exp max rel error %.3g on [-87, 0] (bound %.3g)\n", errExp, EXP_MAX_REL_ERROR);
+}
+
+static void PrintUsage()
+{
+    printf("usage: hello [--points N] [--frames N] [--threads N] [--isa scalar|sse2|avx2|avx512|all] [--accuracy]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t pointCount = DEFAULT_POINTS;
+    uint32_t frameCount = DEFAULT_FRAMES;
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    const char* isa = NULL;
+    bool accuracy = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--points") == 0 && i + 1 < argc) {
+            pointCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = (uint32_t)std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            isa = argv[++i];
+        } else if (strcmp(argv[i], "--accuracy") == 0) {
+            accuracy = true;
+        } else {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (accuracy) {
+        MeasureAccuracy();
+    }
+
+    // The back ends to benchmark: the one asked for, all of them, or the widest available
+    std::vector<Backend> backends = Backends();
+    std::vector<Backend> selected;
+    for (const Backend& backend : backends) {
+        bool usable = backend.compiled && backend.supported;
+        if (isa && strcmp(isa, "all") != 0 && strcmp(isa, backend.name) == 0) {
+            if (!usable) {
+                printf("%s is %s\n", backend.name, backend.compiled ? "not supported by this CPU" : "not compiled in (see build.sh)");
+                return EXIT_FAILURE;
+            }
+            selected.push_back(backend);
+        } else if (isa && strcmp(isa, "all") == 0 && usable) {
+            selected.push_back(backend);
+        } else if (!isa && usable) {
+            selected.assign(1, backend);
+        }
+    }
+    if (selected.empty()) {
+        printf("unknown instruction set: %s\n", isa);
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    Harmonograph h = { {
+        { 50.0f, 2.0f, 1.0f / 16.0f, 0.02f },
+        { 50.0f, 2.0f, 3.0f / 2.0f, 0.0315f },
+        { 50.0f, 2.0f, 13.0f / 15.0f, 0.02f },
+        { 50.0f, 2.0f, 1.0f, 0.02f }
+    } };
+
+    PointStreams ref, out;
+    if (!AllocStreams(&ref, pointCount) || !AllocStreams(&out, pointCount)) {
+        printf("Failed to allocate %u points\n", pointCount);
+        return EXIT_FAILURE;
+    }
+
+    // A pool of one thread would only add hand-off latency
+    ThreadPool* pool = threadCount > 1 ? new ThreadPool(threadCount) : NULL;
+    printf("%u points, %u frames, %u threads, %u points per chunk\n", pointCount, frameCount, pool ? threadCount : 1, CHUNK_POINTS);
+
+    float maxArg = MaxArgument(&h, pointCount);
+    if (maxArg > SINCOS_MAX_ARGUMENT) {
+        printf("warning: sin/cos arguments reach %g, beyond the %g the error bound holds for\n", maxArg, SINCOS_MAX_ARGUMENT);
+    }
+
+    printf("validation against libm:\n");
+    GenerateReference(&h, &ref);
+    bool ok = true;
+    for (const Backend& backend : backends) {
+        if (backend.compiled && backend.supported) {
+            ok = Validate(backend, &h, &ref, &out, pool) && ok;
+        }
+    }
+
+    // The reference as the baseline for the speedups
+    double start = Now();
+    GenerateReference(&h, &ref);
+    double referenceTime = Now() - start;
+    printf("libm reference (1 thread): %.2f M points/s\n", pointCount / referenceTime / 1e6);
+
+    for (const Backend& backend : selected) {
+        std::mt19937 rng(1);
+        Harmonograph frame = h;
+        std::vector<double> times;
+        times.reserve(frameCount);
+
+        double benchStart = Now();
+        for (uint32_t i = 0; i < frameCount; i++) {
+            Animate(&frame, rng);
+            double frameStart = Now();
+            Generate(backend, &frame, &out, pool);
+            times.push_back((Now() - frameStart) * 1e3);
+        }
+        double seconds = Now() - benchStart;
+
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (double time : times) {
+            sum += time;
+        }
+        double avg = sum / times.size();
+        printf("%-7s %7.2f M points/s, %5.1fx the reference, ms/frame: min %.3f, avg %.3f, p99 %.3f, max %.3f\n",
+            backend.name, (double)pointCount * frameCount / seconds / 1e6, referenceTime * 1e3 / avg,
+            times.front(), avg, times[std::min(times.size() - 1, (size_t)ceil(times.size() * 0.99) - 1)], times.back());
+    }
+
+    delete pool;
+    FreeStreams(&out);
+    FreeStreams(&ref);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
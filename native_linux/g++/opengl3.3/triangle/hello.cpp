@@ -5,6 +5,17 @@
 #include <GL/glx.h>
 
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #define WINDOW_WIDTH    640
 #define WINDOW_HEIGHT   480
@@ -21,9 +32,19 @@
 #define GL_STATIC_DRAW                    0x88E4
 #define GL_FRAGMENT_SHADER                0x8B30
 #define GL_VERTEX_SHADER                  0x8B31
+#define GL_STREAM_READ                    0x88E1
+#define GL_PIXEL_PACK_BUFFER              0x88EB
+#define GL_MAP_READ_BIT                   0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_TIMEOUT_EXPIRED                0x911B
+#define GL_WAIT_FAILED                    0x911D
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
 
 typedef ptrdiff_t GLsizeiptr;
 typedef char GLchar;
+typedef ptrdiff_t GLintptr;
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
 
 typedef void (APIENTRYP PFNGLGENBUFFERSPROC) (GLsizei n, GLuint *buffers);
 typedef void (APIENTRYP PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
@@ -38,6 +59,12 @@ typedef void (APIENTRYP PFNGLUSEPROGRAMPROC) (GLuint program);
 typedef GLint (APIENTRYP PFNGLGETATTRIBLOCATIONPROC) (GLuint program, const GLchar *name);
 typedef void (APIENTRYP PFNGLENABLEVERTEXATTRIBARRAYPROC) (GLuint index);
 typedef void (APIENTRYP PFNGLVERTEXATTRIBPOINTERPROC) (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+typedef void (APIENTRYP PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint *buffers);
+typedef void *(APIENTRYP PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP PFNGLUNMAPBUFFERPROC) (GLenum target);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
 
 PFNGLGENBUFFERSPROC               glGenBuffers;
 PFNGLBINDBUFFERPROC               glBindBuffer;
@@ -52,6 +79,12 @@ PFNGLUSEPROGRAMPROC               glUseProgram;
 PFNGLGETATTRIBLOCATIONPROC        glGetAttribLocation;
 PFNGLENABLEVERTEXATTRIBARRAYPROC  glEnableVertexAttribArray;
 PFNGLVERTEXATTRIBPOINTERPROC      glVertexAttribPointer;
+PFNGLDELETEBUFFERSPROC            glDeleteBuffers;
+PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+PFNGLFENCESYNCPROC                glFenceSync;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+PFNGLDELETESYNCPROC               glDeleteSync;
 
 extern bool Initialize(int w, int h);
 extern void InitOpenGLFunc();
@@ -85,6 +118,425 @@ GLuint vbo[2];
 GLint posAttrib;
 GLint colAttrib;
 
+// Frame capture: glReadPixels goes into a ring of pixel pack buffers and is
+// only mapped CAPTURE_RING - 1 frames later, once its fence has signaled, so
+// the GPU never has to drain the pipeline. A worker thread writes the frames
+// to disk as a PPM stream (ffmpeg -f image2pipe -c:v ppm -i capture.ppm ...).
+#define CAPTURE_RING        3
+#define CAPTURE_QUEUE       8
+
+struct FrameCapture {
+    int            width;
+    int            height;
+    size_t         frameSize;
+    FILE*          fp;
+
+    GLuint         pbo[CAPTURE_RING];
+    GLsync         fence[CAPTURE_RING];
+    int            head;
+
+    std::thread    worker;
+    std::mutex     mutex;
+    std::condition_variable cond;
+    unsigned char* buffers[CAPTURE_QUEUE];
+    unsigned char* freeList[CAPTURE_QUEUE];
+    unsigned char* queue[CAPTURE_QUEUE];
+    int            freeCount;
+    int            queueHead;
+    int            queueCount;
+    bool           done;
+
+    // statistics
+    double         start;
+    int            frames;
+    int            written;
+    int            dropped;
+    bool           writeFailed;
+    int            fenceStalls;
+    int            encoderStalls;
+    int            maxQueued;
+};
+
+static double CaptureNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void FrameCaptureWorker(FrameCapture* capture)
+{
+    size_t rowSize = (size_t)capture->width * 3;
+    unsigned char* row = (unsigned char*)malloc(rowSize);
+
+    for (;;) {
+        unsigned char* pixels;
+        {
+            std::unique_lock<std::mutex> lock(capture->mutex);
+            capture->cond.wait(lock, [capture] { return capture->queueCount > 0 || capture->done; });
+            if (capture->queueCount == 0) {
+                break;
+            }
+            pixels = capture->queue[capture->queueHead];
+            capture->queueHead = (capture->queueHead + 1) % CAPTURE_QUEUE;
+            capture->queueCount--;
+        }
+
+        // RGBA bottom-up rows to RGB top-down; after a short write the rest
+        // of the stream is useless, so later frames are only counted as dropped
+        bool ok = !capture->writeFailed &&
+            fprintf(capture->fp, "P6\n%d %d\n255\n", capture->width, capture->height) > 0;
+        for (int y = capture->height - 1; ok && y >= 0; y--) {
+            const unsigned char* src = pixels + (size_t)y * capture->width * 4;
+            for (int x = 0; x < capture->width; x++) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            ok = fwrite(row, 1, rowSize, capture->fp) == rowSize;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(capture->mutex);
+            capture->freeList[capture->freeCount++] = pixels;
+            if (ok) {
+                capture->written++;
+            } else {
+                capture->writeFailed = true;
+                capture->dropped++;
+            }
+        }
+        capture->cond.notify_all();
+    }
+
+    free(row);
+}
+
+bool FrameCaptureInit(FrameCapture* capture, const char* path, int w, int h)
+{
+    capture->fp = fopen(path, "wb");
+    if (!capture->fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    capture->width = w;
+    capture->height = h;
+    capture->frameSize = (size_t)w * h * 4;
+    capture->head = 0;
+
+    glGenBuffers(CAPTURE_RING, capture->pbo);
+    for (int i = 0; i < CAPTURE_RING; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, capture->frameSize, NULL, GL_STREAM_READ);
+        capture->fence[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (int i = 0; i < CAPTURE_QUEUE; i++) {
+        capture->buffers[i] = (unsigned char*)malloc(capture->frameSize);
+        capture->freeList[i] = capture->buffers[i];
+    }
+    capture->freeCount = CAPTURE_QUEUE;
+    capture->queueHead = 0;
+    capture->queueCount = 0;
+    capture->done = false;
+
+    capture->start = CaptureNow();
+    capture->frames = 0;
+    capture->written = 0;
+    capture->dropped = 0;
+    capture->writeFailed = false;
+    capture->fenceStalls = 0;
+    capture->encoderStalls = 0;
+    capture->maxQueued = 0;
+
+    capture->worker = std::thread(FrameCaptureWorker, capture);
+
+    printf("Capturing to %s (%d PBOs, %d frames queued for the encoder)\n", path, CAPTURE_RING, CAPTURE_QUEUE);
+    return true;
+}
+
+static void FrameCaptureRetire(FrameCapture* capture, int slot)
+{
+    if (!capture->fence[slot]) {
+        return;
+    }
+
+    // Normally signaled long ago; waiting here means the GPU is more than
+    // CAPTURE_RING - 1 frames behind.
+    GLenum status = glClientWaitSync(capture->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        capture->fenceStalls++;
+        status = glClientWaitSync(capture->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    }
+    glDeleteSync(capture->fence[slot]);
+    capture->fence[slot] = 0;
+    if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->dropped++;
+        return;
+    }
+
+    unsigned char* pixels;
+    {
+        std::unique_lock<std::mutex> lock(capture->mutex);
+        if (capture->freeCount == 0) {
+            capture->encoderStalls++;
+            capture->cond.wait(lock, [capture] { return capture->freeCount > 0; });
+        }
+        pixels = capture->freeList[--capture->freeCount];
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[slot]);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture->frameSize, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(pixels, mapped, capture->frameSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        if (mapped) {
+            capture->queue[(capture->queueHead + capture->queueCount) % CAPTURE_QUEUE] = pixels;
+            capture->queueCount++;
+            if (capture->queueCount > capture->maxQueued) {
+                capture->maxQueued = capture->queueCount;
+            }
+        } else {
+            capture->freeList[capture->freeCount++] = pixels;
+            capture->dropped++;
+        }
+    }
+    capture->cond.notify_all();
+}
+
+// Call after Render() and before the swap, while the back buffer holds the frame.
+void FrameCaptureFrame(FrameCapture* capture)
+{
+    int slot = capture->head;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[slot]);
+    glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    capture->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    capture->frames++;
+
+    // The oldest slot holds frame N - (CAPTURE_RING - 1)
+    capture->head = (slot + 1) % CAPTURE_RING;
+    FrameCaptureRetire(capture, capture->head);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCaptureShutdown(FrameCapture* capture)
+{
+    for (int i = 1; i <= CAPTURE_RING; i++) {
+        FrameCaptureRetire(capture, (capture->head + i) % CAPTURE_RING);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->done = true;
+    }
+    capture->cond.notify_all();
+    capture->worker.join();
+
+    if (fclose(capture->fp) != 0) {
+        capture->writeFailed = true;
+    }
+
+    double elapsed = CaptureNow() - capture->start;
+    printf("Captured %d of %d frames in %.3f s: %.1f fps, %.1f MB/s\n",
+        capture->written, capture->frames, elapsed, capture->written / elapsed,
+        capture->written * (capture->frameSize / 1048576.0) / elapsed);
+    if (capture->dropped > 0) {
+        printf("Dropped %d frames (fence timeout, map failure or write error)\n", capture->dropped);
+    }
+    if (capture->writeFailed) {
+        printf("Writing the capture failed, the file is incomplete\n");
+    }
+    printf("Pipeline depth %d frames, fence stalls %d, encoder stalls %d, max encoder queue %d\n",
+        CAPTURE_RING - 1, capture->fenceStalls, capture->encoderStalls, capture->maxQueued);
+
+    glDeleteBuffers(CAPTURE_RING, capture->pbo);
+    for (int i = 0; i < CAPTURE_QUEUE; i++) {
+        free(capture->buffers[i]);
+    }
+}
+
+// Frame pacing: 0 = sync to vblank, otherwise a fixed rate in frames per second
+#define FRAME_RATE          0
+#define FRAME_STATS_PERIOD  5.0
+
+typedef void (*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+typedef int  (*glXSwapIntervalMESAProc)(unsigned int);
+typedef int  (*glXGetVideoSyncSGIProc)(unsigned int*);
+typedef int  (*glXWaitVideoSyncSGIProc)(int, int, unsigned int*);
+
+enum { PACE_FIXED, PACE_SWAP_CONTROL, PACE_VIDEO_SYNC };
+
+typedef struct {
+    int       mode;
+    long long interval;
+    long long deadline;
+    glXGetVideoSyncSGIProc  getVideoSync;
+    glXWaitVideoSyncSGIProc waitVideoSync;
+
+    // statistics for the current reporting period
+    long long periodStart;
+    long long cpuStart;
+    long long lastFrame;
+    double    lastDelta;
+    double    sumDelta;
+    double    sumJitter;
+    double    maxDelta;
+    int       frames;
+} FramePacer;
+
+static long long NowNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool HasGLXExtension(Display* display, int screenId, const char* name)
+{
+    const char* extensions = glXQueryExtensionsString(display, screenId);
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static void FramePacerInit(FramePacer* pacer, Display* display, int screenId, GLXDrawable drawable, int rate)
+{
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->mode = PACE_FIXED;
+    pacer->interval = 1000000000LL / (rate > 0 ? rate : 60);
+
+    if (rate <= 0) {
+        if (HasGLXExtension(display, screenId, "GLX_EXT_swap_control")) {
+            glXSwapIntervalEXTProc glXSwapIntervalEXT = (glXSwapIntervalEXTProc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+            if (glXSwapIntervalEXT) {
+                glXSwapIntervalEXT(display, drawable, 1);
+                pacer->mode = PACE_SWAP_CONTROL;
+            }
+        }
+        if (pacer->mode == PACE_FIXED && HasGLXExtension(display, screenId, "GLX_MESA_swap_control")) {
+            glXSwapIntervalMESAProc glXSwapIntervalMESA = (glXSwapIntervalMESAProc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+            if (glXSwapIntervalMESA && glXSwapIntervalMESA(1) == 0) {
+                pacer->mode = PACE_SWAP_CONTROL;
+            }
+        }
+        if (pacer->mode == PACE_FIXED && HasGLXExtension(display, screenId, "GLX_SGI_video_sync")) {
+            pacer->getVideoSync = (glXGetVideoSyncSGIProc)glXGetProcAddressARB((const GLubyte *)"glXGetVideoSyncSGI");
+            pacer->waitVideoSync = (glXWaitVideoSyncSGIProc)glXGetProcAddressARB((const GLubyte *)"glXWaitVideoSyncSGI");
+            if (pacer->getVideoSync && pacer->waitVideoSync) {
+                pacer->mode = PACE_VIDEO_SYNC;
+            }
+        }
+    }
+
+    pacer->deadline = pacer->periodStart = pacer->lastFrame = NowNs(CLOCK_MONOTONIC);
+    pacer->cpuStart = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+
+    if (pacer->mode == PACE_SWAP_CONTROL) {
+        printf("Frame pacing: vsync (swap control)\n");
+    } else if (pacer->mode == PACE_VIDEO_SYNC) {
+        printf("Frame pacing: vsync (SGI video sync)\n");
+    } else {
+        printf("Frame pacing: fixed %.2f fps\n", 1e9 / pacer->interval);
+    }
+}
+
+// Sleeps on the X connection until the next frame is due. Returns false when
+// woken early by X events, so the caller can dispatch them and wait again.
+static bool FramePacerWait(FramePacer* pacer, Display* display)
+{
+    if (pacer->mode == PACE_SWAP_CONTROL) {
+        // glXSwapBuffers throttles to the display refresh
+        return true;
+    }
+    if (pacer->mode == PACE_VIDEO_SYNC) {
+        // A divisor of 1 returns at once (every count is a multiple of 1);
+        // wait for the counter to change parity instead
+        unsigned int count;
+        pacer->getVideoSync(&count);
+        pacer->waitVideoSync(2, (count + 1) % 2, &count);
+        return true;
+    }
+
+    long long remaining = pacer->deadline - NowNs(CLOCK_MONOTONIC);
+    if (remaining >= 1000000) {
+        struct pollfd pfd;
+        pfd.fd = ConnectionNumber(display);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)(remaining / 1000000)) > 0) {
+            return false;
+        }
+    }
+
+    // poll() only has millisecond resolution, finish the last fraction on the clock
+    struct timespec ts;
+    ts.tv_sec = (time_t)(pacer->deadline / 1000000000LL);
+    ts.tv_nsec = (long)(pacer->deadline % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+    return true;
+}
+
+// Call once per presented frame.
+static void FramePacerTick(FramePacer* pacer)
+{
+    long long now = NowNs(CLOCK_MONOTONIC);
+    double delta = (now - pacer->lastFrame) / 1e6;
+    double jitter = delta - pacer->lastDelta;
+
+    if (pacer->frames > 0) {
+        pacer->sumJitter += jitter < 0.0 ? -jitter : jitter;
+    }
+    pacer->sumDelta += delta;
+    if (delta > pacer->maxDelta) {
+        pacer->maxDelta = delta;
+    }
+    pacer->lastDelta = delta;
+    pacer->lastFrame = now;
+    pacer->frames++;
+
+    // Advance on an absolute schedule so sleep overshoot never accumulates into
+    // drift; after a stall longer than a frame, resync instead of bursting.
+    pacer->deadline += pacer->interval;
+    if (now - pacer->deadline > pacer->interval) {
+        pacer->deadline = now + pacer->interval;
+    }
+
+    double elapsed = (now - pacer->periodStart) / 1e9;
+    if (elapsed >= FRAME_STATS_PERIOD) {
+        long long cpu = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+        printf("%.1f fps, frame %.2f ms (max %.2f ms), jitter %.3f ms, cpu %.1f%%\n",
+            pacer->frames / elapsed,
+            pacer->sumDelta / pacer->frames,
+            pacer->maxDelta,
+            pacer->frames > 1 ? pacer->sumJitter / (pacer->frames - 1) : 0.0,
+            100.0 * (cpu - pacer->cpuStart) / (now - pacer->periodStart));
+        fflush(stdout);
+
+        pacer->periodStart = now;
+        pacer->cpuStart = cpu;
+        pacer->sumDelta = 0.0;
+        pacer->sumJitter = 0.0;
+        pacer->maxDelta = 0.0;
+        pacer->frames = 0;
+    }
+}
+
 int main(int argc, char** argv) {
     Display* display;
     Window window;
@@ -181,9 +633,16 @@ int main(int argc, char** argv) {
     InitOpenGLFunc();
     
     InitShader();
-    
-    while (true) {
-        if (XPending(display) > 0) {
+
+    FrameCapture capture;
+    bool capturing = argc > 2 && FrameCaptureInit(&capture, argv[2], WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    FramePacer pacer;
+    FramePacerInit(&pacer, display, screenId, window, argc > 1 ? atoi(argv[1]) : FRAME_RATE);
+
+    bool running = true;
+    while (running) {
+        while (XPending(display) > 0) {
             XNextEvent(display, &ev);
             if (ev.type == Expose) {
                 XWindowAttributes attribs;
@@ -191,19 +650,31 @@ int main(int argc, char** argv) {
             }
             if (ev.type == ClientMessage) {
                 if (ev.xclient.data.l[0] == atomWmDeleteWindow) {
-                    break;
+                    running = false;
                 }
             }
             else if (ev.type == DestroyNotify) { 
-                break;
+                running = false;
             }
         }
 
+        if (!running || !FramePacerWait(&pacer, display)) {
+            continue;
+        }
+
         Render();
 
+        if (capturing) {
+            FrameCaptureFrame(&capture);
+        }
+
         glXSwapBuffers(display, window);
 
-        usleep((unsigned int)(1/60));
+        FramePacerTick(&pacer);
+    }
+
+    if (capturing) {
+        FrameCaptureShutdown(&capture);
     }
 
     glXDestroyContext(display, context);
@@ -236,6 +707,12 @@ void InitOpenGLFunc()
     glGetAttribLocation       = (PFNGLGETATTRIBLOCATIONPROC)       glXGetProcAddressARB((const GLubyte *)"glGetAttribLocation");
     glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC) glXGetProcAddressARB((const GLubyte *)"glEnableVertexAttribArray");
     glVertexAttribPointer     = (PFNGLVERTEXATTRIBPOINTERPROC)     glXGetProcAddressARB((const GLubyte *)"glVertexAttribPointer");
+    glDeleteBuffers           = (PFNGLDELETEBUFFERSPROC)          glXGetProcAddressARB((const GLubyte *)"glDeleteBuffers");
+    glMapBufferRange          = (PFNGLMAPBUFFERRANGEPROC)         glXGetProcAddressARB((const GLubyte *)"glMapBufferRange");
+    glUnmapBuffer             = (PFNGLUNMAPBUFFERPROC)            glXGetProcAddressARB((const GLubyte *)"glUnmapBuffer");
+    glFenceSync               = (PFNGLFENCESYNCPROC)              glXGetProcAddressARB((const GLubyte *)"glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC)         glXGetProcAddressARB((const GLubyte *)"glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC)             glXGetProcAddressARB((const GLubyte *)"glDeleteSync");
 }
 
 void InitShader()
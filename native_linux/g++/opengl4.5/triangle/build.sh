@@ -1 +1 @@
-g++ -o hello  hello.cpp -lX11 -lGL
+g++ -o hello  hello.cpp -lX11 -lGL -lpthread
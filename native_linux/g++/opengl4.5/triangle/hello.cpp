@@ -5,8 +5,18 @@
 #include <GL/glx.h>
 
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <time.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #define WINDOW_WIDTH    640
 #define WINDOW_HEIGHT   480
@@ -26,9 +36,23 @@
 #define GL_COMPILE_STATUS                 0x8B81
 #define GL_LINK_STATUS                    0x8B82
 #define GL_INFO_LOG_LENGTH                0x8B84
+#define GL_STREAM_READ                    0x88E1
+#define GL_PIXEL_PACK_BUFFER              0x88EB
+#define GL_MAP_READ_BIT                   0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_TIMEOUT_EXPIRED                0x911B
+#define GL_WAIT_FAILED                    0x911D
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+#define GL_ELEMENT_ARRAY_BUFFER           0x8893
+#define GL_DRAW_INDIRECT_BUFFER           0x8F3F
+#define GL_SHADER_STORAGE_BUFFER          0x90D2
+#define GL_NUM_EXTENSIONS                 0x821D
 
 typedef ptrdiff_t GLsizeiptr;
 typedef char GLchar;
+typedef ptrdiff_t GLintptr;
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
 
 typedef void (APIENTRYP PFNGLGENBUFFERSPROC) (GLsizei n, GLuint *buffers);
 typedef void (APIENTRYP PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
@@ -49,6 +73,20 @@ typedef void (APIENTRYP PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLin
 typedef void (APIENTRYP PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
 typedef void (APIENTRYP PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
 typedef void (APIENTRYP PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef void (APIENTRYP PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint *buffers);
+typedef void *(APIENTRYP PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP PFNGLUNMAPBUFFERPROC) (GLenum target);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+typedef void (APIENTRYP PFNGLDELETESHADERPROC) (GLuint shader);
+typedef void (APIENTRYP PFNGLDELETEPROGRAMPROC) (GLuint program);
+typedef const GLubyte *(APIENTRYP PFNGLGETSTRINGIPROC) (GLenum name, GLuint index);
+typedef GLint (APIENTRYP PFNGLGETUNIFORMLOCATIONPROC) (GLuint program, const GLchar *name);
+typedef void (APIENTRYP PFNGLUNIFORM1FPROC) (GLint location, GLfloat v0);
+typedef void (APIENTRYP PFNGLUNIFORM4FVPROC) (GLint location, GLsizei count, const GLfloat *value);
+typedef void (APIENTRYP PFNGLBINDBUFFERBASEPROC) (GLenum target, GLuint index, GLuint buffer);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC) (GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
 
 PFNGLGENBUFFERSPROC               glGenBuffers;
 PFNGLBINDBUFFERPROC               glBindBuffer;
@@ -69,6 +107,20 @@ PFNGLGETSHADERIVPROC             glGetShaderiv;
 PFNGLGETSHADERINFOLOGPROC        glGetShaderInfoLog;
 PFNGLGETPROGRAMIVPROC            glGetProgramiv;
 PFNGLGETPROGRAMINFOLOGPROC       glGetProgramInfoLog;
+PFNGLDELETEBUFFERSPROC            glDeleteBuffers;
+PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+PFNGLFENCESYNCPROC                glFenceSync;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+PFNGLDELETESYNCPROC               glDeleteSync;
+PFNGLDELETESHADERPROC             glDeleteShader;
+PFNGLDELETEPROGRAMPROC            glDeleteProgram;
+PFNGLGETSTRINGIPROC               glGetStringi;
+PFNGLGETUNIFORMLOCATIONPROC       glGetUniformLocation;
+PFNGLUNIFORM1FPROC                glUniform1f;
+PFNGLUNIFORM4FVPROC               glUniform4fv;
+PFNGLBINDBUFFERBASEPROC           glBindBufferBase;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
 
 extern bool Initialize(int w, int h);
 extern void InitOpenGLFunc();
@@ -76,6 +128,7 @@ extern void InitShader();
 extern bool Update(float deltaTime);
 extern void Render();
 extern void Shutdown();
+extern bool InitScene(int meshCount, bool naive);
 
 // Shader sources
 const GLchar* vertexSource =
@@ -102,7 +155,520 @@ GLuint vbo[2];
 GLint posAttrib;
 GLint colAttrib;
 
+// Scene mode: thousands of small distinct meshes on a grid, all of them in
+// one vertex buffer and one index buffer. The fast path draws every mesh with
+// a single glMultiDrawElementsIndirect; the vertex shader finds its mesh's
+// transform and color in a shader storage buffer indexed by gl_DrawIDARB. The
+// naive path sets the same data with glUniform and issues one glDrawElements
+// per mesh.
+const GLchar* sceneVertexSource =
+    "#version 450 core                                            \n"
+    "#extension GL_ARB_shader_draw_parameters : require           \n"
+    "layout(location = 0) in vec2 position;                       \n"
+    "struct Draw {                                                \n"
+    "  vec4 transform;  // offset.xy, scale, angle                \n"
+    "  vec4 color;                                                \n"
+    "};                                                           \n"
+    "layout(std430, binding = 0) readonly buffer Draws {          \n"
+    "  Draw draws[];                                              \n"
+    "};                                                           \n"
+    "uniform float time;                                          \n"
+    "out vec4 vColor;                                             \n"
+    "void main()                                                  \n"
+    "{                                                            \n"
+    "  Draw draw = draws[gl_DrawIDARB];                           \n"
+    "  float a = draw.transform.w + time;                         \n"
+    "  vec2 p = mat2(cos(a), sin(a), -sin(a), cos(a)) * position; \n"
+    "  gl_Position = vec4(p * draw.transform.z + draw.transform.xy, 0.0, 1.0); \n"
+    "  vColor = draw.color;                                       \n"
+    "}                                                            \n";
+const GLchar* naiveVertexSource =
+    "#version 450 core                                            \n"
+    "layout(location = 0) in vec2 position;                       \n"
+    "uniform vec4 transform;  // offset.xy, scale, angle          \n"
+    "uniform vec4 color;                                          \n"
+    "uniform float time;                                          \n"
+    "out vec4 vColor;                                             \n"
+    "void main()                                                  \n"
+    "{                                                            \n"
+    "  float a = transform.w + time;                              \n"
+    "  vec2 p = mat2(cos(a), sin(a), -sin(a), cos(a)) * position; \n"
+    "  gl_Position = vec4(p * transform.z + transform.xy, 0.0, 1.0); \n"
+    "  vColor = color;                                            \n"
+    "}                                                            \n";
+
+#define SCENE_STATS_PERIOD  5.0
+
+struct SceneDraw {
+    GLfloat transform[4];
+    GLfloat color[4];
+};
+
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+struct Scene {
+    int          meshCount;
+    int          triangles;
+    bool         naive;
+    GLuint       program;
+    GLint        timeLocation;
+    GLint        transformLocation;
+    GLint        colorLocation;
+    GLuint       vao;
+    GLuint       buffers[4];     // vertices, indices, draws, indirect commands
+    SceneDraw*   draws;          // naive: the uniforms of every mesh
+    DrawElementsIndirectCommand* commands;
+    double       start;
+
+    // statistics for the current reporting period
+    double       periodStart;
+    double       renderTime;
+    int          frames;
+};
+
+Scene scene;
+
+// Frame capture: glReadPixels goes into a ring of pixel pack buffers and is
+// only mapped CAPTURE_RING - 1 frames later, once its fence has signaled, so
+// the GPU never has to drain the pipeline. A worker thread writes the frames
+// to disk as a PPM stream (ffmpeg -f image2pipe -c:v ppm -i capture.ppm ...).
+#define CAPTURE_RING        3
+#define CAPTURE_QUEUE       8
+
+struct FrameCapture {
+    int            width;
+    int            height;
+    size_t         frameSize;
+    FILE*          fp;
+
+    GLuint         pbo[CAPTURE_RING];
+    GLsync         fence[CAPTURE_RING];
+    int            head;
+
+    std::thread    worker;
+    std::mutex     mutex;
+    std::condition_variable cond;
+    unsigned char* buffers[CAPTURE_QUEUE];
+    unsigned char* freeList[CAPTURE_QUEUE];
+    unsigned char* queue[CAPTURE_QUEUE];
+    int            freeCount;
+    int            queueHead;
+    int            queueCount;
+    bool           done;
+
+    // statistics
+    double         start;
+    int            frames;
+    int            written;
+    int            dropped;
+    bool           writeFailed;
+    int            fenceStalls;
+    int            encoderStalls;
+    int            maxQueued;
+};
+
+static double CaptureNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void FrameCaptureWorker(FrameCapture* capture)
+{
+    size_t rowSize = (size_t)capture->width * 3;
+    unsigned char* row = (unsigned char*)malloc(rowSize);
+
+    for (;;) {
+        unsigned char* pixels;
+        {
+            std::unique_lock<std::mutex> lock(capture->mutex);
+            capture->cond.wait(lock, [capture] { return capture->queueCount > 0 || capture->done; });
+            if (capture->queueCount == 0) {
+                break;
+            }
+            pixels = capture->queue[capture->queueHead];
+            capture->queueHead = (capture->queueHead + 1) % CAPTURE_QUEUE;
+            capture->queueCount--;
+        }
+
+        // RGBA bottom-up rows to RGB top-down; after a short write the rest
+        // of the stream is useless, so later frames are only counted as dropped
+        bool ok = !capture->writeFailed &&
+            fprintf(capture->fp, "P6\n%d %d\n255\n", capture->width, capture->height) > 0;
+        for (int y = capture->height - 1; ok && y >= 0; y--) {
+            const unsigned char* src = pixels + (size_t)y * capture->width * 4;
+            for (int x = 0; x < capture->width; x++) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            ok = fwrite(row, 1, rowSize, capture->fp) == rowSize;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(capture->mutex);
+            capture->freeList[capture->freeCount++] = pixels;
+            if (ok) {
+                capture->written++;
+            } else {
+                capture->writeFailed = true;
+                capture->dropped++;
+            }
+        }
+        capture->cond.notify_all();
+    }
+
+    free(row);
+}
+
+bool FrameCaptureInit(FrameCapture* capture, const char* path, int w, int h)
+{
+    capture->fp = fopen(path, "wb");
+    if (!capture->fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    capture->width = w;
+    capture->height = h;
+    capture->frameSize = (size_t)w * h * 4;
+    capture->head = 0;
+
+    glGenBuffers(CAPTURE_RING, capture->pbo);
+    for (int i = 0; i < CAPTURE_RING; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, capture->frameSize, NULL, GL_STREAM_READ);
+        capture->fence[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (int i = 0; i < CAPTURE_QUEUE; i++) {
+        capture->buffers[i] = (unsigned char*)malloc(capture->frameSize);
+        capture->freeList[i] = capture->buffers[i];
+    }
+    capture->freeCount = CAPTURE_QUEUE;
+    capture->queueHead = 0;
+    capture->queueCount = 0;
+    capture->done = false;
+
+    capture->start = CaptureNow();
+    capture->frames = 0;
+    capture->written = 0;
+    capture->dropped = 0;
+    capture->writeFailed = false;
+    capture->fenceStalls = 0;
+    capture->encoderStalls = 0;
+    capture->maxQueued = 0;
+
+    capture->worker = std::thread(FrameCaptureWorker, capture);
+
+    printf("Capturing to %s (%d PBOs, %d frames queued for the encoder)\n", path, CAPTURE_RING, CAPTURE_QUEUE);
+    return true;
+}
+
+static void FrameCaptureRetire(FrameCapture* capture, int slot)
+{
+    if (!capture->fence[slot]) {
+        return;
+    }
+
+    // Normally signaled long ago; waiting here means the GPU is more than
+    // CAPTURE_RING - 1 frames behind.
+    GLenum status = glClientWaitSync(capture->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        capture->fenceStalls++;
+        status = glClientWaitSync(capture->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    }
+    glDeleteSync(capture->fence[slot]);
+    capture->fence[slot] = 0;
+    if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->dropped++;
+        return;
+    }
+
+    unsigned char* pixels;
+    {
+        std::unique_lock<std::mutex> lock(capture->mutex);
+        if (capture->freeCount == 0) {
+            capture->encoderStalls++;
+            capture->cond.wait(lock, [capture] { return capture->freeCount > 0; });
+        }
+        pixels = capture->freeList[--capture->freeCount];
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[slot]);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture->frameSize, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(pixels, mapped, capture->frameSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        if (mapped) {
+            capture->queue[(capture->queueHead + capture->queueCount) % CAPTURE_QUEUE] = pixels;
+            capture->queueCount++;
+            if (capture->queueCount > capture->maxQueued) {
+                capture->maxQueued = capture->queueCount;
+            }
+        } else {
+            capture->freeList[capture->freeCount++] = pixels;
+            capture->dropped++;
+        }
+    }
+    capture->cond.notify_all();
+}
+
+// Call after Render() and before the swap, while the back buffer holds the frame.
+void FrameCaptureFrame(FrameCapture* capture)
+{
+    int slot = capture->head;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[slot]);
+    glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    capture->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    capture->frames++;
+
+    // The oldest slot holds frame N - (CAPTURE_RING - 1)
+    capture->head = (slot + 1) % CAPTURE_RING;
+    FrameCaptureRetire(capture, capture->head);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCaptureShutdown(FrameCapture* capture)
+{
+    for (int i = 1; i <= CAPTURE_RING; i++) {
+        FrameCaptureRetire(capture, (capture->head + i) % CAPTURE_RING);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->done = true;
+    }
+    capture->cond.notify_all();
+    capture->worker.join();
+
+    if (fclose(capture->fp) != 0) {
+        capture->writeFailed = true;
+    }
+
+    double elapsed = CaptureNow() - capture->start;
+    printf("Captured %d of %d frames in %.3f s: %.1f fps, %.1f MB/s\n",
+        capture->written, capture->frames, elapsed, capture->written / elapsed,
+        capture->written * (capture->frameSize / 1048576.0) / elapsed);
+    if (capture->dropped > 0) {
+        printf("Dropped %d frames (fence timeout, map failure or write error)\n", capture->dropped);
+    }
+    if (capture->writeFailed) {
+        printf("Writing the capture failed, the file is incomplete\n");
+    }
+    printf("Pipeline depth %d frames, fence stalls %d, encoder stalls %d, max encoder queue %d\n",
+        CAPTURE_RING - 1, capture->fenceStalls, capture->encoderStalls, capture->maxQueued);
+
+    glDeleteBuffers(CAPTURE_RING, capture->pbo);
+    for (int i = 0; i < CAPTURE_QUEUE; i++) {
+        free(capture->buffers[i]);
+    }
+}
+
+// Frame pacing: 0 = sync to vblank, otherwise a fixed rate in frames per second
+#define FRAME_RATE          0
+#define FRAME_STATS_PERIOD  5.0
+
+typedef void (*glXSwapIntervalEXTProc)(Display*, GLXDrawable, int);
+typedef int  (*glXSwapIntervalMESAProc)(unsigned int);
+typedef int  (*glXGetVideoSyncSGIProc)(unsigned int*);
+typedef int  (*glXWaitVideoSyncSGIProc)(int, int, unsigned int*);
+
+enum { PACE_FIXED, PACE_SWAP_CONTROL, PACE_VIDEO_SYNC };
+
+typedef struct {
+    int       mode;
+    long long interval;
+    long long deadline;
+    glXGetVideoSyncSGIProc  getVideoSync;
+    glXWaitVideoSyncSGIProc waitVideoSync;
+
+    // statistics for the current reporting period
+    long long periodStart;
+    long long cpuStart;
+    long long lastFrame;
+    double    lastDelta;
+    double    sumDelta;
+    double    sumJitter;
+    double    maxDelta;
+    int       frames;
+} FramePacer;
+
+static long long NowNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static bool HasGLXExtension(Display* display, int screenId, const char* name)
+{
+    const char* extensions = glXQueryExtensionsString(display, screenId);
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static void FramePacerInit(FramePacer* pacer, Display* display, int screenId, GLXDrawable drawable, int rate)
+{
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->mode = PACE_FIXED;
+    pacer->interval = 1000000000LL / (rate > 0 ? rate : 60);
+
+    if (rate <= 0) {
+        if (HasGLXExtension(display, screenId, "GLX_EXT_swap_control")) {
+            glXSwapIntervalEXTProc glXSwapIntervalEXT = (glXSwapIntervalEXTProc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+            if (glXSwapIntervalEXT) {
+                glXSwapIntervalEXT(display, drawable, 1);
+                pacer->mode = PACE_SWAP_CONTROL;
+            }
+        }
+        if (pacer->mode == PACE_FIXED && HasGLXExtension(display, screenId, "GLX_MESA_swap_control")) {
+            glXSwapIntervalMESAProc glXSwapIntervalMESA = (glXSwapIntervalMESAProc)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+            if (glXSwapIntervalMESA && glXSwapIntervalMESA(1) == 0) {
+                pacer->mode = PACE_SWAP_CONTROL;
+            }
+        }
+        if (pacer->mode == PACE_FIXED && HasGLXExtension(display, screenId, "GLX_SGI_video_sync")) {
+            pacer->getVideoSync = (glXGetVideoSyncSGIProc)glXGetProcAddressARB((const GLubyte *)"glXGetVideoSyncSGI");
+            pacer->waitVideoSync = (glXWaitVideoSyncSGIProc)glXGetProcAddressARB((const GLubyte *)"glXWaitVideoSyncSGI");
+            if (pacer->getVideoSync && pacer->waitVideoSync) {
+                pacer->mode = PACE_VIDEO_SYNC;
+            }
+        }
+    }
+
+    pacer->deadline = pacer->periodStart = pacer->lastFrame = NowNs(CLOCK_MONOTONIC);
+    pacer->cpuStart = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+
+    if (pacer->mode == PACE_SWAP_CONTROL) {
+        printf("Frame pacing: vsync (swap control)\n");
+    } else if (pacer->mode == PACE_VIDEO_SYNC) {
+        printf("Frame pacing: vsync (SGI video sync)\n");
+    } else {
+        printf("Frame pacing: fixed %.2f fps\n", 1e9 / pacer->interval);
+    }
+}
+
+// Sleeps on the X connection until the next frame is due. Returns false when
+// woken early by X events, so the caller can dispatch them and wait again.
+static bool FramePacerWait(FramePacer* pacer, Display* display)
+{
+    if (pacer->mode == PACE_SWAP_CONTROL) {
+        // glXSwapBuffers throttles to the display refresh
+        return true;
+    }
+    if (pacer->mode == PACE_VIDEO_SYNC) {
+        // A divisor of 1 returns at once (every count is a multiple of 1);
+        // wait for the counter to change parity instead
+        unsigned int count;
+        pacer->getVideoSync(&count);
+        pacer->waitVideoSync(2, (count + 1) % 2, &count);
+        return true;
+    }
+
+    long long remaining = pacer->deadline - NowNs(CLOCK_MONOTONIC);
+    if (remaining >= 1000000) {
+        struct pollfd pfd;
+        pfd.fd = ConnectionNumber(display);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)(remaining / 1000000)) > 0) {
+            return false;
+        }
+    }
+
+    // poll() only has millisecond resolution, finish the last fraction on the clock
+    struct timespec ts;
+    ts.tv_sec = (time_t)(pacer->deadline / 1000000000LL);
+    ts.tv_nsec = (long)(pacer->deadline % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+    return true;
+}
+
+// Call once per presented frame.
+static void FramePacerTick(FramePacer* pacer)
+{
+    long long now = NowNs(CLOCK_MONOTONIC);
+    double delta = (now - pacer->lastFrame) / 1e6;
+    double jitter = delta - pacer->lastDelta;
+
+    if (pacer->frames > 0) {
+        pacer->sumJitter += jitter < 0.0 ? -jitter : jitter;
+    }
+    pacer->sumDelta += delta;
+    if (delta > pacer->maxDelta) {
+        pacer->maxDelta = delta;
+    }
+    pacer->lastDelta = delta;
+    pacer->lastFrame = now;
+    pacer->frames++;
+
+    // Advance on an absolute schedule so sleep overshoot never accumulates into
+    // drift; after a stall longer than a frame, resync instead of bursting.
+    pacer->deadline += pacer->interval;
+    if (now - pacer->deadline > pacer->interval) {
+        pacer->deadline = now + pacer->interval;
+    }
+
+    double elapsed = (now - pacer->periodStart) / 1e9;
+    if (elapsed >= FRAME_STATS_PERIOD) {
+        long long cpu = NowNs(CLOCK_PROCESS_CPUTIME_ID);
+        printf("%.1f fps, frame %.2f ms (max %.2f ms), jitter %.3f ms, cpu %.1f%%\n",
+            pacer->frames / elapsed,
+            pacer->sumDelta / pacer->frames,
+            pacer->maxDelta,
+            pacer->frames > 1 ? pacer->sumJitter / (pacer->frames - 1) : 0.0,
+            100.0 * (cpu - pacer->cpuStart) / (now - pacer->periodStart));
+        fflush(stdout);
+
+        pacer->periodStart = now;
+        pacer->cpuStart = cpu;
+        pacer->sumDelta = 0.0;
+        pacer->sumJitter = 0.0;
+        pacer->maxDelta = 0.0;
+        pacer->frames = 0;
+    }
+}
+
 int main(int argc, char** argv) {
+    // --scene and --naive may go anywhere; everything else is positional
+    int sceneMeshes = 0;
+    bool sceneNaive = false;
+    const char* positional[2] = { NULL, NULL };
+    int positionalCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            sceneMeshes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--naive") == 0) {
+            sceneNaive = true;
+        } else if (positionalCount < 2) {
+            positional[positionalCount++] = argv[i];
+        }
+    }
+
     Display* display;
     Window window;
     Screen* screen;
@@ -199,9 +765,20 @@ int main(int argc, char** argv) {
     InitOpenGLFunc();
     
     InitShader();
-    
-    while (true) {
-        if (XPending(display) > 0) {
+
+    if (sceneMeshes > 0 && !InitScene(sceneMeshes, sceneNaive)) {
+        sceneMeshes = 0;
+    }
+
+    FrameCapture capture;
+    bool capturing = positional[1] && FrameCaptureInit(&capture, positional[1], WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    FramePacer pacer;
+    FramePacerInit(&pacer, display, screenId, window, positional[0] ? atoi(positional[0]) : FRAME_RATE);
+
+    bool running = true;
+    while (running) {
+        while (XPending(display) > 0) {
             XNextEvent(display, &ev);
             if (ev.type == Expose) {
                 XWindowAttributes attribs;
@@ -209,19 +786,31 @@ int main(int argc, char** argv) {
             }
             if (ev.type == ClientMessage) {
                 if (ev.xclient.data.l[0] == atomWmDeleteWindow) {
-                    break;
+                    running = false;
                 }
             }
             else if (ev.type == DestroyNotify) { 
-                break;
+                running = false;
             }
         }
 
+        if (!running || !FramePacerWait(&pacer, display)) {
+            continue;
+        }
+
         Render();
 
+        if (capturing) {
+            FrameCaptureFrame(&capture);
+        }
+
         glXSwapBuffers(display, window);
 
-        usleep((unsigned int)(1/60));
+        FramePacerTick(&pacer);
+    }
+
+    if (capturing) {
+        FrameCaptureShutdown(&capture);
     }
 
     glXDestroyContext(display, context);
@@ -260,6 +849,20 @@ void InitOpenGLFunc()
     glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)        glXGetProcAddressARB((const GLubyte *)"glGetShaderInfoLog");
     glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)            glXGetProcAddressARB((const GLubyte *)"glGetProgramiv");
     glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)       glXGetProcAddressARB((const GLubyte *)"glGetProgramInfoLog");
+    glDeleteBuffers           = (PFNGLDELETEBUFFERSPROC)          glXGetProcAddressARB((const GLubyte *)"glDeleteBuffers");
+    glMapBufferRange          = (PFNGLMAPBUFFERRANGEPROC)         glXGetProcAddressARB((const GLubyte *)"glMapBufferRange");
+    glUnmapBuffer             = (PFNGLUNMAPBUFFERPROC)            glXGetProcAddressARB((const GLubyte *)"glUnmapBuffer");
+    glFenceSync               = (PFNGLFENCESYNCPROC)              glXGetProcAddressARB((const GLubyte *)"glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC)         glXGetProcAddressARB((const GLubyte *)"glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC)             glXGetProcAddressARB((const GLubyte *)"glDeleteSync");
+    glDeleteShader            = (PFNGLDELETESHADERPROC)           glXGetProcAddressARB((const GLubyte *)"glDeleteShader");
+    glDeleteProgram           = (PFNGLDELETEPROGRAMPROC)          glXGetProcAddressARB((const GLubyte *)"glDeleteProgram");
+    glGetStringi              = (PFNGLGETSTRINGIPROC)             glXGetProcAddressARB((const GLubyte *)"glGetStringi");
+    glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC)     glXGetProcAddressARB((const GLubyte *)"glGetUniformLocation");
+    glUniform1f               = (PFNGLUNIFORM1FPROC)              glXGetProcAddressARB((const GLubyte *)"glUniform1f");
+    glUniform4fv              = (PFNGLUNIFORM4FVPROC)             glXGetProcAddressARB((const GLubyte *)"glUniform4fv");
+    glBindBufferBase          = (PFNGLBINDBUFFERBASEPROC)         glXGetProcAddressARB((const GLubyte *)"glBindBufferBase");
+    glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC) glXGetProcAddressARB((const GLubyte *)"glMultiDrawElementsIndirect");
 }
 
 void InitShader()
@@ -347,7 +950,218 @@ void InitShader()
     printf("Initialization complete\n");
 }
 
+static GLuint BuildProgram(const GLchar* vertex, const GLchar* fragment)
+{
+    GLint success;
+    GLchar infoLog[512];
+    const GLchar* sources[2] = { vertex, fragment };
+    GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+
+    GLuint program = glCreateProgram();
+    GLuint shaders[2] = { 0, 0 };
+    bool compiled = true;
+    for (int i = 0; i < 2 && compiled; i++) {
+        shaders[i] = glCreateShader(types[i]);
+        glShaderSource(shaders[i], 1, &sources[i], nullptr);
+        glCompileShader(shaders[i]);
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shaders[i], 512, nullptr, infoLog);
+            printf("Scene shader compilation failed: %s\n", infoLog);
+            compiled = false;
+        }
+        glAttachShader(program, shaders[i]);
+    }
+
+    success = GL_FALSE;
+    if (compiled) {
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(program, 512, nullptr, infoLog);
+            printf("Scene program linking failed: %s\n", infoLog);
+        }
+    }
+
+    // The program keeps what it needs; the shader objects go away with it
+    for (int i = 0; i < 2; i++) {
+        if (shaders[i]) {
+            glDeleteShader(shaders[i]);
+        }
+    }
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static bool HasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const GLubyte* extension = glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp((const char*)extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static float SceneHash(unsigned int n)
+{
+    n = (n ^ 61u) ^ (n >> 16);
+    n *= 9u;
+    n ^= n >> 4;
+    n *= 0x27d4eb2du;
+    n ^= n >> 15;
+    return (n & 0xFFFFFF) / 16777216.0f;
+}
+
+bool InitScene(int meshCount, bool naive)
+{
+    if (!naive && !HasGLExtension("GL_ARB_shader_draw_parameters")) {
+        printf("GL_ARB_shader_draw_parameters is missing, using the naive path\n");
+        naive = true;
+    }
+
+    scene.meshCount = meshCount;
+    scene.naive = naive;
+    scene.program = BuildProgram(naive ? naiveVertexSource : sceneVertexSource, fragmentSource);
+    if (!scene.program) {
+        return false;
+    }
+    scene.timeLocation = glGetUniformLocation(scene.program, "time");
+    scene.transformLocation = glGetUniformLocation(scene.program, "transform");
+    scene.colorLocation = glGetUniformLocation(scene.program, "color");
+
+    // Every mesh is its own irregular polygon of 3 to 10 corners, fanned from
+    // its first corner. Indices are absolute, so no draw needs a base vertex.
+    int vertexCount = 0;
+    int indexCount = 0;
+    for (int i = 0; i < meshCount; i++) {
+        int corners = 3 + i * 7 % 8;
+        vertexCount += corners;
+        indexCount += (corners - 2) * 3;
+    }
+    GLfloat* vertices = (GLfloat*)malloc(sizeof(GLfloat) * 2 * vertexCount);
+    GLuint* indices = (GLuint*)malloc(sizeof(GLuint) * indexCount);
+    scene.draws = (SceneDraw*)malloc(sizeof(SceneDraw) * meshCount);
+    scene.commands = (DrawElementsIndirectCommand*)malloc(sizeof(DrawElementsIndirectCommand) * meshCount);
+
+    int columns = (int)ceilf(sqrtf((float)meshCount));
+    float cell = 2.0f / columns;
+    int vertex = 0;
+    int index = 0;
+    for (int i = 0; i < meshCount; i++) {
+        int corners = 3 + i * 7 % 8;
+        for (int c = 0; c < corners; c++) {
+            float angle = 6.2831853f * (c + 0.5f * SceneHash(i * 16 + c)) / corners;
+            float radius = 0.7f + 0.3f * SceneHash(i * 16 + c + 8);
+            vertices[(vertex + c) * 2 + 0] = radius * cosf(angle);
+            vertices[(vertex + c) * 2 + 1] = radius * sinf(angle);
+        }
+
+        DrawElementsIndirectCommand* command = &scene.commands[i];
+        command->count = (corners - 2) * 3;
+        command->instanceCount = 1;
+        command->firstIndex = index;
+        command->baseVertex = 0;
+        command->baseInstance = 0;
+        for (int c = 1; c < corners - 1; c++) {
+            indices[index++] = vertex;
+            indices[index++] = vertex + c;
+            indices[index++] = vertex + c + 1;
+        }
+        vertex += corners;
+
+        SceneDraw* draw = &scene.draws[i];
+        draw->transform[0] = -1.0f + cell * (i % columns + 0.5f);
+        draw->transform[1] = -1.0f + cell * (i / columns + 0.5f);
+        draw->transform[2] = cell * 0.45f;
+        draw->transform[3] = 6.2831853f * SceneHash(i);
+        draw->color[0] = 0.5f + 0.5f * cosf(i * 0.01f);
+        draw->color[1] = 0.5f + 0.5f * cosf(i * 0.01f + 2.0943951f);
+        draw->color[2] = 0.5f + 0.5f * cosf(i * 0.01f + 4.1887902f);
+        draw->color[3] = 1.0f;
+    }
+    scene.triangles = indexCount / 3;
+
+    glGenVertexArrays(1, &scene.vao);
+    glBindVertexArray(scene.vao);
+    glGenBuffers(4, scene.buffers);
+
+    glBindBuffer(GL_ARRAY_BUFFER, scene.buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 2 * vertexCount, vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene.buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indexCount, indices, GL_STATIC_DRAW);
+
+    if (!naive) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, scene.buffers[2]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(SceneDraw) * meshCount, scene.draws, GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, scene.buffers[2]);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, scene.buffers[3]);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * meshCount, scene.commands, GL_STATIC_DRAW);
+    }
+
+    free(vertices);
+    free(indices);
+
+    scene.start = scene.periodStart = NowNs(CLOCK_MONOTONIC) / 1e9;
+    scene.renderTime = 0.0;
+    scene.frames = 0;
+
+    printf("Scene: %d meshes, %d vertices, %d triangles, %s\n", meshCount, vertexCount, scene.triangles,
+        naive ? "one glDrawElements per mesh" : "one glMultiDrawElementsIndirect");
+    return true;
+}
+
+static void RenderScene()
+{
+    double start = NowNs(CLOCK_MONOTONIC) / 1e9;
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(scene.program);
+    glBindVertexArray(scene.vao);
+    glUniform1f(scene.timeLocation, (float)(start - scene.start));
+
+    if (scene.naive) {
+        for (int i = 0; i < scene.meshCount; i++) {
+            glUniform4fv(scene.transformLocation, 1, scene.draws[i].transform);
+            glUniform4fv(scene.colorLocation, 1, scene.draws[i].color);
+            glDrawElements(GL_TRIANGLES, scene.commands[i].count, GL_UNSIGNED_INT,
+                (const void*)(uintptr_t)(scene.commands[i].firstIndex * sizeof(GLuint)));
+        }
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, scene.meshCount, 0);
+    }
+
+    // CPU time spent issuing the frame; on llvmpipe the draws themselves
+    // are rasterized by other threads
+    double now = NowNs(CLOCK_MONOTONIC) / 1e9;
+    scene.renderTime += now - start;
+    scene.frames++;
+
+    if (now - scene.periodStart >= SCENE_STATS_PERIOD) {
+        printf("  %s: render %.3f ms/frame CPU, %d draws/frame\n", scene.naive ? "glDrawElements" : "glMultiDrawElementsIndirect",
+            scene.renderTime * 1000.0 / scene.frames, scene.naive ? scene.meshCount : 1);
+        scene.periodStart = now;
+        scene.renderTime = 0.0;
+        scene.frames = 0;
+    }
+}
+
 void Render() {
+    if (scene.meshCount > 0) {
+        RenderScene();
+        return;
+    }
+
     glClear(GL_COLOR_BUFFER_BIT);
     glBindVertexArray(vao);
 
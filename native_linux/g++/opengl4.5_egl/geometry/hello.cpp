@@ -0,0 +1,958 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+
+#define WINDOW_WIDTH    800
+#define WINDOW_HEIGHT   600
+
+#define FRAME_COUNT     60
+#define CALIBRATE_COUNT 8
+#define OUTPUT_FILE     "hello.ppm"
+
+#define POINT_COUNT     (256 * 1024)
+#define GALAXY_RADIUS   100.0f
+#define CAMERA_DISTANCE 140.0f
+#define CULL_GROUP_SIZE 256         // local_size_x of the culling compute shader
+#define FRAME_RING      3           // frames the CPU may queue ahead of the GPU
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef APIENTRYP
+#define APIENTRYP APIENTRY *
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA     0x31DD
+#endif
+
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_GEOMETRY_SHADER                0x8DD9
+#define GL_COMPUTE_SHADER                 0x91B9
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_FRAMEBUFFER                    0x8D40
+#define GL_RENDERBUFFER                   0x8D41
+#define GL_COLOR_ATTACHMENT0              0x8CE0
+#define GL_DEPTH_ATTACHMENT               0x8D00
+#define GL_FRAMEBUFFER_COMPLETE           0x8CD5
+#define GL_RGBA8                          0x8058
+#define GL_DEPTH_COMPONENT24              0x81A6
+#define GL_R32UI                          0x8236
+#define GL_RED_INTEGER                    0x8D94
+#define GL_ELEMENT_ARRAY_BUFFER           0x8893
+#define GL_DRAW_INDIRECT_BUFFER           0x8F3F
+#define GL_SHADER_STORAGE_BUFFER          0x90D2
+#define GL_STATIC_DRAW                    0x88E4
+#define GL_DYNAMIC_COPY                   0x88EA
+#define GL_ELEMENT_ARRAY_BARRIER_BIT      0x00000002
+#define GL_COMMAND_BARRIER_BIT            0x00000040
+#define GL_BUFFER_UPDATE_BARRIER_BIT      0x00000200
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+
+typedef char GLchar;
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
+
+typedef GLuint (APIENTRYP PFNGLCREATESHADERPROC) (GLenum type);
+typedef void (APIENTRYP PFNGLSHADERSOURCEPROC) (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length);
+typedef void (APIENTRYP PFNGLCOMPILESHADERPROC) (GLuint shader);
+typedef GLuint (APIENTRYP PFNGLCREATEPROGRAMPROC) (void);
+typedef void (APIENTRYP PFNGLATTACHSHADERPROC) (GLuint program, GLuint shader);
+typedef void (APIENTRYP PFNGLLINKPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLUSEPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef void (APIENTRYP PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef GLint (APIENTRYP PFNGLGETUNIFORMLOCATIONPROC) (GLuint program, const GLchar *name);
+typedef void (APIENTRYP PFNGLUNIFORM1UIPROC) (GLint location, GLuint v0);
+typedef void (APIENTRYP PFNGLUNIFORMMATRIX4FVPROC) (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+typedef void (APIENTRYP PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
+typedef void (APIENTRYP PFNGLBINDVERTEXARRAYPROC) (GLuint array);
+typedef void (APIENTRYP PFNGLGENBUFFERSPROC) (GLsizei n, GLuint *buffers);
+typedef void (APIENTRYP PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
+typedef void (APIENTRYP PFNGLBINDBUFFERBASEPROC) (GLenum target, GLuint index, GLuint buffer);
+typedef void (APIENTRYP PFNGLBUFFERDATAPROC) (GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+typedef void (APIENTRYP PFNGLGETBUFFERSUBDATAPROC) (GLenum target, GLintptr offset, GLsizeiptr size, void *data);
+typedef void (APIENTRYP PFNGLCLEARBUFFERSUBDATAPROC) (GLenum target, GLenum internalformat, GLintptr offset, GLsizeiptr size, GLenum format, GLenum type, const void *data);
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC) (GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC) (GLbitfield barriers);
+typedef void (APIENTRYP PFNGLDRAWARRAYSINSTANCEDPROC) (GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+typedef void (APIENTRYP PFNGLDRAWELEMENTSINDIRECTPROC) (GLenum mode, GLenum type, const void *indirect);
+typedef void (APIENTRYP PFNGLGENFRAMEBUFFERSPROC) (GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLBINDFRAMEBUFFERPROC) (GLenum target, GLuint framebuffer);
+typedef void (APIENTRYP PFNGLFRAMEBUFFERRENDERBUFFERPROC) (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+typedef GLenum (APIENTRYP PFNGLCHECKFRAMEBUFFERSTATUSPROC) (GLenum target);
+typedef void (APIENTRYP PFNGLGENRENDERBUFFERSPROC) (GLsizei n, GLuint *renderbuffers);
+typedef void (APIENTRYP PFNGLBINDRENDERBUFFERPROC) (GLenum target, GLuint renderbuffer);
+typedef void (APIENTRYP PFNGLRENDERBUFFERSTORAGEPROC) (GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+
+PFNGLCREATESHADERPROC             glCreateShader;
+PFNGLSHADERSOURCEPROC             glShaderSource;
+PFNGLCOMPILESHADERPROC            glCompileShader;
+PFNGLCREATEPROGRAMPROC            glCreateProgram;
+PFNGLATTACHSHADERPROC             glAttachShader;
+PFNGLLINKPROGRAMPROC              glLinkProgram;
+PFNGLUSEPROGRAMPROC               glUseProgram;
+PFNGLGETSHADERIVPROC              glGetShaderiv;
+PFNGLGETSHADERINFOLOGPROC         glGetShaderInfoLog;
+PFNGLGETPROGRAMIVPROC             glGetProgramiv;
+PFNGLGETPROGRAMINFOLOGPROC        glGetProgramInfoLog;
+PFNGLGETUNIFORMLOCATIONPROC       glGetUniformLocation;
+PFNGLUNIFORM1UIPROC               glUniform1ui;
+PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv;
+PFNGLGENVERTEXARRAYSPROC          glGenVertexArrays;
+PFNGLBINDVERTEXARRAYPROC          glBindVertexArray;
+PFNGLGENBUFFERSPROC               glGenBuffers;
+PFNGLBINDBUFFERPROC               glBindBuffer;
+PFNGLBINDBUFFERBASEPROC           glBindBufferBase;
+PFNGLBUFFERDATAPROC               glBufferData;
+PFNGLGETBUFFERSUBDATAPROC         glGetBufferSubData;
+PFNGLCLEARBUFFERSUBDATAPROC       glClearBufferSubData;
+PFNGLDISPATCHCOMPUTEPROC          glDispatchCompute;
+PFNGLMEMORYBARRIERPROC            glMemoryBarrier;
+PFNGLDRAWARRAYSINSTANCEDPROC      glDrawArraysInstanced;
+PFNGLDRAWELEMENTSINDIRECTPROC     glDrawElementsIndirect;
+PFNGLGENFRAMEBUFFERSPROC          glGenFramebuffers;
+PFNGLBINDFRAMEBUFFERPROC          glBindFramebuffer;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC  glFramebufferRenderbuffer;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus;
+PFNGLGENRENDERBUFFERSPROC         glGenRenderbuffers;
+PFNGLBINDRENDERBUFFERPROC         glBindRenderbuffer;
+PFNGLRENDERBUFFERSTORAGEPROC      glRenderbufferStorage;
+PFNGLFENCESYNCPROC                glFenceSync;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+PFNGLDELETESYNCPROC               glDeleteSync;
+
+enum Path {
+    PATH_GEOMETRY,      // GL_POINTS, a geometry shader emits a 4 vertex strip per visible point
+    PATH_INSTANCED,     // one 4 vertex strip instance per point, culled ones clipped away
+    PATH_COMPUTE,       // a compute shader culls and writes 6 indices per visible point
+    PATH_COUNT
+};
+
+static const char* pathNames[PATH_COUNT] = { "geometry", "instanced", "compute" };
+
+extern void InitOpenGLFunc();
+extern bool InitFramebuffer(int w, int h);
+extern bool InitShader();
+extern void InitPoints(int count);
+extern void Render(Path path, int frame);
+extern bool ReadPixels(unsigned char* pixels, int w, int h);
+extern bool SavePPM(const char* path, const unsigned char* pixels, int w, int h);
+
+// Shader sources
+
+// The point cloud and camera, shared by every stage that reads points
+const GLchar* pointSource =
+    "#version 450 core\n"
+    "struct Point {\n"
+    "  vec4 positionSize;\n"
+    "  vec4 color;\n"
+    "};\n"
+    "layout(std430, binding = 0) readonly buffer Points {\n"
+    "  Point points[];\n"
+    "};\n"
+    "uniform mat4 uView;\n"
+    "uniform mat4 uProj;\n"
+    "\n"
+    "// Corners 0..3 are (-1,-1), (1,-1), (-1,1), (1,1): a triangle strip, or\n"
+    "// the triangles 0 1 2 and 2 1 3\n"
+    "vec2 CornerOffset(uint corner)\n"
+    "{\n"
+    "  return vec2(corner & 1u, corner >> 1u) * 2.0 - 1.0;\n"
+    "}\n"
+    "\n"
+    "// Every path drops the quads outside the view frustum. The quad of a point\n"
+    "// at view space `center` lies in the plane z = center.z; x and y overlap\n"
+    "// the frustum when the nearest edge is inside depth / proj[0][0] (or [1][1])\n"
+    "bool Visible(vec3 center, float size)\n"
+    "{\n"
+    "  float depth = -center.z;\n"
+    "  float nearZ = uProj[3][2] / (uProj[2][2] - 1.0);\n"
+    "  float farZ = uProj[3][2] / (uProj[2][2] + 1.0);\n"
+    "  return depth > nearZ && depth < farZ &&\n"
+    "         (abs(center.x) - size) * uProj[0][0] <= depth &&\n"
+    "         (abs(center.y) - size) * uProj[1][1] <= depth;\n"
+    "}\n";
+
+// Geometry shader path: the vertex shader moves the point to view space, the
+// geometry shader writes out the camera facing quad, or nothing when culled
+const GLchar* pointVertexSource =
+    "out vec4 vCenter;\n"
+    "out float vSize;\n"
+    "out vec3 vColor;\n"
+    "void main()\n"
+    "{\n"
+    "  Point p = points[gl_VertexID];\n"
+    "  vCenter = uView * vec4(p.positionSize.xyz, 1.0);\n"
+    "  vSize = p.positionSize.w;\n"
+    "  vColor = p.color.rgb;\n"
+    "}\n";
+
+const GLchar* geometrySource =
+    "layout(points) in;\n"
+    "layout(triangle_strip, max_vertices = 4) out;\n"
+    "in vec4 vCenter[];\n"
+    "in float vSize[];\n"
+    "in vec3 vColor[];\n"
+    "out vec2 fOffset;\n"
+    "out vec3 fColor;\n"
+    "void main()\n"
+    "{\n"
+    "  if (!Visible(vCenter[0].xyz, vSize[0])) {\n"
+    "    return;\n"
+    "  }\n"
+    "  for (uint corner = 0u; corner < 4u; corner++) {\n"
+    "    vec4 position = vCenter[0];\n"
+    "    fOffset = CornerOffset(corner);\n"
+    "    position.xy += fOffset * vSize[0];\n"
+    "    fColor = vColor[0];\n"
+    "    gl_Position = uProj * position;\n"
+    "    EmitVertex();\n"
+    "  }\n"
+    "  EndPrimitive();\n"
+    "}\n";
+
+// Instanced and compute paths: every quad corner is its own vertex and pulls
+// the point from the buffer. The instanced draw takes the point from
+// gl_InstanceID and moves the corners of a culled quad behind the far plane,
+// so its two triangles are clipped; the compute path writes indices
+// point * 4 + corner for the visible quads only.
+const GLchar* quadVertexSource =
+    "out vec2 fOffset;\n"
+    "out vec3 fColor;\n"
+    "void main()\n"
+    "{\n"
+    "#ifdef INSTANCED\n"
+    "  uint pointIndex = uint(gl_InstanceID);\n"
+    "  uint corner = uint(gl_VertexID);\n"
+    "#else\n"
+    "  uint pointIndex = uint(gl_VertexID) >> 2u;\n"
+    "  uint corner = uint(gl_VertexID) & 3u;\n"
+    "#endif\n"
+    "  Point p = points[pointIndex];\n"
+    "  vec4 position = uView * vec4(p.positionSize.xyz, 1.0);\n"
+    "  fOffset = CornerOffset(corner);\n"
+    "  fColor = p.color.rgb;\n"
+    "#ifdef INSTANCED\n"
+    "  if (!Visible(position.xyz, p.positionSize.w)) {\n"
+    "    gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n"
+    "    return;\n"
+    "  }\n"
+    "#endif\n"
+    "  position.xy += fOffset * p.positionSize.w;\n"
+    "  gl_Position = uProj * position;\n"
+    "}\n";
+
+// One invocation per point. A quad is kept when it overlaps the view frustum;
+// survivors are counted in shared memory first, so each workgroup does a
+// single atomic on the draw command.
+const GLchar* cullSource =
+    "layout(local_size_x = 256) in;\n"
+    "layout(std430, binding = 1) buffer Command {\n"
+    "  uint count;\n"
+    "  uint instanceCount;\n"
+    "  uint firstIndex;\n"
+    "  int  baseVertex;\n"
+    "  uint baseInstance;\n"
+    "};\n"
+    "layout(std430, binding = 2) writeonly buffer Indices {\n"
+    "  uint indices[];\n"
+    "};\n"
+    "uniform uint uPointCount;\n"
+    "shared uint groupCount;\n"
+    "shared uint groupBase;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "  if (gl_LocalInvocationIndex == 0u) {\n"
+    "    groupCount = 0u;\n"
+    "  }\n"
+    "  barrier();\n"
+    "\n"
+    "  uint pointIndex = gl_GlobalInvocationID.x;\n"
+    "  bool visible = false;\n"
+    "  if (pointIndex < uPointCount) {\n"
+    "    Point p = points[pointIndex];\n"
+    "    visible = Visible((uView * vec4(p.positionSize.xyz, 1.0)).xyz, p.positionSize.w);\n"
+    "  }\n"
+    "  uint slot = visible ? atomicAdd(groupCount, 1u) : 0u;\n"
+    "  barrier();\n"
+    "\n"
+    "  if (gl_LocalInvocationIndex == 0u) {\n"
+    "    groupBase = atomicAdd(count, groupCount * 6u);\n"
+    "  }\n"
+    "  barrier();\n"
+    "\n"
+    "  if (visible) {\n"
+    "    uint first = groupBase + slot * 6u;\n"
+    "    uint vertex = pointIndex * 4u;\n"
+    "    indices[first + 0u] = vertex;\n"
+    "    indices[first + 1u] = vertex + 1u;\n"
+    "    indices[first + 2u] = vertex + 2u;\n"
+    "    indices[first + 3u] = vertex + 2u;\n"
+    "    indices[first + 4u] = vertex + 1u;\n"
+    "    indices[first + 5u] = vertex + 3u;\n"
+    "  }\n"
+    "}\n";
+
+// Round sprites, shaded like small spheres
+const GLchar* fragmentSource =
+    "#version 450 core\n"
+    "in vec2 fOffset;\n"
+    "in vec3 fColor;\n"
+    "out vec4 outColor;\n"
+    "void main()\n"
+    "{\n"
+    "  float r2 = dot(fOffset, fOffset);\n"
+    "  if (r2 > 1.0) {\n"
+    "    discard;\n"
+    "  }\n"
+    "  outColor = vec4(fColor * (0.35 + 0.65 * sqrt(1.0 - r2)), 1.0);\n"
+    "}\n";
+
+// glDrawElementsIndirect command, written by the compute shader
+struct DrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+GLuint vao;
+GLuint fbo;
+GLuint colorRbo;
+GLuint depthRbo;
+GLuint programs[PATH_COUNT];
+GLuint cullProgram;
+GLuint pointBuffer;
+GLuint indexBuffer;
+GLuint commandBuffer;
+int pointCount;
+int outputWidth;
+int outputHeight;
+float cameraDistance = CAMERA_DISTANCE;
+
+static bool HasExtension(const char* extensions, const char* name)
+{
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static double NowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void PrintUsage()
+{
+    printf("usage: hello [--path auto|geometry|instanced|compute|all] [--points N]\n"
+           "             [--frames N] [--calibrate N] [--distance D] [--size W H] [--output FILE]\n");
+}
+
+struct PathResult {
+    double wallSeconds;
+    double frameMs;
+    int    measured;
+};
+
+// The CPU runs at most FRAME_RING frames ahead: before a frame is submitted
+// the fence of the frame FRAME_RING back is waited on, so once the ring is
+// full the time between submissions is the time the driver needs per frame
+// (llvmpipe does not time its rasterizer threads with timer queries).
+static void RunPath(Path path, int frameCount, PathResult* result)
+{
+    GLsync fences[FRAME_RING] = {};
+
+    memset(result, 0, sizeof(*result));
+
+    double start = NowSeconds();
+    double last = start;
+    for (int i = 0; i < frameCount; i++) {
+        int slot = i % FRAME_RING;
+        if (fences[slot]) {
+            glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 10000000000ull);
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+
+        double now = NowSeconds();
+        if (i > FRAME_RING) {
+            result->frameMs += (now - last) * 1e3;
+            result->measured++;
+        }
+        last = now;
+
+        Render(path, i);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+    glFinish();
+    result->wallSeconds = NowSeconds() - start;
+
+    for (int i = 0; i < FRAME_RING; i++) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+        }
+    }
+
+    // Too few frames to fill the ring: fall back to the average over all
+    if (result->measured == 0) {
+        result->frameMs = result->wallSeconds * 1e3;
+        result->measured = frameCount;
+    }
+}
+
+static void PrintResult(const char* label, Path path, const PathResult* result)
+{
+    double frameMs = result->frameMs / result->measured;
+    printf("%-10s %-9s %8.2f ms/frame %7.1f fps %8.2f Mpoints/s\n", label, pathNames[path],
+        frameMs, 1e3 / frameMs, pointCount / frameMs / 1e3);
+}
+
+// Pixels where any channel differs by more than 2
+static int CountDifferences(const unsigned char* a, const unsigned char* b, int pixelCount)
+{
+    int count = 0;
+    for (int i = 0; i < pixelCount; i++) {
+        for (int c = 0; c < 3; c++) {
+            if (abs((int)a[i * 3 + c] - (int)b[i * 3 + c]) > 2) {
+                count++;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    int frameCount = FRAME_COUNT;
+    int calibrateCount = CALIBRATE_COUNT;
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    int points = POINT_COUNT;
+    const char* outputFile = OUTPUT_FILE;
+    int forcedPath = -1;        // -1 lets the calibration choose
+    bool runAll = false;        // time every path, without calibration
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            runAll = strcmp(name, "all") == 0;
+            bool known = runAll || strcmp(name, "auto") == 0;
+            forcedPath = -1;
+            for (int p = 0; p < PATH_COUNT; p++) {
+                if (strcmp(name, pathNames[p]) == 0) {
+                    forcedPath = p;
+                    known = true;
+                }
+            }
+            if (!known) {
+                PrintUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc) {
+            points = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--calibrate") == 0 && i + 1 < argc) {
+            calibrateCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--distance") == 0 && i + 1 < argc) {
+            cameraDistance = fmaxf((float)atof(argv[++i]), 1.0f);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (frameCount < 1) {
+        frameCount = 1;
+    }
+    if (calibrateCount < 1) {
+        calibrateCount = 1;
+    }
+    // Indices point * 4 + corner must fit 32 bits
+    if (width < 1 || height < 1 || points < 1 || points > (1 << 28)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Prefer the surfaceless platform, which needs neither a display server nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint majorEGL, minorEGL;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &majorEGL, &minorEGL)) {
+        printf("Failed to initialize EGL\n");
+        return 1;
+    }
+    printf("EGL %d.%d (%s)\n", majorEGL, minorEGL, eglQueryString(display, EGL_VENDOR));
+
+    bool surfaceless = HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    EGLint eglAttribs[] = {
+        EGL_SURFACE_TYPE    , surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE , EGL_OPENGL_BIT,
+        EGL_RED_SIZE        , 8,
+        EGL_GREEN_SIZE      , 8,
+        EGL_BLUE_SIZE       , 8,
+        EGL_ALPHA_SIZE      , 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, eglAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("No suitable EGL config\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION           , 4,
+        EGL_CONTEXT_MINOR_VERSION           , 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK     , EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        printf("Failed to create an OpenGL 4.5 context\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        EGLint pbufferAttribs[] = {
+            EGL_WIDTH   , 1,
+            EGL_HEIGHT  , 1,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+    }
+    eglMakeCurrent(display, surface, surface, context);
+
+    printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+
+    InitOpenGLFunc();
+
+    if (!InitFramebuffer(width, height)) {
+        printf("Framebuffer incomplete\n");
+        return 1;
+    }
+
+    if (!InitShader()) {
+        return 1;
+    }
+
+    InitPoints(points);
+    bool calibrate = forcedPath < 0 && !runAll;
+    printf("%dx%d, %d points, %d calibration frames, %d frames\n",
+        width, height, pointCount, calibrate ? calibrateCount : 0, frameCount);
+
+    size_t imageSize = (size_t)width * height * 3;
+    unsigned char* reference = (unsigned char*)malloc(imageSize);
+    unsigned char* pixels = (unsigned char*)malloc(imageSize);
+
+    // Startup calibration: every path draws the same first frames, the
+    // fastest one is used from then on. Each path ends on the same camera,
+    // so its last image is also checked against the first path's.
+    int chosen = forcedPath;
+    if (calibrate) {
+        double best = 0.0;
+        for (int p = 0; p < PATH_COUNT; p++) {
+            PathResult result;
+            RunPath((Path)p, calibrateCount, &result);
+            PrintResult("calibrate", (Path)p, &result);
+
+            ReadPixels(p == 0 ? reference : pixels, width, height);
+            if (p > 0) {
+                printf("  differs from %s in %d of %d pixels\n", pathNames[0],
+                    CountDifferences(reference, pixels, width * height), width * height);
+            }
+
+            double frameMs = result.frameMs / result.measured;
+            if (chosen < 0 || frameMs < best) {
+                chosen = p;
+                best = frameMs;
+            }
+        }
+        printf("Using the %s path\n", pathNames[chosen]);
+    }
+
+    for (int p = 0; p < PATH_COUNT; p++) {
+        if (!runAll && p != chosen) {
+            continue;
+        }
+        PathResult result;
+        RunPath((Path)p, frameCount, &result);
+        PrintResult("run", (Path)p, &result);
+        if (p == PATH_COMPUTE) {
+            DrawElementsCommand command;
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+            printf("  compute pass kept %u of %d points\n", command.count / 6, pointCount);
+        }
+    }
+
+    ReadPixels(pixels, width, height);
+    if (SavePPM(outputFile, pixels, width, height)) {
+        printf("Wrote %s\n", outputFile);
+    }
+
+    free(reference);
+    free(pixels);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+    }
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return 0;
+}
+
+void InitOpenGLFunc()
+{
+    glCreateShader            = (PFNGLCREATESHADERPROC)            eglGetProcAddress("glCreateShader");
+    glShaderSource            = (PFNGLSHADERSOURCEPROC)            eglGetProcAddress("glShaderSource");
+    glCompileShader           = (PFNGLCOMPILESHADERPROC)           eglGetProcAddress("glCompileShader");
+    glCreateProgram           = (PFNGLCREATEPROGRAMPROC)           eglGetProcAddress("glCreateProgram");
+    glAttachShader            = (PFNGLATTACHSHADERPROC)            eglGetProcAddress("glAttachShader");
+    glLinkProgram             = (PFNGLLINKPROGRAMPROC)             eglGetProcAddress("glLinkProgram");
+    glUseProgram              = (PFNGLUSEPROGRAMPROC)              eglGetProcAddress("glUseProgram");
+    glGetShaderiv             = (PFNGLGETSHADERIVPROC)             eglGetProcAddress("glGetShaderiv");
+    glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)        eglGetProcAddress("glGetShaderInfoLog");
+    glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)            eglGetProcAddress("glGetProgramiv");
+    glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)       eglGetProcAddress("glGetProgramInfoLog");
+    glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC)      eglGetProcAddress("glGetUniformLocation");
+    glUniform1ui              = (PFNGLUNIFORM1UIPROC)              eglGetProcAddress("glUniform1ui");
+    glUniformMatrix4fv        = (PFNGLUNIFORMMATRIX4FVPROC)        eglGetProcAddress("glUniformMatrix4fv");
+    glGenVertexArrays         = (PFNGLGENVERTEXARRAYSPROC)         eglGetProcAddress("glGenVertexArrays");
+    glBindVertexArray         = (PFNGLBINDVERTEXARRAYPROC)         eglGetProcAddress("glBindVertexArray");
+    glGenBuffers              = (PFNGLGENBUFFERSPROC)              eglGetProcAddress("glGenBuffers");
+    glBindBuffer              = (PFNGLBINDBUFFERPROC)              eglGetProcAddress("glBindBuffer");
+    glBindBufferBase          = (PFNGLBINDBUFFERBASEPROC)          eglGetProcAddress("glBindBufferBase");
+    glBufferData              = (PFNGLBUFFERDATAPROC)              eglGetProcAddress("glBufferData");
+    glGetBufferSubData        = (PFNGLGETBUFFERSUBDATAPROC)        eglGetProcAddress("glGetBufferSubData");
+    glClearBufferSubData      = (PFNGLCLEARBUFFERSUBDATAPROC)      eglGetProcAddress("glClearBufferSubData");
+    glDispatchCompute         = (PFNGLDISPATCHCOMPUTEPROC)         eglGetProcAddress("glDispatchCompute");
+    glMemoryBarrier           = (PFNGLMEMORYBARRIERPROC)           eglGetProcAddress("glMemoryBarrier");
+    glDrawArraysInstanced     = (PFNGLDRAWARRAYSINSTANCEDPROC)     eglGetProcAddress("glDrawArraysInstanced");
+    glDrawElementsIndirect    = (PFNGLDRAWELEMENTSINDIRECTPROC)    eglGetProcAddress("glDrawElementsIndirect");
+    glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)         eglGetProcAddress("glGenFramebuffers");
+    glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)         eglGetProcAddress("glBindFramebuffer");
+    glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC) eglGetProcAddress("glFramebufferRenderbuffer");
+    glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)  eglGetProcAddress("glCheckFramebufferStatus");
+    glGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)        eglGetProcAddress("glGenRenderbuffers");
+    glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)        eglGetProcAddress("glBindRenderbuffer");
+    glRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)     eglGetProcAddress("glRenderbufferStorage");
+    glFenceSync               = (PFNGLFENCESYNCPROC)               eglGetProcAddress("glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC)          eglGetProcAddress("glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC)              eglGetProcAddress("glDeleteSync");
+}
+
+bool InitFramebuffer(int w, int h)
+{
+    outputWidth = w;
+    outputHeight = h;
+
+    // There is no default framebuffer to draw into, so render to color and
+    // depth renderbuffers
+    glGenRenderbuffers(1, &colorRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+
+    glGenRenderbuffers(1, &depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+static GLuint CompileShader(GLenum type, const GLchar* const* sources, GLsizei count, const char* name)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, count, sources, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        printf("%s shader compilation failed: %s\n", name, infoLog);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint LinkProgram(const GLuint* shaders, int count, const char* name)
+{
+    GLuint program = glCreateProgram();
+    for (int i = 0; i < count; i++) {
+        if (!shaders[i]) {
+            return 0;
+        }
+        glAttachShader(program, shaders[i]);
+    }
+    glLinkProgram(program);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        printf("%s program linking failed: %s\n", name, infoLog);
+        return 0;
+    }
+    return program;
+}
+
+bool InitShader()
+{
+    const GLchar* pointVertexSources[] = { pointSource, pointVertexSource };
+    const GLchar* geometrySources[] = { pointSource, geometrySource };
+    const GLchar* instancedSources[] = { pointSource, "#define INSTANCED\n", quadVertexSource };
+    const GLchar* indexedSources[] = { pointSource, quadVertexSource };
+    const GLchar* cullSources[] = { pointSource, cullSource };
+
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, &fragmentSource, 1, "Fragment");
+
+    GLuint geometryShaders[] = {
+        CompileShader(GL_VERTEX_SHADER, pointVertexSources, 2, "Point vertex"),
+        CompileShader(GL_GEOMETRY_SHADER, geometrySources, 2, "Geometry"),
+        fragmentShader
+    };
+    GLuint instancedShaders[] = {
+        CompileShader(GL_VERTEX_SHADER, instancedSources, 3, "Instanced vertex"),
+        fragmentShader
+    };
+    GLuint indexedShaders[] = {
+        CompileShader(GL_VERTEX_SHADER, indexedSources, 2, "Indexed vertex"),
+        fragmentShader
+    };
+    GLuint cullShader = CompileShader(GL_COMPUTE_SHADER, cullSources, 2, "Cull");
+
+    programs[PATH_GEOMETRY] = LinkProgram(geometryShaders, 3, "Geometry");
+    programs[PATH_INSTANCED] = LinkProgram(instancedShaders, 2, "Instanced");
+    programs[PATH_COMPUTE] = LinkProgram(indexedShaders, 2, "Indexed");
+    cullProgram = LinkProgram(&cullShader, 1, "Cull");
+    if (!programs[PATH_GEOMETRY] || !programs[PATH_INSTANCED] || !programs[PATH_COMPUTE] || !cullProgram) {
+        return false;
+    }
+
+    printf("Initialization complete\n");
+    return true;
+}
+
+// A four armed spiral galaxy: a dense bulge of yellow points, blue arms
+// thinning out towards the rim
+void InitPoints(int count)
+{
+    pointCount = count;
+
+    float* data = (float*)malloc((size_t)count * 8 * sizeof(float));
+    uint32_t seed = 12345;
+    auto Random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    auto Gaussian = [&Random]() {
+        return (Random() + Random() + Random() + Random() - 2.0f) * 1.7f;
+    };
+
+    for (int i = 0; i < count; i++) {
+        float r = GALAXY_RADIUS * powf(Random(), 0.6f);
+        float t = r / GALAXY_RADIUS;
+        float arm = (float)(i & 3) * 1.5707963f;
+        float angle = arm + t * 5.0f + Gaussian() * 0.25f * (1.1f - t);
+        float* p = data + (size_t)i * 8;
+        p[0] = r * cosf(angle) + Gaussian() * 2.0f;
+        p[1] = Gaussian() * (1.0f + 6.0f * (1.0f - t) * (1.0f - t));
+        p[2] = r * sinf(angle) + Gaussian() * 2.0f;
+        p[3] = 0.12f + 0.2f * Random();
+        p[4] = 1.0f - 0.6f * t;
+        p[5] = 0.85f - 0.3f * t + 0.1f * Random();
+        p[6] = 0.4f + 0.6f * t;
+        p[7] = 1.0f;
+    }
+
+    glGenBuffers(1, &pointBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)count * 8 * sizeof(float), data, GL_STATIC_DRAW);
+    free(data);
+
+    // Six indices for every point in the worst case
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)count * 6 * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+    // Only count changes from frame to frame, it is cleared before each cull
+    DrawElementsCommand command = { 0, 1, 0, 0, 0 };
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(command), &command, GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indexBuffer);
+}
+
+// Column-major view and projection for frame `frame`: the camera circles the
+// galaxy 30 degrees above its plane, half a degree per frame
+static void CameraMatrices(int frame, float view[16], float proj[16])
+{
+    const float pitch = 30.0f * 3.14159265f / 180.0f;
+    const float fovy = 50.0f * 3.14159265f / 180.0f;
+    float yaw = frame * 0.5f * 3.14159265f / 180.0f;
+    float nearZ = 1.0f;
+    float farZ = cameraDistance + GALAXY_RADIUS * 2.0f;
+
+    float cy = cosf(yaw), sy = sinf(yaw);
+    float cp = cosf(pitch), sp = sinf(pitch);
+
+    // Rotate the world by -yaw about y, tilt it by pitch about x, then move
+    // it cameraDistance in front of the camera
+    float m[16] = {
+        cy,       sy * sp,  -sy * cp, 0.0f,
+        0.0f,     cp,       sp,       0.0f,
+        sy,      -cy * sp,  cy * cp,  0.0f,
+        0.0f,     0.0f,     -cameraDistance, 1.0f
+    };
+    memcpy(view, m, sizeof(m));
+
+    float cot = 1.0f / tanf(fovy / 2.0f);
+    float aspect = (float)outputWidth / outputHeight;
+    memset(proj, 0, 16 * sizeof(float));
+    proj[0] = cot / aspect;
+    proj[5] = cot;
+    proj[10] = (farZ + nearZ) / (nearZ - farZ);
+    proj[11] = -1.0f;
+    proj[14] = 2.0f * farZ * nearZ / (nearZ - farZ);
+}
+
+static void SetCamera(GLuint program, const float view[16], const float proj[16])
+{
+    glUniformMatrix4fv(glGetUniformLocation(program, "uView"), 1, GL_FALSE, view);
+    glUniformMatrix4fv(glGetUniformLocation(program, "uProj"), 1, GL_FALSE, proj);
+}
+
+void Render(Path path, int frame)
+{
+    float view[16], proj[16];
+    CameraMatrices(frame, view, proj);
+
+    if (path == PATH_COMPUTE) {
+        GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+        glUseProgram(cullProgram);
+        SetCamera(cullProgram, view, proj);
+        glUniform1ui(glGetUniformLocation(cullProgram, "uPointCount"), (GLuint)pointCount);
+        glDispatchCompute((pointCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, outputWidth, outputHeight);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.02f, 0.02f, 0.05f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glUseProgram(programs[path]);
+    SetCamera(programs[path], view, proj);
+    glBindVertexArray(vao);
+
+    switch (path) {
+    case PATH_GEOMETRY:
+        glDrawArrays(GL_POINTS, 0, pointCount);
+        break;
+    case PATH_INSTANCED:
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, pointCount);
+        break;
+    default:
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL);
+        break;
+    }
+}
+
+bool ReadPixels(unsigned char* pixels, int w, int h)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    return true;
+}
+
+bool SavePPM(const char* path, const unsigned char* pixels, int w, int h)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    // GL rows start at the bottom, PPM rows at the top
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    for (int y = h - 1; y >= 0; y--) {
+        fwrite(pixels + (size_t)y * w * 3, 1, (size_t)w * 3, fp);
+    }
+    fclose(fp);
+    return true;
+}
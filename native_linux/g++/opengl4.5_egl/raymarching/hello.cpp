@@ -0,0 +1,898 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+
+#define WINDOW_WIDTH    640
+#define WINDOW_HEIGHT   480
+
+#define FRAME_COUNT     60
+#define OUTPUT_FILE     "hello.ppm"
+
+#define DEFAULT_BUDGET_MS   33.3f
+#define DEFAULT_MIN_SCALE   0.25f
+#define FRAME_RING          3       // frames the CPU may queue ahead of the GPU
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef APIENTRYP
+#define APIENTRYP APIENTRY *
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA     0x31DD
+#endif
+
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_FRAMEBUFFER                    0x8D40
+#define GL_RENDERBUFFER                   0x8D41
+#define GL_COLOR_ATTACHMENT0              0x8CE0
+#define GL_COLOR_ATTACHMENT1              0x8CE1
+#define GL_FRAMEBUFFER_COMPLETE           0x8CD5
+#define GL_RGBA8                          0x8058
+#define GL_R32F                           0x822E
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+
+typedef char GLchar;
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
+
+typedef GLuint (APIENTRYP PFNGLCREATESHADERPROC) (GLenum type);
+typedef void (APIENTRYP PFNGLSHADERSOURCEPROC) (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length);
+typedef void (APIENTRYP PFNGLCOMPILESHADERPROC) (GLuint shader);
+typedef GLuint (APIENTRYP PFNGLCREATEPROGRAMPROC) (void);
+typedef void (APIENTRYP PFNGLATTACHSHADERPROC) (GLuint program, GLuint shader);
+typedef void (APIENTRYP PFNGLLINKPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLUSEPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef void (APIENTRYP PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef GLint (APIENTRYP PFNGLGETUNIFORMLOCATIONPROC) (GLuint program, const GLchar *name);
+typedef void (APIENTRYP PFNGLUNIFORM1FPROC) (GLint location, GLfloat v0);
+typedef void (APIENTRYP PFNGLUNIFORM2FPROC) (GLint location, GLfloat v0, GLfloat v1);
+typedef void (APIENTRYP PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
+typedef void (APIENTRYP PFNGLBINDVERTEXARRAYPROC) (GLuint array);
+typedef void (APIENTRYP PFNGLGENFRAMEBUFFERSPROC) (GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLBINDFRAMEBUFFERPROC) (GLenum target, GLuint framebuffer);
+typedef void (APIENTRYP PFNGLFRAMEBUFFERRENDERBUFFERPROC) (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+typedef void (APIENTRYP PFNGLFRAMEBUFFERTEXTURE2DPROC) (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+typedef GLenum (APIENTRYP PFNGLCHECKFRAMEBUFFERSTATUSPROC) (GLenum target);
+typedef void (APIENTRYP PFNGLDRAWBUFFERSPROC) (GLsizei n, const GLenum *bufs);
+typedef void (APIENTRYP PFNGLGENRENDERBUFFERSPROC) (GLsizei n, GLuint *renderbuffers);
+typedef void (APIENTRYP PFNGLBINDRENDERBUFFERPROC) (GLenum target, GLuint renderbuffer);
+typedef void (APIENTRYP PFNGLRENDERBUFFERSTORAGEPROC) (GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLBINDTEXTUREUNITPROC) (GLuint unit, GLuint texture);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+
+PFNGLCREATESHADERPROC             glCreateShader;
+PFNGLSHADERSOURCEPROC             glShaderSource;
+PFNGLCOMPILESHADERPROC            glCompileShader;
+PFNGLCREATEPROGRAMPROC            glCreateProgram;
+PFNGLATTACHSHADERPROC             glAttachShader;
+PFNGLLINKPROGRAMPROC              glLinkProgram;
+PFNGLUSEPROGRAMPROC               glUseProgram;
+PFNGLGETSHADERIVPROC              glGetShaderiv;
+PFNGLGETSHADERINFOLOGPROC         glGetShaderInfoLog;
+PFNGLGETPROGRAMIVPROC             glGetProgramiv;
+PFNGLGETPROGRAMINFOLOGPROC        glGetProgramInfoLog;
+PFNGLGETUNIFORMLOCATIONPROC       glGetUniformLocation;
+PFNGLUNIFORM1FPROC                glUniform1f;
+PFNGLUNIFORM2FPROC                glUniform2f;
+PFNGLGENVERTEXARRAYSPROC          glGenVertexArrays;
+PFNGLBINDVERTEXARRAYPROC          glBindVertexArray;
+PFNGLGENFRAMEBUFFERSPROC          glGenFramebuffers;
+PFNGLBINDFRAMEBUFFERPROC          glBindFramebuffer;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC  glFramebufferRenderbuffer;
+PFNGLFRAMEBUFFERTEXTURE2DPROC     glFramebufferTexture2D;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus;
+PFNGLDRAWBUFFERSPROC              glDrawBuffers;
+PFNGLGENRENDERBUFFERSPROC         glGenRenderbuffers;
+PFNGLBINDRENDERBUFFERPROC         glBindRenderbuffer;
+PFNGLRENDERBUFFERSTORAGEPROC      glRenderbufferStorage;
+PFNGLBINDTEXTUREUNITPROC          glBindTextureUnit;
+PFNGLFENCESYNCPROC                glFenceSync;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+PFNGLDELETESYNCPROC               glDeleteSync;
+
+extern void InitOpenGLFunc();
+extern bool InitFramebuffers(int w, int h);
+extern bool InitShader();
+extern void Render(float time, int marchWidth, int marchHeight, bool upsample);
+extern bool ReadPixels(unsigned char* pixels, int w, int h);
+extern bool SavePPM(const char* path, const unsigned char* pixels, int w, int h);
+
+// Shader sources
+
+// A full screen triangle from gl_VertexID, so no vertex buffer is needed
+const GLchar* vertexSource =
+    "#version 450 core                                          \n"
+    "void main()                                                \n"
+    "{                                                          \n"
+    "  vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;\n"
+    "  gl_Position = vec4(position, 0.0, 1.0);                  \n"
+    "}                                                          \n";
+
+// The scene of native_win/cpp/directx12/raymarching/hello.hlsl, shared by
+// both fragment shaders
+const GLchar* sceneSource =
+    "#version 450 core\n"
+    "uniform float iTime;\n"
+    "uniform vec2 iResolution;\n"
+    "\n"
+    "const int MAX_STEPS = 100;\n"
+    "const float MAX_DIST = 100.0;\n"
+    "const float SURF_DIST = 0.001;\n"
+    "\n"
+    "float sdSphere(vec3 p, float r)\n"
+    "{\n"
+    "  return length(p) - r;\n"
+    "}\n"
+    "\n"
+    "float sdTorus(vec3 p, vec2 t)\n"
+    "{\n"
+    "  vec2 q = vec2(length(p.xz) - t.x, p.y);\n"
+    "  return length(q) - t.y;\n"
+    "}\n"
+    "\n"
+    "float smin(float a, float b, float k)\n"
+    "{\n"
+    "  float h = clamp(0.5 + 0.5 * (b - a) / k, 0.0, 1.0);\n"
+    "  return mix(b, a, h) - k * h * (1.0 - h);\n"
+    "}\n"
+    "\n"
+    "float GetDist(vec3 p)\n"
+    "{\n"
+    "  float sphere = sdSphere(p - vec3(sin(iTime) * 1.5, 0.5 + sin(iTime * 2.0) * 0.3, 0.0), 0.5);\n"
+    "\n"
+    "  float angle = iTime * 0.5;\n"
+    "  vec3 torusPos = p - vec3(0.0, 0.5, 0.0);\n"
+    "  float cosA = cos(angle);\n"
+    "  float sinA = sin(angle);\n"
+    "  torusPos.xz = vec2(cosA * torusPos.x - sinA * torusPos.z, sinA * torusPos.x + cosA * torusPos.z);\n"
+    "\n"
+    "  float angle2 = angle * 0.7;\n"
+    "  float cosA2 = cos(angle2);\n"
+    "  float sinA2 = sin(angle2);\n"
+    "  torusPos.xy = vec2(cosA2 * torusPos.x - sinA2 * torusPos.y, sinA2 * torusPos.x + cosA2 * torusPos.y);\n"
+    "\n"
+    "  float torus = sdTorus(torusPos, vec2(0.8, 0.2));\n"
+    "  float plane = p.y + 0.5;\n"
+    "\n"
+    "  float d = smin(sphere, torus, 0.3);\n"
+    "  return min(d, plane);\n"
+    "}\n"
+    "\n"
+    "vec3 GetNormal(vec3 p)\n"
+    "{\n"
+    "  float d = GetDist(p);\n"
+    "  vec2 e = vec2(0.001, 0.0);\n"
+    "  vec3 n = d - vec3(GetDist(p - e.xyy), GetDist(p - e.yxy), GetDist(p - e.yyx));\n"
+    "  return normalize(n);\n"
+    "}\n"
+    "\n"
+    "float RayMarch(vec3 ro, vec3 rd)\n"
+    "{\n"
+    "  float dO = 0.0;\n"
+    "  for (int i = 0; i < MAX_STEPS; i++) {\n"
+    "    vec3 p = ro + rd * dO;\n"
+    "    float dS = GetDist(p);\n"
+    "    dO += dS;\n"
+    "    if (dO > MAX_DIST || dS < SURF_DIST) break;\n"
+    "  }\n"
+    "  return dO;\n"
+    "}\n"
+    "\n"
+    "float GetShadow(vec3 ro, vec3 rd, float mint, float maxt, float k)\n"
+    "{\n"
+    "  float res = 1.0;\n"
+    "  float t = mint;\n"
+    "  for (int i = 0; i < 64 && t < maxt; i++) {\n"
+    "    float h = GetDist(ro + rd * t);\n"
+    "    if (h < 0.001) return 0.0;\n"
+    "    res = min(res, k * h / t);\n"
+    "    t += h;\n"
+    "  }\n"
+    "  return res;\n"
+    "}\n"
+    "\n"
+    "float GetAO(vec3 p, vec3 n)\n"
+    "{\n"
+    "  float occ = 0.0;\n"
+    "  float sca = 1.0;\n"
+    "  for (int i = 0; i < 5; i++) {\n"
+    "    float h = 0.01 + 0.12 * float(i) / 4.0;\n"
+    "    float d = GetDist(p + h * n);\n"
+    "    occ += (h - d) * sca;\n"
+    "    sca *= 0.95;\n"
+    "  }\n"
+    "  return clamp(1.0 - 3.0 * occ, 0.0, 1.0);\n"
+    "}\n"
+    "\n"
+    "// uv in [0, 1] over the image; the aspect ratio is always the output's\n"
+    "void CameraRay(vec2 uv, out vec3 ro, out vec3 rd)\n"
+    "{\n"
+    "  uv -= 0.5;\n"
+    "  uv.x *= iResolution.x / iResolution.y;\n"
+    "  ro = vec3(0.0, 1.5, -4.0);\n"
+    "  rd = normalize(vec3(uv.x, uv.y, 1.0));\n"
+    "}\n"
+    "\n"
+    "// HLSL fmod truncates where GLSL mod floors; keep the original checkerboard\n"
+    "float hlslFmod(float x, float y)\n"
+    "{\n"
+    "  return x - y * trunc(x / y);\n"
+    "}\n"
+    "\n"
+    "vec3 Shade(vec3 ro, vec3 rd, float d, float uvY)\n"
+    "{\n"
+    "  vec3 lightPos = vec3(3.0, 5.0, -2.0);\n"
+    "  vec3 col;\n"
+    "  if (d < MAX_DIST) {\n"
+    "    vec3 p = ro + rd * d;\n"
+    "    vec3 n = GetNormal(p);\n"
+    "    vec3 l = normalize(lightPos - p);\n"
+    "    vec3 v = normalize(ro - p);\n"
+    "    vec3 r = reflect(-l, n);\n"
+    "\n"
+    "    vec3 matCol = vec3(0.4, 0.6, 0.9);\n"
+    "    if (p.y < -0.49) {\n"
+    "      float checker = hlslFmod(floor(p.x) + floor(p.z), 2.0);\n"
+    "      matCol = mix(vec3(0.2), vec3(0.8), checker);\n"
+    "    }\n"
+    "\n"
+    "    float diff = max(dot(n, l), 0.0);\n"
+    "    float spec = pow(max(dot(r, v), 0.0), 32.0);\n"
+    "    float ao = GetAO(p, n);\n"
+    "    float shadow = GetShadow(p + n * 0.01, l, 0.01, length(lightPos - p), 16.0);\n"
+    "    vec3 ambient = vec3(0.1, 0.12, 0.15);\n"
+    "\n"
+    "    col = matCol * (ambient * ao + diff * shadow) + vec3(1.0) * spec * shadow * 0.5;\n"
+    "    col = mix(col, vec3(0.05, 0.05, 0.1), 1.0 - exp(-0.02 * d * d));\n"
+    "  } else {\n"
+    "    col = mix(vec3(0.1, 0.1, 0.15), vec3(0.02, 0.02, 0.05), uvY);\n"
+    "  }\n"
+    "  return pow(col, vec3(0.4545));\n"
+    "}\n";
+
+// The full raymarch at the march resolution. Besides the color it keeps the
+// hit distance, which guides the upsample.
+const GLchar* marchSource =
+    "uniform vec2 uMarchSize;\n"
+    "layout(location = 0) out vec4 outColor;\n"
+    "layout(location = 1) out float outDepth;\n"
+    "void main()\n"
+    "{\n"
+    "  vec2 uv = gl_FragCoord.xy / uMarchSize;\n"
+    "  vec3 ro, rd;\n"
+    "  CameraRay(uv, ro, rd);\n"
+    "  float d = RayMarch(ro, rd);\n"
+    "  outColor = vec4(Shade(ro, rd, d, uv.y), 1.0);\n"
+    "  outDepth = min(d, MAX_DIST);\n"
+    "}\n";
+
+// Joint bilateral upsample to the output resolution. Where the four nearest
+// march texels agree in depth this is a bilinear filter; across a silhouette
+// the pixel finds its own depth with a short march started just in front of
+// the nearest texel, and texels at a different depth lose their weight, so
+// edges stay sharp instead of bleeding foreground into background. The
+// expensive normal, shadow and AO work only ever runs at march resolution.
+const GLchar* upsampleSource =
+    "uniform vec2 uMarchSize;\n"
+    "layout(binding = 0) uniform sampler2D uColor;\n"
+    "layout(binding = 1) uniform sampler2D uDepth;\n"
+    "out vec4 outColor;\n"
+    "\n"
+    "const int REFINE_STEPS = 32;\n"
+    "const float EDGE_THRESHOLD = 0.1;\n"
+    "const float DEPTH_SIGMA = 0.1;\n"
+    "\n"
+    "float RefineDepth(vec3 ro, vec3 rd, float t)\n"
+    "{\n"
+    "  for (int i = 0; i < REFINE_STEPS; i++) {\n"
+    "    float h = GetDist(ro + rd * t);\n"
+    "    if (h < SURF_DIST * t) return t;\n"
+    "    t += h;\n"
+    "    if (t > MAX_DIST) break;\n"
+    "  }\n"
+    "  return MAX_DIST;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "  vec2 uv = gl_FragCoord.xy / iResolution;\n"
+    "  vec2 p = uv * uMarchSize - 0.5;\n"
+    "  ivec2 base = ivec2(floor(p));\n"
+    "  vec2 f = p - vec2(base);\n"
+    "  ivec2 last = ivec2(uMarchSize) - 1;\n"
+    "\n"
+    "  ivec2 offsets[4] = ivec2[4](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));\n"
+    "  float weights[4] = float[4]((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);\n"
+    "  vec3 colors[4];\n"
+    "  float depths[4];\n"
+    "  float dMin = MAX_DIST, dMax = 0.0;\n"
+    "  for (int i = 0; i < 4; i++) {\n"
+    "    ivec2 texel = clamp(base + offsets[i], ivec2(0), last);\n"
+    "    colors[i] = texelFetch(uColor, texel, 0).rgb;\n"
+    "    depths[i] = texelFetch(uDepth, texel, 0).r;\n"
+    "    dMin = min(dMin, depths[i]);\n"
+    "    dMax = max(dMax, depths[i]);\n"
+    "  }\n"
+    "\n"
+    "  if (dMax - dMin > EDGE_THRESHOLD * dMin) {\n"
+    "    vec3 ro, rd;\n"
+    "    CameraRay(uv, ro, rd);\n"
+    "    float guide = RefineDepth(ro, rd, dMin * 0.9);\n"
+    "    float best = MAX_DIST;\n"
+    "    int nearest = 0;\n"
+    "    for (int i = 0; i < 4; i++) {\n"
+    "      float delta = abs(depths[i] - guide) / guide;\n"
+    "      weights[i] *= exp(-delta / DEPTH_SIGMA);\n"
+    "      if (delta < best) { best = delta; nearest = i; }\n"
+    "    }\n"
+    "    // No texel at this pixel's depth: take the closest match as is\n"
+    "    if (weights[0] + weights[1] + weights[2] + weights[3] < 1e-4) {\n"
+    "      outColor = vec4(colors[nearest], 1.0);\n"
+    "      return;\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  vec3 sum = vec3(0.0);\n"
+    "  float total = 0.0;\n"
+    "  for (int i = 0; i < 4; i++) {\n"
+    "    sum += colors[i] * weights[i];\n"
+    "    total += weights[i];\n"
+    "  }\n"
+    "  outColor = vec4(sum / total, 1.0);\n"
+    "}\n";
+
+enum Mode {
+    MODE_FULL,          // march every output pixel
+    MODE_HALF,          // march at half resolution, bilateral upsample
+    MODE_DYNAMIC,       // march resolution follows the frame time budget
+    MODE_COUNT
+};
+
+static const char* modeNames[MODE_COUNT] = { "full", "half", "dynamic" };
+
+GLuint vao;
+GLuint outputFbo;
+GLuint outputRbo;
+GLuint marchFbo;
+GLuint marchColor;
+GLuint marchDepth;
+GLuint marchProgram;
+GLuint upsampleProgram;
+int outputWidth;
+int outputHeight;
+
+static bool HasExtension(const char* extensions, const char* name)
+{
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static double NowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void PrintUsage()
+{
+    printf("usage: hello [--mode full|half|dynamic|all] [--frames N] [--size W H]\n"
+           "             [--budget MS] [--min-scale S] [--output FILE]\n");
+}
+
+// Dynamic resolution: the march cost scales with its pixel count, so the
+// scale that fits the budget is about the measured scale times
+// sqrt(budget / frame time). The upsample adds a cost that does not scale,
+// which the feedback absorbs over a few frames. Half of the correction is
+// applied per frame, since the measured frame is FRAME_RING frames old, and
+// changes under 2% are ignored to keep the size steady.
+struct ResolutionController {
+    float budgetMs;
+    float minScale;
+    float scale;
+};
+
+static void UpdateScale(ResolutionController* controller, float measuredScale, float frameMs)
+{
+    float target = measuredScale * sqrtf(controller->budgetMs / frameMs);
+    target = fminf(fmaxf(target, controller->minScale), 1.0f);
+    if (fabsf(target - controller->scale) > 0.02f) {
+        controller->scale += 0.5f * (target - controller->scale);
+    }
+}
+
+struct ModeResult {
+    double wallSeconds;
+    double frameMs;
+    double maxFrameMs;
+    double scale;
+    int    measured;
+};
+
+static void MarchSize(float scale, int* w, int* h)
+{
+    *w = (int)lroundf(outputWidth * scale);
+    *h = (int)lroundf(outputHeight * scale);
+    if (*w < 1) *w = 1;
+    if (*h < 1) *h = 1;
+}
+
+// The CPU runs at most FRAME_RING frames ahead: before a frame is submitted
+// the fence of the frame FRAME_RING back is waited on, so once the ring is
+// full the time between submissions is the time the driver needs per frame.
+// Timer queries would split march and upsample, but llvmpipe does not time
+// its rasterizer threads with them. The animation advances by 1/60 s per
+// frame, so every mode ends on the same image.
+static void RunMode(Mode mode, int frameCount, ResolutionController* controller, ModeResult* result)
+{
+    GLsync fences[FRAME_RING] = {};
+    float slotScale[FRAME_RING] = {};
+
+    memset(result, 0, sizeof(*result));
+    if (mode == MODE_DYNAMIC) {
+        controller->scale = 0.5f;
+    }
+
+    double start = NowSeconds();
+    double last = start;
+    for (int i = 0; i < frameCount; i++) {
+        int slot = i % FRAME_RING;
+        float measuredScale = slotScale[slot];
+        if (fences[slot]) {
+            glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+
+        double now = NowSeconds();
+        float frameMs = (float)((now - last) * 1e3);
+        last = now;
+        if (i > FRAME_RING) {
+            result->frameMs += frameMs;
+            result->maxFrameMs = fmax(result->maxFrameMs, frameMs);
+            result->scale += measuredScale;
+            result->measured++;
+            if (mode == MODE_DYNAMIC) {
+                UpdateScale(controller, measuredScale, frameMs);
+            }
+        }
+
+        float scale = mode == MODE_FULL ? 1.0f : mode == MODE_HALF ? 0.5f : controller->scale;
+        int marchWidth, marchHeight;
+        MarchSize(scale, &marchWidth, &marchHeight);
+
+        Render(i / 60.0f, marchWidth, marchHeight, mode != MODE_FULL);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slotScale[slot] = scale;
+        glFlush();
+    }
+    glFinish();
+    result->wallSeconds = NowSeconds() - start;
+
+    for (int i = 0; i < FRAME_RING; i++) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+        }
+    }
+}
+
+static double PSNR(const unsigned char* a, const unsigned char* b, size_t size)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        double d = (double)a[i] - b[i];
+        sum += d * d;
+    }
+    double mse = sum / size;
+    return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+int main(int argc, char** argv) {
+    int frameCount = FRAME_COUNT;
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    const char* outputFile = OUTPUT_FILE;
+    ResolutionController controller = { DEFAULT_BUDGET_MS, DEFAULT_MIN_SCALE, 1.0f };
+    bool runMode[MODE_COUNT] = { false, false, true };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            bool all = strcmp(name, "all") == 0;
+            bool known = all;
+            for (int m = 0; m < MODE_COUNT; m++) {
+                runMode[m] = all || strcmp(name, modeNames[m]) == 0;
+                known = known || runMode[m];
+            }
+            if (!known) {
+                PrintUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            controller.budgetMs = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc) {
+            controller.minScale = fminf(fmaxf((float)atof(argv[++i]), 0.05f), 1.0f);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (frameCount < 1) {
+        frameCount = 1;
+    }
+    if (width < 1 || height < 1) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Prefer the surfaceless platform, which needs neither a display server nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint majorEGL, minorEGL;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &majorEGL, &minorEGL)) {
+        printf("Failed to initialize EGL\n");
+        return 1;
+    }
+    printf("EGL %d.%d (%s)\n", majorEGL, minorEGL, eglQueryString(display, EGL_VENDOR));
+
+    bool surfaceless = HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    EGLint eglAttribs[] = {
+        EGL_SURFACE_TYPE    , surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE , EGL_OPENGL_BIT,
+        EGL_RED_SIZE        , 8,
+        EGL_GREEN_SIZE      , 8,
+        EGL_BLUE_SIZE       , 8,
+        EGL_ALPHA_SIZE      , 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, eglAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("No suitable EGL config\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION           , 4,
+        EGL_CONTEXT_MINOR_VERSION           , 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK     , EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        printf("Failed to create an OpenGL 4.5 context\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        EGLint pbufferAttribs[] = {
+            EGL_WIDTH   , 1,
+            EGL_HEIGHT  , 1,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+    }
+    eglMakeCurrent(display, surface, surface, context);
+
+    printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+
+    InitOpenGLFunc();
+
+    if (!InitFramebuffers(width, height)) {
+        printf("Framebuffer incomplete\n");
+        return 1;
+    }
+
+    if (!InitShader()) {
+        return 1;
+    }
+
+    printf("%dx%d, %d frames, budget %.1f ms, min scale %.2f\n",
+        width, height, frameCount, controller.budgetMs, controller.minScale);
+
+    size_t imageSize = (size_t)width * height * 3;
+    unsigned char* pixels = (unsigned char*)malloc(imageSize);
+    unsigned char* reference = NULL;
+    int modesRun = 0;
+    for (int m = 0; m < MODE_COUNT; m++) {
+        modesRun += runMode[m] ? 1 : 0;
+    }
+
+    for (int m = 0; m < MODE_COUNT; m++) {
+        if (!runMode[m]) {
+            continue;
+        }
+
+        ModeResult result;
+        RunMode((Mode)m, frameCount, &controller, &result);
+
+        int n = result.measured > 0 ? result.measured : 1;
+        int marchWidth, marchHeight;
+        MarchSize((float)(result.scale / n), &marchWidth, &marchHeight);
+        printf("%-8s %6.1f fps, ms/frame: avg %.2f, max %.2f, avg scale %.2f (%dx%d)",
+            modeNames[m], frameCount / result.wallSeconds, result.frameMs / n, result.maxFrameMs,
+            result.scale / n, marchWidth, marchHeight);
+        if (m == MODE_DYNAMIC) {
+            printf(", final scale %.2f", controller.scale);
+        }
+
+        ReadPixels(pixels, width, height);
+        if (m == MODE_FULL) {
+            reference = (unsigned char*)malloc(imageSize);
+            memcpy(reference, pixels, imageSize);
+        } else if (reference) {
+            printf(", PSNR %.1f dB", PSNR(pixels, reference, imageSize));
+        }
+        printf("\n");
+
+        // With several modes each one gets its own file: hello_full.ppm, ...
+        char path[1024];
+        const char* dot = strrchr(outputFile, '.');
+        int stem = dot ? (int)(dot - outputFile) : (int)strlen(outputFile);
+        if (modesRun > 1) {
+            snprintf(path, sizeof(path), "%.*s_%s%s", stem, outputFile, modeNames[m], dot ? dot : "");
+        } else {
+            snprintf(path, sizeof(path), "%s", outputFile);
+        }
+        if (SavePPM(path, pixels, width, height)) {
+            printf("Wrote %s\n", path);
+        }
+    }
+
+    free(reference);
+    free(pixels);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+    }
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return 0;
+}
+
+void InitOpenGLFunc()
+{
+    glCreateShader            = (PFNGLCREATESHADERPROC)            eglGetProcAddress("glCreateShader");
+    glShaderSource            = (PFNGLSHADERSOURCEPROC)            eglGetProcAddress("glShaderSource");
+    glCompileShader           = (PFNGLCOMPILESHADERPROC)           eglGetProcAddress("glCompileShader");
+    glCreateProgram           = (PFNGLCREATEPROGRAMPROC)           eglGetProcAddress("glCreateProgram");
+    glAttachShader            = (PFNGLATTACHSHADERPROC)            eglGetProcAddress("glAttachShader");
+    glLinkProgram             = (PFNGLLINKPROGRAMPROC)             eglGetProcAddress("glLinkProgram");
+    glUseProgram              = (PFNGLUSEPROGRAMPROC)              eglGetProcAddress("glUseProgram");
+    glGetShaderiv             = (PFNGLGETSHADERIVPROC)             eglGetProcAddress("glGetShaderiv");
+    glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)        eglGetProcAddress("glGetShaderInfoLog");
+    glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)            eglGetProcAddress("glGetProgramiv");
+    glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)       eglGetProcAddress("glGetProgramInfoLog");
+    glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC)      eglGetProcAddress("glGetUniformLocation");
+    glUniform1f               = (PFNGLUNIFORM1FPROC)               eglGetProcAddress("glUniform1f");
+    glUniform2f               = (PFNGLUNIFORM2FPROC)               eglGetProcAddress("glUniform2f");
+    glGenVertexArrays         = (PFNGLGENVERTEXARRAYSPROC)         eglGetProcAddress("glGenVertexArrays");
+    glBindVertexArray         = (PFNGLBINDVERTEXARRAYPROC)         eglGetProcAddress("glBindVertexArray");
+    glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)         eglGetProcAddress("glGenFramebuffers");
+    glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)         eglGetProcAddress("glBindFramebuffer");
+    glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC) eglGetProcAddress("glFramebufferRenderbuffer");
+    glFramebufferTexture2D    = (PFNGLFRAMEBUFFERTEXTURE2DPROC)    eglGetProcAddress("glFramebufferTexture2D");
+    glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)  eglGetProcAddress("glCheckFramebufferStatus");
+    glDrawBuffers             = (PFNGLDRAWBUFFERSPROC)             eglGetProcAddress("glDrawBuffers");
+    glGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)        eglGetProcAddress("glGenRenderbuffers");
+    glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)        eglGetProcAddress("glBindRenderbuffer");
+    glRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)     eglGetProcAddress("glRenderbufferStorage");
+    glBindTextureUnit         = (PFNGLBINDTEXTUREUNITPROC)         eglGetProcAddress("glBindTextureUnit");
+    glFenceSync               = (PFNGLFENCESYNCPROC)               eglGetProcAddress("glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC)          eglGetProcAddress("glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC)              eglGetProcAddress("glDeleteSync");
+}
+
+static GLuint CreateTexture(GLenum internalFormat, GLenum format, GLenum type, int w, int h)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+bool InitFramebuffers(int w, int h)
+{
+    outputWidth = w;
+    outputHeight = h;
+
+    // There is no default framebuffer to draw into, so render to a color renderbuffer
+    glGenRenderbuffers(1, &outputRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, outputRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+
+    glGenFramebuffers(1, &outputFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, outputRbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        return false;
+    }
+
+    // The march target is allocated at full size once; lower resolutions only
+    // use its lower left corner, so changing the scale never reallocates
+    marchColor = CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+    marchDepth = CreateTexture(GL_R32F, GL_RED, GL_FLOAT, w, h);
+
+    glGenFramebuffers(1, &marchFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, marchFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, marchColor, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, marchDepth, 0);
+    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        return false;
+    }
+
+    glGenVertexArrays(1, &vao);
+    return true;
+}
+
+static GLuint CompileShader(GLenum type, const GLchar* const* sources, GLsizei count, const char* name)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, count, sources, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        printf("%s shader compilation failed: %s\n", name, infoLog);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, const char* name)
+{
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        printf("%s program linking failed: %s\n", name, infoLog);
+        return 0;
+    }
+    return program;
+}
+
+bool InitShader()
+{
+    const GLchar* marchSources[] = { sceneSource, marchSource };
+    const GLchar* upsampleSources[] = { sceneSource, upsampleSource };
+
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, &vertexSource, 1, "Vertex");
+    GLuint marchShader = CompileShader(GL_FRAGMENT_SHADER, marchSources, 2, "March");
+    GLuint upsampleShader = CompileShader(GL_FRAGMENT_SHADER, upsampleSources, 2, "Upsample");
+    if (!vertexShader || !marchShader || !upsampleShader) {
+        return false;
+    }
+
+    marchProgram = LinkProgram(vertexShader, marchShader, "March");
+    upsampleProgram = LinkProgram(vertexShader, upsampleShader, "Upsample");
+    if (!marchProgram || !upsampleProgram) {
+        return false;
+    }
+
+    printf("Initialization complete\n");
+    return true;
+}
+
+static void SetUniforms(GLuint program, float time, int marchWidth, int marchHeight)
+{
+    glUseProgram(program);
+    glUniform1f(glGetUniformLocation(program, "iTime"), time);
+    glUniform2f(glGetUniformLocation(program, "iResolution"), (float)outputWidth, (float)outputHeight);
+    glUniform2f(glGetUniformLocation(program, "uMarchSize"), (float)marchWidth, (float)marchHeight);
+}
+
+// March at marchWidth x marchHeight. Without upsampling that must be the
+// output size and the march writes the output directly; otherwise it fills
+// the corner of the march target and the upsample covers the output.
+void Render(float time, int marchWidth, int marchHeight, bool upsample)
+{
+    glBindVertexArray(vao);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, upsample ? marchFbo : outputFbo);
+    glViewport(0, 0, marchWidth, marchHeight);
+    SetUniforms(marchProgram, time, marchWidth, marchHeight);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    if (upsample) {
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+        glViewport(0, 0, outputWidth, outputHeight);
+        SetUniforms(upsampleProgram, time, marchWidth, marchHeight);
+        glBindTextureUnit(0, marchColor);
+        glBindTextureUnit(1, marchDepth);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+}
+
+bool ReadPixels(unsigned char* pixels, int w, int h)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    return true;
+}
+
+bool SavePPM(const char* path, const unsigned char* pixels, int w, int h)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    // GL rows start at the bottom, PPM rows at the top
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    for (int y = h - 1; y >= 0; y--) {
+        fwrite(pixels + (size_t)y * w * 3, 1, (size_t)w * 3, fp);
+    }
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,901 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+
+#define WINDOW_WIDTH    800
+#define WINDOW_HEIGHT   600
+
+#define FRAME_COUNT     60
+#define RUN_SECONDS     2.0         // per mode and distance, once a frame time is measured
+#define OUTPUT_FILE     "hello.ppm"
+
+#define GRID_SIZE       64          // patches per side of the terrain
+#define PATCH_SIZE      16.0f       // world units per patch
+#define HEIGHT_SCALE    40.0f       // terrain heights lie in [0, 2 * HEIGHT_SCALE)
+#define DEFAULT_PIXELS_PER_EDGE 8.0f
+#define DEFAULT_FIXED_LEVEL     8.0f    // the constant factor of the DirectX 12 sample
+#define MAX_DISTANCES   16
+#define FRAME_RING      3           // frames the CPU may queue ahead of the GPU
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef APIENTRYP
+#define APIENTRYP APIENTRY *
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA     0x31DD
+#endif
+
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_TESS_EVALUATION_SHADER         0x8E87
+#define GL_TESS_CONTROL_SHADER            0x8E88
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_FRAMEBUFFER                    0x8D40
+#define GL_RENDERBUFFER                   0x8D41
+#define GL_COLOR_ATTACHMENT0              0x8CE0
+#define GL_DEPTH_ATTACHMENT               0x8D00
+#define GL_FRAMEBUFFER_COMPLETE           0x8CD5
+#define GL_RGBA8                          0x8058
+#define GL_DEPTH_COMPONENT24              0x81A6
+#define GL_PATCHES                        0x000E
+#define GL_PATCH_VERTICES                 0x8E72
+#define GL_MAX_TESS_GEN_LEVEL             0x8E7E
+#define GL_PRIMITIVES_GENERATED           0x8C87
+#define GL_QUERY_RESULT                   0x8866
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+
+typedef char GLchar;
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
+
+typedef GLuint (APIENTRYP PFNGLCREATESHADERPROC) (GLenum type);
+typedef void (APIENTRYP PFNGLSHADERSOURCEPROC) (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length);
+typedef void (APIENTRYP PFNGLCOMPILESHADERPROC) (GLuint shader);
+typedef GLuint (APIENTRYP PFNGLCREATEPROGRAMPROC) (void);
+typedef void (APIENTRYP PFNGLATTACHSHADERPROC) (GLuint program, GLuint shader);
+typedef void (APIENTRYP PFNGLLINKPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLUSEPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef void (APIENTRYP PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef GLint (APIENTRYP PFNGLGETUNIFORMLOCATIONPROC) (GLuint program, const GLchar *name);
+typedef void (APIENTRYP PFNGLUNIFORM1FPROC) (GLint location, GLfloat v0);
+typedef void (APIENTRYP PFNGLUNIFORM1IPROC) (GLint location, GLint v0);
+typedef void (APIENTRYP PFNGLUNIFORM2FPROC) (GLint location, GLfloat v0, GLfloat v1);
+typedef void (APIENTRYP PFNGLUNIFORM3FPROC) (GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+typedef void (APIENTRYP PFNGLUNIFORM4FVPROC) (GLint location, GLsizei count, const GLfloat *value);
+typedef void (APIENTRYP PFNGLUNIFORMMATRIX4FVPROC) (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+typedef void (APIENTRYP PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
+typedef void (APIENTRYP PFNGLBINDVERTEXARRAYPROC) (GLuint array);
+typedef void (APIENTRYP PFNGLGENFRAMEBUFFERSPROC) (GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLBINDFRAMEBUFFERPROC) (GLenum target, GLuint framebuffer);
+typedef void (APIENTRYP PFNGLFRAMEBUFFERRENDERBUFFERPROC) (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+typedef GLenum (APIENTRYP PFNGLCHECKFRAMEBUFFERSTATUSPROC) (GLenum target);
+typedef void (APIENTRYP PFNGLGENRENDERBUFFERSPROC) (GLsizei n, GLuint *renderbuffers);
+typedef void (APIENTRYP PFNGLBINDRENDERBUFFERPROC) (GLenum target, GLuint renderbuffer);
+typedef void (APIENTRYP PFNGLRENDERBUFFERSTORAGEPROC) (GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLPATCHPARAMETERIPROC) (GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLGENQUERIESPROC) (GLsizei n, GLuint *ids);
+typedef void (APIENTRYP PFNGLDELETEQUERIESPROC) (GLsizei n, const GLuint *ids);
+typedef void (APIENTRYP PFNGLBEGINQUERYPROC) (GLenum target, GLuint id);
+typedef void (APIENTRYP PFNGLENDQUERYPROC) (GLenum target);
+typedef void (APIENTRYP PFNGLGETQUERYOBJECTUI64VPROC) (GLuint id, GLenum pname, GLuint64 *params);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+
+PFNGLCREATESHADERPROC             glCreateShader;
+PFNGLSHADERSOURCEPROC             glShaderSource;
+PFNGLCOMPILESHADERPROC            glCompileShader;
+PFNGLCREATEPROGRAMPROC            glCreateProgram;
+PFNGLATTACHSHADERPROC             glAttachShader;
+PFNGLLINKPROGRAMPROC              glLinkProgram;
+PFNGLUSEPROGRAMPROC               glUseProgram;
+PFNGLGETSHADERIVPROC              glGetShaderiv;
+PFNGLGETSHADERINFOLOGPROC         glGetShaderInfoLog;
+PFNGLGETPROGRAMIVPROC             glGetProgramiv;
+PFNGLGETPROGRAMINFOLOGPROC        glGetProgramInfoLog;
+PFNGLGETUNIFORMLOCATIONPROC       glGetUniformLocation;
+PFNGLUNIFORM1FPROC                glUniform1f;
+PFNGLUNIFORM1IPROC                glUniform1i;
+PFNGLUNIFORM2FPROC                glUniform2f;
+PFNGLUNIFORM3FPROC                glUniform3f;
+PFNGLUNIFORM4FVPROC               glUniform4fv;
+PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv;
+PFNGLGENVERTEXARRAYSPROC          glGenVertexArrays;
+PFNGLBINDVERTEXARRAYPROC          glBindVertexArray;
+PFNGLGENFRAMEBUFFERSPROC          glGenFramebuffers;
+PFNGLBINDFRAMEBUFFERPROC          glBindFramebuffer;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC  glFramebufferRenderbuffer;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus;
+PFNGLGENRENDERBUFFERSPROC         glGenRenderbuffers;
+PFNGLBINDRENDERBUFFERPROC         glBindRenderbuffer;
+PFNGLRENDERBUFFERSTORAGEPROC      glRenderbufferStorage;
+PFNGLPATCHPARAMETERIPROC          glPatchParameteri;
+PFNGLGENQUERIESPROC               glGenQueries;
+PFNGLDELETEQUERIESPROC            glDeleteQueries;
+PFNGLBEGINQUERYPROC               glBeginQuery;
+PFNGLENDQUERYPROC                 glEndQuery;
+PFNGLGETQUERYOBJECTUI64VPROC      glGetQueryObjectui64v;
+PFNGLFENCESYNCPROC                glFenceSync;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+PFNGLDELETESYNCPROC               glDeleteSync;
+
+struct Camera;
+
+extern void InitOpenGLFunc();
+extern bool InitFramebuffer(int w, int h);
+extern bool InitShader();
+extern void Render(const Camera* camera, float fixedLevel, bool wireframe);
+extern bool ReadPixels(unsigned char* pixels, int w, int h);
+extern bool SavePPM(const char* path, const unsigned char* pixels, int w, int h);
+
+// Shader sources
+
+// The terrain height, shared by the vertex shader (which needs the corner
+// heights for the tessellation factors) and the evaluation shader: six
+// octaves of value noise with an integer hash, so every stage computes
+// bit-identical heights for the same position.
+const GLchar* terrainSource =
+    "#version 450 core\n"
+    "uniform float uHeightScale;\n"
+    "\n"
+    "float Hash(ivec2 p)\n"
+    "{\n"
+    "  uint h = uint(p.x) * 374761393u + uint(p.y) * 668265263u;\n"
+    "  h = (h ^ (h >> 13)) * 1274126177u;\n"
+    "  return float(h ^ (h >> 16)) * (1.0 / 4294967296.0);\n"
+    "}\n"
+    "\n"
+    "float Noise(vec2 p)\n"
+    "{\n"
+    "  ivec2 i = ivec2(floor(p));\n"
+    "  vec2 f = p - floor(p);\n"
+    "  vec2 u = f * f * (3.0 - 2.0 * f);\n"
+    "  float a = Hash(i);\n"
+    "  float b = Hash(i + ivec2(1, 0));\n"
+    "  float c = Hash(i + ivec2(0, 1));\n"
+    "  float d = Hash(i + ivec2(1, 1));\n"
+    "  return mix(mix(a, b, u.x), mix(c, d, u.x), u.y);\n"
+    "}\n"
+    "\n"
+    "float Height(vec2 xz)\n"
+    "{\n"
+    "  float h = 0.0;\n"
+    "  float amplitude = 1.0;\n"
+    "  vec2 p = xz / 128.0;\n"
+    "  for (int i = 0; i < 6; i++) {\n"
+    "    h += amplitude * Noise(p);\n"
+    "    amplitude *= 0.5;\n"
+    "    p *= 2.0;\n"
+    "  }\n"
+    "  return h * uHeightScale;\n"
+    "}\n";
+
+// Four control points per patch straight from gl_VertexID, so no vertex
+// buffer is needed. Integer grid coordinates keep the corners that
+// neighbouring patches share bit-identical.
+const GLchar* vertexSource =
+    "uniform int uGridSize;\n"
+    "uniform float uPatchSize;\n"
+    "out vec3 vPosition;\n"
+    "void main()\n"
+    "{\n"
+    "  int patchIndex = gl_VertexID >> 2;\n"
+    "  int corner = gl_VertexID & 3;\n"
+    "  ivec2 cell = ivec2(patchIndex % uGridSize, patchIndex / uGridSize);\n"
+    "  ivec2 offset = ivec2(corner == 1 || corner == 2 ? 1 : 0, corner >= 2 ? 1 : 0);\n"
+    "  vec2 xz = vec2(cell + offset - uGridSize / 2) * uPatchSize;\n"
+    "  vPosition = vec3(xz.x, Height(xz), xz.y);\n"
+    "}\n";
+
+// Tessellation factors. Each outer factor depends only on the two corners of
+// its edge: the edge is treated as a sphere around its midpoint, and the
+// factor is its projected diameter in pixels over uPixelsPerEdge. Both
+// patches that share an edge compute it from the same two corners with
+// commutative operations, so they agree exactly and no cracks can open.
+// Patches whose bounding box lies outside the frustum get factor 0 and are
+// dropped before evaluation. uFixedLevel > 0 uses that factor everywhere,
+// like the DirectX 12 sample.
+const GLchar* controlSource =
+    "#version 450 core\n"
+    "layout(vertices = 4) out;\n"
+    "uniform mat4 uViewProj;\n"
+    "uniform vec4 uPlanes[6];\n"
+    "uniform vec2 uViewport;\n"
+    "uniform float uProjScale;\n"
+    "uniform float uPixelsPerEdge;\n"
+    "uniform float uMaxLevel;\n"
+    "uniform float uFixedLevel;\n"
+    "uniform float uHeightScale;\n"
+    "in vec3 vPosition[];\n"
+    "out vec3 tcPosition[];\n"
+    "\n"
+    "float EdgeLevel(vec3 a, vec3 b)\n"
+    "{\n"
+    "  vec3 center = (a + b) * 0.5;\n"
+    "  float diameter = length(a - b);\n"
+    "  float w = max((uViewProj * vec4(center, 1.0)).w, 1e-3);\n"
+    "  float pixels = diameter * uProjScale * uViewport.y * 0.5 / w;\n"
+    "  return clamp(pixels / uPixelsPerEdge, 1.0, uMaxLevel);\n"
+    "}\n"
+    "\n"
+    "bool Culled()\n"
+    "{\n"
+    "  vec3 lo = vec3(min(vPosition[0].x, vPosition[2].x), 0.0, min(vPosition[0].z, vPosition[2].z));\n"
+    "  vec3 hi = vec3(max(vPosition[0].x, vPosition[2].x), 2.0 * uHeightScale, max(vPosition[0].z, vPosition[2].z));\n"
+    "  for (int i = 0; i < 6; i++) {\n"
+    "    vec3 p = mix(lo, hi, step(vec3(0.0), uPlanes[i].xyz));\n"
+    "    if (dot(uPlanes[i].xyz, p) + uPlanes[i].w < 0.0) return true;\n"
+    "  }\n"
+    "  return false;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "  tcPosition[gl_InvocationID] = vPosition[gl_InvocationID];\n"
+    "  if (gl_InvocationID == 0) {\n"
+    "    if (Culled()) {\n"
+    "      gl_TessLevelOuter[0] = 0.0;\n"
+    "      gl_TessLevelOuter[1] = 0.0;\n"
+    "      gl_TessLevelOuter[2] = 0.0;\n"
+    "      gl_TessLevelOuter[3] = 0.0;\n"
+    "      gl_TessLevelInner[0] = 0.0;\n"
+    "      gl_TessLevelInner[1] = 0.0;\n"
+    "      return;\n"
+    "    }\n"
+    "    // Corners 0..3 are (0,0), (1,0), (1,1), (0,1) in (u,v); outer level\n"
+    "    // 0 is the u = 0 edge, 1 is v = 0, 2 is u = 1 and 3 is v = 1\n"
+    "    vec4 outer;\n"
+    "    if (uFixedLevel > 0.0) {\n"
+    "      outer = vec4(uFixedLevel);\n"
+    "    } else {\n"
+    "      outer = vec4(EdgeLevel(vPosition[0], vPosition[3]), EdgeLevel(vPosition[0], vPosition[1]),\n"
+    "                   EdgeLevel(vPosition[1], vPosition[2]), EdgeLevel(vPosition[3], vPosition[2]));\n"
+    "    }\n"
+    "    gl_TessLevelOuter[0] = outer.x;\n"
+    "    gl_TessLevelOuter[1] = outer.y;\n"
+    "    gl_TessLevelOuter[2] = outer.z;\n"
+    "    gl_TessLevelOuter[3] = outer.w;\n"
+    "    gl_TessLevelInner[0] = max(outer.y, outer.w);\n"
+    "    gl_TessLevelInner[1] = max(outer.x, outer.z);\n"
+    "  }\n"
+    "}\n";
+
+// Bilinear position on the flat patch, then the height and its normal
+const GLchar* evaluationSource =
+    "layout(quads, fractional_odd_spacing, cw) in;\n"
+    "uniform mat4 uViewProj;\n"
+    "in vec3 tcPosition[];\n"
+    "out vec3 tePosition;\n"
+    "out vec3 teNormal;\n"
+    "void main()\n"
+    "{\n"
+    "  vec2 uv = gl_TessCoord.xy;\n"
+    "  vec3 a = mix(tcPosition[0], tcPosition[1], uv.x);\n"
+    "  vec3 b = mix(tcPosition[3], tcPosition[2], uv.x);\n"
+    "  vec2 xz = mix(a, b, uv.y).xz;\n"
+    "  float h = Height(xz);\n"
+    "  const float e = 0.5;\n"
+    "  teNormal = normalize(vec3(Height(xz - vec2(e, 0.0)) - Height(xz + vec2(e, 0.0)), 2.0 * e,\n"
+    "                            Height(xz - vec2(0.0, e)) - Height(xz + vec2(0.0, e))));\n"
+    "  tePosition = vec3(xz.x, h, xz.y);\n"
+    "  gl_Position = uViewProj * vec4(tePosition, 1.0);\n"
+    "}\n";
+
+// Grass, rock and snow by height and slope, with distance fog
+const GLchar* fragmentSource =
+    "#version 450 core\n"
+    "uniform vec3 uCameraPosition;\n"
+    "uniform float uHeightScale;\n"
+    "in vec3 tePosition;\n"
+    "in vec3 teNormal;\n"
+    "out vec4 outColor;\n"
+    "void main()\n"
+    "{\n"
+    "  vec3 n = normalize(teNormal);\n"
+    "  float height = tePosition.y / (2.0 * uHeightScale);\n"
+    "  vec3 color = mix(vec3(0.25, 0.45, 0.15), vec3(0.45, 0.4, 0.35), smoothstep(0.7, 0.9, 1.0 - n.y));\n"
+    "  color = mix(color, vec3(0.95), smoothstep(0.6, 0.7, height) * step(0.75, n.y));\n"
+    "  vec3 light = normalize(vec3(0.5, 0.8, 0.3));\n"
+    "  color *= 0.25 + 0.75 * max(dot(n, light), 0.0);\n"
+    "  float fog = 1.0 - exp(-length(tePosition - uCameraPosition) * 0.0008);\n"
+    "  outColor = vec4(mix(color, vec3(0.6, 0.7, 0.8), fog), 1.0);\n"
+    "}\n";
+
+GLuint vao;
+GLuint fbo;
+GLuint colorRbo;
+GLuint depthRbo;
+GLuint program;
+int outputWidth;
+int outputHeight;
+float maxTessLevel;
+float pixelsPerEdge = DEFAULT_PIXELS_PER_EDGE;
+
+// Column-major, as glUniformMatrix4fv expects without transposing
+struct Matrix {
+    float m[16];
+};
+
+struct Camera {
+    float position[3];
+    Matrix viewProj;
+    float projScale;        // cot(fovy / 2), the [1][1] element of the projection
+    float planes[6][4];     // left, right, bottom, top, near, far
+};
+
+static Matrix Multiply(const Matrix& a, const Matrix& b)
+{
+    Matrix r;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+            }
+            r.m[column * 4 + row] = sum;
+        }
+    }
+    return r;
+}
+
+static void Normalize(float v[3])
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+}
+
+static void Cross(const float a[3], const float b[3], float r[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// The camera looks at the terrain centre from `distance` away, 35 degrees
+// above the horizon, and circles it slowly as the frames advance
+static void SetupCamera(Camera* camera, float distance, float angle)
+{
+    const float pitch = 35.0f * 3.14159265f / 180.0f;
+    const float fovy = 45.0f * 3.14159265f / 180.0f;
+    float nearZ = fmaxf(distance * 0.01f, 0.5f);
+    float farZ = distance + GRID_SIZE * PATCH_SIZE * 1.5f;
+
+    float eye[3] = {
+        distance * cosf(pitch) * sinf(angle),
+        distance * sinf(pitch) + HEIGHT_SCALE,
+        -distance * cosf(pitch) * cosf(angle)
+    };
+    float center[3] = { 0.0f, HEIGHT_SCALE, 0.0f };
+    float up[3] = { 0.0f, 1.0f, 0.0f };
+    memcpy(camera->position, eye, sizeof(eye));
+
+    float f[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    Normalize(f);
+    float s[3];
+    Cross(f, up, s);
+    Normalize(s);
+    float u[3];
+    Cross(s, f, u);
+
+    Matrix view = { {
+        s[0], u[0], -f[0], 0.0f,
+        s[1], u[1], -f[1], 0.0f,
+        s[2], u[2], -f[2], 0.0f,
+        -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]),
+        -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]),
+        f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2], 1.0f
+    } };
+
+    float cot = 1.0f / tanf(fovy / 2.0f);
+    float aspect = (float)outputWidth / outputHeight;
+    Matrix proj = {};
+    proj.m[0] = cot / aspect;
+    proj.m[5] = cot;
+    proj.m[10] = (farZ + nearZ) / (nearZ - farZ);
+    proj.m[11] = -1.0f;
+    proj.m[14] = 2.0f * farZ * nearZ / (nearZ - farZ);
+
+    camera->viewProj = Multiply(proj, view);
+    camera->projScale = cot;
+
+    // Gribb-Hartmann: clip planes are sums and differences of the rows
+    const float* m = camera->viewProj.m;
+    for (int i = 0; i < 6; i++) {
+        int axis = i / 2;
+        float sign = (i & 1) ? -1.0f : 1.0f;
+        for (int k = 0; k < 4; k++) {
+            camera->planes[i][k] = m[k * 4 + 3] + sign * m[k * 4 + axis];
+        }
+    }
+}
+
+static bool HasExtension(const char* extensions, const char* name)
+{
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static double NowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void PrintUsage()
+{
+    printf("usage: hello [--distances D1,D2,...] [--frames N] [--seconds S] [--size W H]\n"
+           "             [--pixels-per-edge P] [--fixed-level L] [--wireframe] [--output FILE]\n");
+}
+
+struct RunResult {
+    double wallSeconds;
+    double frameMs;
+    double triangles;
+    int    frames;
+    int    measured;
+};
+
+// The CPU runs at most FRAME_RING frames ahead: before a frame is submitted
+// the fence of the frame FRAME_RING back is waited on, so once the ring is
+// full the time between submissions is the time the driver needs per frame
+// (llvmpipe does not time its rasterizer threads with timer queries). The
+// primitives generated by the evaluation shader are counted with one query per
+// ring slot, read once that slot's fence has signaled. A run ends after
+// frameCount frames, or earlier once it has measured at least one frame time
+// and spent `seconds` (fixed level 8 far away costs seconds per frame on
+// llvmpipe).
+static void RunDistance(float distance, float fixedLevel, int frameCount, double seconds, bool wireframe,
+    RunResult* result)
+{
+    GLsync fences[FRAME_RING] = {};
+    GLuint queries[FRAME_RING];
+    bool queried[FRAME_RING] = {};
+    glGenQueries(FRAME_RING, queries);
+
+    memset(result, 0, sizeof(*result));
+    int triangleFrames = 0;
+
+    double start = NowSeconds();
+    double last = start;
+    for (int i = 0; i < frameCount; i++) {
+        int slot = i % FRAME_RING;
+        if (fences[slot]) {
+            glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 10000000000ull);
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+        if (queried[slot]) {
+            GLuint64 primitives = 0;
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &primitives);
+            result->triangles += (double)primitives;
+            triangleFrames++;
+        }
+
+        double now = NowSeconds();
+        if (i > FRAME_RING) {
+            result->frameMs += (now - last) * 1e3;
+            result->measured++;
+        }
+        last = now;
+        if (seconds > 0.0 && result->measured > 0 && now - start >= seconds) {
+            break;
+        }
+
+        Camera camera;
+        SetupCamera(&camera, distance, i * 0.25f * 3.14159265f / 180.0f);
+
+        glBeginQuery(GL_PRIMITIVES_GENERATED, queries[slot]);
+        Render(&camera, fixedLevel, wireframe);
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        queried[slot] = true;
+
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        result->frames++;
+    }
+    glFinish();
+    result->wallSeconds = NowSeconds() - start;
+
+    for (int i = 0; i < FRAME_RING; i++) {
+        if (fences[i]) {
+            glDeleteSync(fences[i]);
+        }
+        // Every slot still holds the unread count of one of the last frames
+        if (queried[i]) {
+            GLuint64 primitives = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &primitives);
+            result->triangles += (double)primitives;
+            triangleFrames++;
+        }
+    }
+    glDeleteQueries(FRAME_RING, queries);
+
+    result->triangles /= triangleFrames > 0 ? triangleFrames : 1;
+    if (result->measured == 0) {
+        result->frameMs = result->wallSeconds * 1e3;
+        result->measured = result->frames;
+    }
+}
+
+int main(int argc, char** argv) {
+    int frameCount = FRAME_COUNT;
+    double seconds = RUN_SECONDS;
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    const char* outputFile = OUTPUT_FILE;
+    float fixedLevel = DEFAULT_FIXED_LEVEL;
+    bool wireframe = false;
+    float distances[MAX_DISTANCES] = { 100.0f, 250.0f, 600.0f, 1500.0f };
+    int distanceCount = 4;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--distances") == 0 && i + 1 < argc) {
+            distanceCount = 0;
+            char* list = argv[++i];
+            char* end = list;
+            while (*list && distanceCount < MAX_DISTANCES) {
+                float d = strtof(list, &end);
+                if (end == list || d <= 0.0f) {
+                    PrintUsage();
+                    return 1;
+                }
+                distances[distanceCount++] = d;
+                list = *end == ',' ? end + 1 : end;
+            }
+            if (distanceCount == 0) {
+                PrintUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pixels-per-edge") == 0 && i + 1 < argc) {
+            pixelsPerEdge = fmaxf((float)atof(argv[++i]), 0.5f);
+        } else if (strcmp(argv[i], "--fixed-level") == 0 && i + 1 < argc) {
+            fixedLevel = fmaxf((float)atof(argv[++i]), 1.0f);
+        } else if (strcmp(argv[i], "--wireframe") == 0) {
+            wireframe = true;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (frameCount < 1) {
+        frameCount = 1;
+    }
+    if (width < 1 || height < 1) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Prefer the surfaceless platform, which needs neither a display server nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint majorEGL, minorEGL;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &majorEGL, &minorEGL)) {
+        printf("Failed to initialize EGL\n");
+        return 1;
+    }
+    printf("EGL %d.%d (%s)\n", majorEGL, minorEGL, eglQueryString(display, EGL_VENDOR));
+
+    bool surfaceless = HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    EGLint eglAttribs[] = {
+        EGL_SURFACE_TYPE    , surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE , EGL_OPENGL_BIT,
+        EGL_RED_SIZE        , 8,
+        EGL_GREEN_SIZE      , 8,
+        EGL_BLUE_SIZE       , 8,
+        EGL_ALPHA_SIZE      , 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, eglAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("No suitable EGL config\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION           , 4,
+        EGL_CONTEXT_MINOR_VERSION           , 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK     , EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        printf("Failed to create an OpenGL 4.5 context\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        EGLint pbufferAttribs[] = {
+            EGL_WIDTH   , 1,
+            EGL_HEIGHT  , 1,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+    }
+    eglMakeCurrent(display, surface, surface, context);
+
+    printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+
+    InitOpenGLFunc();
+
+    if (!InitFramebuffer(width, height)) {
+        printf("Framebuffer incomplete\n");
+        return 1;
+    }
+
+    if (!InitShader()) {
+        return 1;
+    }
+
+    GLint maxLevel = 64;
+    glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxLevel);
+    maxTessLevel = (float)maxLevel;
+    fixedLevel = fminf(fixedLevel, maxTessLevel);
+
+    printf("%dx%d, up to %d frames or %.1f s per run, %dx%d patches, %.0f pixels per edge, fixed level %.0f, max level %d\n",
+        width, height, frameCount, seconds, GRID_SIZE, GRID_SIZE, pixelsPerEdge, fixedLevel, maxLevel);
+    printf("distance  mode        frames  triangles/frame  ms/frame     fps  Mtris/s\n");
+
+    size_t imageSize = (size_t)width * height * 3;
+    unsigned char* pixels = (unsigned char*)malloc(imageSize);
+    bool saved = false;
+
+    for (int d = 0; d < distanceCount; d++) {
+        for (int fixed = 0; fixed < 2; fixed++) {
+            RunResult result;
+            RunDistance(distances[d], fixed ? fixedLevel : 0.0f, frameCount, seconds, wireframe, &result);
+
+            double frameMs = result.frameMs / result.measured;
+            char mode[32];
+            snprintf(mode, sizeof(mode), fixed ? "fixed %.0f" : "adaptive", fixedLevel);
+            printf("%8.0f  %-10s  %6d  %15.0f  %8.2f  %6.1f  %7.2f\n", distances[d], mode, result.frames,
+                result.triangles,
+                frameMs, 1e3 / frameMs, result.triangles / frameMs / 1e3);
+
+            // The adaptive image at the closest distance shows the most detail
+            if (!fixed && !saved) {
+                ReadPixels(pixels, width, height);
+                saved = SavePPM(outputFile, pixels, width, height);
+            }
+        }
+    }
+    if (saved) {
+        printf("Wrote %s\n", outputFile);
+    }
+
+    free(pixels);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+    }
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return 0;
+}
+
+void InitOpenGLFunc()
+{
+    glCreateShader            = (PFNGLCREATESHADERPROC)            eglGetProcAddress("glCreateShader");
+    glShaderSource            = (PFNGLSHADERSOURCEPROC)            eglGetProcAddress("glShaderSource");
+    glCompileShader           = (PFNGLCOMPILESHADERPROC)           eglGetProcAddress("glCompileShader");
+    glCreateProgram           = (PFNGLCREATEPROGRAMPROC)           eglGetProcAddress("glCreateProgram");
+    glAttachShader            = (PFNGLATTACHSHADERPROC)            eglGetProcAddress("glAttachShader");
+    glLinkProgram             = (PFNGLLINKPROGRAMPROC)             eglGetProcAddress("glLinkProgram");
+    glUseProgram              = (PFNGLUSEPROGRAMPROC)              eglGetProcAddress("glUseProgram");
+    glGetShaderiv             = (PFNGLGETSHADERIVPROC)             eglGetProcAddress("glGetShaderiv");
+    glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)        eglGetProcAddress("glGetShaderInfoLog");
+    glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)            eglGetProcAddress("glGetProgramiv");
+    glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)       eglGetProcAddress("glGetProgramInfoLog");
+    glGetUniformLocation      = (PFNGLGETUNIFORMLOCATIONPROC)      eglGetProcAddress("glGetUniformLocation");
+    glUniform1f               = (PFNGLUNIFORM1FPROC)               eglGetProcAddress("glUniform1f");
+    glUniform1i               = (PFNGLUNIFORM1IPROC)               eglGetProcAddress("glUniform1i");
+    glUniform2f               = (PFNGLUNIFORM2FPROC)               eglGetProcAddress("glUniform2f");
+    glUniform3f               = (PFNGLUNIFORM3FPROC)               eglGetProcAddress("glUniform3f");
+    glUniform4fv              = (PFNGLUNIFORM4FVPROC)              eglGetProcAddress("glUniform4fv");
+    glUniformMatrix4fv        = (PFNGLUNIFORMMATRIX4FVPROC)        eglGetProcAddress("glUniformMatrix4fv");
+    glGenVertexArrays         = (PFNGLGENVERTEXARRAYSPROC)         eglGetProcAddress("glGenVertexArrays");
+    glBindVertexArray         = (PFNGLBINDVERTEXARRAYPROC)         eglGetProcAddress("glBindVertexArray");
+    glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)         eglGetProcAddress("glGenFramebuffers");
+    glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)         eglGetProcAddress("glBindFramebuffer");
+    glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC) eglGetProcAddress("glFramebufferRenderbuffer");
+    glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)  eglGetProcAddress("glCheckFramebufferStatus");
+    glGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)        eglGetProcAddress("glGenRenderbuffers");
+    glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)        eglGetProcAddress("glBindRenderbuffer");
+    glRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)     eglGetProcAddress("glRenderbufferStorage");
+    glPatchParameteri         = (PFNGLPATCHPARAMETERIPROC)         eglGetProcAddress("glPatchParameteri");
+    glGenQueries              = (PFNGLGENQUERIESPROC)              eglGetProcAddress("glGenQueries");
+    glDeleteQueries           = (PFNGLDELETEQUERIESPROC)           eglGetProcAddress("glDeleteQueries");
+    glBeginQuery              = (PFNGLBEGINQUERYPROC)              eglGetProcAddress("glBeginQuery");
+    glEndQuery                = (PFNGLENDQUERYPROC)                eglGetProcAddress("glEndQuery");
+    glGetQueryObjectui64v     = (PFNGLGETQUERYOBJECTUI64VPROC)     eglGetProcAddress("glGetQueryObjectui64v");
+    glFenceSync               = (PFNGLFENCESYNCPROC)               eglGetProcAddress("glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC)          eglGetProcAddress("glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC)              eglGetProcAddress("glDeleteSync");
+}
+
+bool InitFramebuffer(int w, int h)
+{
+    outputWidth = w;
+    outputHeight = h;
+
+    // There is no default framebuffer to draw into, so render to color and
+    // depth renderbuffers
+    glGenRenderbuffers(1, &colorRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+
+    glGenRenderbuffers(1, &depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        return false;
+    }
+
+    glGenVertexArrays(1, &vao);
+    return true;
+}
+
+static GLuint CompileShader(GLenum type, const GLchar* const* sources, GLsizei count, const char* name)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, count, sources, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+        printf("%s shader compilation failed: %s\n", name, infoLog);
+        return 0;
+    }
+    return shader;
+}
+
+bool InitShader()
+{
+    const GLchar* vertexSources[] = { terrainSource, vertexSource };
+    const GLchar* evaluationSources[] = { terrainSource, evaluationSource };
+
+    GLuint shaders[4] = {
+        CompileShader(GL_VERTEX_SHADER, vertexSources, 2, "Vertex"),
+        CompileShader(GL_TESS_CONTROL_SHADER, &controlSource, 1, "Tessellation control"),
+        CompileShader(GL_TESS_EVALUATION_SHADER, evaluationSources, 2, "Tessellation evaluation"),
+        CompileShader(GL_FRAGMENT_SHADER, &fragmentSource, 1, "Fragment")
+    };
+
+    program = glCreateProgram();
+    for (int i = 0; i < 4; i++) {
+        if (!shaders[i]) {
+            return false;
+        }
+        glAttachShader(program, shaders[i]);
+    }
+    glLinkProgram(program);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        printf("Program linking failed: %s\n", infoLog);
+        return false;
+    }
+
+    printf("Initialization complete\n");
+    return true;
+}
+
+void Render(const Camera* camera, float fixedLevel, bool wireframe)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, outputWidth, outputHeight);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
+    glClearColor(0.6f, 0.7f, 0.8f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uGridSize"), GRID_SIZE);
+    glUniform1f(glGetUniformLocation(program, "uPatchSize"), PATCH_SIZE);
+    glUniform1f(glGetUniformLocation(program, "uHeightScale"), HEIGHT_SCALE);
+    glUniformMatrix4fv(glGetUniformLocation(program, "uViewProj"), 1, GL_FALSE, camera->viewProj.m);
+    glUniform4fv(glGetUniformLocation(program, "uPlanes"), 6, &camera->planes[0][0]);
+    glUniform3f(glGetUniformLocation(program, "uCameraPosition"), camera->position[0], camera->position[1], camera->position[2]);
+    glUniform2f(glGetUniformLocation(program, "uViewport"), (float)outputWidth, (float)outputHeight);
+    glUniform1f(glGetUniformLocation(program, "uProjScale"), camera->projScale);
+    glUniform1f(glGetUniformLocation(program, "uPixelsPerEdge"), pixelsPerEdge);
+    glUniform1f(glGetUniformLocation(program, "uMaxLevel"), maxTessLevel);
+    glUniform1f(glGetUniformLocation(program, "uFixedLevel"), fixedLevel);
+
+    glBindVertexArray(vao);
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glDrawArrays(GL_PATCHES, 0, GRID_SIZE * GRID_SIZE * 4);
+}
+
+bool ReadPixels(unsigned char* pixels, int w, int h)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    return true;
+}
+
+bool SavePPM(const char* path, const unsigned char* pixels, int w, int h)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    // GL rows start at the bottom, PPM rows at the top
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    for (int y = h - 1; y >= 0; y--) {
+        fwrite(pixels + (size_t)y * w * 3, 1, (size_t)w * 3, fp);
+    }
+    fclose(fp);
+    return true;
+}
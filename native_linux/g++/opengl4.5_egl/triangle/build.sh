@@ -0,0 +1 @@
+g++ -o hello  hello.cpp -lEGL -lGL -lpthread
@@ -0,0 +1,1021 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define WINDOW_WIDTH    640
+#define WINDOW_HEIGHT   480
+
+#define FRAME_COUNT     1000
+#define OUTPUT_FILE     "hello.ppm"
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef APIENTRYP
+#define APIENTRYP APIENTRY *
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA     0x31DD
+#endif
+
+#define GL_ARRAY_BUFFER                   0x8892
+#define GL_STATIC_DRAW                    0x88E4
+#define GL_FRAGMENT_SHADER                0x8B30
+#define GL_VERTEX_SHADER                  0x8B31
+#define GL_COMPILE_STATUS                 0x8B81
+#define GL_LINK_STATUS                    0x8B82
+#define GL_INFO_LOG_LENGTH                0x8B84
+#define GL_FRAMEBUFFER                    0x8D40
+#define GL_RENDERBUFFER                   0x8D41
+#define GL_COLOR_ATTACHMENT0              0x8CE0
+#define GL_FRAMEBUFFER_COMPLETE           0x8CD5
+#define GL_RGBA8                          0x8058
+#define GL_STREAM_READ                    0x88E1
+#define GL_PIXEL_PACK_BUFFER              0x88EB
+#define GL_MAP_READ_BIT                   0x0001
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_TIMEOUT_EXPIRED                0x911B
+#define GL_WAIT_FAILED                    0x911D
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+#define GL_STREAM_DRAW                    0x88E0
+#define GL_MAP_WRITE_BIT                  0x0002
+#define GL_MAP_PERSISTENT_BIT             0x0040
+#define GL_MAP_COHERENT_BIT               0x0080
+
+typedef ptrdiff_t GLsizeiptr;
+typedef char GLchar;
+typedef ptrdiff_t GLintptr;
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
+
+typedef void (APIENTRYP PFNGLGENBUFFERSPROC) (GLsizei n, GLuint *buffers);
+typedef void (APIENTRYP PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
+typedef void (APIENTRYP PFNGLBUFFERDATAPROC) (GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+typedef GLuint (APIENTRYP PFNGLCREATESHADERPROC) (GLenum type);
+typedef void (APIENTRYP PFNGLSHADERSOURCEPROC) (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length);
+typedef void (APIENTRYP PFNGLCOMPILESHADERPROC) (GLuint shader);
+typedef GLuint (APIENTRYP PFNGLCREATEPROGRAMPROC) (void);
+typedef void (APIENTRYP PFNGLATTACHSHADERPROC) (GLuint program, GLuint shader);
+typedef void (APIENTRYP PFNGLLINKPROGRAMPROC) (GLuint program);
+typedef void (APIENTRYP PFNGLUSEPROGRAMPROC) (GLuint program);
+typedef GLint (APIENTRYP PFNGLGETATTRIBLOCATIONPROC) (GLuint program, const GLchar *name);
+typedef void (APIENTRYP PFNGLENABLEVERTEXATTRIBARRAYPROC) (GLuint index);
+typedef void (APIENTRYP PFNGLVERTEXATTRIBPOINTERPROC) (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+typedef void (APIENTRYP PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
+typedef void (APIENTRYP PFNGLBINDVERTEXARRAYPROC) (GLuint array);
+typedef void (APIENTRYP PFNGLGETSHADERIVPROC) (GLuint shader, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETSHADERINFOLOGPROC) (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef void (APIENTRYP PFNGLGETPROGRAMIVPROC) (GLuint program, GLenum pname, GLint *params);
+typedef void (APIENTRYP PFNGLGETPROGRAMINFOLOGPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+typedef void (APIENTRYP PFNGLGENFRAMEBUFFERSPROC) (GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLBINDFRAMEBUFFERPROC) (GLenum target, GLuint framebuffer);
+typedef void (APIENTRYP PFNGLFRAMEBUFFERRENDERBUFFERPROC) (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+typedef GLenum (APIENTRYP PFNGLCHECKFRAMEBUFFERSTATUSPROC) (GLenum target);
+typedef void (APIENTRYP PFNGLGENRENDERBUFFERSPROC) (GLsizei n, GLuint *renderbuffers);
+typedef void (APIENTRYP PFNGLBINDRENDERBUFFERPROC) (GLenum target, GLuint renderbuffer);
+typedef void (APIENTRYP PFNGLRENDERBUFFERSTORAGEPROC) (GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint *buffers);
+typedef void *(APIENTRYP PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP PFNGLUNMAPBUFFERPROC) (GLenum target);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+typedef void (APIENTRYP PFNGLBUFFERSUBDATAPROC) (GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+typedef void (APIENTRYP PFNGLCREATEBUFFERSPROC) (GLsizei n, GLuint *buffers);
+typedef void (APIENTRYP PFNGLNAMEDBUFFERSTORAGEPROC) (GLuint buffer, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void *(APIENTRYP PFNGLMAPNAMEDBUFFERRANGEPROC) (GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP PFNGLUNMAPNAMEDBUFFERPROC) (GLuint buffer);
+typedef void (APIENTRYP PFNGLCREATEVERTEXARRAYSPROC) (GLsizei n, GLuint *arrays);
+typedef void (APIENTRYP PFNGLDELETEVERTEXARRAYSPROC) (GLsizei n, const GLuint *arrays);
+typedef void (APIENTRYP PFNGLVERTEXARRAYVERTEXBUFFERPROC) (GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride);
+typedef void (APIENTRYP PFNGLVERTEXARRAYATTRIBFORMATPROC) (GLuint vaobj, GLuint attribindex, GLint size, GLenum type, GLboolean normalized, GLuint relativeoffset);
+typedef void (APIENTRYP PFNGLVERTEXARRAYATTRIBBINDINGPROC) (GLuint vaobj, GLuint attribindex, GLuint bindingindex);
+typedef void (APIENTRYP PFNGLENABLEVERTEXARRAYATTRIBPROC) (GLuint vaobj, GLuint index);
+
+PFNGLGENBUFFERSPROC               glGenBuffers;
+PFNGLBINDBUFFERPROC               glBindBuffer;
+PFNGLBUFFERDATAPROC               glBufferData;
+PFNGLCREATESHADERPROC             glCreateShader;
+PFNGLSHADERSOURCEPROC             glShaderSource;
+PFNGLCOMPILESHADERPROC            glCompileShader;
+PFNGLCREATEPROGRAMPROC            glCreateProgram;
+PFNGLATTACHSHADERPROC             glAttachShader;
+PFNGLLINKPROGRAMPROC              glLinkProgram;
+PFNGLUSEPROGRAMPROC               glUseProgram;
+PFNGLGETATTRIBLOCATIONPROC        glGetAttribLocation;
+PFNGLENABLEVERTEXATTRIBARRAYPROC  glEnableVertexAttribArray;
+PFNGLVERTEXATTRIBPOINTERPROC      glVertexAttribPointer;
+PFNGLGENVERTEXARRAYSPROC          glGenVertexArrays;
+PFNGLBINDVERTEXARRAYPROC          glBindVertexArray;
+PFNGLGETSHADERIVPROC              glGetShaderiv;
+PFNGLGETSHADERINFOLOGPROC         glGetShaderInfoLog;
+PFNGLGETPROGRAMIVPROC             glGetProgramiv;
+PFNGLGETPROGRAMINFOLOGPROC        glGetProgramInfoLog;
+PFNGLGENFRAMEBUFFERSPROC          glGenFramebuffers;
+PFNGLBINDFRAMEBUFFERPROC          glBindFramebuffer;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC  glFramebufferRenderbuffer;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus;
+PFNGLGENRENDERBUFFERSPROC         glGenRenderbuffers;
+PFNGLBINDRENDERBUFFERPROC         glBindRenderbuffer;
+PFNGLRENDERBUFFERSTORAGEPROC      glRenderbufferStorage;
+PFNGLDELETEBUFFERSPROC            glDeleteBuffers;
+PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+PFNGLFENCESYNCPROC                glFenceSync;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+PFNGLDELETESYNCPROC               glDeleteSync;
+PFNGLBUFFERSUBDATAPROC            glBufferSubData;
+PFNGLCREATEBUFFERSPROC            glCreateBuffers;
+PFNGLNAMEDBUFFERSTORAGEPROC       glNamedBufferStorage;
+PFNGLMAPNAMEDBUFFERRANGEPROC      glMapNamedBufferRange;
+PFNGLUNMAPNAMEDBUFFERPROC         glUnmapNamedBuffer;
+PFNGLCREATEVERTEXARRAYSPROC       glCreateVertexArrays;
+PFNGLDELETEVERTEXARRAYSPROC       glDeleteVertexArrays;
+PFNGLVERTEXARRAYVERTEXBUFFERPROC  glVertexArrayVertexBuffer;
+PFNGLVERTEXARRAYATTRIBFORMATPROC  glVertexArrayAttribFormat;
+PFNGLVERTEXARRAYATTRIBBINDINGPROC glVertexArrayAttribBinding;
+PFNGLENABLEVERTEXARRAYATTRIBPROC  glEnableVertexArrayAttrib;
+
+extern bool Initialize(int w, int h);
+extern void InitOpenGLFunc();
+extern bool InitFramebuffer(int w, int h);
+extern void InitShader();
+extern void Render();
+extern bool SavePPM(const char* path, int w, int h);
+
+// Shader sources
+const GLchar* vertexSource =
+    "#version 450 core                            \n"
+    "layout(location = 0) in  vec3 position;      \n"
+    "layout(location = 1) in  vec3 color;         \n"
+    "out vec4 vColor;                             \n"
+    "void main()                                  \n"
+    "{                                            \n"
+    "  vColor = vec4(color, 1.0);                 \n"
+    "  gl_Position = vec4(position, 1.0);         \n"
+    "}                                            \n";
+const GLchar* fragmentSource =
+    "#version 450 core                            \n"
+    "in  vec4 vColor;                             \n"
+    "out vec4 outColor;                           \n"
+    "void main()                                  \n"
+    "{                                            \n"
+    "  outColor = vColor;                         \n"
+    "}                                            \n";
+
+GLuint vao;
+GLuint vbo[2];
+GLuint fbo;
+GLuint rbo;
+GLint posAttrib;
+GLint colAttrib;
+
+static bool HasExtension(const char* extensions, const char* name)
+{
+    size_t length = strlen(name);
+    const char* p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+        p += length;
+    }
+    return false;
+}
+
+static double NowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Streaming: a grid of spinning triangles whose vertices are rebuilt on the
+// CPU every frame and uploaded in one of three ways:
+//   persistent  one immutable buffer (glNamedBufferStorage) holding
+//               STREAM_RING frames, mapped once with GL_MAP_PERSISTENT_BIT |
+//               GL_MAP_COHERENT_BIT; the CPU writes straight into the slot of
+//               the current frame after waiting on the fence of the draw that
+//               used it STREAM_RING frames ago
+//   orphan      glBufferData(NULL) hands the old storage to the driver, then
+//               glBufferSubData fills the new one
+//   subdata     glBufferSubData into the same storage every frame, leaving any
+//               synchronization with the previous draw to the driver
+#define STREAM_RING         3
+#define STREAM_TRIANGLES    65536
+#define STREAM_VERTEX_SIZE  (6 * sizeof(GLfloat))    // position, color
+
+enum { STREAM_NONE, STREAM_PERSISTENT, STREAM_ORPHAN, STREAM_SUBDATA, STREAM_ALL };
+
+static const char* const streamModeNames[] = { "none", "persistent", "orphan", "subdata", "all" };
+
+struct StreamBuffer {
+    int            mode;
+    int            triangles;
+    GLsizeiptr     frameSize;
+    GLuint         vao;
+    GLuint         buffer;
+
+    unsigned char* mapped;          // persistent: all STREAM_RING slots
+    GLsync         fence[STREAM_RING];
+    int            slot;
+    GLfloat*       staging;         // orphan, subdata: the frame built on the CPU
+
+    // statistics
+    double         uploadedBytes;
+    double         uploadTime;      // CPU seconds from the fence wait to the last upload call
+    int            fenceWaits;
+};
+
+static const GLfloat streamColors[3][3] = {
+    { 1.0f, 0.0f, 0.0f },
+    { 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f }
+};
+
+// Writes every vertex exactly once and in order, which is what write-combined
+// mappings want. The spin angle only changes per row, so the inner loop is
+// adds and stores.
+static void StreamWriteVertices(GLfloat* dst, int triangles, float time)
+{
+    int columns = (int)ceilf(sqrtf((float)triangles));
+    float cell = 2.0f / columns;
+    float radius = cell * 0.45f;
+
+    for (int first = 0, row = 0; first < triangles; first += columns, row++) {
+        float corner[3][2];
+        for (int v = 0; v < 3; v++) {
+            float angle = time * (1.0f + (row & 7) * 0.25f) + row * 0.1f + v * 2.0943951f;
+            corner[v][0] = radius * sinf(angle);
+            corner[v][1] = radius * cosf(angle);
+        }
+
+        float y = -1.0f + cell * (row + 0.5f);
+        int last = first + columns < triangles ? first + columns : triangles;
+        for (int i = first; i < last; i++) {
+            float x = -1.0f + cell * (i - first + 0.5f);
+            for (int v = 0; v < 3; v++) {
+                dst[0] = x + corner[v][0];
+                dst[1] = y + corner[v][1];
+                dst[2] = 0.0f;
+                dst[3] = streamColors[v][0];
+                dst[4] = streamColors[v][1];
+                dst[5] = streamColors[v][2];
+                dst += 6;
+            }
+        }
+    }
+}
+
+bool StreamInit(StreamBuffer* stream, int mode, int triangles)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->mode = mode;
+    stream->triangles = triangles;
+    stream->frameSize = (GLsizeiptr)triangles * 3 * STREAM_VERTEX_SIZE;
+
+    glCreateBuffers(1, &stream->buffer);
+    if (mode == STREAM_PERSISTENT) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glNamedBufferStorage(stream->buffer, stream->frameSize * STREAM_RING, NULL, flags);
+        stream->mapped = (unsigned char*)glMapNamedBufferRange(stream->buffer, 0, stream->frameSize * STREAM_RING, flags);
+        if (!stream->mapped) {
+            printf("Failed to map the streaming buffer persistently\n");
+            glDeleteBuffers(1, &stream->buffer);
+            return false;
+        }
+    } else {
+        // Mutable storage, so orphan can replace it
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        glBufferData(GL_ARRAY_BUFFER, stream->frameSize, NULL, GL_STREAM_DRAW);
+        stream->staging = (GLfloat*)malloc(stream->frameSize);
+    }
+
+    // The vertex format is set up once; only the buffer offset changes per frame
+    glCreateVertexArrays(1, &stream->vao);
+    glVertexArrayVertexBuffer(stream->vao, 0, stream->buffer, 0, STREAM_VERTEX_SIZE);
+    glVertexArrayAttribFormat(stream->vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribFormat(stream->vao, 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+    glVertexArrayAttribBinding(stream->vao, 0, 0);
+    glVertexArrayAttribBinding(stream->vao, 1, 0);
+    glEnableVertexArrayAttrib(stream->vao, 0);
+    glEnableVertexArrayAttrib(stream->vao, 1);
+    return true;
+}
+
+// Returns false when the fence of the slot to be written cannot be waited on
+bool RenderStream(StreamBuffer* stream, float time)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindVertexArray(stream->vao);
+
+    double start = NowSeconds();
+    GLint first = 0;
+    if (stream->mode == STREAM_PERSISTENT) {
+        int slot = stream->slot;
+        if (stream->fence[slot]) {
+            // Normally signaled already; waiting means the GPU is STREAM_RING
+            // frames behind. The slot must not be written before the GPU is
+            // done reading it, so keep waiting however long that takes.
+            GLenum status = glClientWaitSync(stream->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                stream->fenceWaits++;
+                do {
+                    status = glClientWaitSync(stream->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+                } while (status == GL_TIMEOUT_EXPIRED);
+            }
+            if (status == GL_WAIT_FAILED) {
+                printf("Waiting for the stream fence failed\n");
+                return false;
+            }
+            glDeleteSync(stream->fence[slot]);
+            stream->fence[slot] = 0;
+        }
+
+        // Coherent mapping: no flush, the writes are visible to the draw below
+        StreamWriteVertices((GLfloat*)(stream->mapped + stream->frameSize * slot), stream->triangles, time);
+        first = slot * stream->triangles * 3;
+    } else {
+        StreamWriteVertices(stream->staging, stream->triangles, time);
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        if (stream->mode == STREAM_ORPHAN) {
+            glBufferData(GL_ARRAY_BUFFER, stream->frameSize, NULL, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, stream->frameSize, stream->staging);
+    }
+    stream->uploadTime += NowSeconds() - start;
+    stream->uploadedBytes += stream->frameSize;
+
+    glDrawArrays(GL_TRIANGLES, first, stream->triangles * 3);
+
+    if (stream->mode == STREAM_PERSISTENT) {
+        stream->fence[stream->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream->slot = (stream->slot + 1) % STREAM_RING;
+    }
+    return true;
+}
+
+void StreamShutdown(StreamBuffer* stream)
+{
+    for (int i = 0; i < STREAM_RING; i++) {
+        if (stream->fence[i]) {
+            glDeleteSync(stream->fence[i]);
+        }
+    }
+    if (stream->mapped) {
+        glUnmapNamedBuffer(stream->buffer);
+    }
+    glDeleteVertexArrays(1, &stream->vao);
+    glDeleteBuffers(1, &stream->buffer);
+    free(stream->staging);
+    glBindVertexArray(vao);
+}
+
+// Frame capture: glReadPixels goes into a ring of pixel pack buffers and is
+// only mapped CAPTURE_RING - 1 frames later, once its fence has signaled, so
+// the GPU never has to drain the pipeline. A worker thread writes the frames
+// to disk as a PPM stream (ffmpeg -f image2pipe -c:v ppm -i capture.ppm ...).
+#define CAPTURE_RING        3
+#define CAPTURE_QUEUE       8
+
+struct FrameCapture {
+    int            width;
+    int            height;
+    size_t         frameSize;
+    FILE*          fp;
+
+    GLuint         pbo[CAPTURE_RING];
+    GLsync         fence[CAPTURE_RING];
+    int            head;
+
+    std::thread    worker;
+    std::mutex     mutex;
+    std::condition_variable cond;
+    unsigned char* buffers[CAPTURE_QUEUE];
+    unsigned char* freeList[CAPTURE_QUEUE];
+    unsigned char* queue[CAPTURE_QUEUE];
+    int            freeCount;
+    int            queueHead;
+    int            queueCount;
+    bool           done;
+
+    // statistics
+    double         start;
+    int            frames;
+    int            written;
+    int            dropped;
+    bool           writeFailed;
+    int            fenceStalls;
+    int            encoderStalls;
+    int            maxQueued;
+};
+
+static void FrameCaptureWorker(FrameCapture* capture)
+{
+    size_t rowSize = (size_t)capture->width * 3;
+    unsigned char* row = (unsigned char*)malloc(rowSize);
+
+    for (;;) {
+        unsigned char* pixels;
+        {
+            std::unique_lock<std::mutex> lock(capture->mutex);
+            capture->cond.wait(lock, [capture] { return capture->queueCount > 0 || capture->done; });
+            if (capture->queueCount == 0) {
+                break;
+            }
+            pixels = capture->queue[capture->queueHead];
+            capture->queueHead = (capture->queueHead + 1) % CAPTURE_QUEUE;
+            capture->queueCount--;
+        }
+
+        // RGBA bottom-up rows to RGB top-down; after a short write the rest
+        // of the stream is useless, so later frames are only counted as dropped
+        bool ok = !capture->writeFailed &&
+            fprintf(capture->fp, "P6\n%d %d\n255\n", capture->width, capture->height) > 0;
+        for (int y = capture->height - 1; ok && y >= 0; y--) {
+            const unsigned char* src = pixels + (size_t)y * capture->width * 4;
+            for (int x = 0; x < capture->width; x++) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            ok = fwrite(row, 1, rowSize, capture->fp) == rowSize;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(capture->mutex);
+            capture->freeList[capture->freeCount++] = pixels;
+            if (ok) {
+                capture->written++;
+            } else {
+                capture->writeFailed = true;
+                capture->dropped++;
+            }
+        }
+        capture->cond.notify_all();
+    }
+
+    free(row);
+}
+
+bool FrameCaptureInit(FrameCapture* capture, const char* path, int w, int h)
+{
+    capture->fp = fopen(path, "wb");
+    if (!capture->fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    capture->width = w;
+    capture->height = h;
+    capture->frameSize = (size_t)w * h * 4;
+    capture->head = 0;
+
+    glGenBuffers(CAPTURE_RING, capture->pbo);
+    for (int i = 0; i < CAPTURE_RING; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, capture->frameSize, NULL, GL_STREAM_READ);
+        capture->fence[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (int i = 0; i < CAPTURE_QUEUE; i++) {
+        capture->buffers[i] = (unsigned char*)malloc(capture->frameSize);
+        capture->freeList[i] = capture->buffers[i];
+    }
+    capture->freeCount = CAPTURE_QUEUE;
+    capture->queueHead = 0;
+    capture->queueCount = 0;
+    capture->done = false;
+
+    capture->start = NowSeconds();
+    capture->frames = 0;
+    capture->written = 0;
+    capture->dropped = 0;
+    capture->writeFailed = false;
+    capture->fenceStalls = 0;
+    capture->encoderStalls = 0;
+    capture->maxQueued = 0;
+
+    capture->worker = std::thread(FrameCaptureWorker, capture);
+
+    printf("Capturing to %s (%d PBOs, %d frames queued for the encoder)\n", path, CAPTURE_RING, CAPTURE_QUEUE);
+    return true;
+}
+
+static void FrameCaptureRetire(FrameCapture* capture, int slot)
+{
+    if (!capture->fence[slot]) {
+        return;
+    }
+
+    // Normally signaled long ago; waiting here means the GPU is more than
+    // CAPTURE_RING - 1 frames behind.
+    GLenum status = glClientWaitSync(capture->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        capture->fenceStalls++;
+        status = glClientWaitSync(capture->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    }
+    glDeleteSync(capture->fence[slot]);
+    capture->fence[slot] = 0;
+    if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->dropped++;
+        return;
+    }
+
+    unsigned char* pixels;
+    {
+        std::unique_lock<std::mutex> lock(capture->mutex);
+        if (capture->freeCount == 0) {
+            capture->encoderStalls++;
+            capture->cond.wait(lock, [capture] { return capture->freeCount > 0; });
+        }
+        pixels = capture->freeList[--capture->freeCount];
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[slot]);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture->frameSize, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(pixels, mapped, capture->frameSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        if (mapped) {
+            capture->queue[(capture->queueHead + capture->queueCount) % CAPTURE_QUEUE] = pixels;
+            capture->queueCount++;
+            if (capture->queueCount > capture->maxQueued) {
+                capture->maxQueued = capture->queueCount;
+            }
+        } else {
+            capture->freeList[capture->freeCount++] = pixels;
+            capture->dropped++;
+        }
+    }
+    capture->cond.notify_all();
+}
+
+// Call after Render() and before the swap, while the back buffer holds the frame.
+void FrameCaptureFrame(FrameCapture* capture)
+{
+    int slot = capture->head;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->pbo[slot]);
+    glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    capture->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    capture->frames++;
+
+    // The oldest slot holds frame N - (CAPTURE_RING - 1)
+    capture->head = (slot + 1) % CAPTURE_RING;
+    FrameCaptureRetire(capture, capture->head);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCaptureShutdown(FrameCapture* capture)
+{
+    for (int i = 1; i <= CAPTURE_RING; i++) {
+        FrameCaptureRetire(capture, (capture->head + i) % CAPTURE_RING);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->done = true;
+    }
+    capture->cond.notify_all();
+    capture->worker.join();
+
+    if (fclose(capture->fp) != 0) {
+        capture->writeFailed = true;
+    }
+
+    double elapsed = NowSeconds() - capture->start;
+    printf("Captured %d of %d frames in %.3f s: %.1f fps, %.1f MB/s\n",
+        capture->written, capture->frames, elapsed, capture->written / elapsed,
+        capture->written * (capture->frameSize / 1048576.0) / elapsed);
+    if (capture->dropped > 0) {
+        printf("Dropped %d frames (fence timeout, map failure or write error)\n", capture->dropped);
+    }
+    if (capture->writeFailed) {
+        printf("Writing the capture failed, the file is incomplete\n");
+    }
+    printf("Pipeline depth %d frames, fence stalls %d, encoder stalls %d, max encoder queue %d\n",
+        CAPTURE_RING - 1, capture->fenceStalls, capture->encoderStalls, capture->maxQueued);
+
+    glDeleteBuffers(CAPTURE_RING, capture->pbo);
+    for (int i = 0; i < CAPTURE_QUEUE; i++) {
+        free(capture->buffers[i]);
+    }
+}
+
+int main(int argc, char** argv) {
+    // --stream and --triangles may go anywhere; everything else is positional
+    int streamMode = STREAM_NONE;
+    int streamTriangles = STREAM_TRIANGLES;
+    const char* positional[3] = { NULL, NULL, NULL };
+    int positionalCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            streamMode = -1;
+            for (int m = STREAM_NONE; m <= STREAM_ALL; m++) {
+                if (strcmp(name, streamModeNames[m]) == 0) {
+                    streamMode = m;
+                }
+            }
+            if (streamMode < 0) {
+                printf("Unknown streaming mode %s (none, persistent, orphan, subdata, all)\n", name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--triangles") == 0 && i + 1 < argc) {
+            streamTriangles = atoi(argv[++i]);
+            if (streamTriangles < 1) {
+                streamTriangles = 1;
+            }
+        } else if (positionalCount < 3) {
+            positional[positionalCount++] = argv[i];
+        }
+    }
+
+    int frameCount = positional[0] ? atoi(positional[0]) : FRAME_COUNT;
+    if (frameCount < 1) {
+        frameCount = 1;
+    }
+    const char* outputFile = positional[1] ? positional[1] : OUTPUT_FILE;
+    const char* captureFile = positional[2];
+
+    // Prefer the surfaceless platform, which needs neither a display server nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint majorEGL, minorEGL;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &majorEGL, &minorEGL)) {
+        printf("Failed to initialize EGL\n");
+        return 1;
+    }
+    printf("EGL %d.%d (%s)\n", majorEGL, minorEGL, eglQueryString(display, EGL_VENDOR));
+
+    bool surfaceless = HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    EGLint eglAttribs[] = {
+        EGL_SURFACE_TYPE    , surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE , EGL_OPENGL_BIT,
+        EGL_RED_SIZE        , 8,
+        EGL_GREEN_SIZE      , 8,
+        EGL_BLUE_SIZE       , 8,
+        EGL_ALPHA_SIZE      , 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, eglAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("No suitable EGL config\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        printf("Failed to bind the OpenGL API\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION           , 4,
+        EGL_CONTEXT_MINOR_VERSION           , 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK     , EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        printf("Failed to create an OpenGL 4.5 context\n");
+        eglTerminate(display);
+        return 1;
+    }
+
+    // Without EGL_KHR_surfaceless_context a pbuffer keeps the context current;
+    // rendering still goes to the FBO either way.
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        EGLint pbufferAttribs[] = {
+            EGL_WIDTH   , WINDOW_WIDTH,
+            EGL_HEIGHT  , WINDOW_HEIGHT,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+        if (surface == EGL_NO_SURFACE) {
+            printf("Failed to create a pbuffer surface\n");
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+            return 1;
+        }
+    }
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        printf("Failed to make the context current\n");
+        if (surface != EGL_NO_SURFACE) {
+            eglDestroySurface(display, surface);
+        }
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return 1;
+    }
+
+    printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+
+    InitOpenGLFunc();
+
+    if (!InitFramebuffer(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        printf("Framebuffer incomplete\n");
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE) {
+            eglDestroySurface(display, surface);
+        }
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return 1;
+    }
+
+    Initialize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    InitShader();
+
+    FrameCapture capture;
+    bool capturing = captureFile && FrameCaptureInit(&capture, captureFile, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    int firstMode = streamMode == STREAM_ALL ? STREAM_PERSISTENT : streamMode;
+    int lastMode = streamMode == STREAM_ALL ? STREAM_SUBDATA : streamMode;
+    if (streamMode != STREAM_NONE) {
+        printf("Streaming %d triangles, %.2f MB per frame\n", streamTriangles,
+            streamTriangles * 3.0 * STREAM_VERTEX_SIZE / 1048576.0);
+    }
+
+    bool streamFailed = false;
+    for (int mode = firstMode; mode <= lastMode && !streamFailed; mode++) {
+        StreamBuffer stream;
+        if (mode != STREAM_NONE && !StreamInit(&stream, mode, streamTriangles)) {
+            streamFailed = true;
+            break;
+        }
+
+        double start = NowSeconds();
+        for (int i = 0; i < frameCount; i++) {
+            if (mode == STREAM_NONE) {
+                Render();
+            } else if (!RenderStream(&stream, i / 60.0f)) {
+                streamFailed = true;
+                break;
+            }
+            if (capturing) {
+                FrameCaptureFrame(&capture);
+            }
+            glFlush();
+        }
+        glFinish();
+        double elapsed = NowSeconds() - start;
+
+        if (streamFailed) {
+            StreamShutdown(&stream);
+            break;
+        }
+
+        if (mode != STREAM_NONE) {
+            printf("%s: ", streamModeNames[mode]);
+        }
+        printf("%d frames in %.3f s: %.1f fps, %.3f ms/frame\n",
+            frameCount, elapsed, frameCount / elapsed, elapsed * 1000.0 / frameCount);
+
+        if (mode != STREAM_NONE) {
+            printf("  %.1f MB uploaded, %.1f MB/s over the run, upload %.3f ms/frame (%.1f MB/s), %d fence waits\n",
+                stream.uploadedBytes / 1048576.0, stream.uploadedBytes / 1048576.0 / elapsed,
+                stream.uploadTime * 1000.0 / frameCount, stream.uploadedBytes / 1048576.0 / stream.uploadTime, stream.fenceWaits);
+            StreamShutdown(&stream);
+        }
+    }
+
+    if (capturing) {
+        FrameCaptureShutdown(&capture);
+    }
+
+    if (!streamFailed && SavePPM(outputFile, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        printf("Wrote %s\n", outputFile);
+    }
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+    }
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return streamFailed ? 1 : 0;
+}
+
+bool Initialize(int w, int h) {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glViewport(0, 0, w, h);
+    return true;
+}
+
+void InitOpenGLFunc()
+{
+    glGenBuffers              = (PFNGLGENBUFFERSPROC)              eglGetProcAddress("glGenBuffers");
+    glBindBuffer              = (PFNGLBINDBUFFERPROC)              eglGetProcAddress("glBindBuffer");
+    glBufferData              = (PFNGLBUFFERDATAPROC)              eglGetProcAddress("glBufferData");
+    glCreateShader            = (PFNGLCREATESHADERPROC)            eglGetProcAddress("glCreateShader");
+    glShaderSource            = (PFNGLSHADERSOURCEPROC)            eglGetProcAddress("glShaderSource");
+    glCompileShader           = (PFNGLCOMPILESHADERPROC)           eglGetProcAddress("glCompileShader");
+    glCreateProgram           = (PFNGLCREATEPROGRAMPROC)           eglGetProcAddress("glCreateProgram");
+    glAttachShader            = (PFNGLATTACHSHADERPROC)            eglGetProcAddress("glAttachShader");
+    glLinkProgram             = (PFNGLLINKPROGRAMPROC)             eglGetProcAddress("glLinkProgram");
+    glUseProgram              = (PFNGLUSEPROGRAMPROC)              eglGetProcAddress("glUseProgram");
+    glGetAttribLocation       = (PFNGLGETATTRIBLOCATIONPROC)       eglGetProcAddress("glGetAttribLocation");
+    glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC) eglGetProcAddress("glEnableVertexAttribArray");
+    glVertexAttribPointer     = (PFNGLVERTEXATTRIBPOINTERPROC)     eglGetProcAddress("glVertexAttribPointer");
+    glGenVertexArrays         = (PFNGLGENVERTEXARRAYSPROC)         eglGetProcAddress("glGenVertexArrays");
+    glBindVertexArray         = (PFNGLBINDVERTEXARRAYPROC)         eglGetProcAddress("glBindVertexArray");
+    glGetShaderiv             = (PFNGLGETSHADERIVPROC)             eglGetProcAddress("glGetShaderiv");
+    glGetShaderInfoLog        = (PFNGLGETSHADERINFOLOGPROC)        eglGetProcAddress("glGetShaderInfoLog");
+    glGetProgramiv            = (PFNGLGETPROGRAMIVPROC)            eglGetProcAddress("glGetProgramiv");
+    glGetProgramInfoLog       = (PFNGLGETPROGRAMINFOLOGPROC)       eglGetProcAddress("glGetProgramInfoLog");
+    glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)         eglGetProcAddress("glGenFramebuffers");
+    glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)         eglGetProcAddress("glBindFramebuffer");
+    glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC) eglGetProcAddress("glFramebufferRenderbuffer");
+    glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)  eglGetProcAddress("glCheckFramebufferStatus");
+    glGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)        eglGetProcAddress("glGenRenderbuffers");
+    glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)        eglGetProcAddress("glBindRenderbuffer");
+    glRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)     eglGetProcAddress("glRenderbufferStorage");
+    glDeleteBuffers           = (PFNGLDELETEBUFFERSPROC)          eglGetProcAddress("glDeleteBuffers");
+    glMapBufferRange          = (PFNGLMAPBUFFERRANGEPROC)         eglGetProcAddress("glMapBufferRange");
+    glUnmapBuffer             = (PFNGLUNMAPBUFFERPROC)            eglGetProcAddress("glUnmapBuffer");
+    glFenceSync               = (PFNGLFENCESYNCPROC)              eglGetProcAddress("glFenceSync");
+    glClientWaitSync          = (PFNGLCLIENTWAITSYNCPROC)         eglGetProcAddress("glClientWaitSync");
+    glDeleteSync              = (PFNGLDELETESYNCPROC)             eglGetProcAddress("glDeleteSync");
+    glBufferSubData           = (PFNGLBUFFERSUBDATAPROC)            eglGetProcAddress("glBufferSubData");
+    glCreateBuffers           = (PFNGLCREATEBUFFERSPROC)            eglGetProcAddress("glCreateBuffers");
+    glNamedBufferStorage      = (PFNGLNAMEDBUFFERSTORAGEPROC)       eglGetProcAddress("glNamedBufferStorage");
+    glMapNamedBufferRange     = (PFNGLMAPNAMEDBUFFERRANGEPROC)      eglGetProcAddress("glMapNamedBufferRange");
+    glUnmapNamedBuffer        = (PFNGLUNMAPNAMEDBUFFERPROC)         eglGetProcAddress("glUnmapNamedBuffer");
+    glCreateVertexArrays      = (PFNGLCREATEVERTEXARRAYSPROC)       eglGetProcAddress("glCreateVertexArrays");
+    glDeleteVertexArrays      = (PFNGLDELETEVERTEXARRAYSPROC)       eglGetProcAddress("glDeleteVertexArrays");
+    glVertexArrayVertexBuffer = (PFNGLVERTEXARRAYVERTEXBUFFERPROC)  eglGetProcAddress("glVertexArrayVertexBuffer");
+    glVertexArrayAttribFormat = (PFNGLVERTEXARRAYATTRIBFORMATPROC)  eglGetProcAddress("glVertexArrayAttribFormat");
+    glVertexArrayAttribBinding = (PFNGLVERTEXARRAYATTRIBBINDINGPROC) eglGetProcAddress("glVertexArrayAttribBinding");
+    glEnableVertexArrayAttrib = (PFNGLENABLEVERTEXARRAYATTRIBPROC)  eglGetProcAddress("glEnableVertexArrayAttrib");
+}
+
+bool InitFramebuffer(int w, int h)
+{
+    // There is no default framebuffer to draw into, so render to a color renderbuffer
+    glGenRenderbuffers(1, &rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void InitShader()
+{
+    // Create and compile the vertex shader
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, nullptr);
+    glCompileShader(vertexShader);
+
+    // Check for vertex shader compile errors
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(vertexShader, 512, nullptr, infoLog);
+        printf("Vertex shader compilation failed: %s\n", infoLog);
+    } else {
+        printf("Vertex shader compiled successfully\n");
+    }
+
+    // Create and compile the fragment shader
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
+    glCompileShader(fragmentShader);
+
+    // Check for fragment shader compile errors
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(fragmentShader, 512, nullptr, infoLog);
+        printf("Fragment shader compilation failed: %s\n", infoLog);
+    } else {
+        printf("Fragment shader compiled successfully\n");
+    }
+
+    // Link the vertex and fragment shader into a shader program
+    GLuint shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
+
+    // Check for linking errors
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
+        printf("Program linking failed: %s\n", infoLog);
+    } else {
+        printf("Program linked successfully\n");
+    }
+
+    glUseProgram(shaderProgram);
+
+    // Create VAO
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(2, vbo);
+
+    GLfloat vertices[] = {
+          0.0f,  0.5f, 0.0f,
+          0.5f, -0.5f, 0.0f,
+         -0.5f, -0.5f, 0.0f
+    };
+
+    GLfloat colors[] = {
+         1.0f,  0.0f,  0.0f,
+         0.0f,  1.0f,  0.0f,
+         0.0f,  0.0f,  1.0f
+    };
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    // Specify the layout of the vertex data
+    posAttrib = glGetAttribLocation(shaderProgram, "position");
+    glEnableVertexAttribArray(posAttrib);
+    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(colors), colors, GL_STATIC_DRAW);
+
+    colAttrib = glGetAttribLocation(shaderProgram, "color");
+    glEnableVertexAttribArray(colAttrib);
+    glVertexAttribPointer(colAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    printf("Initialization complete\n");
+}
+
+void Render() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindVertexArray(vao);
+
+    // Draw a triangle from the 3 vertices
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+bool SavePPM(const char* path, int w, int h)
+{
+    unsigned char* pixels = (unsigned char*)malloc((size_t)w * h * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open %s\n", path);
+        free(pixels);
+        return false;
+    }
+
+    // GL rows start at the bottom, PPM rows at the top
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    for (int y = h - 1; y >= 0; y--) {
+        fwrite(pixels + (size_t)y * w * 3, 1, (size_t)w * 3, fp);
+    }
+    fclose(fp);
+    free(pixels);
+    return true;
+}
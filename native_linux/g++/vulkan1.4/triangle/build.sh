@@ -1,6 +1,18 @@
 glslangValidator -V hello.vert -o hello_vert.spv
 glslangValidator -V hello.frag -o hello_frag.spv
-g++ -o hello hello.cpp \
+glslangValidator -V instance.comp -o instance_comp.spv
+glslangValidator -V cull.comp -o cull_comp.spv
+glslangValidator -V shadow.vert -o shadow_vert.spv
+glslangValidator -V ground.vert -o ground_vert.spv
+glslangValidator -V --target-env vulkan1.2 ground.frag -o ground_frag.spv
+glslangValidator -V hello.vert --vn hello_vert_spv -o hello_vert.h
+glslangValidator -V hello.frag --vn hello_frag_spv -o hello_frag.h
+glslangValidator -V instance.comp --vn instance_comp_spv -o instance_comp.h
+glslangValidator -V cull.comp --vn cull_comp_spv -o cull_comp.h
+glslangValidator -V shadow.vert --vn shadow_vert_spv -o shadow_vert.h
+glslangValidator -V ground.vert --vn ground_vert_spv -o ground_vert.h
+glslangValidator -V --target-env vulkan1.2 ground.frag --vn ground_frag_spv -o ground_frag.h
+g++ -o hello hello.cpp -DEMBED_SHADERS \
   `pkg-config --cflags vulkan` \
   `pkg-config --libs vulkan` \
   -lvulkan -lglfw
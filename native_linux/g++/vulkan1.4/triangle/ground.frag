@@ -0,0 +1,32 @@
+#version 460
+#extension GL_EXT_ray_query : require
+
+layout(push_constant) uniform ShadowConstants {
+    vec2 offset;
+    float scale;
+    float height;
+    vec4 light;     // direction towards the light
+} pc;
+
+layout(binding = 0) uniform accelerationStructureEXT scene;
+
+layout(location = 0) in vec2 groundPosition;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 SHADOW_COLOR = vec3(0.2, 0.2, 0.22);
+
+void main() {
+    // Any opaque triangle between the ground and the light will do, so the
+    // query stops at the first one it finds
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, scene, gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT, 0xFF,
+        vec3(groundPosition, 0.0), 0.0, pc.light.xyz, 1000.0);
+    while (rayQueryProceedEXT(query)) {
+    }
+
+    if (rayQueryGetIntersectionTypeEXT(query, true) == gl_RayQueryCommittedIntersectionNoneEXT) {
+        discard;
+    }
+    outColor = vec4(SHADOW_COLOR, 1.0);
+}
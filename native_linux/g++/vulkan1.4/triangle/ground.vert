@@ -0,0 +1,11 @@
+#version 450
+
+// One triangle covering the viewport: the ground plane at z = 0, seen from
+// above with the same x/y as the triangles
+layout(location = 0) out vec2 groundPosition;
+
+void main() {
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    groundPosition = position;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -1,21 +1,21 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) out vec3 fragColor;
+layout(push_constant) uniform PushConstants {
+    vec2 offset;
+    float scale;
+} pc;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec4 inInstance;  // offset.xy, scale, rotation angle
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    float c = cos(inInstance.w);
+    float s = sin(inInstance.w);
+    vec2 position = mat2(c, s, -s, c) * inPosition * inInstance.z + inInstance.xy;
+    gl_Position = vec4(position * pc.scale + pc.offset, 0.0, 1.0);
+    fragColor = inColor;
 }
\ No newline at end of file
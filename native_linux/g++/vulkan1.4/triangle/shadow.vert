@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform ShadowConstants {
+    vec2 offset;
+    float scale;
+    float height;
+    vec4 light;     // direction towards the light
+} pc;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 2) in vec4 inInstance;  // offset.xy, scale, rotation angle
+
+layout(location = 0) out vec3 fragColor;
+
+const vec3 SHADOW_COLOR = vec3(0.2, 0.2, 0.22);
+
+void main() {
+    float c = cos(inInstance.w);
+    float s = sin(inInstance.w);
+    vec2 position = (mat2(c, s, -s, c) * inPosition * inInstance.z + inInstance.xy) * pc.scale + pc.offset;
+
+    // Slide the triangle from its height down the light direction onto z = 0
+    position -= pc.light.xy * (pc.height / pc.light.z);
+    gl_Position = vec4(position, 0.0, 1.0);
+    fragColor = SHADOW_COLOR;
+}
@@ -0,0 +1,47 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform PushConstants {
+    float aspect;
+} pc;
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 fragColor;
+
+mat4 perspective(float fov, float aspect, float nearZ, float farZ) {
+    float v = 1.0 / tan(radians(fov / 2.0));
+    float u = v / aspect;
+    float w = nearZ - farZ;
+
+    return mat4(
+        u, 0, 0, 0,
+        0, v, 0, 0,
+        0, 0, (nearZ + farZ) / w, -1,
+        0, 0, (nearZ * farZ * 2.0) / w, 0
+    );
+}
+
+mat4 lookAt(vec3 eye, vec3 center, vec3 up) {
+    vec3 w = normalize(eye - center);
+    vec3 u = normalize(cross(up, w));
+    vec3 v = cross(w, u);
+
+    return mat4(
+        u.x, v.x, w.x, 0,
+        u.y, v.y, w.y, 0,
+        u.z, v.z, w.z, 0,
+        -dot(u, eye), -dot(v, eye), -dot(w, eye), 1
+    );
+}
+
+void main() {
+    mat4 proj = perspective(45.0, pc.aspect, 0.1, 200.0);
+    mat4 view = lookAt(vec3(0.0, 5.0, 10.0), vec3(0.0), vec3(0.0, 1.0, 0.0));
+
+    gl_Position = proj * view * inPosition;
+    // Vulkan clip space has y pointing down
+    gl_Position.y = -gl_Position.y;
+    fragColor = inColor;
+}
@@ -0,0 +1,11 @@
+glslangValidator -V --target-env vulkan1.2 hello.task -o hello_task.spv
+glslangValidator -V --target-env vulkan1.2 hello.mesh -o hello_mesh.spv
+glslangValidator -V hello.vert -o hello_vert.spv
+glslangValidator -V hello.frag -o hello_frag.spv
+glslangValidator -V --target-env vulkan1.2 hello.task --vn hello_task_spv -o hello_task.h
+glslangValidator -V --target-env vulkan1.2 hello.mesh --vn hello_mesh_spv -o hello_mesh.h
+glslangValidator -V hello.vert --vn hello_vert_spv -o hello_vert.h
+glslangValidator -V hello.frag --vn hello_frag_spv -o hello_frag.h
+g++ -O2 -DNDEBUG -o hello hello.cpp -DEMBED_SHADERS \
+  `pkg-config --cflags vulkan` \
+  `pkg-config --libs vulkan`
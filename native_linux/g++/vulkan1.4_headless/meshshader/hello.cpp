@@ -0,0 +1,2014 @@
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <optional>
+#include <chrono>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cstddef>
+
+const uint32_t WIDTH = 800;
+const uint32_t HEIGHT = 600;
+
+const int MAX_FRAMES_IN_FLIGHT = 2;
+
+const VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+const VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+// Meshlet size limits, the max_vertices and max_primitives of hello.mesh:
+// 64 vertices and 124 triangles, as recommended for NVIDIA mesh shaders
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// local_size_x of hello.task, one invocation per meshlet
+const uint32_t TASK_WORKGROUP_SIZE = 32;
+
+enum class PipelineType {
+    Vertex,
+    Mesh
+};
+
+struct AppOptions {
+    uint32_t frameCount = 100;
+    uint32_t gridU = 1024;
+    uint32_t gridV = 512;
+    float distance = 9.0f;
+    bool runVertex = true;
+    bool runMesh = true;
+    bool cull = true;
+    bool meshletColors = false;
+    uint32_t width = WIDTH;
+    uint32_t height = HEIGHT;
+    std::string outputFile = "hello.ppm";
+    std::string shaderDir;
+};
+
+AppOptions options;
+
+void parseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            options.frameCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--pipeline" && i + 1 < argc) {
+            std::string pipeline = argv[++i];
+            if (pipeline != "vertex" && pipeline != "mesh" && pipeline != "both") {
+                throw std::runtime_error("unknown pipeline: " + pipeline);
+            }
+            options.runVertex = pipeline != "mesh";
+            options.runMesh = pipeline != "vertex";
+        }
+        else if (arg == "--grid" && i + 2 < argc) {
+            options.gridU = std::max(3, atoi(argv[++i]));
+            options.gridV = std::max(3, atoi(argv[++i]));
+        }
+        else if (arg == "--distance" && i + 1 < argc) {
+            options.distance = std::max(1.0f, (float)atof(argv[++i]));
+        }
+        else if (arg == "--no-cull") {
+            options.cull = false;
+        }
+        else if (arg == "--meshlet-colors") {
+            options.meshletColors = true;
+        }
+        else if (arg == "--size" && i + 2 < argc) {
+            options.width = std::max(1, atoi(argv[++i]));
+            options.height = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            options.outputFile = argv[++i];
+        }
+        else if (arg == "--shader-dir" && i + 1 < argc) {
+            options.shaderDir = argv[++i];
+        }
+        else {
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+}
+
+const std::vector<const char*> validationLayers = {
+    "VK_LAYER_KHRONOS_validation"
+};
+
+#ifdef NDEBUG
+const bool enableValidationLayers = false;
+#else
+const bool enableValidationLayers = true;
+#endif
+
+VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+    }
+    else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator) {
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        func(instance, debugMessenger, pAllocator);
+    }
+}
+
+#ifdef EMBED_SHADERS
+// Generated by glslangValidator --vn, see build.sh
+#include "hello_task.h"
+#include "hello_mesh.h"
+#include "hello_vert.h"
+#include "hello_frag.h"
+#define EMBEDDED_SHADER(name) name, sizeof(name)
+#else
+#define EMBEDDED_SHADER(name) nullptr, 0
+#endif
+
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+// SPIR-V code, either compiled into the executable or mapped read-only from a
+// file; the driver reads the words in place, so nothing is copied.
+class ShaderBinary {
+public:
+    ShaderBinary(const uint32_t* code, size_t size) : words(code), byteSize(size) {
+        validate("embedded shader");
+    }
+
+    explicit ShaderBinary(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open file: " + path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("failed to read file: " + path);
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("failed to map file: " + path);
+        }
+
+        mapping = data;
+        words = static_cast<const uint32_t*>(data);
+        byteSize = (size_t)st.st_size;
+        validate(path);
+    }
+
+    ShaderBinary(ShaderBinary&& other) noexcept : words(other.words), byteSize(other.byteSize), mapping(other.mapping) {
+        other.mapping = nullptr;
+    }
+
+    ShaderBinary(const ShaderBinary&) = delete;
+    ShaderBinary& operator=(const ShaderBinary&) = delete;
+
+    ~ShaderBinary() {
+        if (mapping) {
+            munmap(mapping, byteSize);
+        }
+    }
+
+    const uint32_t* code() const {
+        return words;
+    }
+
+    size_t size() const {
+        return byteSize;
+    }
+
+private:
+    const uint32_t* words = nullptr;
+    size_t byteSize = 0;
+    void* mapping = nullptr;
+
+    // vkCreateShaderModule requires pCode to be 4-byte aligned and codeSize a
+    // multiple of 4; reject anything that is not SPIR-V before the driver sees it.
+    void validate(const std::string& name) {
+        if (reinterpret_cast<uintptr_t>(words) % alignof(uint32_t) != 0 || byteSize % sizeof(uint32_t) != 0) {
+            release();
+            throw std::runtime_error(name + " is not 4-byte aligned SPIR-V!");
+        }
+        // The SPIR-V header is 5 words
+        if (byteSize < 5 * sizeof(uint32_t) || words[0] != SPIRV_MAGIC) {
+            release();
+            throw std::runtime_error(name + " is not a SPIR-V module!");
+        }
+    }
+
+    void release() {
+        if (mapping) {
+            munmap(mapping, byteSize);
+            mapping = nullptr;
+        }
+    }
+};
+
+// Shader files are looked up next to the executable rather than in the
+// working directory, unless --shader-dir says otherwise.
+std::string shaderDirectory() {
+    if (!options.shaderDir.empty()) {
+        return options.shaderDir;
+    }
+
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return ".";
+    }
+    path[length] = '\0';
+
+    char* slash = strrchr(path, '/');
+    if (!slash) {
+        return ".";
+    }
+    *slash = '\0';
+    return path;
+}
+
+
+// Interleaved vertex, read as vertex attributes by hello.vert and as a float
+// array by hello.mesh
+struct Vertex {
+    float position[3];
+    float normal[3];
+};
+
+struct Mesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// std430 layout of the Meshlet struct in hello.task and hello.mesh
+struct Meshlet {
+    float center[3];
+    float radius;
+    // Normal cone: every triangle faces away from a viewer inside the cone
+    // around -axis, see coneCulled() in hello.task
+    float coneAxis[3];
+    float coneCutoff;
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+struct MeshletData {
+    std::vector<Meshlet> meshlets;
+    // Index into Mesh::vertices for every meshlet vertex
+    std::vector<uint32_t> vertices;
+    // Three 8-bit meshlet-local indices per triangle, one word each
+    std::vector<uint32_t> triangles;
+};
+
+static void cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static float normalize(float v[3]) {
+    float length = std::sqrt(dot(v, v));
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+    return length;
+}
+
+// A bumpy torus of u x v quads, closed in both directions, with normals
+// averaged from the faces. Triangles are counter-clockwise seen from outside.
+Mesh createTorus(uint32_t gridU, uint32_t gridV) {
+    const float pi = 3.14159265f;
+    const float R = 3.0f;
+    const float r = 1.0f;
+
+    Mesh mesh;
+    mesh.vertices.resize((size_t)gridU * gridV);
+    for (uint32_t i = 0; i < gridU; i++) {
+        float u = 2.0f * pi * i / gridU;
+        for (uint32_t j = 0; j < gridV; j++) {
+            float v = 2.0f * pi * j / gridV;
+            float tube = r * (1.0f + 0.15f * std::sin(12.0f * u) * std::sin(8.0f * v));
+            Vertex& vertex = mesh.vertices[(size_t)i * gridV + j];
+            vertex.position[0] = (R + tube * std::cos(v)) * std::cos(u);
+            vertex.position[1] = tube * std::sin(v);
+            vertex.position[2] = (R + tube * std::cos(v)) * std::sin(u);
+            vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+        }
+    }
+
+    mesh.indices.reserve((size_t)gridU * gridV * 6);
+    for (uint32_t i = 0; i < gridU; i++) {
+        for (uint32_t j = 0; j < gridV; j++) {
+            uint32_t a = i * gridV + j;
+            uint32_t b = ((i + 1) % gridU) * gridV + j;
+            uint32_t c = i * gridV + (j + 1) % gridV;
+            uint32_t d = ((i + 1) % gridU) * gridV + (j + 1) % gridV;
+            uint32_t quad[6] = { a, c, b, b, c, d };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+
+    // Area weighted face normals
+    for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+        Vertex* v[3] = { &mesh.vertices[mesh.indices[t]], &mesh.vertices[mesh.indices[t + 1]], &mesh.vertices[mesh.indices[t + 2]] };
+        float e1[3], e2[3], n[3];
+        for (int k = 0; k < 3; k++) {
+            e1[k] = v[1]->position[k] - v[0]->position[k];
+            e2[k] = v[2]->position[k] - v[0]->position[k];
+        }
+        cross(e1, e2, n);
+        for (int corner = 0; corner < 3; corner++) {
+            for (int k = 0; k < 3; k++) {
+                v[corner]->normal[k] += n[k];
+            }
+        }
+    }
+    for (Vertex& vertex : mesh.vertices) {
+        normalize(vertex.normal);
+    }
+
+    return mesh;
+}
+
+// Bounding sphere and normal cone of one meshlet, as in meshoptimizer's
+// meshopt_computeMeshletBounds: the cone axis is the area weighted average
+// normal, and the cutoff is the sine of the widest angle between the axis and
+// a triangle normal. Cones wider than ~84 degrees can never cull anything.
+static void computeMeshletBounds(const Mesh& mesh, const MeshletData& data, Meshlet& meshlet) {
+    float lo[3] = { INFINITY, INFINITY, INFINITY };
+    float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const float* p = mesh.vertices[data.vertices[meshlet.vertexOffset + i]].position;
+        for (int k = 0; k < 3; k++) {
+            lo[k] = std::min(lo[k], p[k]);
+            hi[k] = std::max(hi[k], p[k]);
+        }
+    }
+
+    float radius = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        meshlet.center[k] = 0.5f * (lo[k] + hi[k]);
+    }
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const float* p = mesh.vertices[data.vertices[meshlet.vertexOffset + i]].position;
+        float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+        radius = std::max(radius, dot(d, d));
+    }
+    meshlet.radius = std::sqrt(radius);
+
+    std::vector<float> normals(meshlet.triangleCount * 3);
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+        uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+        const float* p[3];
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t local = (packed >> (8 * corner)) & 0xFF;
+            p[corner] = mesh.vertices[data.vertices[meshlet.vertexOffset + local]].position;
+        }
+        float e1[3], e2[3];
+        for (int k = 0; k < 3; k++) {
+            e1[k] = p[1][k] - p[0][k];
+            e2[k] = p[2][k] - p[0][k];
+        }
+        float* n = &normals[t * 3];
+        cross(e1, e2, n);
+        for (int k = 0; k < 3; k++) {
+            axis[k] += n[k];
+        }
+        normalize(n);
+    }
+
+    float minDot = 1.0f;
+    if (normalize(axis) > 0.0f) {
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+            const float* n = &normals[t * 3];
+            // Degenerate triangles have no normal and face nowhere
+            if (dot(n, n) > 0.0f) {
+                minDot = std::min(minDot, dot(axis, n));
+            }
+        }
+    }
+    else {
+        minDot = -1.0f;
+    }
+
+    for (int k = 0; k < 3; k++) {
+        meshlet.coneAxis[k] = axis[k];
+    }
+    meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+}
+
+// Greedy meshlet builder. A meshlet grows from a seed triangle by repeatedly
+// adding the neighbouring triangle that brings the fewest new vertices, ties
+// going to the one closest to the meshlet's centroid, which keeps meshlets
+// compact and their normal cones narrow. A meshlet is closed when the best
+// candidate no longer fits into MESHLET_MAX_VERTICES/MESHLET_MAX_TRIANGLES or
+// no unassigned triangle touches it.
+MeshletData buildMeshlets(const Mesh& mesh) {
+    size_t vertexCount = mesh.vertices.size();
+    size_t triangleCount = mesh.indices.size() / 3;
+
+    // Vertex to triangle adjacency, compressed rows
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t index : mesh.indices) {
+        adjacencyOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<uint32_t> adjacency(mesh.indices.size());
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < mesh.indices.size(); i++) {
+            adjacency[fill[mesh.indices[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+
+    MeshletData data;
+    std::vector<bool> emitted(triangleCount, false);
+    // Meshlet-local index of each vertex in the current meshlet, 0xFF if absent
+    std::vector<uint8_t> localIndex(vertexCount, 0xFF);
+    std::vector<uint32_t> candidates;
+    size_t seed = 0;
+
+    Meshlet meshlet{};
+    float centroid[3] = { 0.0f, 0.0f, 0.0f };
+
+    auto finishMeshlet = [&]() {
+        computeMeshletBounds(mesh, data, meshlet);
+        data.meshlets.push_back(meshlet);
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+            localIndex[data.vertices[meshlet.vertexOffset + i]] = 0xFF;
+        }
+        meshlet = Meshlet{};
+        meshlet.vertexOffset = (uint32_t)data.vertices.size();
+        meshlet.triangleOffset = (uint32_t)data.triangles.size();
+        candidates.clear();
+    };
+
+    auto newVertices = [&](uint32_t triangle) {
+        const uint32_t* corners = &mesh.indices[(size_t)triangle * 3];
+        return (uint32_t)(localIndex[corners[0]] == 0xFF) + (localIndex[corners[1]] == 0xFF) + (localIndex[corners[2]] == 0xFF);
+    };
+
+    auto addTriangle = [&](uint32_t triangle) {
+        const uint32_t* corners = &mesh.indices[(size_t)triangle * 3];
+        uint32_t packed = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = corners[corner];
+            if (localIndex[vertex] == 0xFF) {
+                localIndex[vertex] = (uint8_t)meshlet.vertexCount++;
+                data.vertices.push_back(vertex);
+
+                const float* p = mesh.vertices[vertex].position;
+                for (int k = 0; k < 3; k++) {
+                    centroid[k] += (p[k] - centroid[k]) / meshlet.vertexCount;
+                }
+                for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++) {
+                    if (!emitted[adjacency[a]]) {
+                        candidates.push_back(adjacency[a]);
+                    }
+                }
+            }
+            packed |= (uint32_t)localIndex[vertex] << (8 * corner);
+        }
+        data.triangles.push_back(packed);
+        meshlet.triangleCount++;
+        emitted[triangle] = true;
+    };
+
+    for (;;) {
+        uint32_t best = UINT32_MAX;
+        uint32_t bestNew = 4;
+        float bestDistance = INFINITY;
+
+        // Drop candidates that have been assigned in the meantime while
+        // looking for the best one
+        size_t kept = 0;
+        for (uint32_t triangle : candidates) {
+            if (emitted[triangle]) {
+                continue;
+            }
+            candidates[kept++] = triangle;
+
+            uint32_t added = newVertices(triangle);
+            if (added > bestNew) {
+                continue;
+            }
+            const uint32_t* corners = &mesh.indices[(size_t)triangle * 3];
+            float distance = 0.0f;
+            for (int corner = 0; corner < 3; corner++) {
+                const float* p = mesh.vertices[corners[corner]].position;
+                float d[3] = { p[0] - centroid[0], p[1] - centroid[1], p[2] - centroid[2] };
+                distance += dot(d, d);
+            }
+            if (added < bestNew || distance < bestDistance) {
+                best = triangle;
+                bestNew = added;
+                bestDistance = distance;
+            }
+        }
+        candidates.resize(kept);
+
+        if (best != UINT32_MAX && meshlet.vertexCount + bestNew <= MESHLET_MAX_VERTICES && meshlet.triangleCount < MESHLET_MAX_TRIANGLES) {
+            addTriangle(best);
+            continue;
+        }
+
+        if (meshlet.triangleCount > 0) {
+            finishMeshlet();
+        }
+
+        // Seed the next meshlet with the first unassigned triangle
+        while (seed < triangleCount && emitted[seed]) {
+            seed++;
+        }
+        if (seed == triangleCount) {
+            break;
+        }
+        centroid[0] = centroid[1] = centroid[2] = 0.0f;
+        addTriangle((uint32_t)seed);
+    }
+
+    return data;
+}
+
+// Column-major 4x4 matrices as GLSL expects them
+struct Mat4 {
+    float m[16];
+};
+
+Mat4 multiply(const Mat4& a, const Mat4& b) {
+    Mat4 result;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+            }
+            result.m[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+// Right handed, depth 0 to 1 and y pointing down, as Vulkan clip space wants
+Mat4 perspective(float fovY, float aspect, float nearZ, float farZ) {
+    float f = 1.0f / std::tan(fovY / 2.0f);
+    Mat4 result{};
+    result.m[0] = f / aspect;
+    result.m[5] = -f;
+    result.m[10] = farZ / (nearZ - farZ);
+    result.m[11] = -1.0f;
+    result.m[14] = nearZ * farZ / (nearZ - farZ);
+    return result;
+}
+
+Mat4 lookAt(const float eye[3], const float center[3], const float up[3]) {
+    float w[3] = { eye[0] - center[0], eye[1] - center[1], eye[2] - center[2] };
+    normalize(w);
+    float u[3];
+    cross(up, w, u);
+    normalize(u);
+    float v[3];
+    cross(w, u, v);
+
+    Mat4 result = { {
+        u[0], v[0], w[0], 0.0f,
+        u[1], v[1], w[1], 0.0f,
+        u[2], v[2], w[2], 0.0f,
+        -dot(u, eye), -dot(v, eye), -dot(w, eye), 1.0f
+    } };
+    return result;
+}
+
+// Push constants shared by all stages of both pipelines
+struct PushConstants {
+    Mat4 viewProj;
+    float cameraPosition[4];
+    uint32_t meshletCount;
+    // Bit 0: cull meshlets in hello.task, bit 1: color by meshlet
+    uint32_t flags;
+    // First of the two counters of this frame in the statistics buffer
+    uint32_t statisticsOffset;
+};
+
+const uint32_t FLAG_CULL = 1;
+const uint32_t FLAG_MESHLET_COLORS = 2;
+
+// Visible meshlets and triangles counted by hello.task
+const uint32_t STATISTICS_PER_FRAME = 2;
+
+// Vulkan equivalent of the DirectX 12 mesh shader sample, which emits one
+// hard coded triangle from MSMain. Here a large mesh is split into meshlets on
+// the CPU before any Vulkan object exists; hello.task tests every meshlet's
+// bounding sphere against the view frustum and its normal cone against the
+// camera, and launches hello.mesh only for the survivors. The same mesh is
+// also drawn through the classic vertex pipeline with one vkCmdDrawIndexed,
+// so both can be timed against each other on the same frames.
+class HelloMeshShaderApplication {
+public:
+    void run() {
+        buildMesh();
+        initVulkan();
+
+        std::vector<unsigned char> vertexImage;
+        std::vector<unsigned char> image;
+        if (options.runVertex) {
+            benchmark(PipelineType::Vertex);
+            image = vertexImage = readImage();
+        }
+        if (options.runMesh) {
+            benchmark(PipelineType::Mesh);
+            image = readImage();
+            if (!vertexImage.empty() && !options.meshletColors) {
+                compareImages(vertexImage, image);
+            }
+        }
+
+        saveImage(image);
+        cleanup();
+    }
+
+private:
+    Mesh mesh;
+    MeshletData meshletData;
+
+    VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger;
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device;
+
+    uint32_t graphicsFamily = 0;
+    VkQueue graphicsQueue;
+
+    VkExtent2D extent;
+    VkImage colorImage;
+    VkDeviceMemory colorImageMemory;
+    VkImageView colorImageView;
+    VkImage depthImage;
+    VkDeviceMemory depthImageMemory;
+    VkImageView depthImageView;
+    VkFramebuffer framebuffer;
+
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackBufferMemory;
+
+    VkRenderPass renderPass;
+    VkPipelineLayout vertexPipelineLayout;
+    VkPipeline vertexPipeline;
+    VkPipelineLayout meshPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline meshPipeline = VK_NULL_HANDLE;
+
+    // Mesh and meshlets, device local
+    VkBuffer vertexBuffer;
+    VkDeviceMemory vertexBufferMemory;
+    VkBuffer indexBuffer;
+    VkDeviceMemory indexBufferMemory;
+    VkBuffer meshletBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory meshletBufferMemory = VK_NULL_HANDLE;
+    VkBuffer meshletVertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory meshletVertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer meshletTriangleBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory meshletTriangleBufferMemory = VK_NULL_HANDLE;
+
+    // Counters written by hello.task, host visible, one pair per frame in flight
+    VkBuffer statisticsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory statisticsBufferMemory = VK_NULL_HANDLE;
+    uint32_t* statistics = nullptr;
+
+    VkDescriptorSetLayout meshDescriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet meshDescriptorSet;
+
+    PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasks = nullptr;
+    VkPhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
+
+    VkCommandPool commandPool;
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<VkFence> inFlightFences;
+
+    // Two timestamps per frame in flight, read back after the frame's fence
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+    float timestampPeriod = 1.0f;
+    uint64_t timestampMask = 0;
+    std::vector<bool> timestampsWritten;
+    std::vector<bool> statisticsWritten;
+    std::vector<double> gpuTimes;
+    std::vector<double> cpuTimes;
+    uint64_t visibleMeshlets = 0;
+    uint64_t visibleTriangles = 0;
+    uint32_t statisticsFrames = 0;
+
+    void buildMesh() {
+        auto start = std::chrono::steady_clock::now();
+        mesh = createTorus(options.gridU, options.gridV);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "mesh: " << mesh.vertices.size() << " vertices, " << mesh.indices.size() / 3 << " triangles in "
+            << elapsed.count() << " ms" << std::endl;
+
+        start = std::chrono::steady_clock::now();
+        meshletData = buildMeshlets(mesh);
+        elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t count = meshletData.meshlets.size();
+        std::cout << "meshlets: " << count << " (avg " << (double)meshletData.vertices.size() / count << " vertices, "
+            << (double)meshletData.triangles.size() / count << " triangles) built in " << elapsed.count() << " ms" << std::endl;
+    }
+
+    void initVulkan() {
+        auto start = std::chrono::steady_clock::now();
+
+        createInstance();
+        setupDebugMessenger();
+        pickPhysicalDevice();
+        createLogicalDevice();
+        createColorImage();
+        createDepthImage();
+        createReadbackBuffer();
+        createCommandPool();
+        createMeshBuffers();
+        createRenderPass();
+        createVertexPipeline();
+        if (options.runMesh) {
+            createMeshDescriptorSet();
+            createMeshPipeline();
+        }
+        createFramebuffer();
+        createCommandBuffers();
+        createSyncObjects();
+        createTimestampQueries();
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "initVulkan: " << elapsed.count() << " ms" << std::endl;
+    }
+
+    void benchmark(PipelineType type) {
+        gpuTimes.clear();
+        cpuTimes.clear();
+        visibleMeshlets = 0;
+        visibleTriangles = 0;
+        statisticsFrames = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint32_t frame = 0; frame < options.frameCount; frame++) {
+            drawFrame(type, frame, frame + 1 == options.frameCount);
+        }
+
+        vkDeviceWaitIdle(device);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            collectResults(i);
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        reportTimes(type, elapsed.count());
+    }
+
+    void cleanup() {
+        vkDestroyQueryPool(device, timestampPool, nullptr);
+
+        for (auto fence : inFlightFences) {
+            vkDestroyFence(device, fence, nullptr);
+        }
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+        vkDestroyPipeline(device, meshPipeline, nullptr);
+        vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
+        vkDestroyPipeline(device, vertexPipeline, nullptr);
+        vkDestroyPipelineLayout(device, vertexPipelineLayout, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, meshDescriptorSetLayout, nullptr);
+
+        if (statistics) {
+            vkUnmapMemory(device, statisticsBufferMemory);
+        }
+        vkDestroyBuffer(device, statisticsBuffer, nullptr);
+        vkFreeMemory(device, statisticsBufferMemory, nullptr);
+        vkDestroyBuffer(device, meshletTriangleBuffer, nullptr);
+        vkFreeMemory(device, meshletTriangleBufferMemory, nullptr);
+        vkDestroyBuffer(device, meshletVertexBuffer, nullptr);
+        vkFreeMemory(device, meshletVertexBufferMemory, nullptr);
+        vkDestroyBuffer(device, meshletBuffer, nullptr);
+        vkFreeMemory(device, meshletBufferMemory, nullptr);
+        vkDestroyBuffer(device, indexBuffer, nullptr);
+        vkFreeMemory(device, indexBufferMemory, nullptr);
+        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        vkFreeMemory(device, vertexBufferMemory, nullptr);
+
+        vkDestroyBuffer(device, readbackBuffer, nullptr);
+        vkFreeMemory(device, readbackBufferMemory, nullptr);
+
+        vkDestroyImageView(device, depthImageView, nullptr);
+        vkDestroyImage(device, depthImage, nullptr);
+        vkFreeMemory(device, depthImageMemory, nullptr);
+        vkDestroyImageView(device, colorImageView, nullptr);
+        vkDestroyImage(device, colorImage, nullptr);
+        vkFreeMemory(device, colorImageMemory, nullptr);
+
+        vkDestroyDevice(device, nullptr);
+
+        if (enableValidationLayers) {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Hello Mesh Shader (headless)";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No Engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        // Mesh shaders are SPIR-V 1.4, which is core in Vulkan 1.2
+        appInfo.apiVersion = VK_API_VERSION_1_3;
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        // No surface extensions: nothing here needs a display
+        std::vector<const char*> extensions;
+        if (enableValidationLayers) {
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        }
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+            createInfo.pNext = nullptr;
+        }
+
+        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+        createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo;
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+            throw std::runtime_error("failed to set up debug messenger!");
+        }
+    }
+
+    void pickPhysicalDevice() {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+        if (deviceCount == 0) {
+            throw std::runtime_error("failed to find GPUs with Vulkan support!");
+        }
+
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        // Any device with a graphics queue will do, including CPU
+        // implementations such as lavapipe, as long as it has task and mesh
+        // shaders when the mesh pipeline is going to run
+        for (const auto& device : devices) {
+            std::optional<uint32_t> family = findGraphicsQueueFamily(device);
+            if (family.has_value() && (!options.runMesh || supportsMeshShaders(device))) {
+                physicalDevice = device;
+                graphicsFamily = family.value();
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE) {
+            throw std::runtime_error(options.runMesh ? "failed to find a GPU with VK_EXT_mesh_shader task and mesh shaders!"
+                : "failed to find a suitable GPU!");
+        }
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        meshShaderProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT;
+        if (options.runMesh) {
+            properties.pNext = &meshShaderProperties;
+        }
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+        std::cout << properties.properties.deviceName << std::endl;
+
+        if (options.runMesh) {
+            // The guaranteed minimums cover the fixed sizes used here, except
+            // for the number of task workgroups, which grows with the mesh
+            uint32_t taskGroups = taskGroupCount();
+            if (taskGroups > meshShaderProperties.maxTaskWorkGroupCount[0] || taskGroups > meshShaderProperties.maxTaskWorkGroupTotalCount) {
+                throw std::runtime_error("too many meshlets for one task dispatch, use a smaller --grid!");
+            }
+        }
+    }
+
+    uint32_t taskGroupCount() {
+        return ((uint32_t)meshletData.meshlets.size() + TASK_WORKGROUP_SIZE - 1) / TASK_WORKGROUP_SIZE;
+    }
+
+    std::optional<uint32_t> findGraphicsQueueFamily(VkPhysicalDevice device) {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                return i;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    bool supportsMeshShaders(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        bool found = false;
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+        meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &meshShaderFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
+    }
+
+    void createLogicalDevice() {
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = graphicsFamily;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+        meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        meshShaderFeatures.taskShader = VK_TRUE;
+        meshShaderFeatures.meshShader = VK_TRUE;
+
+        std::vector<const char*> extensions;
+        if (options.runMesh) {
+            extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        }
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = options.runMesh ? &meshShaderFeatures : nullptr;
+
+        createInfo.queueCreateInfoCount = 1;
+        createInfo.pQueueCreateInfos = &queueCreateInfo;
+
+        createInfo.pEnabledFeatures = &deviceFeatures;
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        }
+        else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+
+        vkGetDeviceQueue(device, graphicsFamily, 0, &graphicsQueue);
+
+        if (options.runMesh) {
+            cmdDrawMeshTasks = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+            if (cmdDrawMeshTasks == nullptr) {
+                throw std::runtime_error("failed to load vkCmdDrawMeshTasksEXT!");
+            }
+        }
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    void createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage& image, VkDeviceMemory& imageMemory, VkImageView& imageView) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent = { extent.width, extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate image memory!");
+        }
+
+        vkBindImageMemory(device, image, imageMemory, 0);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = aspect;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image views!");
+        }
+    }
+
+    void createColorImage() {
+        extent = { options.width, options.height };
+        createImage(COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+            colorImage, colorImageMemory, colorImageView);
+    }
+
+    void createDepthImage() {
+        // D32_SFLOAT is mandatory as a depth attachment
+        createImage(DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+            depthImage, depthImageMemory, depthImageView);
+    }
+
+    void createReadbackBuffer() {
+        createBuffer((VkDeviceSize)extent.width * extent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate buffer memory!");
+        }
+
+        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    }
+
+    // Copies data into a new device local buffer through a temporary staging
+    // buffer and waits for the copy; only used at startup.
+    void createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer, stagingBufferMemory);
+
+        void* mapped;
+        if (vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map staging buffer!");
+        }
+        memcpy(mapped, data, (size_t)size);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        // Waiting for the queue to go idle also makes the copy visible to
+        // every later submission
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit copy command buffer!");
+        }
+        vkQueueWaitIdle(graphicsQueue);
+
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        vkFreeMemory(device, stagingBufferMemory, nullptr);
+    }
+
+    void createMeshBuffers() {
+        // The vertex pipeline reads the vertices as attributes, hello.mesh
+        // pulls them from the same buffer as storage
+        createDeviceLocalBuffer(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex),
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, vertexBuffer, vertexBufferMemory);
+        createDeviceLocalBuffer(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory);
+
+        if (!options.runMesh) {
+            return;
+        }
+
+        createDeviceLocalBuffer(meshletData.meshlets.data(), meshletData.meshlets.size() * sizeof(Meshlet),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletBuffer, meshletBufferMemory);
+        createDeviceLocalBuffer(meshletData.vertices.data(), meshletData.vertices.size() * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletVertexBuffer, meshletVertexBufferMemory);
+        createDeviceLocalBuffer(meshletData.triangles.data(), meshletData.triangles.size() * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletTriangleBuffer, meshletTriangleBufferMemory);
+
+        VkDeviceSize statisticsSize = MAX_FRAMES_IN_FLIGHT * STATISTICS_PER_FRAME * sizeof(uint32_t);
+        createBuffer(statisticsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, statisticsBuffer, statisticsBufferMemory);
+
+        void* mapped;
+        if (vkMapMemory(device, statisticsBufferMemory, 0, statisticsSize, 0, &mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map statistics buffer!");
+        }
+        statistics = static_cast<uint32_t*>(mapped);
+    }
+
+    void createRenderPass() {
+        VkAttachmentDescription attachments[2] = {};
+        attachments[0].format = COLOR_FORMAT;
+        attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        // Depth is only needed within the frame
+        attachments[1].format = DEPTH_FORMAT;
+        attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentRef{};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        // Every frame renders into the same images: order this frame's clears
+        // after the previous frame's color and depth writes and readback copy.
+        VkSubpassDependency dependencies[2] = {};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // ...and make the final layout transition visible to the copy
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 2;
+        renderPassInfo.pAttachments = attachments;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 2;
+        renderPassInfo.pDependencies = dependencies;
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render pass!");
+        }
+    }
+
+    void createMeshDescriptorSet() {
+        // Vertices, meshlets, meshlet vertices, meshlet triangles, statistics
+        const uint32_t bindingCount = 5;
+        VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+        for (uint32_t i = 0; i < bindingCount; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = bindingCount;
+        layoutInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &meshDescriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = bindingCount;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &meshDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &meshDescriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        VkBuffer buffers[bindingCount] = { vertexBuffer, meshletBuffer, meshletVertexBuffer, meshletTriangleBuffer, statisticsBuffer };
+        VkDescriptorBufferInfo bufferInfos[bindingCount] = {};
+        for (uint32_t i = 0; i < bindingCount; i++) {
+            bufferInfos[i].buffer = buffers[i];
+            bufferInfos[i].offset = 0;
+            bufferInfos[i].range = VK_WHOLE_SIZE;
+        }
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = meshDescriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrite.descriptorCount = bindingCount;
+        descriptorWrite.pBufferInfo = bufferInfos;
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    // Fixed function state shared by both pipelines: depth tested, back faces
+    // culled, so the vertex pipeline rejects the same triangles the mesh
+    // pipeline never emits
+    VkPipeline createGraphicsPipeline(const VkPipelineShaderStageCreateInfo* stages, uint32_t stageCount,
+        const VkPipelineVertexInputStateCreateInfo* vertexInputInfo, const VkPipelineInputAssemblyStateCreateInfo* inputAssembly,
+        VkPipelineLayout layout) {
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)extent.width;
+        viewport.height = (float)extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = extent;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = stageCount;
+        pipelineInfo.pStages = stages;
+        pipelineInfo.pVertexInputState = vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = layout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        return pipeline;
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStage(VkShaderStageFlagBits stage, VkShaderModule module) {
+        VkPipelineShaderStageCreateInfo stageInfo{};
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = stage;
+        stageInfo.module = module;
+        stageInfo.pName = "main";
+        return stageInfo;
+    }
+
+    void createVertexPipeline() {
+        ShaderBinary vertShaderCode = loadShader("hello_vert.spv", EMBEDDED_SHADER(hello_vert_spv));
+        ShaderBinary fragShaderCode = loadShader("hello_frag.spv", EMBEDDED_SHADER(hello_frag_spv));
+
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {
+            shaderStage(VK_SHADER_STAGE_VERTEX_BIT, vertShaderModule),
+            shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule)
+        };
+
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkVertexInputAttributeDescription attributeDescriptions[2] = {};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Vertex, position);
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Vertex, normal);
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = 2;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 0;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &vertexPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        vertexPipeline = createGraphicsPipeline(shaderStages, 2, &vertexInputInfo, &inputAssembly, vertexPipelineLayout);
+
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    }
+
+    void createMeshPipeline() {
+        ShaderBinary taskShaderCode = loadShader("hello_task.spv", EMBEDDED_SHADER(hello_task_spv));
+        ShaderBinary meshShaderCode = loadShader("hello_mesh.spv", EMBEDDED_SHADER(hello_mesh_spv));
+        ShaderBinary fragShaderCode = loadShader("hello_frag.spv", EMBEDDED_SHADER(hello_frag_spv));
+
+        VkShaderModule taskShaderModule = createShaderModule(taskShaderCode);
+        VkShaderModule meshShaderModule = createShaderModule(meshShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {
+            shaderStage(VK_SHADER_STAGE_TASK_BIT_EXT, taskShaderModule),
+            shaderStage(VK_SHADER_STAGE_MESH_BIT_EXT, meshShaderModule),
+            shaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule)
+        };
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &meshDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &meshPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        // No vertex input or input assembly: hello.mesh fetches its own
+        // vertices and emits triangles directly
+        meshPipeline = createGraphicsPipeline(shaderStages, 3, nullptr, nullptr, meshPipelineLayout);
+
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        vkDestroyShaderModule(device, meshShaderModule, nullptr);
+        vkDestroyShaderModule(device, taskShaderModule, nullptr);
+    }
+
+    void createFramebuffer() {
+        VkImageView attachments[] = { colorImageView, depthImageView };
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = 2;
+        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+
+    void createCommandPool() {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = graphicsFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+    }
+
+    void createCommandBuffers() {
+        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+
+    void createSyncObjects() {
+        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+
+        statisticsWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+    }
+
+    void createTimestampQueries() {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[graphicsFamily].timestampValidBits;
+        if (validBits == 0) {
+            std::cout << "timestamps are not supported, GPU times will not be reported" << std::endl;
+            return;
+        }
+        timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+        timestampsWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+    }
+
+    void collectResults(uint32_t frameIndex) {
+        // The frame's fence has signaled, so the results are available
+        if (timestampPool != VK_NULL_HANDLE && timestampsWritten[frameIndex]) {
+            uint64_t timestamps[2];
+            if (vkGetQueryPoolResults(device, timestampPool, frameIndex * 2, 2, sizeof(timestamps), timestamps,
+                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                gpuTimes.push_back(((timestamps[1] - timestamps[0]) & timestampMask) * timestampPeriod / 1e6);
+            }
+            timestampsWritten[frameIndex] = false;
+        }
+
+        if (statisticsWritten[frameIndex]) {
+            visibleMeshlets += statistics[frameIndex * STATISTICS_PER_FRAME];
+            visibleTriangles += statistics[frameIndex * STATISTICS_PER_FRAME + 1];
+            statisticsFrames++;
+            statisticsWritten[frameIndex] = false;
+        }
+    }
+
+    // The camera circles the torus once every 360 frames, slightly above it;
+    // both pipelines see the same sequence of views
+    PushConstants frameConstants(uint32_t frame, uint32_t frameIndex) {
+        float angle = 2.0f * 3.14159265f * (frame % 360) / 360.0f;
+        float eye[3] = { options.distance * std::cos(angle), options.distance * 0.45f, options.distance * std::sin(angle) };
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+
+        Mat4 proj = perspective(45.0f * 3.14159265f / 180.0f, (float)extent.width / extent.height, 0.1f, 100.0f);
+        Mat4 view = lookAt(eye, center, up);
+
+        PushConstants constants{};
+        constants.viewProj = multiply(proj, view);
+        constants.cameraPosition[0] = eye[0];
+        constants.cameraPosition[1] = eye[1];
+        constants.cameraPosition[2] = eye[2];
+        constants.cameraPosition[3] = 1.0f;
+        constants.meshletCount = (uint32_t)meshletData.meshlets.size();
+        constants.flags = (options.cull ? FLAG_CULL : 0) | (options.meshletColors ? FLAG_MESHLET_COLORS : 0);
+        constants.statisticsOffset = frameIndex * STATISTICS_PER_FRAME;
+        return constants;
+    }
+
+    void recordCommandBuffer(PipelineType type, uint32_t frame, uint32_t frameIndex, bool readback) {
+        VkCommandBuffer commandBuffer = commandBuffers[frameIndex];
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, timestampPool, frameIndex * 2, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, frameIndex * 2);
+        }
+
+        PushConstants constants = frameConstants(frame, frameIndex);
+
+        if (type == PipelineType::Mesh) {
+            // hello.task adds to this frame's counters
+            vkCmdFillBuffer(commandBuffer, statisticsBuffer, constants.statisticsOffset * sizeof(uint32_t),
+                STATISTICS_PER_FRAME * sizeof(uint32_t), 0);
+
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, 0,
+                1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = framebuffer;
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = extent;
+
+        VkClearValue clearValues[2] = {};
+        clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+        renderPassInfo.clearValueCount = 2;
+        renderPassInfo.pClearValues = clearValues;
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        if (type == PipelineType::Mesh) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipelineLayout, 0, 1, &meshDescriptorSet, 0, nullptr);
+            vkCmdPushConstants(commandBuffer, meshPipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+                0, sizeof(constants), &constants);
+            // One task invocation per meshlet
+            cmdDrawMeshTasks(commandBuffer, taskGroupCount(), 1, 1);
+        }
+        else {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vertexPipeline);
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+            vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdPushConstants(commandBuffer, vertexPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+            vkCmdDrawIndexed(commandBuffer, (uint32_t)mesh.indices.size(), 1, 0, 0, 0);
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+
+        if (type == PipelineType::Mesh) {
+            // Counters are read on the host once the fence has signaled
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                1, &barrier, 0, nullptr, 0, nullptr);
+            statisticsWritten[frameIndex] = true;
+        }
+
+        if (readback) {
+            recordReadback(commandBuffer);
+        }
+
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, frameIndex * 2 + 1);
+            timestampsWritten[frameIndex] = true;
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    void recordReadback(VkCommandBuffer commandBuffer) {
+        // The render pass left the image in TRANSFER_SRC_OPTIMAL
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { extent.width, extent.height, 1 };
+
+        vkCmdCopyImageToBuffer(commandBuffer, colorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = readbackBuffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    void drawFrame(PipelineType type, uint32_t frame, bool readback) {
+        uint32_t frameIndex = frame % MAX_FRAMES_IN_FLIGHT;
+
+        vkWaitForFences(device, 1, &inFlightFences[frameIndex], VK_TRUE, UINT64_MAX);
+        collectResults(frameIndex);
+
+        // CPU time covers recording and submission, not the wait above
+        auto start = std::chrono::steady_clock::now();
+
+        vkResetCommandBuffer(commandBuffers[frameIndex], 0);
+        recordCommandBuffer(type, frame, frameIndex, readback);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[frameIndex];
+
+        vkResetFences(device, 1, &inFlightFences[frameIndex]);
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[frameIndex]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        cpuTimes.push_back(elapsed.count());
+    }
+
+    static double printTimes(const char* name, std::vector<double>& times) {
+        if (times.empty()) {
+            return 0.0;
+        }
+
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (double time : times) {
+            sum += time;
+        }
+        size_t count = times.size();
+        std::cout << name << " ms/frame: min " << times.front() << ", avg " << sum / count
+            << ", p99 " << times[std::min(count - 1, (size_t)std::ceil(count * 0.99) - 1)]
+            << ", max " << times.back() << std::endl;
+        return sum / count;
+    }
+
+    void reportTimes(PipelineType type, double seconds) {
+        const char* name = type == PipelineType::Mesh ? "mesh" : "vertex";
+        double triangles = (double)mesh.indices.size() / 3;
+
+        std::cout << name << " pipeline: " << options.frameCount << " frames in " << seconds << " s: "
+            << options.frameCount / seconds << " fps, " << (size_t)triangles << " triangles, "
+            << extent.width << "x" << extent.height << std::endl;
+
+        printTimes("  CPU", cpuTimes);
+        double gpuAverage = printTimes("  GPU", gpuTimes);
+
+        // Throughput counts the whole mesh, culled or not, so both pipelines
+        // are measured against the same amount of work
+        std::cout << "  triangles/sec: " << triangles * options.frameCount / seconds / 1e6 << " M (wall clock)";
+        if (gpuAverage > 0.0) {
+            std::cout << ", " << triangles / (gpuAverage / 1e3) / 1e6 << " M (GPU)";
+        }
+        std::cout << std::endl;
+
+        if (type == PipelineType::Mesh && statisticsFrames > 0) {
+            double meshlets = (double)visibleMeshlets / statisticsFrames;
+            double visible = (double)visibleTriangles / statisticsFrames;
+            std::cout << "  task shader kept " << meshlets << " of " << meshletData.meshlets.size() << " meshlets ("
+                << 100.0 * meshlets / meshletData.meshlets.size() << "%), " << (size_t)visible << " triangles per frame"
+                << std::endl;
+        }
+    }
+
+    std::vector<unsigned char> readImage() {
+        void* data;
+        if (vkMapMemory(device, readbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map readback buffer!");
+        }
+
+        const unsigned char* pixels = static_cast<const unsigned char*>(data);
+        std::vector<unsigned char> image(pixels, pixels + (size_t)extent.width * extent.height * 4);
+
+        vkUnmapMemory(device, readbackBufferMemory);
+        return image;
+    }
+
+    // Cone and frustum culling are conservative, so the last frame of both
+    // pipelines should match except where rasterization order differs
+    void compareImages(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b) {
+        size_t differing = 0;
+        for (size_t i = 0; i < a.size(); i += 4) {
+            if (a[i] != b[i] || a[i + 1] != b[i + 1] || a[i + 2] != b[i + 2]) {
+                differing++;
+            }
+        }
+        std::cout << "vertex and mesh pipeline images differ in " << differing << " of " << a.size() / 4 << " pixels" << std::endl;
+    }
+
+    void saveImage(const std::vector<unsigned char>& pixels) {
+        std::ofstream file(options.outputFile, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open file: " + options.outputFile);
+        }
+
+        // RGBA rows to binary PPM
+        file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+        std::vector<char> row(extent.width * 3);
+        for (uint32_t y = 0; y < extent.height; y++) {
+            const unsigned char* src = pixels.data() + (size_t)y * extent.width * 4;
+            for (uint32_t x = 0; x < extent.width; x++) {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            file.write(row.data(), row.size());
+        }
+
+        if (!file) {
+            throw std::runtime_error("failed to write file: " + options.outputFile);
+        }
+        std::cout << "Wrote " << options.outputFile << std::endl;
+    }
+
+    ShaderBinary loadShader(const char* fileName, const uint32_t* embedded, size_t embeddedSize) {
+        // Embedded code wins unless a shader directory was given explicitly,
+        // so a default start does no file I/O for shaders at all.
+        if (embedded && options.shaderDir.empty()) {
+            return ShaderBinary(embedded, embeddedSize);
+        }
+        return ShaderBinary(shaderDirectory() + "/" + fileName);
+    }
+
+    VkShaderModule createShaderModule(const ShaderBinary& code) {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = code.code();
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        return shaderModule;
+    }
+
+    bool checkValidationLayerSupport() {
+        uint32_t layerCount;
+        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+        std::vector<VkLayerProperties> availableLayers(layerCount);
+        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+        for (const char* layerName : validationLayers) {
+            bool layerFound = false;
+
+            for (const auto& layerProperties : availableLayers) {
+                if (strcmp(layerName, layerProperties.layerName) == 0) {
+                    layerFound = true;
+                    break;
+                }
+            }
+
+            if (!layerFound) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
+        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+
+        return VK_FALSE;
+    }
+};
+
+int main(int argc, char** argv) {
+    HelloMeshShaderApplication app;
+
+    try {
+        parseOptions(argc, argv);
+        app.run();
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#version 460
+
+layout(push_constant) uniform PushConstants {
+    mat4 viewProj;
+    vec4 cameraPosition;
+    uint meshletCount;
+    uint flags;
+    uint statisticsOffset;
+} pc;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec4 fragColor;
+
+// Same lighting as hello.mesh
+vec3 shade(vec3 normal) {
+    vec3 light = normalize(vec3(0.4, 1.0, 0.6));
+    return vec3(0.9, 0.6, 0.3) * (0.2 + 0.8 * max(dot(normal, light), 0.0));
+}
+
+void main() {
+    gl_Position = pc.viewProj * vec4(inPosition, 1.0);
+    fragColor = vec4(shade(inNormal), 1.0);
+}
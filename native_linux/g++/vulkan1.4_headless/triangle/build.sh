@@ -0,0 +1,7 @@
+glslangValidator -V hello.vert -o hello_vert.spv
+glslangValidator -V hello.frag -o hello_frag.spv
+glslangValidator -V hello.vert --vn hello_vert_spv -o hello_vert.h
+glslangValidator -V hello.frag --vn hello_frag_spv -o hello_frag.h
+g++ -O2 -DNDEBUG -o hello hello.cpp -DEMBED_SHADERS \
+  `pkg-config --cflags vulkan` \
+  `pkg-config --libs vulkan`
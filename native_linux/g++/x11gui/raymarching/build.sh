@@ -0,0 +1 @@
+g++ -O2 -march=native -pthread -o hello hello.cpp -lX11 -lXext -L/usr/X11/lib
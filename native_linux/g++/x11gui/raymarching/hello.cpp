@@ -0,0 +1,1219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// CPU version of the DirectX 12 raymarcher
+// (native_win/cpp/directx12/raymarching/hello.hlsl) for hosts without any GL
+// driver. The frame is cut into tiles that the threads of a pool take from
+// work-stealing queues, and each tile is marched in packets of 4, 8 or 16
+// rays, one ray per SIMD lane. Frames go to an X11 window through MIT-SHM,
+// or to a PPM file without a display.
+
+#define WINDOW_WIDTH        640
+#define WINDOW_HEIGHT       480
+#define DEFAULT_TILE        32
+#define HEADLESS_FRAMES     60
+#define OUTPUT_FILE         "hello.ppm"
+#define STATS_INTERVAL      5.0         // seconds between reports in the window
+#define IMAGE_COUNT         2           // XShm images, one on screen while the next renders
+
+// The constants of the shader
+static const int   MAX_STEPS = 100;
+static const float MAX_DIST = 100.0f;
+static const float SURF_DIST = 0.001f;
+
+/* ---------------------------------------------------------------- */
+/* SIMD back ends                                                   */
+/*                                                                  */
+/* A packet is a PACKET_W x PACKET_H block of pixels, one per lane. */
+/* F is a vector of floats, I of 32-bit integers and M a lane mask. */
+/* ---------------------------------------------------------------- */
+
+struct ScalarOps {
+    typedef float   F;
+    typedef int32_t I;
+    typedef bool    M;
+    enum { WIDTH = 1, PACKET_W = 1, PACKET_H = 1 };
+
+    static F set(float v)                 { return v; }
+    static F laneX()                      { return 0.0f; }
+    static F laneY()                      { return 0.0f; }
+    static void store(float* p, F v)      { *p = v; }
+    static F add(F a, F b)                { return a + b; }
+    static F sub(F a, F b)                { return a - b; }
+    static F mul(F a, F b)                { return a * b; }
+    static F div(F a, F b)                { return a / b; }
+    static F madd(F a, F b, F c)          { return a * b + c; }
+    static F min(F a, F b)                { return a < b ? a : b; }
+    static F max(F a, F b)                { return a > b ? a : b; }
+    static F abs(F a)                     { return fabsf(a); }
+    static F sqrt(F a)                    { return sqrtf(a); }
+    static F floor(F a)                   { return floorf(a); }
+    static I trunc(F a)                   { return (int32_t)a; }
+    static F tofloat(I a)                 { return (float)a; }
+    static I seti(int32_t v)              { return v; }
+    static I addi(I a, I b)               { return a + b; }
+    static I shl23(I a)                   { return (int32_t)((uint32_t)a << 23); }
+    static F frombits(I a)                { F f; memcpy(&f, &a, 4); return f; }
+    static M lt(F a, F b)                 { return a < b; }
+    static M mand(M a, M b)               { return a && b; }
+    static M mor(M a, M b)                { return a || b; }
+    static M mandnot(M a, M b)            { return a && !b; }
+    static M mtrue()                      { return true; }
+    static bool any(M m)                  { return m; }
+    static int count(M m)                 { return m ? 1 : 0; }
+    static F select(M m, F a, F b)        { return m ? a : b; }
+};
+
+#ifdef __SSE2__
+struct SseOps {
+    typedef __m128  F;
+    typedef __m128i I;
+    typedef __m128  M;
+    enum { WIDTH = 4, PACKET_W = 2, PACKET_H = 2 };
+
+    static F set(float v)                 { return _mm_set1_ps(v); }
+    static F laneX()                      { return _mm_setr_ps(0, 1, 0, 1); }
+    static F laneY()                      { return _mm_setr_ps(0, 0, 1, 1); }
+    static void store(float* p, F v)      { _mm_storeu_ps(p, v); }
+    static F add(F a, F b)                { return _mm_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F min(F a, F b)                { return _mm_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm_max_ps(a, b); }
+    static F abs(F a)                     { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static F sqrt(F a)                    { return _mm_sqrt_ps(a); }
+    static F floor(F a) {
+        // SSE2 has no roundps: truncate, then step down where that rounded up
+        F t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    }
+    static I trunc(F a)                   { return _mm_cvttps_epi32(a); }
+    static F tofloat(I a)                 { return _mm_cvtepi32_ps(a); }
+    static I seti(int32_t v)              { return _mm_set1_epi32(v); }
+    static I addi(I a, I b)               { return _mm_add_epi32(a, b); }
+    static I shl23(I a)                   { return _mm_slli_epi32(a, 23); }
+    static F frombits(I a)                { return _mm_castsi128_ps(a); }
+    static M lt(F a, F b)                 { return _mm_cmplt_ps(a, b); }
+    static M mand(M a, M b)               { return _mm_and_ps(a, b); }
+    static M mor(M a, M b)                { return _mm_or_ps(a, b); }
+    static M mandnot(M a, M b)            { return _mm_andnot_ps(b, a); }
+    static M mtrue()                      { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static bool any(M m)                  { return _mm_movemask_ps(m) != 0; }
+    static int count(M m)                 { return __builtin_popcount(_mm_movemask_ps(m)); }
+    static F select(M m, F a, F b)        { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+};
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+struct Avx2Ops {
+    typedef __m256  F;
+    typedef __m256i I;
+    typedef __m256  M;
+    enum { WIDTH = 8, PACKET_W = 4, PACKET_H = 2 };
+
+    static F set(float v)                 { return _mm256_set1_ps(v); }
+    static F laneX()                      { return _mm256_setr_ps(0, 1, 2, 3, 0, 1, 2, 3); }
+    static F laneY()                      { return _mm256_setr_ps(0, 0, 0, 0, 1, 1, 1, 1); }
+    static void store(float* p, F v)      { _mm256_storeu_ps(p, v); }
+    static F add(F a, F b)                { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm256_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm256_fmadd_ps(a, b, c); }
+    static F min(F a, F b)                { return _mm256_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm256_max_ps(a, b); }
+    static F abs(F a)                     { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F sqrt(F a)                    { return _mm256_sqrt_ps(a); }
+    static F floor(F a)                   { return _mm256_floor_ps(a); }
+    static I trunc(F a)                   { return _mm256_cvttps_epi32(a); }
+    static F tofloat(I a)                 { return _mm256_cvtepi32_ps(a); }
+    static I seti(int32_t v)              { return _mm256_set1_epi32(v); }
+    static I addi(I a, I b)               { return _mm256_add_epi32(a, b); }
+    static I shl23(I a)                   { return _mm256_slli_epi32(a, 23); }
+    static F frombits(I a)                { return _mm256_castsi256_ps(a); }
+    static M lt(F a, F b)                 { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M mand(M a, M b)               { return _mm256_and_ps(a, b); }
+    static M mor(M a, M b)                { return _mm256_or_ps(a, b); }
+    static M mandnot(M a, M b)            { return _mm256_andnot_ps(b, a); }
+    static M mtrue()                      { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static bool any(M m)                  { return _mm256_movemask_ps(m) != 0; }
+    static int count(M m)                 { return __builtin_popcount(_mm256_movemask_ps(m)); }
+    static F select(M m, F a, F b)        { return _mm256_blendv_ps(b, a, m); }
+};
+#endif
+
+#ifdef __AVX512F__
+struct Avx512Ops {
+    typedef __m512    F;
+    typedef __m512i   I;
+    typedef __mmask16 M;
+    enum { WIDTH = 16, PACKET_W = 4, PACKET_H = 4 };
+
+    static F set(float v)                 { return _mm512_set1_ps(v); }
+    static F laneX()                      { return _mm512_setr_ps(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3); }
+    static F laneY()                      { return _mm512_setr_ps(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3); }
+    static void store(float* p, F v)      { _mm512_storeu_ps(p, v); }
+    static F add(F a, F b)                { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm512_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm512_fmadd_ps(a, b, c); }
+    static F min(F a, F b)                { return _mm512_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm512_max_ps(a, b); }
+    static F abs(F a)                     { return _mm512_abs_ps(a); }
+    static F sqrt(F a)                    { return _mm512_sqrt_ps(a); }
+    static F floor(F a)                   { return _mm512_floor_ps(a); }
+    static I trunc(F a)                   { return _mm512_cvttps_epi32(a); }
+    static F tofloat(I a)                 { return _mm512_cvtepi32_ps(a); }
+    static I seti(int32_t v)              { return _mm512_set1_epi32(v); }
+    static I addi(I a, I b)               { return _mm512_add_epi32(a, b); }
+    static I shl23(I a)                   { return _mm512_slli_epi32(a, 23); }
+    static F frombits(I a)                { return _mm512_castsi512_ps(a); }
+    static M lt(F a, F b)                 { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M mand(M a, M b)               { return a & b; }
+    static M mor(M a, M b)                { return a | b; }
+    static M mandnot(M a, M b)            { return a & ~b; }
+    static M mtrue()                      { return 0xFFFF; }
+    static bool any(M m)                  { return m != 0; }
+    static int count(M m)                 { return __builtin_popcount(m); }
+    static F select(M m, F a, F b)        { return _mm512_mask_blend_ps(m, b, a); }
+};
+#endif
+
+/* ---------------------------------------------------------------- */
+/* Scene                                                            */
+/* ---------------------------------------------------------------- */
+
+// Everything in GetDist that only depends on iTime, computed once per frame
+// instead of once per distance evaluation
+struct Scene {
+    float sphere[3];
+    float cosA, sinA;
+    float cosA2, sinA2;
+    int   width;
+    int   height;
+};
+
+static void SetupScene(Scene* scene, float time, int width, int height)
+{
+    scene->sphere[0] = sinf(time) * 1.5f;
+    scene->sphere[1] = 0.5f + sinf(time * 2.0f) * 0.3f;
+    scene->sphere[2] = 0.0f;
+
+    float angle = time * 0.5f;
+    scene->cosA = cosf(angle);
+    scene->sinA = sinf(angle);
+    scene->cosA2 = cosf(angle * 0.7f);
+    scene->sinA2 = sinf(angle * 0.7f);
+
+    scene->width = width;
+    scene->height = height;
+}
+
+template <class V>
+struct Vec3 {
+    typename V::F x, y, z;
+};
+
+template <class V>
+static inline Vec3<V> Make(typename V::F x, typename V::F y, typename V::F z)
+{
+    Vec3<V> v = { x, y, z };
+    return v;
+}
+
+template <class V>
+static inline Vec3<V> Splat(float x, float y, float z)
+{
+    return Make<V>(V::set(x), V::set(y), V::set(z));
+}
+
+template <class V>
+static inline Vec3<V> Add(const Vec3<V>& a, const Vec3<V>& b)
+{
+    return Make<V>(V::add(a.x, b.x), V::add(a.y, b.y), V::add(a.z, b.z));
+}
+
+template <class V>
+static inline Vec3<V> Sub(const Vec3<V>& a, const Vec3<V>& b)
+{
+    return Make<V>(V::sub(a.x, b.x), V::sub(a.y, b.y), V::sub(a.z, b.z));
+}
+
+// a + b * s
+template <class V>
+static inline Vec3<V> Madd(const Vec3<V>& a, const Vec3<V>& b, typename V::F s)
+{
+    return Make<V>(V::madd(b.x, s, a.x), V::madd(b.y, s, a.y), V::madd(b.z, s, a.z));
+}
+
+template <class V>
+static inline typename V::F Dot(const Vec3<V>& a, const Vec3<V>& b)
+{
+    return V::madd(a.x, b.x, V::madd(a.y, b.y, V::mul(a.z, b.z)));
+}
+
+template <class V>
+static inline Vec3<V> Normalize(const Vec3<V>& a)
+{
+    typename V::F inv = V::div(V::set(1.0f), V::sqrt(Dot<V>(a, a)));
+    return Make<V>(V::mul(a.x, inv), V::mul(a.y, inv), V::mul(a.z, inv));
+}
+
+// exp (Cephes expf), as in console/harmonograph; only the fog needs it
+template <class V>
+static inline typename V::F Exp(typename V::F x)
+{
+    typedef typename V::F F;
+
+    x = V::min(V::max(x, V::set(-87.3365447504f)), V::set(88.3762626647949f));
+
+    F n = V::floor(V::madd(x, V::set(1.44269504088896341f), V::set(0.5f)));
+    x = V::madd(n, V::set(-0.693359375f), x);
+    x = V::madd(n, V::set(2.12194440e-4f), x);
+
+    F z = V::mul(x, x);
+    F y = V::madd(V::set(1.9875691500e-4f), x, V::set(1.3981999507e-3f));
+    y = V::madd(y, x, V::set(8.3334519073e-3f));
+    y = V::madd(y, x, V::set(4.1665795894e-2f));
+    y = V::madd(y, x, V::set(1.6666665459e-1f));
+    y = V::madd(y, x, V::set(5.0000001201e-1f));
+    y = V::madd(y, z, x);
+    y = V::add(y, V::set(1.0f));
+
+    F scale = V::frombits(V::shl23(V::addi(V::trunc(n), V::seti(127))));
+    return V::mul(y, scale);
+}
+
+// smin(sdSphere, sdTorus) against the ground plane, lane by lane
+template <class V>
+static inline typename V::F GetDist(const Scene& s, const Vec3<V>& p)
+{
+    typedef typename V::F F;
+
+    F dx = V::sub(p.x, V::set(s.sphere[0]));
+    F dy = V::sub(p.y, V::set(s.sphere[1]));
+    F dz = V::sub(p.z, V::set(s.sphere[2]));
+    F sphere = V::sub(V::sqrt(V::madd(dx, dx, V::madd(dy, dy, V::mul(dz, dz)))), V::set(0.5f));
+
+    F tx = p.x;
+    F ty = V::sub(p.y, V::set(0.5f));
+    F tz = p.z;
+    F rx = V::sub(V::mul(V::set(s.cosA), tx), V::mul(V::set(s.sinA), tz));
+    tz = V::add(V::mul(V::set(s.sinA), tx), V::mul(V::set(s.cosA), tz));
+    tx = V::sub(V::mul(V::set(s.cosA2), rx), V::mul(V::set(s.sinA2), ty));
+    ty = V::add(V::mul(V::set(s.sinA2), rx), V::mul(V::set(s.cosA2), ty));
+    F qx = V::sub(V::sqrt(V::madd(tx, tx, V::mul(tz, tz))), V::set(0.8f));
+    F torus = V::sub(V::sqrt(V::madd(qx, qx, V::mul(ty, ty))), V::set(0.2f));
+
+    F plane = V::add(p.y, V::set(0.5f));
+
+    const float k = 0.3f;
+    F h = V::madd(V::sub(torus, sphere), V::set(0.5f / k), V::set(0.5f));
+    h = V::min(V::max(h, V::set(0.0f)), V::set(1.0f));
+    F blend = V::madd(V::sub(sphere, torus), h, torus);
+    F d = V::sub(blend, V::mul(V::set(k), V::mul(h, V::sub(V::set(1.0f), h))));
+    return V::min(d, plane);
+}
+
+template <class V>
+static inline Vec3<V> GetNormal(const Scene& s, const Vec3<V>& p)
+{
+    typename V::F d = GetDist<V>(s, p);
+    typename V::F e = V::set(0.001f);
+    Vec3<V> n = Make<V>(
+        V::sub(d, GetDist<V>(s, Make<V>(V::sub(p.x, e), p.y, p.z))),
+        V::sub(d, GetDist<V>(s, Make<V>(p.x, V::sub(p.y, e), p.z))),
+        V::sub(d, GetDist<V>(s, Make<V>(p.x, p.y, V::sub(p.z, e)))));
+    return Normalize<V>(n);
+}
+
+// A lane stops where the original loop would break; the packet stops when
+// every lane has
+template <class V>
+static inline typename V::F RayMarch(const Scene& s, const Vec3<V>& ro, const Vec3<V>& rd)
+{
+    typedef typename V::F F;
+    typedef typename V::M M;
+
+    F dO = V::set(0.0f);
+    M active = V::mtrue();
+    for (int i = 0; i < MAX_STEPS && V::any(active); i++) {
+        F dS = GetDist<V>(s, Madd<V>(ro, rd, dO));
+        dO = V::add(dO, V::select(active, dS, V::set(0.0f)));
+        M done = V::mor(V::lt(V::set(MAX_DIST), dO), V::lt(dS, V::set(SURF_DIST)));
+        active = V::mandnot(active, done);
+    }
+    return dO;
+}
+
+template <class V>
+static inline typename V::F GetShadow(const Scene& s, typename V::M active, const Vec3<V>& ro, const Vec3<V>& rd,
+    float mint, typename V::F maxt, float k)
+{
+    typedef typename V::F F;
+    typedef typename V::M M;
+
+    F res = V::set(1.0f);
+    F t = V::set(mint);
+    active = V::mand(active, V::lt(t, maxt));
+    for (int i = 0; i < 64 && V::any(active); i++) {
+        F h = GetDist<V>(s, Madd<V>(ro, rd, t));
+        M occluded = V::mand(active, V::lt(h, V::set(0.001f)));
+        res = V::select(occluded, V::set(0.0f), res);
+        active = V::mandnot(active, occluded);
+        res = V::select(active, V::min(res, V::div(V::mul(V::set(k), h), t)), res);
+        t = V::select(active, V::add(t, h), t);
+        active = V::mand(active, V::lt(t, maxt));
+    }
+    return res;
+}
+
+template <class V>
+static inline typename V::F GetAO(const Scene& s, const Vec3<V>& p, const Vec3<V>& n)
+{
+    typedef typename V::F F;
+
+    F occ = V::set(0.0f);
+    float sca = 1.0f;
+    for (int i = 0; i < 5; i++) {
+        float h = 0.01f + 0.12f * i / 4.0f;
+        F d = GetDist<V>(s, Madd<V>(p, n, V::set(h)));
+        occ = V::madd(V::sub(V::set(h), d), V::set(sca), occ);
+        sca *= 0.95f;
+    }
+    return V::min(V::max(V::madd(occ, V::set(-3.0f), V::set(1.0f)), V::set(0.0f)), V::set(1.0f));
+}
+
+/* ---------------------------------------------------------------- */
+/* Framebuffer                                                      */
+/* ---------------------------------------------------------------- */
+
+// 32-bit pixels; the shifts come from the X visual (or are 16/8/0 headless).
+// The size is padded to whole tiles, only width x height is shown.
+struct Framebuffer {
+    uint32_t* pixels;
+    int       stride;
+    int       width;
+    int       height;
+    int       shift[3];
+};
+
+// pow(c, 0.4545) and the conversion to 8 bits in one table
+#define GAMMA_TABLE_SIZE    4096
+static uint8_t gammaTable[GAMMA_TABLE_SIZE];
+
+static void InitGammaTable()
+{
+    for (int i = 0; i < GAMMA_TABLE_SIZE; i++) {
+        gammaTable[i] = (uint8_t)lroundf(powf(i / (float)(GAMMA_TABLE_SIZE - 1), 0.4545f) * 255.0f);
+    }
+}
+
+static inline uint32_t ToByte(float c)
+{
+    int i = (int)(c * (GAMMA_TABLE_SIZE - 1) + 0.5f);
+    return gammaTable[i < 0 ? 0 : i >= GAMMA_TABLE_SIZE ? GAMMA_TABLE_SIZE - 1 : i];
+}
+
+struct ThreadStats {
+    alignas(64) uint64_t rays;
+    uint64_t shadowRays;
+    uint64_t tiles;
+    uint64_t steals;
+};
+
+/* ---------------------------------------------------------------- */
+/* Kernel                                                           */
+/* ---------------------------------------------------------------- */
+
+// PSMain for one packet at (px, py)
+template <class V>
+static void RenderPacket(const Scene& s, Framebuffer* fb, int px, int py, ThreadStats* stats)
+{
+    typedef typename V::F F;
+    typedef typename V::M M;
+
+    // uv as in the shader: 0..1 with y up, centered and aspect corrected
+    F fx = V::add(V::set(px + 0.5f), V::laneX());
+    F fy = V::add(V::set(py + 0.5f), V::laneY());
+    F uvY = V::sub(V::set(1.0f), V::div(fy, V::set((float)s.height)));
+    F u = V::mul(V::sub(V::div(fx, V::set((float)s.width)), V::set(0.5f)), V::set((float)s.width / s.height));
+    F v = V::sub(uvY, V::set(0.5f));
+
+    Vec3<V> ro = Splat<V>(0.0f, 1.5f, -4.0f);
+    Vec3<V> rd = Normalize<V>(Make<V>(u, v, V::set(1.0f)));
+    F d = RayMarch<V>(s, ro, rd);
+    M hit = V::lt(d, V::set(MAX_DIST));
+
+    // Background gradient
+    Vec3<V> col = Make<V>(
+        V::madd(uvY, V::set(0.02f - 0.1f), V::set(0.1f)),
+        V::madd(uvY, V::set(0.02f - 0.1f), V::set(0.1f)),
+        V::madd(uvY, V::set(0.05f - 0.15f), V::set(0.15f)));
+
+    if (V::any(hit)) {
+        Vec3<V> lightPos = Splat<V>(3.0f, 5.0f, -2.0f);
+        Vec3<V> p = Madd<V>(ro, rd, d);
+        Vec3<V> n = GetNormal<V>(s, p);
+        Vec3<V> toLight = Sub<V>(lightPos, p);
+        F lightDist = V::sqrt(Dot<V>(toLight, toLight));
+        Vec3<V> l = Normalize<V>(toLight);
+        Vec3<V> view = Normalize<V>(Sub<V>(ro, p));
+        F nl = Dot<V>(n, l);
+        Vec3<V> r = Madd<V>(Make<V>(V::sub(V::set(0.0f), l.x), V::sub(V::set(0.0f), l.y), V::sub(V::set(0.0f), l.z)),
+            n, V::mul(V::set(2.0f), nl));
+
+        // Checkerboard floor; HLSL fmod truncates, so cells with a negative
+        // sum come out darker than 0.2, as in the original
+        M floor = V::lt(p.y, V::set(-0.49f));
+        F cells = V::add(V::floor(p.x), V::floor(p.z));
+        F checker = V::sub(cells, V::mul(V::set(2.0f), V::tofloat(V::trunc(V::mul(cells, V::set(0.5f))))));
+        F floorCol = V::madd(checker, V::set(0.6f), V::set(0.2f));
+        Vec3<V> matCol = Make<V>(
+            V::select(floor, floorCol, V::set(0.4f)),
+            V::select(floor, floorCol, V::set(0.6f)),
+            V::select(floor, floorCol, V::set(0.9f)));
+
+        F diff = V::max(nl, V::set(0.0f));
+        F spec = V::max(Dot<V>(r, view), V::set(0.0f));
+        for (int i = 0; i < 5; i++) {
+            spec = V::mul(spec, spec);      // pow(x, 32)
+        }
+        F ao = GetAO<V>(s, p, n);
+        F shadow = GetShadow<V>(s, hit, Madd<V>(p, n, V::set(0.01f)), l, 0.01f, lightDist, 16.0f);
+
+        F lit = V::mul(diff, shadow);
+        F highlight = V::mul(V::mul(spec, shadow), V::set(0.5f));
+        Vec3<V> shaded = Make<V>(
+            V::madd(matCol.x, V::madd(V::set(0.1f), ao, lit), highlight),
+            V::madd(matCol.y, V::madd(V::set(0.12f), ao, lit), highlight),
+            V::madd(matCol.z, V::madd(V::set(0.15f), ao, lit), highlight));
+
+        // Fog
+        F fog = V::sub(V::set(1.0f), Exp<V>(V::mul(V::set(-0.02f), V::mul(d, d))));
+        shaded = Make<V>(
+            V::madd(V::sub(V::set(0.05f), shaded.x), fog, shaded.x),
+            V::madd(V::sub(V::set(0.05f), shaded.y), fog, shaded.y),
+            V::madd(V::sub(V::set(0.1f), shaded.z), fog, shaded.z));
+
+        col = Make<V>(V::select(hit, shaded.x, col.x), V::select(hit, shaded.y, col.y), V::select(hit, shaded.z, col.z));
+        stats->shadowRays += V::count(hit);
+    }
+    stats->rays += V::WIDTH;
+
+    float r[V::WIDTH], g[V::WIDTH], b[V::WIDTH];
+    V::store(r, col.x);
+    V::store(g, col.y);
+    V::store(b, col.z);
+    for (int i = 0; i < V::WIDTH; i++) {
+        uint32_t* dst = fb->pixels + (size_t)(py + i / V::PACKET_W) * fb->stride + px + i % V::PACKET_W;
+        *dst = (ToByte(r[i]) << fb->shift[0]) | (ToByte(g[i]) << fb->shift[1]) | (ToByte(b[i]) << fb->shift[2]);
+    }
+}
+
+template <class V>
+static void RenderTile(const Scene& s, Framebuffer* fb, int x0, int y0, int tileSize, ThreadStats* stats)
+{
+    for (int y = y0; y < y0 + tileSize; y += V::PACKET_H) {
+        for (int x = x0; x < x0 + tileSize; x += V::PACKET_W) {
+            RenderPacket<V>(s, fb, x, y, stats);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+/* Instruction set selection                                        */
+/* ---------------------------------------------------------------- */
+
+typedef void (*RenderTileFunc)(const Scene&, Framebuffer*, int, int, int, ThreadStats*);
+
+struct Backend {
+    const char*    name;
+    int            width;
+    RenderTileFunc renderTile;
+    bool           compiled;
+    bool           supported;
+};
+
+static std::vector<Backend> Backends()
+{
+    std::vector<Backend> backends;
+    backends.push_back({ "scalar", 1, RenderTile<ScalarOps>, true, true });
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+#define CPU_SUPPORTS(feature) __builtin_cpu_supports(feature)
+#else
+#define CPU_SUPPORTS(feature) false
+#endif
+
+#ifdef __SSE2__
+    backends.push_back({ "sse2", 4, RenderTile<SseOps>, true, (bool)CPU_SUPPORTS("sse2") });
+#else
+    backends.push_back({ "sse2", 4, NULL, false, false });
+#endif
+#if defined(__AVX2__) && defined(__FMA__)
+    backends.push_back({ "avx2", 8, RenderTile<Avx2Ops>, true, CPU_SUPPORTS("avx2") && CPU_SUPPORTS("fma") });
+#else
+    backends.push_back({ "avx2", 8, NULL, false, false });
+#endif
+#ifdef __AVX512F__
+    backends.push_back({ "avx512", 16, RenderTile<Avx512Ops>, true, (bool)CPU_SUPPORTS("avx512f") });
+#else
+    backends.push_back({ "avx512", 16, NULL, false, false });
+#endif
+
+    return backends;
+}
+
+/* ---------------------------------------------------------------- */
+/* Threads                                                          */
+/* ---------------------------------------------------------------- */
+
+// Runs the same job on every worker thread and waits for all of them
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threadCount) {
+        for (uint32_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        startCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void run(const std::function<void(uint32_t)>& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        currentJob = &job;
+        pending = static_cast<uint32_t>(workers.size());
+        generation++;
+        startCondition.notify_all();
+        doneCondition.wait(lock, [this] { return pending == 0; });
+        currentJob = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(uint32_t)>* currentJob = nullptr;
+    uint64_t generation = 0;
+    uint32_t pending = 0;
+    bool stop = false;
+
+    void workerLoop(uint32_t index) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(uint32_t)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [&] { return stop || generation != seen; });
+                if (stop) {
+                    return;
+                }
+                seen = generation;
+                job = currentJob;
+            }
+
+            (*job)(index);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    doneCondition.notify_one();
+                }
+            }
+        }
+    }
+};
+
+// Work-stealing tile queue: every thread owns a range of tile indices packed
+// as begin | end << 32 in one atomic word. The owner takes tiles from the
+// front and thieves take the back half, both with a compare-and-swap on the
+// same word, so no locks are needed and a tile is never handed out twice.
+// Tiles are only ever moved between ranges, never added, so a thread that
+// finds every range empty is done.
+struct TileQueue {
+    alignas(64) std::atomic<uint64_t> range;
+};
+
+static inline uint64_t PackRange(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+static bool PopTile(TileQueue* queue, uint32_t* tile)
+{
+    uint64_t value = queue->range.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t begin = (uint32_t)value;
+        uint32_t end = (uint32_t)(value >> 32);
+        if (begin >= end) {
+            return false;
+        }
+        if (queue->range.compare_exchange_weak(value, PackRange(begin + 1, end), std::memory_order_relaxed)) {
+            *tile = begin;
+            return true;
+        }
+    }
+}
+
+static bool StealTiles(TileQueue* victim, uint32_t* begin, uint32_t* end)
+{
+    uint64_t value = victim->range.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t first = (uint32_t)value;
+        uint32_t last = (uint32_t)(value >> 32);
+        if (first >= last) {
+            return false;
+        }
+        uint32_t middle = first + (last - first) / 2;
+        if (victim->range.compare_exchange_weak(value, PackRange(first, middle), std::memory_order_relaxed)) {
+            *begin = middle;
+            *end = last;
+            return true;
+        }
+    }
+}
+
+struct Renderer {
+    Backend     backend;
+    uint32_t    threadCount;
+    int         tileSize;
+    int         tilesX;
+    int         tilesY;
+    ThreadPool* pool;
+    std::unique_ptr<TileQueue[]>   queues;
+    std::unique_ptr<ThreadStats[]> stats;
+};
+
+static void InitRenderer(Renderer* renderer, const Backend& backend, uint32_t threadCount, int tileSize, int width, int height)
+{
+    renderer->backend = backend;
+    renderer->threadCount = threadCount;
+    renderer->tileSize = tileSize;
+    renderer->tilesX = (width + tileSize - 1) / tileSize;
+    renderer->tilesY = (height + tileSize - 1) / tileSize;
+    renderer->pool = threadCount > 1 ? new ThreadPool(threadCount) : NULL;
+    renderer->queues.reset(new TileQueue[threadCount]);
+    renderer->stats.reset(new ThreadStats[threadCount]());
+}
+
+static void DestroyRenderer(Renderer* renderer)
+{
+    delete renderer->pool;
+    renderer->pool = NULL;
+}
+
+static void RenderWorker(Renderer* renderer, const Scene& s, Framebuffer* fb, uint32_t index)
+{
+    TileQueue* own = &renderer->queues[index];
+    ThreadStats* stats = &renderer->stats[index];
+    int tileSize = renderer->tileSize;
+
+    for (;;) {
+        uint32_t tile;
+        while (PopTile(own, &tile)) {
+            renderer->backend.renderTile(s, fb, (tile % renderer->tilesX) * tileSize, (tile / renderer->tilesX) * tileSize, tileSize, stats);
+            stats->tiles++;
+        }
+
+        // Out of work: take half of the next non-empty range
+        bool stolen = false;
+        for (uint32_t i = 1; i < renderer->threadCount && !stolen; i++) {
+            uint32_t begin, end;
+            if (StealTiles(&renderer->queues[(index + i) % renderer->threadCount], &begin, &end)) {
+                own->range.store(PackRange(begin, end), std::memory_order_relaxed);
+                stats->steals++;
+                stolen = true;
+            }
+        }
+        if (!stolen) {
+            return;
+        }
+    }
+}
+
+// Each thread starts with a contiguous band of tiles, which keeps neighbouring
+// tiles on one core; stealing evens out bands that hit more geometry.
+static void RenderFrame(Renderer* renderer, const Scene& s, Framebuffer* fb)
+{
+    uint32_t tileCount = (uint32_t)(renderer->tilesX * renderer->tilesY);
+    for (uint32_t i = 0; i < renderer->threadCount; i++) {
+        uint32_t begin = (uint32_t)((uint64_t)tileCount * i / renderer->threadCount);
+        uint32_t end = (uint32_t)((uint64_t)tileCount * (i + 1) / renderer->threadCount);
+        renderer->queues[i].range.store(PackRange(begin, end), std::memory_order_relaxed);
+    }
+
+    if (!renderer->pool) {
+        RenderWorker(renderer, s, fb, 0);
+        return;
+    }
+    renderer->pool->run([&](uint32_t index) { RenderWorker(renderer, s, fb, index); });
+}
+
+struct RenderTotals {
+    uint64_t rays;
+    uint64_t shadowRays;
+    uint64_t steals;
+    uint64_t maxTiles;
+    uint64_t minTiles;
+};
+
+static RenderTotals TakeStats(Renderer* renderer)
+{
+    RenderTotals totals = { 0, 0, 0, 0, UINT64_MAX };
+    for (uint32_t i = 0; i < renderer->threadCount; i++) {
+        ThreadStats* stats = &renderer->stats[i];
+        totals.rays += stats->rays;
+        totals.shadowRays += stats->shadowRays;
+        totals.steals += stats->steals;
+        totals.maxTiles = std::max(totals.maxTiles, stats->tiles);
+        totals.minTiles = std::min(totals.minTiles, stats->tiles);
+        memset(stats, 0, sizeof(*stats));
+    }
+    return totals;
+}
+
+static double NowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void PrintStats(const Renderer* renderer, const RenderTotals& totals, int frames, double seconds)
+{
+    printf("%s, %u threads: %.1f fps, %.2f Mrays/s primary, %.2f Mrays/s with shadow rays, "
+        "%.1f steals/frame, tiles/frame per thread %.1f..%.1f\n",
+        renderer->backend.name, renderer->threadCount, frames / seconds,
+        totals.rays / seconds / 1e6, (totals.rays + totals.shadowRays) / seconds / 1e6,
+        (double)totals.steals / frames, (double)totals.minTiles / frames, (double)totals.maxTiles / frames);
+}
+
+/* ---------------------------------------------------------------- */
+/* X11 output                                                       */
+/* ---------------------------------------------------------------- */
+
+struct Window11 {
+    Display*        display;
+    Window          window;
+    GC              gc;
+    Atom            atomWmDeleteWindow;
+    bool            shm;
+    int             completionType;
+    XImage*         images[IMAGE_COUNT];
+    XShmSegmentInfo shmInfo[IMAGE_COUNT];
+    bool            pending[IMAGE_COUNT];
+    Framebuffer     framebuffers[IMAGE_COUNT];
+};
+
+static bool shmAttachFailed;
+
+static int ShmErrorHandler(Display*, XErrorEvent*)
+{
+    shmAttachFailed = true;
+    return 0;
+}
+
+static int MaskShift(unsigned long mask)
+{
+    return mask ? __builtin_ctzl(mask) : 0;
+}
+
+static void DestroyImages(Window11* w)
+{
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        if (!w->images[i]) {
+            continue;
+        }
+        if (w->shm) {
+            XShmDetach(w->display, &w->shmInfo[i]);
+            shmdt(w->shmInfo[i].shmaddr);
+            w->images[i]->data = NULL;
+        }
+        XDestroyImage(w->images[i]);
+        w->images[i] = NULL;
+    }
+}
+
+static XImage* CreateShmImage(Window11* w, Visual* visual, int depth, int width, int height, XShmSegmentInfo* info)
+{
+    XImage* image = XShmCreateImage(w->display, visual, depth, ZPixmap, NULL, info, width, height);
+    if (!image) {
+        return NULL;
+    }
+    info->shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * image->height, IPC_CREAT | 0600);
+    if (info->shmid < 0) {
+        XDestroyImage(image);
+        return NULL;
+    }
+    info->shmaddr = image->data = (char*)shmat(info->shmid, NULL, 0);
+    info->readOnly = False;
+
+    // Attaching fails with BadAccess when the server is on another machine
+    shmAttachFailed = false;
+    XErrorHandler previous = XSetErrorHandler(ShmErrorHandler);
+    XShmAttach(w->display, info);
+    XSync(w->display, False);
+    XSetErrorHandler(previous);
+
+    // Freed once both sides have detached
+    shmctl(info->shmid, IPC_RMID, NULL);
+    if (shmAttachFailed) {
+        shmdt(info->shmaddr);
+        image->data = NULL;
+        XDestroyImage(image);
+        return NULL;
+    }
+    return image;
+}
+
+// Images live in shared memory segments that the X server reads directly.
+// Remote displays cannot attach them; those get plain XPutImage.
+static bool CreateImages(Window11* w, int paddedWidth, int paddedHeight, int width, int height)
+{
+    int screen = DefaultScreen(w->display);
+    Visual* visual = DefaultVisual(w->display, screen);
+    int depth = DefaultDepth(w->display, screen);
+    if (visual->c_class != TrueColor || depth < 24) {
+        printf("A 24-bit TrueColor visual is required\n");
+        return false;
+    }
+
+    w->shm = XShmQueryExtension(w->display);
+    for (int i = 0; i < IMAGE_COUNT && w->shm; i++) {
+        w->images[i] = CreateShmImage(w, visual, depth, paddedWidth, paddedHeight, &w->shmInfo[i]);
+        if (!w->images[i]) {
+            DestroyImages(w);
+            w->shm = false;
+            printf("MIT-SHM not usable, using XPutImage\n");
+        }
+    }
+    w->completionType = w->shm ? XShmGetEventBase(w->display) + ShmCompletion : -1;
+
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        if (!w->shm) {
+            char* data = (char*)malloc((size_t)paddedWidth * paddedHeight * 4);
+            w->images[i] = XCreateImage(w->display, visual, depth, ZPixmap, 0, data, paddedWidth, paddedHeight, 32, 0);
+        }
+        w->pending[i] = false;
+
+        Framebuffer* fb = &w->framebuffers[i];
+        fb->pixels = (uint32_t*)w->images[i]->data;
+        fb->stride = w->images[i]->bytes_per_line / 4;
+        fb->width = width;
+        fb->height = height;
+        fb->shift[0] = MaskShift(visual->red_mask);
+        fb->shift[1] = MaskShift(visual->green_mask);
+        fb->shift[2] = MaskShift(visual->blue_mask);
+    }
+    return true;
+}
+
+static bool OpenWindow(Window11* w, int width, int height, int paddedWidth, int paddedHeight, int argc, char* argv[])
+{
+    memset(w, 0, sizeof(*w));
+
+    /* setup display/screen */
+    w->display = XOpenDisplay("");
+    if (!w->display) {
+        return false;
+    }
+    int screen = DefaultScreen(w->display);
+
+    XSizeHints hint;
+    hint.x = 0;
+    hint.y = 0;
+    hint.width = hint.min_width = hint.max_width = width;
+    hint.height = hint.min_height = hint.max_height = height;
+    hint.flags = PPosition | PSize | PMinSize | PMaxSize;
+
+    /* create window */
+    w->window = XCreateSimpleWindow(w->display, DefaultRootWindow(w->display),
+        hint.x, hint.y, hint.width, hint.height, 5,
+        BlackPixel(w->display, screen), BlackPixel(w->display, screen));
+
+    char title[] = "Hello, World!";
+    XSetStandardProperties(w->display, w->window, title, title, None, argv, argc, &hint);
+
+    w->atomWmDeleteWindow = XInternAtom(w->display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(w->display, w->window, &w->atomWmDeleteWindow, 1);
+
+    w->gc = XCreateGC(w->display, w->window, 0, 0);
+    XSelectInput(w->display, w->window, KeyPressMask | ExposureMask | StructureNotifyMask);
+
+    if (!CreateImages(w, paddedWidth, paddedHeight, width, height)) {
+        return false;
+    }
+
+    XMapRaised(w->display, w->window);
+    return true;
+}
+
+static void CloseWindow(Window11* w)
+{
+    XSync(w->display, False);
+    DestroyImages(w);
+    XFreeGC(w->display, w->gc);
+    XDestroyWindow(w->display, w->window);
+    XCloseDisplay(w->display);
+}
+
+// Returns false once the window is closed or Escape is pressed
+static bool HandleEvent(Window11* w, XEvent* ev)
+{
+    if (ev->type == w->completionType) {
+        XShmCompletionEvent* completion = (XShmCompletionEvent*)ev;
+        for (int i = 0; i < IMAGE_COUNT; i++) {
+            if (completion->shmseg == w->shmInfo[i].shmseg) {
+                w->pending[i] = false;
+            }
+        }
+    } else if (ev->type == ClientMessage) {
+        if ((Atom)ev->xclient.data.l[0] == w->atomWmDeleteWindow) {
+            return false;
+        }
+    } else if (ev->type == KeyPress) {
+        if (XLookupKeysym(&ev->xkey, 0) == XK_Escape) {
+            return false;
+        }
+    } else if (ev->type == DestroyNotify) {
+        return false;
+    }
+    return true;
+}
+
+// The server reads an XShm image after XShmPutImage returns, so an image is
+// only rendered into again after its completion event
+static bool WaitForImage(Window11* w, int index)
+{
+    while (w->pending[index]) {
+        XEvent ev;
+        XNextEvent(w->display, &ev);
+        if (!HandleEvent(w, &ev)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Present(Window11* w, int index)
+{
+    Framebuffer* fb = &w->framebuffers[index];
+    if (w->shm) {
+        XShmPutImage(w->display, w->window, w->gc, w->images[index], 0, 0, 0, 0, fb->width, fb->height, True);
+        w->pending[index] = true;
+    } else {
+        XPutImage(w->display, w->window, w->gc, w->images[index], 0, 0, 0, 0, fb->width, fb->height);
+    }
+    XFlush(w->display);
+}
+
+/* ---------------------------------------------------------------- */
+/* Main                                                             */
+/* ---------------------------------------------------------------- */
+
+static bool SavePPM(const char* path, const Framebuffer* fb)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", fb->width, fb->height);
+    for (int y = 0; y < fb->height; y++) {
+        for (int x = 0; x < fb->width; x++) {
+            uint32_t pixel = fb->pixels[(size_t)y * fb->stride + x];
+            unsigned char rgb[3] = {
+                (unsigned char)(pixel >> fb->shift[0]),
+                (unsigned char)(pixel >> fb->shift[1]),
+                (unsigned char)(pixel >> fb->shift[2])
+            };
+            fwrite(rgb, 1, 3, fp);
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+// Renders frameCount frames into memory at a fixed 1/60 s time step
+static void RenderHeadless(Renderer* renderer, Framebuffer* fb, int frameCount)
+{
+    Scene scene;
+    TakeStats(renderer);
+    double start = NowSeconds();
+    for (int i = 0; i < frameCount; i++) {
+        SetupScene(&scene, i / 60.0f, fb->width, fb->height);
+        RenderFrame(renderer, scene, fb);
+    }
+    PrintStats(renderer, TakeStats(renderer), frameCount, NowSeconds() - start);
+}
+
+static void PrintUsage()
+{
+    printf("usage: hello [--size W H] [--threads N] [--tile N] [--isa scalar|sse2|avx2|avx512|all]\n"
+           "             [--frames N] [--output FILE]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    int tileSize = DEFAULT_TILE;
+    int frameCount = 0;
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    const char* isa = NULL;
+    const char* outputFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            tileSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            isa = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Tiles hold whole packets of up to 4x4 rays
+    if (width < 1 || height < 1 || tileSize < 4 || tileSize % 4 != 0) {
+        printf("The size must be positive and the tile size a multiple of 4\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Backend> backends = Backends();
+    std::vector<Backend> selected;
+    for (const Backend& backend : backends) {
+        bool usable = backend.compiled && backend.supported;
+        if (isa && strcmp(isa, "all") != 0 && strcmp(isa, backend.name) == 0) {
+            if (!usable) {
+                printf("%s is %s\n", backend.name, backend.compiled ? "not supported by this CPU" : "not compiled in (see build.sh)");
+                return EXIT_FAILURE;
+            }
+            selected.push_back(backend);
+        } else if (isa && strcmp(isa, "all") == 0 && usable) {
+            selected.push_back(backend);
+        } else if (!isa && usable) {
+            selected.assign(1, backend);
+        }
+    }
+    if (selected.empty()) {
+        printf("unknown instruction set: %s\n", isa);
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    InitGammaTable();
+
+    int paddedWidth = (width + tileSize - 1) / tileSize * tileSize;
+    int paddedHeight = (height + tileSize - 1) / tileSize * tileSize;
+    printf("%dx%d, %dx%d tiles, %u threads\n", width, height, tileSize, tileSize, threadCount);
+
+    // Benchmark every instruction set, or render without a display
+    Window11 w;
+    bool headless = selected.size() > 1 || outputFile || !OpenWindow(&w, width, height, paddedWidth, paddedHeight, argc, argv);
+    if (headless) {
+        std::vector<uint32_t> pixels((size_t)paddedWidth * paddedHeight);
+        Framebuffer fb = { pixels.data(), paddedWidth, width, height, { 16, 8, 0 } };
+        for (const Backend& backend : selected) {
+            Renderer renderer;
+            InitRenderer(&renderer, backend, threadCount, tileSize, width, height);
+            RenderHeadless(&renderer, &fb, frameCount ? frameCount : HEADLESS_FRAMES);
+            DestroyRenderer(&renderer);
+        }
+        const char* path = outputFile ? outputFile : OUTPUT_FILE;
+        if (SavePPM(path, &fb)) {
+            printf("Wrote %s\n", path);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    printf("Presenting with %s\n", w.shm ? "MIT-SHM" : "XPutImage");
+
+    Renderer renderer;
+    InitRenderer(&renderer, selected[0], threadCount, tileSize, width, height);
+
+    double start = NowSeconds();
+    double reportStart = start;
+    int reportFrames = 0;
+    bool running = true;
+    for (int frame = 0; running && (frameCount == 0 || frame < frameCount); frame++) {
+        while (running && XPending(w.display)) {
+            XEvent ev;
+            XNextEvent(w.display, &ev);
+            running = HandleEvent(&w, &ev);
+        }
+
+        int index = frame % IMAGE_COUNT;
+        if (!running || !WaitForImage(&w, index)) {
+            break;
+        }
+
+        Scene scene;
+        SetupScene(&scene, (float)(NowSeconds() - start), width, height);
+        RenderFrame(&renderer, scene, &w.framebuffers[index]);
+        Present(&w, index);
+        reportFrames++;
+
+        double now = NowSeconds();
+        if (now - reportStart >= STATS_INTERVAL) {
+            PrintStats(&renderer, TakeStats(&renderer), reportFrames, now - reportStart);
+            reportStart = now;
+            reportFrames = 0;
+        }
+    }
+    if (reportFrames > 0) {
+        PrintStats(&renderer, TakeStats(&renderer), reportFrames, NowSeconds() - reportStart);
+    }
+
+    DestroyRenderer(&renderer);
+    CloseWindow(&w);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1762 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// CPU version of the DXR sample (native_win/cpp/directx12/raytracing) for
+// hosts without ray tracing hardware. The scene is two level like the
+// original: bottom level BVHs over triangles, a top level BVH over instances
+// of them. Both are binned SAH BVHs; the bottom levels are built by a thread
+// pool, the deforming one is refit every frame and the top level rebuilt.
+// Rays are traced in packets of 4, 8 or 16, one ray per SIMD lane, and frames
+// go to an X11 window through MIT-SHM, or to a PPM file without a display.
+
+#define WINDOW_WIDTH        800
+#define WINDOW_HEIGHT       600
+#define DEFAULT_TILE        32
+#define DEFAULT_DETAIL      512         // segments per edge of the subdivided triangle
+#define DEFAULT_GRID        6           // instances per side behind the original triangle
+#define HEADLESS_FRAMES     60
+#define OUTPUT_FILE         "hello.ppm"
+#define STATS_INTERVAL      5.0         // seconds between reports in the window
+#define IMAGE_COUNT         2           // XShm images, one on screen while the next renders
+
+// The ray of RayGen
+static const float T_MIN = 0.001f;
+static const float T_MAX = 10000.0f;
+
+// BVH construction
+static const int      BIN_COUNT = 16;           // SAH bins per axis
+static const uint32_t MAX_LEAF_SIZE = 8;
+static const uint32_t SPAWN_THRESHOLD = 4096;   // smaller subtrees stay on the thread that split them
+static const int      STACK_SIZE = 128;
+
+/* ---------------------------------------------------------------- */
+/* SIMD back ends                                                   */
+/*                                                                  */
+/* A packet is a PACKET_W x PACKET_H block of pixels, one per lane. */
+/* F is a vector of floats and M a lane mask.                       */
+/* ---------------------------------------------------------------- */
+
+struct ScalarOps {
+    typedef float   F;
+    typedef bool    M;
+    enum { WIDTH = 1, PACKET_W = 1, PACKET_H = 1 };
+
+    static F set(float v)                 { return v; }
+    static F laneX()                      { return 0.0f; }
+    static F laneY()                      { return 0.0f; }
+    static void store(float* p, F v)      { *p = v; }
+    static F add(F a, F b)                { return a + b; }
+    static F sub(F a, F b)                { return a - b; }
+    static F mul(F a, F b)                { return a * b; }
+    static F div(F a, F b)                { return a / b; }
+    static F madd(F a, F b, F c)          { return a * b + c; }
+    static F min(F a, F b)                { return a < b ? a : b; }
+    static F max(F a, F b)                { return a > b ? a : b; }
+    static F abs(F a)                     { return fabsf(a); }
+    static F sqrt(F a)                    { return sqrtf(a); }
+    static M lt(F a, F b)                 { return a < b; }
+    static M mand(M a, M b)               { return a && b; }
+    static M mor(M a, M b)                { return a || b; }
+    static M mandnot(M a, M b)            { return a && !b; }
+    static M mtrue()                      { return true; }
+    static M mfalse()                     { return false; }
+    static bool any(M m)                  { return m; }
+    static F select(M m, F a, F b)        { return m ? a : b; }
+};
+
+#ifdef __SSE2__
+struct SseOps {
+    typedef __m128  F;
+    typedef __m128  M;
+    enum { WIDTH = 4, PACKET_W = 2, PACKET_H = 2 };
+
+    static F set(float v)                 { return _mm_set1_ps(v); }
+    static F laneX()                      { return _mm_setr_ps(0, 1, 0, 1); }
+    static F laneY()                      { return _mm_setr_ps(0, 0, 1, 1); }
+    static void store(float* p, F v)      { _mm_storeu_ps(p, v); }
+    static F add(F a, F b)                { return _mm_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F min(F a, F b)                { return _mm_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm_max_ps(a, b); }
+    static F abs(F a)                     { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static F sqrt(F a)                    { return _mm_sqrt_ps(a); }
+    static M lt(F a, F b)                 { return _mm_cmplt_ps(a, b); }
+    static M mand(M a, M b)               { return _mm_and_ps(a, b); }
+    static M mor(M a, M b)                { return _mm_or_ps(a, b); }
+    static M mandnot(M a, M b)            { return _mm_andnot_ps(b, a); }
+    static M mtrue()                      { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static M mfalse()                     { return _mm_setzero_ps(); }
+    static bool any(M m)                  { return _mm_movemask_ps(m) != 0; }
+    static F select(M m, F a, F b)        { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+};
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+struct Avx2Ops {
+    typedef __m256  F;
+    typedef __m256  M;
+    enum { WIDTH = 8, PACKET_W = 4, PACKET_H = 2 };
+
+    static F set(float v)                 { return _mm256_set1_ps(v); }
+    static F laneX()                      { return _mm256_setr_ps(0, 1, 2, 3, 0, 1, 2, 3); }
+    static F laneY()                      { return _mm256_setr_ps(0, 0, 0, 0, 1, 1, 1, 1); }
+    static void store(float* p, F v)      { _mm256_storeu_ps(p, v); }
+    static F add(F a, F b)                { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm256_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm256_fmadd_ps(a, b, c); }
+    static F min(F a, F b)                { return _mm256_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm256_max_ps(a, b); }
+    static F abs(F a)                     { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F sqrt(F a)                    { return _mm256_sqrt_ps(a); }
+    static M lt(F a, F b)                 { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M mand(M a, M b)               { return _mm256_and_ps(a, b); }
+    static M mor(M a, M b)                { return _mm256_or_ps(a, b); }
+    static M mandnot(M a, M b)            { return _mm256_andnot_ps(b, a); }
+    static M mtrue()                      { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static M mfalse()                     { return _mm256_setzero_ps(); }
+    static bool any(M m)                  { return _mm256_movemask_ps(m) != 0; }
+    static F select(M m, F a, F b)        { return _mm256_blendv_ps(b, a, m); }
+};
+#endif
+
+#ifdef __AVX512F__
+struct Avx512Ops {
+    typedef __m512    F;
+    typedef __mmask16 M;
+    enum { WIDTH = 16, PACKET_W = 4, PACKET_H = 4 };
+
+    static F set(float v)                 { return _mm512_set1_ps(v); }
+    static F laneX()                      { return _mm512_setr_ps(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3); }
+    static F laneY()                      { return _mm512_setr_ps(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3); }
+    static void store(float* p, F v)      { _mm512_storeu_ps(p, v); }
+    static F add(F a, F b)                { return _mm512_add_ps(a, b); }
+    static F sub(F a, F b)                { return _mm512_sub_ps(a, b); }
+    static F mul(F a, F b)                { return _mm512_mul_ps(a, b); }
+    static F div(F a, F b)                { return _mm512_div_ps(a, b); }
+    static F madd(F a, F b, F c)          { return _mm512_fmadd_ps(a, b, c); }
+    static F min(F a, F b)                { return _mm512_min_ps(a, b); }
+    static F max(F a, F b)                { return _mm512_max_ps(a, b); }
+    static F abs(F a)                     { return _mm512_abs_ps(a); }
+    static F sqrt(F a)                    { return _mm512_sqrt_ps(a); }
+    static M lt(F a, F b)                 { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M mand(M a, M b)               { return a & b; }
+    static M mor(M a, M b)                { return a | b; }
+    static M mandnot(M a, M b)            { return a & ~b; }
+    static M mtrue()                      { return 0xFFFF; }
+    static M mfalse()                     { return 0; }
+    static bool any(M m)                  { return m != 0; }
+    static F select(M m, F a, F b)        { return _mm512_mask_blend_ps(m, b, a); }
+};
+#endif
+
+/* ---------------------------------------------------------------- */
+/* Threads                                                          */
+/* ---------------------------------------------------------------- */
+
+// Runs the same job on every worker thread and waits for all of them
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threadCount) {
+        for (uint32_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        startCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    uint32_t size() const {
+        return static_cast<uint32_t>(workers.size());
+    }
+
+    void run(const std::function<void(uint32_t)>& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        currentJob = &job;
+        pending = static_cast<uint32_t>(workers.size());
+        generation++;
+        startCondition.notify_all();
+        doneCondition.wait(lock, [this] { return pending == 0; });
+        currentJob = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    const std::function<void(uint32_t)>* currentJob = nullptr;
+    uint64_t generation = 0;
+    uint32_t pending = 0;
+    bool stop = false;
+
+    void workerLoop(uint32_t index) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(uint32_t)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [&] { return stop || generation != seen; });
+                if (stop) {
+                    return;
+                }
+                seen = generation;
+                job = currentJob;
+            }
+
+            (*job)(index);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    doneCondition.notify_one();
+                }
+            }
+        }
+    }
+};
+
+// body(begin, end) on equal slices of [0, count), one per thread
+static void ParallelFor(ThreadPool* pool, uint32_t count, const std::function<void(uint32_t, uint32_t)>& body)
+{
+    if (!pool) {
+        body(0, count);
+        return;
+    }
+    uint32_t threadCount = pool->size();
+    pool->run([&](uint32_t index) {
+        body((uint32_t)((uint64_t)count * index / threadCount), (uint32_t)((uint64_t)count * (index + 1) / threadCount));
+    });
+}
+
+static double NowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ---------------------------------------------------------------- */
+/* BVH                                                              */
+/* ---------------------------------------------------------------- */
+
+struct Aabb {
+    float min[3];
+    float max[3];
+};
+
+static inline void ResetAabb(Aabb* box)
+{
+    for (int a = 0; a < 3; a++) {
+        box->min[a] = INFINITY;
+        box->max[a] = -INFINITY;
+    }
+}
+
+static inline void GrowAabb(Aabb* box, const float* p)
+{
+    for (int a = 0; a < 3; a++) {
+        box->min[a] = std::min(box->min[a], p[a]);
+        box->max[a] = std::max(box->max[a], p[a]);
+    }
+}
+
+static inline void GrowAabb(Aabb* box, const Aabb& other)
+{
+    for (int a = 0; a < 3; a++) {
+        box->min[a] = std::min(box->min[a], other.min[a]);
+        box->max[a] = std::max(box->max[a], other.max[a]);
+    }
+}
+
+static inline float HalfArea(const Aabb& box)
+{
+    float dx = box.max[0] - box.min[0];
+    float dy = box.max[1] - box.min[1];
+    float dz = box.max[2] - box.min[2];
+    return dx < 0.0f ? 0.0f : dx * dy + dy * dz + dz * dx;
+}
+
+// 32 bytes, two per cache line. Interior nodes keep their children next to
+// each other at leftFirst and leftFirst + 1, leaves their primitives at
+// indices[leftFirst .. leftFirst + count). Children always come after their
+// parent, so walking the array backwards refits bottom up.
+struct BvhNode {
+    float    min[3];
+    uint32_t leftFirst;
+    float    max[3];
+    uint16_t count;         // 0 for interior nodes
+    uint16_t axis;          // split axis, orders the children front to back
+};
+
+struct Bvh {
+    std::vector<BvhNode>  nodes;
+    std::vector<uint32_t> indices;
+    uint32_t              nodeCount;
+};
+
+struct BuildTask {
+    uint32_t node;
+    uint32_t first;
+    uint32_t count;
+};
+
+// Shared by the threads of one build. Subtrees with at least SPAWN_THRESHOLD
+// primitives are pushed as tasks that any thread may take; a thread that
+// finds no task while others are still splitting waits for more.
+struct BuildContext {
+    const Aabb*             boxes;
+    std::vector<float>      centroids;
+    Bvh*                    bvh;
+    std::atomic<uint32_t>   nodeCount;
+    std::mutex              mutex;
+    std::vector<BuildTask>  tasks;
+    std::atomic<int>        pending;
+    bool                    parallel;
+};
+
+static void SetLeaf(BvhNode* node, uint32_t first, uint32_t count)
+{
+    node->leftFirst = first;
+    node->count = (uint16_t)count;
+    node->axis = 0;
+}
+
+static void Subdivide(BuildContext* ctx, uint32_t nodeIndex, uint32_t first, uint32_t count)
+{
+    Bvh* bvh = ctx->bvh;
+    uint32_t* indices = bvh->indices.data();
+    const float* centroids = ctx->centroids.data();
+
+    for (;;) {
+        BvhNode* node = &bvh->nodes[nodeIndex];
+        Aabb bounds, centroidBounds;
+        ResetAabb(&bounds);
+        ResetAabb(&centroidBounds);
+        for (uint32_t i = first; i < first + count; i++) {
+            GrowAabb(&bounds, ctx->boxes[indices[i]]);
+            GrowAabb(&centroidBounds, centroids + indices[i] * 3);
+        }
+        memcpy(node->min, bounds.min, sizeof(bounds.min));
+        memcpy(node->max, bounds.max, sizeof(bounds.max));
+
+        if (count <= 2) {
+            SetLeaf(node, first, count);
+            return;
+        }
+
+        // Bin the centroids on every axis and sweep the BIN_COUNT - 1 planes
+        // between the bins; cost = 1 traversal + area weighted primitive count
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = INFINITY;
+        float scale[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0.0f) {
+                scale[axis] = 0.0f;
+                continue;
+            }
+            scale[axis] = BIN_COUNT / extent;
+
+            Aabb binBounds[BIN_COUNT];
+            uint32_t binCount[BIN_COUNT] = {};
+            for (int b = 0; b < BIN_COUNT; b++) {
+                ResetAabb(&binBounds[b]);
+            }
+            for (uint32_t i = first; i < first + count; i++) {
+                uint32_t prim = indices[i];
+                int b = std::min(BIN_COUNT - 1, (int)((centroids[prim * 3 + axis] - centroidBounds.min[axis]) * scale[axis]));
+                binCount[b]++;
+                GrowAabb(&binBounds[b], ctx->boxes[prim]);
+            }
+
+            float leftArea[BIN_COUNT - 1];
+            uint32_t leftCount[BIN_COUNT - 1];
+            Aabb box;
+            ResetAabb(&box);
+            uint32_t sum = 0;
+            for (int b = 0; b < BIN_COUNT - 1; b++) {
+                sum += binCount[b];
+                GrowAabb(&box, binBounds[b]);
+                leftArea[b] = HalfArea(box);
+                leftCount[b] = sum;
+            }
+            ResetAabb(&box);
+            sum = 0;
+            for (int b = BIN_COUNT - 1; b > 0; b--) {
+                sum += binCount[b];
+                GrowAabb(&box, binBounds[b]);
+                float cost = leftArea[b - 1] * leftCount[b - 1] + HalfArea(box) * sum;
+                if (leftCount[b - 1] > 0 && sum > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        uint32_t leftCount;
+        float parentArea = HalfArea(bounds);
+        bool worthSplitting = bestAxis >= 0 && (parentArea <= 0.0f || 1.0f + bestCost / parentArea < (float)count);
+        if (worthSplitting) {
+            uint32_t* middle = std::partition(indices + first, indices + first + count, [&](uint32_t prim) {
+                int b = std::min(BIN_COUNT - 1, (int)((centroids[prim * 3 + bestAxis] - centroidBounds.min[bestAxis]) * scale[bestAxis]));
+                return b < bestSplit;
+            });
+            leftCount = (uint32_t)(middle - (indices + first));
+        } else if (count <= MAX_LEAF_SIZE) {
+            SetLeaf(node, first, count);
+            return;
+        } else {
+            // Too big for a leaf but no plane separates the centroids (all
+            // of them coincide): halve the range
+            bestAxis = 0;
+            leftCount = count / 2;
+        }
+
+        uint32_t child = ctx->nodeCount.fetch_add(2, std::memory_order_relaxed);
+        node->leftFirst = child;
+        node->count = 0;
+        node->axis = (uint16_t)bestAxis;
+
+        // Hand the right half to another thread if it is big enough, keep
+        // splitting the left half here
+        uint32_t rightCount = count - leftCount;
+        if (ctx->parallel && rightCount >= SPAWN_THRESHOLD) {
+            ctx->pending.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(ctx->mutex);
+            ctx->tasks.push_back({ child + 1, first + leftCount, rightCount });
+        } else {
+            Subdivide(ctx, child + 1, first + leftCount, rightCount);
+        }
+        nodeIndex = child;
+        count = leftCount;
+    }
+}
+
+static void BuildWorker(BuildContext* ctx)
+{
+    for (;;) {
+        BuildTask task;
+        {
+            std::unique_lock<std::mutex> lock(ctx->mutex);
+            if (ctx->tasks.empty()) {
+                lock.unlock();
+                if (ctx->pending.load(std::memory_order_acquire) == 0) {
+                    return;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            task = ctx->tasks.back();
+            ctx->tasks.pop_back();
+        }
+        Subdivide(ctx, task.node, task.first, task.count);
+        ctx->pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// Binned SAH build over primitive bounding boxes. indices maps BVH order to
+// the caller's primitives.
+static void BuildBvh(Bvh* bvh, const Aabb* boxes, uint32_t count, ThreadPool* pool)
+{
+    BuildContext ctx;
+    ctx.boxes = boxes;
+    ctx.bvh = bvh;
+    ctx.nodeCount.store(1);
+    ctx.pending.store(1);
+    ctx.parallel = pool != NULL && count >= 2 * SPAWN_THRESHOLD;
+
+    ctx.centroids.resize((size_t)count * 3);
+    bvh->indices.resize(count);
+    bvh->nodes.resize(std::max(1u, 2 * count - 1));
+    ParallelFor(ctx.parallel ? pool : NULL, count, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            for (int a = 0; a < 3; a++) {
+                ctx.centroids[i * 3 + a] = (boxes[i].min[a] + boxes[i].max[a]) * 0.5f;
+            }
+            bvh->indices[i] = i;
+        }
+    });
+
+    ctx.tasks.push_back({ 0, 0, count });
+    if (ctx.parallel) {
+        pool->run([&](uint32_t) { BuildWorker(&ctx); });
+    } else {
+        BuildWorker(&ctx);
+    }
+    bvh->nodeCount = ctx.nodeCount.load();
+}
+
+// Expected cost of a random ray relative to one primitive test, as the
+// builder estimates it; refitting makes it grow
+static float SahCost(const Bvh& bvh)
+{
+    const BvhNode& root = bvh.nodes[0];
+    Aabb rootBox = { { root.min[0], root.min[1], root.min[2] }, { root.max[0], root.max[1], root.max[2] } };
+    float rootArea = HalfArea(rootBox);
+    double cost = 0.0;
+    for (uint32_t i = 0; i < bvh.nodeCount; i++) {
+        const BvhNode& node = bvh.nodes[i];
+        Aabb box = { { node.min[0], node.min[1], node.min[2] }, { node.max[0], node.max[1], node.max[2] } };
+        cost += HalfArea(box) / rootArea * (node.count ? node.count : 1);
+    }
+    return (float)cost;
+}
+
+/* ---------------------------------------------------------------- */
+/* Scene                                                            */
+/* ---------------------------------------------------------------- */
+
+// One triangle as the intersection test wants it, stored in BVH leaf order
+struct Triangle {
+    float    v0[3];
+    float    e1[3];
+    float    e2[3];
+    uint32_t id;            // index into Blas::indices / 3
+};
+
+// Bottom level: the triangle of the DXR sample cut into detail^2 small
+// triangles. Every vertex carries the barycentric color of its position in
+// the big triangle, so ClosestHit interpolating vertex colors draws the same
+// red/green/blue gradient as the original's single triangle.
+struct Blas {
+    const char*           name;
+    bool                  deforming;
+    std::vector<float>    base;         // undisplaced positions, 3 per vertex
+    std::vector<float>    positions;    // 3 per vertex
+    std::vector<float>    colors;       // 3 per vertex
+    std::vector<uint32_t> indices;      // 3 per triangle
+    std::vector<Triangle> triangles;
+    Bvh                   bvh;
+};
+
+// 3x4 row-major affine transforms, as in D3D12_RAYTRACING_INSTANCE_DESC
+struct Instance {
+    float    objectToWorld[12];
+    float    worldToObject[12];
+    uint32_t blas;
+};
+
+struct Scene {
+    std::vector<Blas>     blases;
+    std::vector<Instance> instances;
+    std::vector<Aabb>     instanceBoxes;
+    Bvh                   tlas;
+    int                   grid;
+    float                 eye[3];
+    float                 tanHalfFov;
+    int                   width;
+    int                   height;
+};
+
+// The vertices of CreateVertexBuffer
+static const float DXR_TRIANGLE[3][3] = {
+    {  0.0f,  0.7f, 0.0f },
+    { -0.7f, -0.7f, 0.0f },
+    {  0.7f, -0.7f, 0.0f },
+};
+
+static void CreateBlas(Blas* blas, const char* name, int detail, bool deforming)
+{
+    blas->name = name;
+    blas->deforming = deforming;
+
+    // Row j of the barycentric grid holds detail - j + 1 vertices
+    std::vector<uint32_t> rowStart(detail + 2);
+    for (int j = 0, start = 0; j <= detail + 1; j++) {
+        rowStart[j] = start;
+        start += detail - j + 1;
+    }
+    for (int j = 0; j <= detail; j++) {
+        for (int i = 0; i <= detail - j; i++) {
+            float b = (float)i / detail;
+            float c = (float)j / detail;
+            float a = 1.0f - b - c;
+            for (int k = 0; k < 3; k++) {
+                blas->base.push_back(a * DXR_TRIANGLE[0][k] + b * DXR_TRIANGLE[1][k] + c * DXR_TRIANGLE[2][k]);
+            }
+            blas->colors.push_back(a);
+            blas->colors.push_back(b);
+            blas->colors.push_back(c);
+        }
+    }
+    for (int j = 0; j < detail; j++) {
+        for (int i = 0; i < detail - j; i++) {
+            uint32_t v = rowStart[j] + i;
+            uint32_t up = rowStart[j + 1] + i;
+            blas->indices.insert(blas->indices.end(), { v, v + 1, up });
+            if (i + 1 < detail - j) {
+                blas->indices.insert(blas->indices.end(), { v + 1, up + 1, up });
+            }
+        }
+    }
+    blas->positions = blas->base;
+    blas->triangles.resize(blas->indices.size() / 3);
+}
+
+// A ripple running out from the middle of the triangle along z
+static void DeformBlas(Blas* blas, float time, ThreadPool* pool)
+{
+    uint32_t vertexCount = (uint32_t)(blas->base.size() / 3);
+    ParallelFor(pool, vertexCount, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const float* p = &blas->base[i * 3];
+            float dx = p[0];
+            float dy = p[1] + 0.233f;
+            float r = sqrtf(dx * dx + dy * dy);
+            blas->positions[i * 3 + 2] = 0.06f * sinf(r * 18.0f - time * 4.0f) * (1.0f - r);
+        }
+    });
+}
+
+// Copies the positions into the leaf ordered triangles
+static void GatherTriangles(Blas* blas, ThreadPool* pool)
+{
+    const float* positions = blas->positions.data();
+    const uint32_t* indices = blas->indices.data();
+    ParallelFor(pool, (uint32_t)blas->triangles.size(), [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            Triangle* tri = &blas->triangles[i];
+            uint32_t id = blas->bvh.indices[i];
+            const float* p0 = positions + indices[id * 3] * 3;
+            const float* p1 = positions + indices[id * 3 + 1] * 3;
+            const float* p2 = positions + indices[id * 3 + 2] * 3;
+            for (int a = 0; a < 3; a++) {
+                tri->v0[a] = p0[a];
+                tri->e1[a] = p1[a] - p0[a];
+                tri->e2[a] = p2[a] - p0[a];
+            }
+            tri->id = id;
+        }
+    });
+}
+
+static void BuildBlas(Blas* blas, ThreadPool* pool)
+{
+    uint32_t triangleCount = (uint32_t)blas->triangles.size();
+    std::vector<Aabb> boxes(triangleCount);
+    ParallelFor(pool, triangleCount, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            ResetAabb(&boxes[i]);
+            for (int k = 0; k < 3; k++) {
+                GrowAabb(&boxes[i], &blas->positions[blas->indices[i * 3 + k] * 3]);
+            }
+        }
+    });
+    BuildBvh(&blas->bvh, boxes.data(), triangleCount, pool);
+    GatherTriangles(blas, pool);
+}
+
+// Keeps the topology, recomputes every box from the moved triangles
+static void RefitBlas(Blas* blas, ThreadPool* pool)
+{
+    GatherTriangles(blas, pool);
+    for (uint32_t i = blas->bvh.nodeCount; i-- > 0;) {
+        BvhNode* node = &blas->bvh.nodes[i];
+        Aabb box;
+        ResetAabb(&box);
+        if (node->count) {
+            for (uint32_t t = node->leftFirst; t < node->leftFirst + node->count; t++) {
+                const Triangle& tri = blas->triangles[t];
+                float p1[3] = { tri.v0[0] + tri.e1[0], tri.v0[1] + tri.e1[1], tri.v0[2] + tri.e1[2] };
+                float p2[3] = { tri.v0[0] + tri.e2[0], tri.v0[1] + tri.e2[1], tri.v0[2] + tri.e2[2] };
+                GrowAabb(&box, tri.v0);
+                GrowAabb(&box, p1);
+                GrowAabb(&box, p2);
+            }
+        } else {
+            for (int c = 0; c < 2; c++) {
+                const BvhNode& child = blas->bvh.nodes[node->leftFirst + c];
+                Aabb childBox = { { child.min[0], child.min[1], child.min[2] }, { child.max[0], child.max[1], child.max[2] } };
+                GrowAabb(&box, childBox);
+            }
+        }
+        memcpy(node->min, box.min, sizeof(box.min));
+        memcpy(node->max, box.max, sizeof(box.max));
+    }
+}
+
+static void TransformPoint(const float* m, const float* p, float* out)
+{
+    for (int r = 0; r < 3; r++) {
+        out[r] = m[r * 4] * p[0] + m[r * 4 + 1] * p[1] + m[r * 4 + 2] * p[2] + m[r * 4 + 3];
+    }
+}
+
+static void InvertAffine(const float* m, float* inv)
+{
+    float a = m[0], b = m[1], c = m[2];
+    float d = m[4], e = m[5], f = m[6];
+    float g = m[8], h = m[9], i = m[10];
+    float A = e * i - f * h, B = f * g - d * i, C = d * h - e * g;
+    float invDet = 1.0f / (a * A + b * B + c * C);
+    float r[9] = {
+        A * invDet, (c * h - b * i) * invDet, (b * f - c * e) * invDet,
+        B * invDet, (a * i - c * g) * invDet, (c * d - a * f) * invDet,
+        C * invDet, (b * g - a * h) * invDet, (a * e - b * d) * invDet
+    };
+    for (int row = 0; row < 3; row++) {
+        inv[row * 4] = r[row * 3];
+        inv[row * 4 + 1] = r[row * 3 + 1];
+        inv[row * 4 + 2] = r[row * 3 + 2];
+        inv[row * 4 + 3] = -(r[row * 3] * m[3] + r[row * 3 + 1] * m[7] + r[row * 3 + 2] * m[11]);
+    }
+}
+
+static void CreateScene(Scene* scene, int detail, int grid, int width, int height)
+{
+    scene->blases.resize(2);
+    CreateBlas(&scene->blases[0], "wave", detail, true);
+    CreateBlas(&scene->blases[1], "flat", detail, false);
+
+    // Instance 0 is the original triangle with the identity transform,
+    // the others stand in a grid behind it
+    scene->grid = grid;
+    scene->instances.resize(1 + grid * grid);
+    scene->instanceBoxes.resize(scene->instances.size());
+
+    // The camera of CreateCameraBuffer: eye (0, 0, -2.5) looking at the
+    // origin, 60 degree vertical field of view, left handed
+    scene->eye[0] = 0.0f;
+    scene->eye[1] = 0.0f;
+    scene->eye[2] = -2.5f;
+    scene->tanHalfFov = tanf(30.0f * 3.14159265f / 180.0f);
+    scene->width = width;
+    scene->height = height;
+}
+
+// Spins the instances about their y axes and rebuilds the top level BVH
+static void UpdateInstances(Scene* scene, float time)
+{
+    int grid = scene->grid;
+    for (size_t k = 0; k < scene->instances.size(); k++) {
+        Instance* instance = &scene->instances[k];
+        float* m = instance->objectToWorld;
+        memset(m, 0, sizeof(instance->objectToWorld));
+        if (k == 0) {
+            m[0] = m[5] = m[10] = 1.0f;
+            instance->blas = 0;
+        } else {
+            int gx = (int)(k - 1) % grid;
+            int gy = (int)(k - 1) / grid;
+            float angle = time * 0.7f + k * 0.9f;
+            float scale = 0.55f;
+            float c = cosf(angle) * scale, s = sinf(angle) * scale;
+            m[0] = c;  m[2] = s;
+            m[5] = scale;
+            m[8] = -s; m[10] = c;
+            m[3] = (gx - (grid - 1) * 0.5f) * 7.0f / grid;
+            m[7] = (gy - (grid - 1) * 0.5f) * 5.0f / grid;
+            m[11] = 2.5f + ((gx + gy) & 1) * 1.5f;
+            instance->blas = (uint32_t)(k & 1);
+        }
+        InvertAffine(m, instance->worldToObject);
+
+        const BvhNode& root = scene->blases[instance->blas].bvh.nodes[0];
+        Aabb* box = &scene->instanceBoxes[k];
+        ResetAabb(box);
+        for (int corner = 0; corner < 8; corner++) {
+            float p[3] = {
+                corner & 1 ? root.max[0] : root.min[0],
+                corner & 2 ? root.max[1] : root.min[1],
+                corner & 4 ? root.max[2] : root.min[2]
+            };
+            float world[3];
+            TransformPoint(m, p, world);
+            GrowAabb(box, world);
+        }
+    }
+    BuildBvh(&scene->tlas, scene->instanceBoxes.data(), (uint32_t)scene->instances.size(), NULL);
+}
+
+struct UpdateTimes {
+    double blasMs;
+    double tlasMs;
+};
+
+// Moves the scene to `time`: the deforming bottom level is refit (or rebuilt
+// from scratch), the top level is always rebuilt
+static void UpdateScene(Scene* scene, float time, bool rebuild, ThreadPool* pool, UpdateTimes* times)
+{
+    double start = NowSeconds();
+    for (Blas& blas : scene->blases) {
+        if (!blas.deforming) {
+            continue;
+        }
+        DeformBlas(&blas, time, pool);
+        if (rebuild) {
+            BuildBlas(&blas, pool);
+        } else {
+            RefitBlas(&blas, pool);
+        }
+    }
+    double middle = NowSeconds();
+    UpdateInstances(scene, time);
+    double end = NowSeconds();
+
+    times->blasMs += (middle - start) * 1e3;
+    times->tlasMs += (end - middle) * 1e3;
+}
+
+/* ---------------------------------------------------------------- */
+/* Traversal                                                        */
+/* ---------------------------------------------------------------- */
+
+template <class V>
+struct Vec3 {
+    typename V::F x, y, z;
+};
+
+template <class V>
+static inline Vec3<V> Make(typename V::F x, typename V::F y, typename V::F z)
+{
+    Vec3<V> v = { x, y, z };
+    return v;
+}
+
+template <class V>
+static inline Vec3<V> Splat(const float* p)
+{
+    return Make<V>(V::set(p[0]), V::set(p[1]), V::set(p[2]));
+}
+
+template <class V>
+static inline Vec3<V> Sub(const Vec3<V>& a, const Vec3<V>& b)
+{
+    return Make<V>(V::sub(a.x, b.x), V::sub(a.y, b.y), V::sub(a.z, b.z));
+}
+
+template <class V>
+static inline typename V::F Dot(const Vec3<V>& a, const Vec3<V>& b)
+{
+    return V::madd(a.x, b.x, V::madd(a.y, b.y, V::mul(a.z, b.z)));
+}
+
+template <class V>
+static inline Vec3<V> Cross(const Vec3<V>& a, const Vec3<V>& b)
+{
+    return Make<V>(
+        V::sub(V::mul(a.y, b.z), V::mul(a.z, b.y)),
+        V::sub(V::mul(a.z, b.x), V::mul(a.x, b.z)),
+        V::sub(V::mul(a.x, b.y), V::mul(a.y, b.x)));
+}
+
+// m * (v, w) for a 3x4 row-major matrix; w is 1 for points and 0 for directions
+template <class V>
+static inline Vec3<V> Transform(const float* m, const Vec3<V>& v, bool point)
+{
+    typedef typename V::F F;
+    F x = V::madd(V::set(m[0]), v.x, V::madd(V::set(m[1]), v.y, V::mul(V::set(m[2]), v.z)));
+    F y = V::madd(V::set(m[4]), v.x, V::madd(V::set(m[5]), v.y, V::mul(V::set(m[6]), v.z)));
+    F z = V::madd(V::set(m[8]), v.x, V::madd(V::set(m[9]), v.y, V::mul(V::set(m[10]), v.z)));
+    if (point) {
+        x = V::add(x, V::set(m[3]));
+        y = V::add(y, V::set(m[7]));
+        z = V::add(z, V::set(m[11]));
+    }
+    return Make<V>(x, y, z);
+}
+
+template <class V>
+struct Ray {
+    Vec3<V> origin;
+    Vec3<V> direction;
+    Vec3<V> invDirection;
+    int     negative[3];    // direction signs of the first lane, order the children
+};
+
+template <class V>
+static inline void SetupRay(Ray<V>* ray, const Vec3<V>& origin, const Vec3<V>& direction)
+{
+    ray->origin = origin;
+    ray->direction = direction;
+
+    // Keep 1/d finite: a tiny component with either sign gives a slab test
+    // just as valid as the infinite one
+    typename V::F eps = V::set(1e-20f);
+    ray->invDirection = Make<V>(
+        V::div(V::set(1.0f), V::select(V::lt(V::abs(direction.x), eps), eps, direction.x)),
+        V::div(V::set(1.0f), V::select(V::lt(V::abs(direction.y), eps), eps, direction.y)),
+        V::div(V::set(1.0f), V::select(V::lt(V::abs(direction.z), eps), eps, direction.z)));
+
+    float x[V::WIDTH], y[V::WIDTH], z[V::WIDTH];
+    V::store(x, direction.x);
+    V::store(y, direction.y);
+    V::store(z, direction.z);
+    ray->negative[0] = x[0] < 0.0f;
+    ray->negative[1] = y[0] < 0.0f;
+    ray->negative[2] = z[0] < 0.0f;
+}
+
+// The closest hit so far. prim and instance hold small integers, exact in
+// float, so one select per lane updates them with t.
+template <class V>
+struct Hit {
+    typename V::F t;
+    typename V::F u;
+    typename V::F v;
+    typename V::F prim;
+    typename V::F instance;
+};
+
+// Slab test of one box against every active lane
+template <class V>
+static inline typename V::M IntersectBox(const BvhNode& node, const Ray<V>& ray, typename V::M active, typename V::F tMax)
+{
+    typedef typename V::F F;
+
+    F t1x = V::mul(V::sub(V::set(node.min[0]), ray.origin.x), ray.invDirection.x);
+    F t2x = V::mul(V::sub(V::set(node.max[0]), ray.origin.x), ray.invDirection.x);
+    F t1y = V::mul(V::sub(V::set(node.min[1]), ray.origin.y), ray.invDirection.y);
+    F t2y = V::mul(V::sub(V::set(node.max[1]), ray.origin.y), ray.invDirection.y);
+    F t1z = V::mul(V::sub(V::set(node.min[2]), ray.origin.z), ray.invDirection.z);
+    F t2z = V::mul(V::sub(V::set(node.max[2]), ray.origin.z), ray.invDirection.z);
+    F tNear = V::max(V::max(V::min(t1x, t2x), V::min(t1y, t2y)), V::max(V::min(t1z, t2z), V::set(T_MIN)));
+    F tFar = V::min(V::min(V::max(t1x, t2x), V::max(t1y, t2y)), V::min(V::max(t1z, t2z), tMax));
+    return V::mandnot(active, V::lt(tFar, tNear));
+}
+
+// Moller-Trumbore; u and v are the barycentrics ClosestHit receives
+template <class V>
+static inline typename V::M IntersectTriangle(const Triangle& tri, const Ray<V>& ray, typename V::M active, Hit<V>* hit)
+{
+    typedef typename V::F F;
+    typedef typename V::M M;
+
+    Vec3<V> e1 = Splat<V>(tri.e1);
+    Vec3<V> e2 = Splat<V>(tri.e2);
+    Vec3<V> p = Cross<V>(ray.direction, e2);
+    F det = Dot<V>(e1, p);
+    M valid = V::mandnot(active, V::lt(V::abs(det), V::set(1e-20f)));
+    F invDet = V::div(V::set(1.0f), det);
+
+    Vec3<V> s = Sub<V>(ray.origin, Splat<V>(tri.v0));
+    F u = V::mul(Dot<V>(s, p), invDet);
+    Vec3<V> q = Cross<V>(s, e1);
+    F v = V::mul(Dot<V>(ray.direction, q), invDet);
+    F t = V::mul(Dot<V>(e2, q), invDet);
+
+    valid = V::mandnot(valid, V::lt(u, V::set(0.0f)));
+    valid = V::mandnot(valid, V::lt(v, V::set(0.0f)));
+    valid = V::mandnot(valid, V::lt(V::set(1.0f), V::add(u, v)));
+    valid = V::mand(valid, V::lt(V::set(T_MIN), t));
+    valid = V::mand(valid, V::lt(t, hit->t));
+    if (V::any(valid)) {
+        hit->t = V::select(valid, t, hit->t);
+        hit->u = V::select(valid, u, hit->u);
+        hit->v = V::select(valid, v, hit->v);
+        hit->prim = V::select(valid, V::set((float)tri.id), hit->prim);
+    }
+    return valid;
+}
+
+// Packet traversal: a node is entered when any active lane hits its box, and
+// its children are visited in the order the first lane would see them.
+// leaf(first, count) tests the primitives of a leaf.
+template <class V, class Leaf>
+static inline void Traverse(const Bvh& bvh, const Ray<V>& ray, typename V::M active, Hit<V>* hit, Leaf leaf)
+{
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = bvh.nodes[stack[--top]];
+        if (!V::any(IntersectBox<V>(node, ray, active, hit->t))) {
+            continue;
+        }
+        if (node.count) {
+            leaf(node.leftFirst, node.count);
+        } else if (ray.negative[node.axis]) {
+            stack[top++] = node.leftFirst;
+            stack[top++] = node.leftFirst + 1;
+        } else {
+            stack[top++] = node.leftFirst + 1;
+            stack[top++] = node.leftFirst;
+        }
+    }
+}
+
+// TraceRay: the top level BVH finds the instances, each instance's ray is
+// moved to object space and traced through its bottom level BVH. Object
+// space directions are not normalized, so t stays comparable between them.
+template <class V>
+static inline void TraceRays(const Scene& scene, const Ray<V>& ray, Hit<V>* hit)
+{
+    typedef typename V::M M;
+
+    Traverse<V>(scene.tlas, ray, V::mtrue(), hit, [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t instanceIndex = scene.tlas.indices[i];
+            const Instance& instance = scene.instances[instanceIndex];
+            const Blas& blas = scene.blases[instance.blas];
+
+            Ray<V> local;
+            SetupRay<V>(&local, Transform<V>(instance.worldToObject, ray.origin, true),
+                Transform<V>(instance.worldToObject, ray.direction, false));
+
+            M hits = V::mfalse();
+            Traverse<V>(blas.bvh, local, V::mtrue(), hit, [&](uint32_t triFirst, uint32_t triCount) {
+                for (uint32_t t = triFirst; t < triFirst + triCount; t++) {
+                    hits = V::mor(hits, IntersectTriangle<V>(blas.triangles[t], local, V::mtrue(), hit));
+                }
+            });
+            hit->instance = V::select(hits, V::set((float)instanceIndex), hit->instance);
+        }
+    });
+}
+
+/* ---------------------------------------------------------------- */
+/* Framebuffer                                                      */
+/* ---------------------------------------------------------------- */
+
+// 32-bit pixels; the shifts come from the X visual (or are 16/8/0 headless).
+// The size is padded to whole tiles, only width x height is shown.
+struct Framebuffer {
+    uint32_t* pixels;
+    int       stride;
+    int       width;
+    int       height;
+    int       shift[3];
+};
+
+// The output texture is R8G8B8A8_UNORM, written without gamma
+static inline uint32_t ToByte(float c)
+{
+    int i = (int)(c * 255.0f + 0.5f);
+    return (uint32_t)(i < 0 ? 0 : i > 255 ? 255 : i);
+}
+
+struct ThreadStats {
+    alignas(64) uint64_t rays;
+    uint64_t hits;
+    uint64_t tiles;
+    uint64_t steals;
+};
+
+/* ---------------------------------------------------------------- */
+/* Kernel                                                           */
+/* ---------------------------------------------------------------- */
+
+// RayGen, ClosestHit and Miss for one packet at (px, py)
+template <class V>
+static void RenderPacket(const Scene& s, Framebuffer* fb, int px, int py, ThreadStats* stats)
+{
+    typedef typename V::F F;
+
+    // Pixel center to NDC, unprojected through the 60 degree frustum
+    F fx = V::add(V::set(px + 0.5f), V::laneX());
+    F fy = V::add(V::set(py + 0.5f), V::laneY());
+    F dx = V::sub(V::mul(V::div(fx, V::set((float)s.width)), V::set(2.0f)), V::set(1.0f));
+    F dy = V::sub(V::mul(V::div(fy, V::set((float)s.height)), V::set(2.0f)), V::set(1.0f));
+    float aspect = (float)s.width / s.height;
+    Vec3<V> d = Make<V>(V::mul(dx, V::set(s.tanHalfFov * aspect)), V::mul(dy, V::set(-s.tanHalfFov)), V::set(1.0f));
+    F invLength = V::div(V::set(1.0f), V::sqrt(Dot<V>(d, d)));
+    d = Make<V>(V::mul(d.x, invLength), V::mul(d.y, invLength), V::mul(d.z, invLength));
+
+    Ray<V> ray;
+    SetupRay<V>(&ray, Splat<V>(s.eye), d);
+
+    Hit<V> hit;
+    hit.t = V::set(T_MAX);
+    hit.u = V::set(0.0f);
+    hit.v = V::set(0.0f);
+    hit.prim = V::set(-1.0f);
+    hit.instance = V::set(-1.0f);
+    TraceRays<V>(s, ray, &hit);
+
+    float u[V::WIDTH], v[V::WIDTH], prim[V::WIDTH], instance[V::WIDTH];
+    V::store(u, hit.u);
+    V::store(v, hit.v);
+    V::store(prim, hit.prim);
+    V::store(instance, hit.instance);
+    for (int i = 0; i < V::WIDTH; i++) {
+        float rgb[3] = { 0.392f, 0.584f, 0.929f };     // Miss: cornflower blue
+        if (prim[i] >= 0.0f) {
+            const Blas& blas = s.blases[s.instances[(uint32_t)instance[i]].blas];
+            const uint32_t* tri = &blas.indices[(uint32_t)prim[i] * 3];
+            float w[3] = { 1.0f - u[i] - v[i], u[i], v[i] };
+            for (int c = 0; c < 3; c++) {
+                rgb[c] = w[0] * blas.colors[tri[0] * 3 + c] + w[1] * blas.colors[tri[1] * 3 + c] + w[2] * blas.colors[tri[2] * 3 + c];
+            }
+            stats->hits++;
+        }
+        uint32_t* dst = fb->pixels + (size_t)(py + i / V::PACKET_W) * fb->stride + px + i % V::PACKET_W;
+        *dst = (ToByte(rgb[0]) << fb->shift[0]) | (ToByte(rgb[1]) << fb->shift[1]) | (ToByte(rgb[2]) << fb->shift[2]);
+    }
+    stats->rays += V::WIDTH;
+}
+
+template <class V>
+static void RenderTile(const Scene& s, Framebuffer* fb, int x0, int y0, int tileSize, ThreadStats* stats)
+{
+    for (int y = y0; y < y0 + tileSize; y += V::PACKET_H) {
+        for (int x = x0; x < x0 + tileSize; x += V::PACKET_W) {
+            RenderPacket<V>(s, fb, x, y, stats);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+/* Instruction set selection                                        */
+/* ---------------------------------------------------------------- */
+
+typedef void (*RenderTileFunc)(const Scene&, Framebuffer*, int, int, int, ThreadStats*);
+
+struct Backend {
+    const char*    name;
+    int            width;
+    RenderTileFunc renderTile;
+    bool           compiled;
+    bool           supported;
+};
+
+static std::vector<Backend> Backends()
+{
+    std::vector<Backend> backends;
+    backends.push_back({ "scalar", 1, RenderTile<ScalarOps>, true, true });
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+#define CPU_SUPPORTS(feature) __builtin_cpu_supports(feature)
+#else
+#define CPU_SUPPORTS(feature) false
+#endif
+
+#ifdef __SSE2__
+    backends.push_back({ "sse2", 4, RenderTile<SseOps>, true, (bool)CPU_SUPPORTS("sse2") });
+#else
+    backends.push_back({ "sse2", 4, NULL, false, false });
+#endif
+#if defined(__AVX2__) && defined(__FMA__)
+    backends.push_back({ "avx2", 8, RenderTile<Avx2Ops>, true, CPU_SUPPORTS("avx2") && CPU_SUPPORTS("fma") });
+#else
+    backends.push_back({ "avx2", 8, NULL, false, false });
+#endif
+#ifdef __AVX512F__
+    backends.push_back({ "avx512", 16, RenderTile<Avx512Ops>, true, (bool)CPU_SUPPORTS("avx512f") });
+#else
+    backends.push_back({ "avx512", 16, NULL, false, false });
+#endif
+
+    return backends;
+}
+
+/* ---------------------------------------------------------------- */
+/* Tiles                                                            */
+/* ---------------------------------------------------------------- */
+
+// Work-stealing tile queue: every thread owns a range of tile indices packed
+// as begin | end << 32 in one atomic word. The owner takes tiles from the
+// front and thieves take the back half, both with a compare-and-swap on the
+// same word, so no locks are needed and a tile is never handed out twice.
+// Tiles are only ever moved between ranges, never added, so a thread that
+// finds every range empty is done.
+struct TileQueue {
+    alignas(64) std::atomic<uint64_t> range;
+};
+
+static inline uint64_t PackRange(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+static bool PopTile(TileQueue* queue, uint32_t* tile)
+{
+    uint64_t value = queue->range.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t begin = (uint32_t)value;
+        uint32_t end = (uint32_t)(value >> 32);
+        if (begin >= end) {
+            return false;
+        }
+        if (queue->range.compare_exchange_weak(value, PackRange(begin + 1, end), std::memory_order_relaxed)) {
+            *tile = begin;
+            return true;
+        }
+    }
+}
+
+static bool StealTiles(TileQueue* victim, uint32_t* begin, uint32_t* end)
+{
+    uint64_t value = victim->range.load(std::memory_order_relaxed);
+    for (;;) {
+        uint32_t first = (uint32_t)value;
+        uint32_t last = (uint32_t)(value >> 32);
+        if (first >= last) {
+            return false;
+        }
+        uint32_t middle = first + (last - first) / 2;
+        if (victim->range.compare_exchange_weak(value, PackRange(first, middle), std::memory_order_relaxed)) {
+            *begin = middle;
+            *end = last;
+            return true;
+        }
+    }
+}
+
+// The pool is shared with the BVH builds and owned by main
+struct Renderer {
+    Backend     backend;
+    uint32_t    threadCount;
+    int         tileSize;
+    int         tilesX;
+    int         tilesY;
+    ThreadPool* pool;
+    std::unique_ptr<TileQueue[]>   queues;
+    std::unique_ptr<ThreadStats[]> stats;
+};
+
+static void InitRenderer(Renderer* renderer, const Backend& backend, ThreadPool* pool, int tileSize, int width, int height)
+{
+    renderer->backend = backend;
+    renderer->threadCount = pool ? pool->size() : 1;
+    renderer->tileSize = tileSize;
+    renderer->tilesX = (width + tileSize - 1) / tileSize;
+    renderer->tilesY = (height + tileSize - 1) / tileSize;
+    renderer->pool = pool;
+    renderer->queues.reset(new TileQueue[renderer->threadCount]);
+    renderer->stats.reset(new ThreadStats[renderer->threadCount]());
+}
+
+static void RenderWorker(Renderer* renderer, const Scene& s, Framebuffer* fb, uint32_t index)
+{
+    TileQueue* own = &renderer->queues[index];
+    ThreadStats* stats = &renderer->stats[index];
+    int tileSize = renderer->tileSize;
+
+    for (;;) {
+        uint32_t tile;
+        while (PopTile(own, &tile)) {
+            renderer->backend.renderTile(s, fb, (tile % renderer->tilesX) * tileSize, (tile / renderer->tilesX) * tileSize, tileSize, stats);
+            stats->tiles++;
+        }
+
+        // Out of work: take half of the next non-empty range
+        bool stolen = false;
+        for (uint32_t i = 1; i < renderer->threadCount && !stolen; i++) {
+            uint32_t begin, end;
+            if (StealTiles(&renderer->queues[(index + i) % renderer->threadCount], &begin, &end)) {
+                own->range.store(PackRange(begin, end), std::memory_order_relaxed);
+                stats->steals++;
+                stolen = true;
+            }
+        }
+        if (!stolen) {
+            return;
+        }
+    }
+}
+
+// Each thread starts with a contiguous band of tiles, which keeps neighbouring
+// tiles on one core; stealing evens out bands that hit more geometry.
+static void RenderFrame(Renderer* renderer, const Scene& s, Framebuffer* fb)
+{
+    uint32_t tileCount = (uint32_t)(renderer->tilesX * renderer->tilesY);
+    for (uint32_t i = 0; i < renderer->threadCount; i++) {
+        uint32_t begin = (uint32_t)((uint64_t)tileCount * i / renderer->threadCount);
+        uint32_t end = (uint32_t)((uint64_t)tileCount * (i + 1) / renderer->threadCount);
+        renderer->queues[i].range.store(PackRange(begin, end), std::memory_order_relaxed);
+    }
+
+    if (!renderer->pool) {
+        RenderWorker(renderer, s, fb, 0);
+        return;
+    }
+    renderer->pool->run([&](uint32_t index) { RenderWorker(renderer, s, fb, index); });
+}
+
+struct RenderTotals {
+    uint64_t rays;
+    uint64_t hits;
+    uint64_t steals;
+};
+
+static RenderTotals TakeStats(Renderer* renderer)
+{
+    RenderTotals totals = { 0, 0, 0 };
+    for (uint32_t i = 0; i < renderer->threadCount; i++) {
+        ThreadStats* stats = &renderer->stats[i];
+        totals.rays += stats->rays;
+        totals.hits += stats->hits;
+        totals.steals += stats->steals;
+        memset(stats, 0, sizeof(*stats));
+    }
+    return totals;
+}
+
+// Mrays/s counts trace time only; the BVH updates are reported separately
+static void PrintStats(const Renderer* renderer, const RenderTotals& totals, int frames, double seconds,
+    double traceSeconds, const UpdateTimes& times, bool rebuild)
+{
+    printf("%s, %u threads: %.1f fps, %.2f Mrays/s, %.1f%% hits, %s %.2f ms/frame, tlas %.3f ms/frame, %.1f steals/frame\n",
+        renderer->backend.name, renderer->threadCount, frames / seconds, totals.rays / traceSeconds / 1e6,
+        totals.rays ? 100.0 * totals.hits / totals.rays : 0.0, rebuild ? "blas rebuild" : "blas refit",
+        times.blasMs / frames, times.tlasMs / frames, (double)totals.steals / frames);
+}
+
+/* ---------------------------------------------------------------- */
+/* X11 output                                                       */
+/* ---------------------------------------------------------------- */
+
+struct Window11 {
+    Display*        display;
+    Window          window;
+    GC              gc;
+    Atom            atomWmDeleteWindow;
+    bool            shm;
+    int             completionType;
+    XImage*         images[IMAGE_COUNT];
+    XShmSegmentInfo shmInfo[IMAGE_COUNT];
+    bool            pending[IMAGE_COUNT];
+    Framebuffer     framebuffers[IMAGE_COUNT];
+};
+
+static bool shmAttachFailed;
+
+static int ShmErrorHandler(Display*, XErrorEvent*)
+{
+    shmAttachFailed = true;
+    return 0;
+}
+
+static int MaskShift(unsigned long mask)
+{
+    return mask ? __builtin_ctzl(mask) : 0;
+}
+
+static void DestroyImages(Window11* w)
+{
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        if (!w->images[i]) {
+            continue;
+        }
+        if (w->shm) {
+            XShmDetach(w->display, &w->shmInfo[i]);
+            shmdt(w->shmInfo[i].shmaddr);
+            w->images[i]->data = NULL;
+        }
+        XDestroyImage(w->images[i]);
+        w->images[i] = NULL;
+    }
+}
+
+static XImage* CreateShmImage(Window11* w, Visual* visual, int depth, int width, int height, XShmSegmentInfo* info)
+{
+    XImage* image = XShmCreateImage(w->display, visual, depth, ZPixmap, NULL, info, width, height);
+    if (!image) {
+        return NULL;
+    }
+    info->shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * image->height, IPC_CREAT | 0600);
+    if (info->shmid < 0) {
+        XDestroyImage(image);
+        return NULL;
+    }
+    info->shmaddr = image->data = (char*)shmat(info->shmid, NULL, 0);
+    info->readOnly = False;
+
+    // Attaching fails with BadAccess when the server is on another machine
+    shmAttachFailed = false;
+    XErrorHandler previous = XSetErrorHandler(ShmErrorHandler);
+    XShmAttach(w->display, info);
+    XSync(w->display, False);
+    XSetErrorHandler(previous);
+
+    // Freed once both sides have detached
+    shmctl(info->shmid, IPC_RMID, NULL);
+    if (shmAttachFailed) {
+        shmdt(info->shmaddr);
+        image->data = NULL;
+        XDestroyImage(image);
+        return NULL;
+    }
+    return image;
+}
+
+// Images live in shared memory segments that the X server reads directly.
+// Remote displays cannot attach them; those get plain XPutImage.
+static bool CreateImages(Window11* w, int paddedWidth, int paddedHeight, int width, int height)
+{
+    int screen = DefaultScreen(w->display);
+    Visual* visual = DefaultVisual(w->display, screen);
+    int depth = DefaultDepth(w->display, screen);
+    if (visual->c_class != TrueColor || depth < 24) {
+        printf("A 24-bit TrueColor visual is required\n");
+        return false;
+    }
+
+    w->shm = XShmQueryExtension(w->display);
+    for (int i = 0; i < IMAGE_COUNT && w->shm; i++) {
+        w->images[i] = CreateShmImage(w, visual, depth, paddedWidth, paddedHeight, &w->shmInfo[i]);
+        if (!w->images[i]) {
+            DestroyImages(w);
+            w->shm = false;
+            printf("MIT-SHM not usable, using XPutImage\n");
+        }
+    }
+    w->completionType = w->shm ? XShmGetEventBase(w->display) + ShmCompletion : -1;
+
+    for (int i = 0; i < IMAGE_COUNT; i++) {
+        if (!w->shm) {
+            char* data = (char*)malloc((size_t)paddedWidth * paddedHeight * 4);
+            w->images[i] = XCreateImage(w->display, visual, depth, ZPixmap, 0, data, paddedWidth, paddedHeight, 32, 0);
+        }
+        w->pending[i] = false;
+
+        Framebuffer* fb = &w->framebuffers[i];
+        fb->pixels = (uint32_t*)w->images[i]->data;
+        fb->stride = w->images[i]->bytes_per_line / 4;
+        fb->width = width;
+        fb->height = height;
+        fb->shift[0] = MaskShift(visual->red_mask);
+        fb->shift[1] = MaskShift(visual->green_mask);
+        fb->shift[2] = MaskShift(visual->blue_mask);
+    }
+    return true;
+}
+
+static bool OpenWindow(Window11* w, int width, int height, int paddedWidth, int paddedHeight, int argc, char* argv[])
+{
+    memset(w, 0, sizeof(*w));
+
+    /* setup display/screen */
+    w->display = XOpenDisplay("");
+    if (!w->display) {
+        return false;
+    }
+    int screen = DefaultScreen(w->display);
+
+    XSizeHints hint;
+    hint.x = 0;
+    hint.y = 0;
+    hint.width = hint.min_width = hint.max_width = width;
+    hint.height = hint.min_height = hint.max_height = height;
+    hint.flags = PPosition | PSize | PMinSize | PMaxSize;
+
+    /* create window */
+    w->window = XCreateSimpleWindow(w->display, DefaultRootWindow(w->display),
+        hint.x, hint.y, hint.width, hint.height, 5,
+        BlackPixel(w->display, screen), BlackPixel(w->display, screen));
+
+    char title[] = "Hello, World!";
+    XSetStandardProperties(w->display, w->window, title, title, None, argv, argc, &hint);
+
+    w->atomWmDeleteWindow = XInternAtom(w->display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(w->display, w->window, &w->atomWmDeleteWindow, 1);
+
+    w->gc = XCreateGC(w->display, w->window, 0, 0);
+    XSelectInput(w->display, w->window, KeyPressMask | ExposureMask | StructureNotifyMask);
+
+    if (!CreateImages(w, paddedWidth, paddedHeight, width, height)) {
+        return false;
+    }
+
+    XMapRaised(w->display, w->window);
+    return true;
+}
+
+static void CloseWindow(Window11* w)
+{
+    XSync(w->display, False);
+    DestroyImages(w);
+    XFreeGC(w->display, w->gc);
+    XDestroyWindow(w->display, w->window);
+    XCloseDisplay(w->display);
+}
+
+// Returns false once the window is closed or Escape is pressed
+static bool HandleEvent(Window11* w, XEvent* ev)
+{
+    if (ev->type == w->completionType) {
+        XShmCompletionEvent* completion = (XShmCompletionEvent*)ev;
+        for (int i = 0; i < IMAGE_COUNT; i++) {
+            if (completion->shmseg == w->shmInfo[i].shmseg) {
+                w->pending[i] = false;
+            }
+        }
+    } else if (ev->type == ClientMessage) {
+        if ((Atom)ev->xclient.data.l[0] == w->atomWmDeleteWindow) {
+            return false;
+        }
+    } else if (ev->type == KeyPress) {
+        if (XLookupKeysym(&ev->xkey, 0) == XK_Escape) {
+            return false;
+        }
+    } else if (ev->type == DestroyNotify) {
+        return false;
+    }
+    return true;
+}
+
+// The server reads an XShm image after XShmPutImage returns, so an image is
+// only rendered into again after its completion event
+static bool WaitForImage(Window11* w, int index)
+{
+    while (w->pending[index]) {
+        XEvent ev;
+        XNextEvent(w->display, &ev);
+        if (!HandleEvent(w, &ev)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Present(Window11* w, int index)
+{
+    Framebuffer* fb = &w->framebuffers[index];
+    if (w->shm) {
+        XShmPutImage(w->display, w->window, w->gc, w->images[index], 0, 0, 0, 0, fb->width, fb->height, True);
+        w->pending[index] = true;
+    } else {
+        XPutImage(w->display, w->window, w->gc, w->images[index], 0, 0, 0, 0, fb->width, fb->height);
+    }
+    XFlush(w->display);
+}
+
+/* ---------------------------------------------------------------- */
+/* Main                                                             */
+/* ---------------------------------------------------------------- */
+
+static bool SavePPM(const char* path, const Framebuffer* fb)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+
+    fprintf(fp, "P6\n%d %d\n255\n", fb->width, fb->height);
+    for (int y = 0; y < fb->height; y++) {
+        for (int x = 0; x < fb->width; x++) {
+            uint32_t pixel = fb->pixels[(size_t)y * fb->stride + x];
+            unsigned char rgb[3] = {
+                (unsigned char)(pixel >> fb->shift[0]),
+                (unsigned char)(pixel >> fb->shift[1]),
+                (unsigned char)(pixel >> fb->shift[2])
+            };
+            fwrite(rgb, 1, 3, fp);
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+// Renders frameCount frames into memory at a fixed 1/60 s time step
+static void RenderHeadless(Renderer* renderer, Scene* scene, Framebuffer* fb, int frameCount, bool rebuild)
+{
+    UpdateTimes times = { 0.0, 0.0 };
+    double traceSeconds = 0.0;
+    TakeStats(renderer);
+    double start = NowSeconds();
+    for (int i = 0; i < frameCount; i++) {
+        UpdateScene(scene, i / 60.0f, rebuild, renderer->pool, &times);
+        double traceStart = NowSeconds();
+        RenderFrame(renderer, *scene, fb);
+        traceSeconds += NowSeconds() - traceStart;
+    }
+    PrintStats(renderer, TakeStats(renderer), frameCount, NowSeconds() - start, traceSeconds, times, rebuild);
+}
+
+static void PrintUsage()
+{
+    printf("usage: hello [--size W H] [--threads N] [--tile N] [--isa scalar|sse2|avx2|avx512|all]\n"
+           "             [--detail N] [--grid N] [--rebuild] [--frames N] [--output FILE]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int width = WINDOW_WIDTH;
+    int height = WINDOW_HEIGHT;
+    int tileSize = DEFAULT_TILE;
+    int detail = DEFAULT_DETAIL;
+    int grid = DEFAULT_GRID;
+    int frameCount = 0;
+    bool rebuild = false;
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    const char* isa = NULL;
+    const char* outputFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            tileSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            isa = argv[++i];
+        } else if (strcmp(argv[i], "--detail") == 0 && i + 1 < argc) {
+            detail = std::max(1, std::min(2048, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            grid = std::max(0, std::min(64, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--rebuild") == 0) {
+            rebuild = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Tiles hold whole packets of up to 4x4 rays
+    if (width < 1 || height < 1 || tileSize < 4 || tileSize % 4 != 0) {
+        printf("The size must be positive and the tile size a multiple of 4\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Backend> backends = Backends();
+    std::vector<Backend> selected;
+    for (const Backend& backend : backends) {
+        bool usable = backend.compiled && backend.supported;
+        if (isa && strcmp(isa, "all") != 0 && strcmp(isa, backend.name) == 0) {
+            if (!usable) {
+                printf("%s is %s\n", backend.name, backend.compiled ? "not supported by this CPU" : "not compiled in (see build.sh)");
+                return EXIT_FAILURE;
+            }
+            selected.push_back(backend);
+        } else if (isa && strcmp(isa, "all") == 0 && usable) {
+            selected.push_back(backend);
+        } else if (!isa && usable) {
+            selected.assign(1, backend);
+        }
+    }
+    if (selected.empty()) {
+        printf("unknown instruction set: %s\n", isa);
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    int paddedWidth = (width + tileSize - 1) / tileSize * tileSize;
+    int paddedHeight = (height + tileSize - 1) / tileSize * tileSize;
+    printf("%dx%d, %dx%d tiles, %u threads\n", width, height, tileSize, tileSize, threadCount);
+
+    std::unique_ptr<ThreadPool> pool(threadCount > 1 ? new ThreadPool(threadCount) : NULL);
+
+    // The bottom levels are built once; the deforming one is refit per frame
+    Scene scene;
+    CreateScene(&scene, detail, grid, width, height);
+    uint64_t instancedTriangles = 0;
+    for (Blas& blas : scene.blases) {
+        DeformBlas(&blas, 0.0f, pool.get());
+        double start = NowSeconds();
+        BuildBlas(&blas, pool.get());
+        printf("blas %s: %zu triangles, %u nodes, SAH cost %.1f, built in %.1f ms\n", blas.name,
+            blas.triangles.size(), blas.bvh.nodeCount, SahCost(blas.bvh), (NowSeconds() - start) * 1e3);
+    }
+    UpdateInstances(&scene, 0.0f);
+    for (const Instance& instance : scene.instances) {
+        instancedTriangles += scene.blases[instance.blas].triangles.size();
+    }
+    printf("tlas: %zu instances, %u nodes, %.1f M triangles in the scene\n",
+        scene.instances.size(), scene.tlas.nodeCount, instancedTriangles / 1e6);
+
+    // Benchmark every instruction set, or render without a display
+    Window11 w;
+    bool headless = selected.size() > 1 || outputFile || !OpenWindow(&w, width, height, paddedWidth, paddedHeight, argc, argv);
+    if (headless) {
+        std::vector<uint32_t> pixels((size_t)paddedWidth * paddedHeight);
+        Framebuffer fb = { pixels.data(), paddedWidth, width, height, { 16, 8, 0 } };
+        for (const Backend& backend : selected) {
+            Renderer renderer;
+            InitRenderer(&renderer, backend, pool.get(), tileSize, width, height);
+            RenderHeadless(&renderer, &scene, &fb, frameCount ? frameCount : HEADLESS_FRAMES, rebuild);
+        }
+        for (const Blas& blas : scene.blases) {
+            if (blas.deforming) {
+                printf("blas %s SAH cost after the last %s: %.1f\n", blas.name, rebuild ? "rebuild" : "refit", SahCost(blas.bvh));
+            }
+        }
+        const char* path = outputFile ? outputFile : OUTPUT_FILE;
+        if (SavePPM(path, &fb)) {
+            printf("Wrote %s\n", path);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    printf("Presenting with %s\n", w.shm ? "MIT-SHM" : "XPutImage");
+
+    Renderer renderer;
+    InitRenderer(&renderer, selected[0], pool.get(), tileSize, width, height);
+
+    UpdateTimes times = { 0.0, 0.0 };
+    double traceSeconds = 0.0;
+    double start = NowSeconds();
+    double reportStart = start;
+    int reportFrames = 0;
+    bool running = true;
+    for (int frame = 0; running && (frameCount == 0 || frame < frameCount); frame++) {
+        while (running && XPending(w.display)) {
+            XEvent ev;
+            XNextEvent(w.display, &ev);
+            running = HandleEvent(&w, &ev);
+        }
+
+        int index = frame % IMAGE_COUNT;
+        if (!running || !WaitForImage(&w, index)) {
+            break;
+        }
+
+        UpdateScene(&scene, (float)(NowSeconds() - start), rebuild, pool.get(), &times);
+        double traceStart = NowSeconds();
+        RenderFrame(&renderer, scene, &w.framebuffers[index]);
+        traceSeconds += NowSeconds() - traceStart;
+        Present(&w, index);
+        reportFrames++;
+
+        double now = NowSeconds();
+        if (now - reportStart >= STATS_INTERVAL) {
+            PrintStats(&renderer, TakeStats(&renderer), reportFrames, now - reportStart, traceSeconds, times, rebuild);
+            reportStart = now;
+            reportFrames = 0;
+            traceSeconds = 0.0;
+            times = { 0.0, 0.0 };
+        }
+    }
+    if (reportFrames > 0) {
+        PrintStats(&renderer, TakeStats(&renderer), reportFrames, NowSeconds() - reportStart, traceSeconds, times, rebuild);
+    }
+
+    CloseWindow(&w);
+    return EXIT_SUCCESS;
+}
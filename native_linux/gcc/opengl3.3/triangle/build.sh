@@ -1 +1 @@
-gcc -o hello hello.c -lX11 -lGL
+gcc -o hello hello.c -lX11 -lGL -lpthread